@@ -44,6 +44,7 @@ struct buffer_wait {
 };
 
 extern struct pool_head *pool_head_buffer;
+extern struct pool_head *pool_head_small_buffer;
 extern struct list buffer_wq;
 __decl_hathreads(extern HA_SPINLOCK_T buffer_wq_lock);
 
@@ -109,11 +110,18 @@ static inline struct buffer *b_alloc_fast(struct buffer *buf)
 	return buf;
 }
 
+/* Returns non-zero if <buf> is an allocated small buffer */
+static inline int b_is_small(const struct buffer *buf)
+{
+	return pool_head_small_buffer && buf->size == pool_head_small_buffer->size;
+}
+
 /* Releases buffer <buf> (no check of emptiness). The buffer's head is marked
- * empty.
+ * empty. Small buffers are returned to their own pool.
  */
 static inline void __b_free(struct buffer *buf)
 {
+	struct pool_head *pool = b_is_small(buf) ? pool_head_small_buffer : pool_head_buffer;
 	char *area = buf->area;
 
 	/* let's first clear the area to save an occasional "show sess all"
@@ -121,7 +129,7 @@ static inline void __b_free(struct buffer *buf)
 	 */
 	*buf = BUF_NULL;
 	__ha_barrier_store();
-	pool_free(pool_head_buffer, area);
+	pool_free(pool, area);
 }
 
 /* Releases buffer <buf> if allocated, and marks it empty. */
@@ -186,11 +194,62 @@ static inline struct buffer *b_alloc_margin(struct buffer *buf, int margin)
 	}
 
  done:
+	if (unlikely(profiling & HA_PROF_MEMORY))
+		pool_prof_alloc(pool_head_buffer);
 	buf->area = area;
 	buf->size = pool_head_buffer->size;
 	return buf;
 }
 
+/* Ensures that <buf> is allocated, preferably as a small buffer when they are
+ * enabled. This is meant for buffers which are often idle or only receive few
+ * data, and which are never exchanged with other buffers. If no small buffer
+ * is available, a regular one is allocated using b_alloc_margin() with margin
+ * <margin>. Use b_upgrade() to turn a small buffer into a large one.
+ */
+static inline struct buffer *b_alloc_small_margin(struct buffer *buf, int margin)
+{
+	char *area;
+
+	if (buf->size)
+		return buf;
+
+	if (pool_head_small_buffer) {
+		area = pool_alloc_dirty(pool_head_small_buffer);
+		if (likely(area)) {
+			buf->area = area;
+			buf->size = pool_head_small_buffer->size;
+			buf->data = buf->head = 0;
+			return buf;
+		}
+	}
+	return b_alloc_margin(buf, margin);
+}
+
+/* Replaces small buffer <buf> with a large one, preserving its contents and
+ * head offset. It returns the buffer, or NULL if no large buffer could be
+ * allocated, in which case <buf> is left untouched.
+ */
+static inline struct buffer *b_upgrade(struct buffer *buf)
+{
+	struct buffer old = *buf;
+	char *area;
+
+	area = pool_alloc_dirty(pool_head_buffer);
+	if (unlikely(!area)) {
+		activity[tid].buf_wait++;
+		return NULL;
+	}
+
+	/* small buffers are at most half of a large one so the data always
+	 * fit contiguously at the same offset.
+	 */
+	b_getblk(&old, area + b_head_ofs(&old), b_data(&old), 0);
+	*buf = b_make(area, pool_head_buffer->size, b_head_ofs(&old), b_data(&old));
+	pool_free(pool_head_small_buffer, old.area);
+	return buf;
+}
+
 
 /* Offer a buffer currently belonging to target <from> to whoever needs one.
  * Any pointer is valid for <from>, including NULL. Its purpose is to avoid
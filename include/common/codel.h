@@ -0,0 +1,122 @@
+/*
+ * include/common/codel.h
+ * Controlled Delay (CoDel) queue management.
+ *
+ * Copyright (C) 2026 agent - agent@local
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, version 2.1
+ * exclusively.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * CoDel is described in RFC8289. The time spent in the queue by each dequeued
+ * element (its sojourn time) is compared to a target. Once the sojourn time
+ * has stayed above the target for a whole interval, the queue enters the
+ * dropping state, where the dequeued elements are dropped at a rate which
+ * increases with the square root of the number of drops, until an element
+ * spends less than the target in the queue. Short bursts are thus absorbed
+ * while a standing queue is drained.
+ *
+ * All dates are in milliseconds and may wrap.
+ */
+
+#ifndef _COMMON_CODEL_H
+#define _COMMON_CODEL_H
+
+#include <common/config.h>
+
+struct codel {
+	unsigned int first_above;  /* end of the interval above target, 0 if below */
+	unsigned int drop_next;    /* date of the next drop in dropping state */
+	unsigned int count;        /* drops since entering the dropping state */
+	unsigned int lastcount;    /* <count> when entering the dropping state */
+	unsigned int dropping;     /* non-zero in dropping state */
+};
+
+/* Returns <interval> / sqrt(<count>) for <count> > 0. */
+static inline unsigned int codel_interval(unsigned int interval, unsigned int count)
+{
+	unsigned long long sq = (unsigned long long)count << 16;
+	unsigned long long r = 0, bit = 1ULL << 62;
+
+	/* integer square root, <r> ends as sqrt(count) << 8 */
+	while (bit > sq)
+		bit >>= 2;
+	while (bit) {
+		if (sq >= r + bit) {
+			sq -= r + bit;
+			r = (r >> 1) + bit;
+		}
+		else
+			r >>= 1;
+		bit >>= 2;
+	}
+	return ((unsigned long long)interval << 8) / r;
+}
+
+/* Accounts for an element dequeued at date <now> after <sojourn> ms in the
+ * queue, for CoDel state <c> using <target> and <interval> in ms. Returns
+ * non-zero if this element must be dropped, in which case the caller should
+ * call it again for the next element.
+ */
+static inline int codel_must_drop(struct codel *c, unsigned int now, unsigned int sojourn,
+                                  unsigned int target, unsigned int interval)
+{
+	int ok_to_drop = 0;
+	unsigned int delta;
+
+	if (sojourn < target)
+		c->first_above = 0;
+	else if (!c->first_above)
+		c->first_above = (now + interval) ? now + interval : 1;
+	else if ((int)(now - c->first_above) >= 0)
+		ok_to_drop = 1;
+
+	if (c->dropping) {
+		if (!ok_to_drop) {
+			c->dropping = 0;
+			return 0;
+		}
+		if ((int)(now - c->drop_next) < 0)
+			return 0;
+		c->count++;
+		c->drop_next += codel_interval(interval, c->count);
+		return 1;
+	}
+
+	if (!ok_to_drop)
+		return 0;
+
+	/* start dropping again at the previous rate if we left the dropping
+	 * state recently.
+	 */
+	c->dropping = 1;
+	delta = c->count - c->lastcount;
+	if (delta > 1 && (int)(now - c->drop_next) < (int)(16 * interval))
+		c->count = delta;
+	else
+		c->count = 1;
+	c->lastcount = c->count;
+	c->drop_next = now + codel_interval(interval, c->count);
+	return 1;
+}
+
+#endif /* _COMMON_CODEL_H */
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
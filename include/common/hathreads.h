@@ -46,6 +46,7 @@
 
 #define MAX_THREADS 1
 #define MAX_THREADS_MASK 1
+#define MAX_TGROUPS 1
 
 /* Only way found to replace variables with constants that are optimized away
  * at build time.
@@ -64,6 +65,8 @@ extern struct thread_info {
 	uint64_t prev_mono_time;   /* previous system wide monotonic time  */
 	unsigned int idle_pct;     /* idle to total ratio over last sample (percent) */
 	unsigned int flags;        /* thread info flags, TI_FL_* */
+	unsigned int tgid;         /* thread group ID, 0..nbtgroups-1 */
+	unsigned long tg_mask;     /* mask of threads belonging to the same group */
 	/* pad to cache line (64B) */
 	char __pad[0];            /* unused except to check remaining room */
 	char __end[0] __attribute__((aligned(64)));
@@ -252,6 +255,10 @@ static inline unsigned long thread_isolated()
 
 #define MAX_THREADS_MASK (~0UL >> (LONGBITS - MAX_THREADS))
 
+#ifndef MAX_TGROUPS
+#define MAX_TGROUPS 16
+#endif
+
 #define __decl_hathreads(decl) decl
 
 /* declare a self-initializing spinlock */
@@ -434,6 +441,8 @@ extern struct thread_info {
 	uint64_t prev_mono_time;   /* previous system wide monotonic time  */
 	unsigned int idle_pct;     /* idle to total ratio over last sample (percent) */
 	unsigned int flags;        /* thread info flags, TI_FL_* */
+	unsigned int tgid;         /* thread group ID, 0..nbtgroups-1 */
+	unsigned long tg_mask;     /* mask of threads belonging to the same group */
 	/* pad to cache line (64B) */
 	char __pad[0];            /* unused except to check remaining room */
 	char __end[0] __attribute__((aligned(64)));
@@ -564,6 +573,7 @@ enum lock_label {
 	PROTO_LOCK,
 	CKCH_LOCK,
 	SNI_LOCK,
+	QSBR_LOCK,
 	OTHER_LOCK,
 	LOCK_LABELS
 };
@@ -683,6 +693,7 @@ static inline const char *lock_label(enum lock_label label)
 	case PROTO_LOCK:           return "PROTO";
 	case CKCH_LOCK:            return "CKCH";
 	case SNI_LOCK:             return "SNI";
+	case QSBR_LOCK:            return "QSBR";
 	case OTHER_LOCK:           return "OTHER";
 	case LOCK_LABELS:          break; /* keep compiler happy */
 	};
@@ -1200,8 +1211,22 @@ void ha_rwlock_init(HA_RWLOCK_T *l);
 
 #endif /* USE_THREAD */
 
+/* Thread groups are sets of contiguous threads which preferably share the
+ * same resources (typically a NUMA node). Work is kept within a group unless
+ * it explicitly targets threads of another group. With a single group (the
+ * default), everything works as if groups did not exist.
+ */
+extern struct tgroup_info {
+	unsigned long threads_mask; /* mask of threads belonging to this group */
+	unsigned int base;          /* first thread ID of the group */
+	unsigned int count;         /* number of threads in the group */
+	int node;                   /* NUMA node the group is bound to, or -1 */
+} ha_tgroup_info[MAX_TGROUPS];
+
 extern int thread_cpus_enabled_at_boot;
 
+int thread_groups_init();
+
 static inline void __ha_compiler_barrier(void)
 {
 	__asm __volatile("" ::: "memory");
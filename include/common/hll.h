@@ -0,0 +1,112 @@
+/*
+ * include/common/hll.h
+ * HyperLogLog estimation of the number of distinct elements.
+ *
+ * Copyright (C) 2026 agent - agent@local
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, version 2.1
+ * exclusively.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * A HyperLogLog counter is made of HLL_REGS registers. The top HLL_BITS bits
+ * of the 64-bit hash of each element select a register, which keeps the
+ * highest rank of the first bit set among the remaining bits. The number of
+ * distinct elements is then derived from the harmonic mean of the registers,
+ * with a standard error of about 1.04 / sqrt(HLL_REGS), so 6.5% with 256
+ * registers. Two counters are merged by keeping the highest of each register,
+ * so that the same elements seen in different places are counted only once.
+ */
+
+#ifndef _COMMON_HLL_H
+#define _COMMON_HLL_H
+
+#include <common/config.h>
+
+#define HLL_BITS  8
+#define HLL_REGS  (1 << HLL_BITS)
+
+struct hll {
+	unsigned char reg[HLL_REGS];
+};
+
+/* Adds the element of 64-bit hash <hash> to counter <hll> */
+static inline void hll_add(struct hll *hll, unsigned long long hash)
+{
+	unsigned int idx = hash >> (64 - HLL_BITS);
+	unsigned int rank;
+
+	hash <<= HLL_BITS;
+	rank = hash ? __builtin_clzll(hash) + 1 : 64 - HLL_BITS + 1;
+	if (hll->reg[idx] < rank)
+		hll->reg[idx] = rank;
+}
+
+/* Merges counter <from> into counter <hll> */
+static inline void hll_merge(struct hll *hll, const struct hll *from)
+{
+	int i;
+
+	for (i = 0; i < HLL_REGS; i++)
+		if (hll->reg[i] < from->reg[i])
+			hll->reg[i] = from->reg[i];
+}
+
+/* Returns the natural logarithm of <x> >= 1, without requiring libm */
+static inline double hll_ln(double x)
+{
+	double y, y2, ret = 0;
+	int i, k = 0;
+
+	while (x >= 2) {
+		x /= 2;
+		k++;
+	}
+	y = (x - 1) / (x + 1);
+	y2 = y * y;
+	for (i = 1; i < 20; i += 2) {
+		ret += y / i;
+		y *= y2;
+	}
+	return k * 0.69314718055994531 + 2 * ret;
+}
+
+/* Returns the estimated number of distinct elements added to <hll> */
+static inline unsigned int hll_count(const struct hll *hll)
+{
+	double sum = 0, est;
+	int i, zeroes = 0;
+
+	for (i = 0; i < HLL_REGS; i++) {
+		sum += 1.0 / (1ULL << hll->reg[i]);
+		zeroes += !hll->reg[i];
+	}
+
+	est = 0.7213 / (1.0 + 1.079 / HLL_REGS) * HLL_REGS * HLL_REGS / sum;
+
+	/* small cardinalities are better estimated by counting empty registers */
+	if (est <= 2.5 * HLL_REGS && zeroes)
+		est = HLL_REGS * hll_ln((double)HLL_REGS / zeroes);
+
+	return est + 0.5;
+}
+
+#endif /* _COMMON_HLL_H */
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
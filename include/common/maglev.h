@@ -0,0 +1,144 @@
+/*
+ * include/common/maglev.h
+ * Maglev lookup table population.
+ *
+ * Copyright (C) 2026 agent - agent@local
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, version 2.1
+ * exclusively.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * Maglev hashing is described in "Maglev: A Fast and Reliable Software Network
+ * Load Balancer" (Eisenbud et al., NSDI 2016). Each backend owns a preference
+ * list which is a permutation of the table's slots, defined by an offset and a
+ * skip derived from a stable hash of the backend. The table is filled by
+ * letting backends claim in turn their next preferred slot which is still
+ * free, until all slots are taken. Each backend thus gets the same number of
+ * slots give or take one, and since preferences don't depend on the other
+ * backends, adding or removing one backend only moves a small fraction of the
+ * slots. Lookups are a single modulo and a table access.
+ *
+ * Weights are supported by giving turns proportionally to them : at every
+ * round, each backend earns its weight in credits and claims one slot per
+ * <max weight> credits.
+ *
+ * The table size must be a prime number so that any skip value generates a
+ * full permutation. It should be at least 100 times larger than the number of
+ * backends to keep the imbalance below 1%.
+ */
+
+#ifndef _COMMON_MAGLEV_H
+#define _COMMON_MAGLEV_H
+
+#include <common/config.h>
+
+/* slot owner of an empty slot */
+#define MAGLEV_EMPTY  (-1)
+
+/* per-backend population state */
+struct maglev_perm {
+	unsigned int offset;    /* first preferred slot */
+	unsigned int skip;      /* distance between preferred slots, non-zero */
+	unsigned int weight;    /* relative weight, 0 to get no slot */
+	unsigned int pos;       /* next preferred slot (population only) */
+	unsigned int credit;    /* accumulated weight (population only) */
+};
+
+/* Returns the smallest supported table size able to hold <entries> backends
+ * with a maximum imbalance around 1%, or the largest supported one.
+ */
+static inline unsigned int maglev_size(unsigned int entries)
+{
+	/* all prime */
+	static const unsigned int sizes[] = {
+		251, 509, 1021, 2039, 4093, 8191, 16381, 32749, 65521, 131071,
+		262139, 524287, 1048573,
+	};
+	int i;
+
+	for (i = 0; i < sizeof(sizes) / sizeof(sizes[0]) - 1; i++)
+		if (sizes[i] >= entries * 100ULL)
+			break;
+	return sizes[i];
+}
+
+/* Sets the preference list of <perm> for table size <size> from the two
+ * independent hashes <h1> and <h2> of the backend.
+ */
+static inline void maglev_perm_init(struct maglev_perm *perm, unsigned int size,
+                                    unsigned int h1, unsigned int h2)
+{
+	perm->offset = h1 % size;
+	perm->skip   = h2 % (size - 1) + 1;
+}
+
+/* Fills all <size> slots of <table> with the index in <perm> of the backend
+ * owning them, based on the <nb> backends' preferences and weights. If all
+ * weights are null, the table is filled with MAGLEV_EMPTY.
+ */
+static inline void maglev_populate(int *table, unsigned int size, struct maglev_perm *perm, int nb)
+{
+	unsigned int filled, wmax, slot;
+	int i;
+
+	for (slot = 0; slot < size; slot++)
+		table[slot] = MAGLEV_EMPTY;
+
+	wmax = 0;
+	for (i = 0; i < nb; i++) {
+		perm[i].pos = perm[i].offset;
+		perm[i].credit = 0;
+		if (perm[i].weight > wmax)
+			wmax = perm[i].weight;
+	}
+
+	if (!wmax)
+		return;
+
+	filled = 0;
+	while (1) {
+		for (i = 0; i < nb; i++) {
+			perm[i].credit += perm[i].weight;
+			while (perm[i].credit >= wmax) {
+				perm[i].credit -= wmax;
+
+				/* claim the next preferred free slot */
+				slot = perm[i].pos;
+				while (table[slot] != MAGLEV_EMPTY) {
+					slot += perm[i].skip;
+					if (slot >= size)
+						slot -= size;
+				}
+				table[slot] = i;
+				slot += perm[i].skip;
+				if (slot >= size)
+					slot -= size;
+				perm[i].pos = slot;
+
+				if (++filled == size)
+					return;
+			}
+		}
+	}
+}
+
+#endif /* _COMMON_MAGLEV_H */
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
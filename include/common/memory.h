@@ -33,6 +33,7 @@
 #include <common/mini-clist.h>
 #include <common/hathreads.h>
 #include <common/initcall.h>
+#include <types/activity.h>
 
 #ifndef DEBUG_DONT_SHARE_POOLS
 #define MEM_F_SHARED	0x1
@@ -72,13 +73,24 @@ struct pool_free_list {
 	void **free_list;
 	uintptr_t seq;
 };
+
+/* Each thread group has its own shared free list in a pool, so that objects
+ * released by a group are reused by the same group. They're placed in distinct
+ * cache lines so that groups don't share them.
+ */
+struct pool_tg_free_list {
+	void **free_list;
+	uintptr_t seq;
+} __attribute__((aligned(64)));
 #endif
 
+struct slab_class;
+
 struct pool_head {
-	void **free_list;
 #ifdef CONFIG_HAP_LOCKLESS_POOLS
-	uintptr_t seq;
+	struct pool_tg_free_list free_lists[MAX_TGROUPS]; /* per-thread group free lists */
 #else
+	void **free_list;
 	__decl_hathreads(HA_SPINLOCK_T lock); /* the spin lock */
 #endif
 	unsigned int used;	/* how many chunks are currently in use */
@@ -89,6 +101,7 @@ struct pool_head {
 	unsigned int flags;	/* MEM_F_* */
 	unsigned int users;	/* number of pools sharing this zone */
 	unsigned int failed;	/* failed allocations */
+	struct slab_class *slab; /* slab class objects are allocated from, or NULL */
 	struct list list;	/* list of all known pools */
 	char name[12];		/* name of the pool */
 } __attribute__((aligned(64)));
@@ -100,6 +113,11 @@ extern unsigned int pool_base_count;
 /* poison each newly allocated area with this byte if >= 0 */
 extern int mem_poison_byte;
 
+/* profiling options, HA_PROF_MEMORY enables the hooks below (see activity.c) */
+extern unsigned int profiling;
+void pool_prof_alloc(const struct pool_head *pool);
+void pool_prof_free(const struct pool_head *pool);
+
 /* Allocates new entries for pool <pool> until there are at least <avail> + 1
  * available, then returns the last one for immediate use, so that at least
  * <avail> are left available in the pool upon return. NULL is returned if the
@@ -140,6 +158,34 @@ int pool_total_failures();
 unsigned long pool_total_allocated();
 unsigned long pool_total_used();
 
+/* Memory pressure levels. When a memory budget is set, the pressure level is
+ * periodically updated from the pools usage, and each level enables one more
+ * load shedding action in addition to the ones of the lower levels.
+ */
+enum mem_pressure_level {
+	MEM_PRESSURE_NONE = 0,  /* below all watermarks */
+	MEM_PRESSURE_COMP,      /* compression is bypassed */
+	MEM_PRESSURE_CACHE,     /* new objects are not stored into caches */
+	MEM_PRESSURE_H2,        /* new H2 streams are refused */
+	MEM_PRESSURE_ACCEPT,    /* listeners stop accepting connections */
+	MEM_PRESSURE_LEVELS     /* must be last */
+};
+
+extern unsigned int mem_budget;
+extern unsigned int mem_pressure;
+extern unsigned int mem_pressure_shed[MEM_PRESSURE_LEVELS];
+
+/* Returns non-zero if the action associated with pressure level <level> must
+ * be applied, in which case it is accounted as such.
+ */
+static inline int mem_pressure_shed_at(enum mem_pressure_level level)
+{
+	if (likely(mem_pressure < level))
+		return 0;
+	_HA_ATOMIC_ADD(&mem_pressure_shed[level], 1);
+	return 1;
+}
+
 /*
  * This function frees whatever can be freed in pool <pool>.
  */
@@ -212,23 +258,24 @@ static inline void *__pool_get_from_cache(struct pool_head *pool)
  */
 static inline void *__pool_get_first(struct pool_head *pool)
 {
+	struct pool_tg_free_list *fl = &pool->free_lists[ti->tgid];
 	struct pool_free_list cmp, new;
 	void *ret = __pool_get_from_cache(pool);
 
 	if (ret)
 		return ret;
 
-	cmp.seq = pool->seq;
+	cmp.seq = fl->seq;
 	__ha_barrier_load();
 
-	cmp.free_list = pool->free_list;
+	cmp.free_list = fl->free_list;
 	do {
 		if (cmp.free_list == NULL)
 			return NULL;
 		new.seq = cmp.seq + 1;
 		__ha_barrier_load();
 		new.free_list = *POOL_LINK(pool, cmp.free_list);
-	} while (HA_ATOMIC_DWCAS((void *)&pool->free_list, (void *)&cmp, (void *)&new) == 0);
+	} while (HA_ATOMIC_DWCAS((void *)&fl->free_list, (void *)&cmp, (void *)&new) == 0);
 	__ha_barrier_atomic_store();
 
 	_HA_ATOMIC_ADD(&pool->used, 1);
@@ -239,11 +286,13 @@ static inline void *__pool_get_first(struct pool_head *pool)
 	return cmp.free_list;
 }
 
-static inline void *pool_get_first(struct pool_head *pool)
+static forceinline void *pool_get_first(struct pool_head *pool)
 {
 	void *ret;
 
 	ret = __pool_get_first(pool);
+	if (unlikely(profiling & HA_PROF_MEMORY) && ret)
+		pool_prof_alloc(pool);
 	return ret;
 }
 /*
@@ -252,12 +301,14 @@ static inline void *pool_get_first(struct pool_head *pool)
  * the next element in the list. No memory poisonning is ever performed on the
  * returned area.
  */
-static inline void *pool_alloc_dirty(struct pool_head *pool)
+static forceinline void *pool_alloc_dirty(struct pool_head *pool)
 {
 	void *p;
 
 	if ((p = __pool_get_first(pool)) == NULL)
 		p = __pool_refill_alloc(pool, 0);
+	if (unlikely(profiling & HA_PROF_MEMORY) && p)
+		pool_prof_alloc(pool);
 	return p;
 }
 
@@ -266,7 +317,7 @@ static inline void *pool_alloc_dirty(struct pool_head *pool)
  * dynamically allocated. In the first case, <pool_type> is updated to point to
  * the next element in the list. Memory poisonning is performed if enabled.
  */
-static inline void *pool_alloc(struct pool_head *pool)
+static forceinline void *pool_alloc(struct pool_head *pool)
 {
 	void *p;
 
@@ -278,18 +329,19 @@ static inline void *pool_alloc(struct pool_head *pool)
 	return p;
 }
 
-/* Locklessly add item <ptr> to pool <pool>, then update the pool used count.
- * Both the pool and the pointer must be valid. Use pool_free() for normal
- * operations.
+/* Locklessly add item <ptr> to pool <pool>'s free list of the current thread
+ * group, then update the pool used count. Both the pool and the pointer must
+ * be valid. Use pool_free() for normal operations.
  */
 static inline void __pool_free(struct pool_head *pool, void *ptr)
 {
-	void **free_list = pool->free_list;
+	struct pool_tg_free_list *fl = &pool->free_lists[ti->tgid];
+	void **free_list = fl->free_list;
 
 	do {
 		*POOL_LINK(pool, ptr) = (void *)free_list;
 		__ha_barrier_store();
-	} while (!_HA_ATOMIC_CAS(&pool->free_list, &free_list, ptr));
+	} while (!_HA_ATOMIC_CAS(&fl->free_list, &free_list, ptr));
 	__ha_barrier_atomic_store();
 	_HA_ATOMIC_SUB(&pool->used, 1);
 }
@@ -324,9 +376,11 @@ static inline void pool_put_to_cache(struct pool_head *pool, void *ptr)
  * pointer. Just like with the libc's free(), nothing
  * is done if <ptr> is NULL.
  */
-static inline void pool_free(struct pool_head *pool, void *ptr)
+static forceinline void pool_free(struct pool_head *pool, void *ptr)
 {
         if (likely(ptr != NULL)) {
+		if (unlikely(profiling & HA_PROF_MEMORY))
+			pool_prof_free(pool);
 #ifdef DEBUG_MEMORY_POOLS
 		/* we'll get late corruption if we refill to the wrong pool or double-free */
 		if (*POOL_LINK(pool, ptr) != (void *)pool)
@@ -359,13 +413,15 @@ static inline void *__pool_get_first(struct pool_head *pool)
 	return p;
 }
 
-static inline void *pool_get_first(struct pool_head *pool)
+static forceinline void *pool_get_first(struct pool_head *pool)
 {
 	void *ret;
 
 	HA_SPIN_LOCK(POOL_LOCK, &pool->lock);
 	ret = __pool_get_first(pool);
 	HA_SPIN_UNLOCK(POOL_LOCK, &pool->lock);
+	if (unlikely(profiling & HA_PROF_MEMORY) && ret)
+		pool_prof_alloc(pool);
 	return ret;
 }
 /*
@@ -374,7 +430,7 @@ static inline void *pool_get_first(struct pool_head *pool)
  * the next element in the list. No memory poisonning is ever performed on the
  * returned area.
  */
-static inline void *pool_alloc_dirty(struct pool_head *pool)
+static forceinline void *pool_alloc_dirty(struct pool_head *pool)
 {
 	void *p;
 
@@ -382,6 +438,8 @@ static inline void *pool_alloc_dirty(struct pool_head *pool)
 	if ((p = __pool_get_first(pool)) == NULL)
 		p = __pool_refill_alloc(pool, 0);
 	HA_SPIN_UNLOCK(POOL_LOCK, &pool->lock);
+	if (unlikely(profiling & HA_PROF_MEMORY) && p)
+		pool_prof_alloc(pool);
 	return p;
 }
 
@@ -466,7 +524,7 @@ static inline void pool_free_area(void *area, size_t size)
  * dynamically allocated. In the first case, <pool_type> is updated to point to
  * the next element in the list. Memory poisonning is performed if enabled.
  */
-static inline void *pool_alloc(struct pool_head *pool)
+static forceinline void *pool_alloc(struct pool_head *pool)
 {
 	void *p;
 
@@ -487,9 +545,11 @@ static inline void *pool_alloc(struct pool_head *pool)
  * pointer. Just like with the libc's free(), nothing
  * is done if <ptr> is NULL.
  */
-static inline void pool_free(struct pool_head *pool, void *ptr)
+static forceinline void pool_free(struct pool_head *pool, void *ptr)
 {
         if (likely(ptr != NULL)) {
+		if (unlikely(profiling & HA_PROF_MEMORY))
+			pool_prof_free(pool);
 #ifdef DEBUG_MEMORY_POOLS
 		/* we'll get late corruption if we refill to the wrong pool or double-free */
 		if (*POOL_LINK(pool, ptr) != (void *)pool)
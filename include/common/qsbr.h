@@ -0,0 +1,79 @@
+/*
+ * include/common/qsbr.h
+ * Quiescent-state based reclamation of shared objects.
+ *
+ * Copyright (C) 2026 agent - agent@local
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, version 2.1
+ * exclusively.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * Some read-mostly objects are never modified in place : a writer builds a new
+ * version, publishes it by replacing a pointer, and retires the old one with
+ * qsbr_retire(). Readers simply dereference the pointer without any lock or
+ * atomic operation, and must not keep it once they return to the polling
+ * loop, which is the quiescent state. A retired object is released once all
+ * threads went through a quiescent state after it was retired, or are
+ * sleeping in the poller (harmless), since none of them may still use it.
+ *
+ * Each retirement increments a generation number, and each thread reports the
+ * last generation it saw from its polling loop. This costs a single read per
+ * loop when nothing is retired.
+ */
+
+#ifndef _COMMON_QSBR_H
+#define _COMMON_QSBR_H
+
+#include <common/config.h>
+#include <common/hathreads.h>
+
+struct qsbr_node {
+	struct qsbr_node *next;
+	unsigned long gen;                      /* generation at retirement */
+	void (*release)(struct qsbr_node *);    /* function releasing the object */
+};
+
+extern volatile unsigned long qsbr_gen;
+extern volatile unsigned long qsbr_oldest;
+extern volatile unsigned long qsbr_seen[MAX_THREADS];
+
+void qsbr_retire(struct qsbr_node *node, void (*release)(struct qsbr_node *));
+void qsbr_reclaim();
+
+/* Reports a quiescent state for the current thread : it doesn't reference any
+ * object obtained before this call anymore. Objects which can be released are
+ * released. It is called from the polling loop.
+ */
+static inline void qsbr_quiescent()
+{
+	unsigned long gen = qsbr_gen;
+
+	if (qsbr_seen[tid] != gen) {
+		qsbr_seen[tid] = gen;
+		__ha_barrier_store();
+	}
+
+	if (qsbr_oldest)
+		qsbr_reclaim();
+}
+
+#endif /* _COMMON_QSBR_H */
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
@@ -1460,6 +1460,26 @@ static inline unsigned long long rdtsc()
 }
 #endif
 
+extern THREAD_LOCAL unsigned int ha_random_state;
+unsigned int ha_random_seed();
+
+/* Returns a 32-bit pseudo-random number from a per-thread xorshift generator.
+ * Contrary to random(), it doesn't take any lock, but it must not be used
+ * where unpredictability matters.
+ */
+static inline unsigned int ha_random()
+{
+	unsigned int x = ha_random_state;
+
+	if (unlikely(!x))
+		x = ha_random_seed();
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	ha_random_state = x;
+	return x;
+}
+
 /* append a copy of string <str> (in a wordlist) at the end of the list <li>
  * On failure : return 0 and <err> filled with an error message.
  * The caller is responsible for freeing the <err> and <str> copy
@@ -0,0 +1,324 @@
+/*
+ * include/common/twheel.h
+ * Hierarchical timer wheel with millisecond resolution.
+ *
+ * Copyright (C) 2026 agent - agent@local
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, version 2.1
+ * exclusively.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+/*
+ * The wheel is made of TW_LEVELS levels of TW_SIZE slots each. Level 0 has
+ * one slot per millisecond, level 1 one slot per TW_SIZE milliseconds, and so
+ * on, so that 6 levels of 64 slots cover the whole 32-bit tick range. A timer
+ * is placed at the level of the highest bit by which its key differs from the
+ * wheel's current date <now>, in the slot designated by the key's bits at this
+ * level. Thus level 0 only contains timers expiring within the current 64ms
+ * block, in their exact slot, and upper levels contain timers which will be
+ * redistributed to lower levels ("cascaded") when <now> reaches the beginning
+ * of their slot. Inserting and deleting a timer are O(1), and each timer is
+ * cascaded at most TW_LEVELS-1 times before expiring, which is rare since most
+ * timers are deleted or moved before that. Keys keep their exact value and are
+ * delivered in order of millisecond, timers sharing the same millisecond being
+ * delivered in insertion order.
+ *
+ * Each level has a bitmap of possibly non-empty slots which is used to quickly
+ * find the next interesting date and to skip empty periods. Deleting a timer
+ * doesn't need to know the wheel nor to update the bitmap, so bits may be
+ * stale and are cleared when the slot is visited.
+ *
+ * Timers already in the past when inserted are placed in the current slot so
+ * that they're delivered on the next call to tw_pop_expired(). Keys must not
+ * be further than 2^31 ms from the wheel's date, like any tick. The wheel's
+ * date only advances when it is popped, so a wheel left without timers may
+ * lag behind the current date by more than that (it is also initialized
+ * before the clock is). Callers must thus call tw_sync() with the current date
+ * before inserting timers, so that an empty wheel restarts from there.
+ *
+ * The wheel doesn't do any locking, this is the caller's responsibility. The
+ * functions which don't modify the wheel (tw_next_key(), tw_is_empty()) may be
+ * called under a shared lock.
+ */
+
+#ifndef _COMMON_TWHEEL_H
+#define _COMMON_TWHEEL_H
+
+#include <common/config.h>
+#include <common/mini-clist.h>
+
+#define TW_BITS    6                    /* bits per level */
+#define TW_SIZE    (1U << TW_BITS)      /* slots per level */
+#define TW_MASK    (TW_SIZE - 1)
+#define TW_LEVELS  6                    /* enough to cover 32 bits */
+
+/* returns a pointer to the structure of type <type> holding timer node <ptr>
+ * in its member <member>.
+ */
+#define tw_entry(ptr, type, member) \
+	((type *)(((void *)(ptr)) - ((size_t)&((type *)0)->member)))
+
+/* a timer node, to be embedded into the timer's owner */
+struct tw_node {
+	struct list list;       /* attach point in the wheel's slot */
+	unsigned int key;       /* expiration date */
+};
+
+struct twheel {
+	unsigned int now;                        /* next date to be visited */
+	unsigned long long used[TW_LEVELS];      /* possibly non-empty slots */
+	struct list slot[TW_LEVELS][TW_SIZE];    /* timer lists */
+};
+
+/* Initializes wheel <w> with current date <now> */
+static inline void tw_init(struct twheel *w, unsigned int now)
+{
+	int lvl, slot;
+
+	w->now = now;
+	for (lvl = 0; lvl < TW_LEVELS; lvl++) {
+		w->used[lvl] = 0;
+		for (slot = 0; slot < TW_SIZE; slot++)
+			LIST_INIT(&w->slot[lvl][slot]);
+	}
+}
+
+/* Initializes timer node <node> so that it may be tested with tw_in_wheel() */
+static inline void tw_node_init(struct tw_node *node)
+{
+	LIST_INIT(&node->list);
+}
+
+/* Returns non-zero if <node> is in a wheel */
+static inline int tw_in_wheel(const struct tw_node *node)
+{
+	return LIST_ADDED(&node->list);
+}
+
+/* Returns non-zero if wheel <w> is empty, zero if it may contain timers */
+static inline int tw_is_empty(const struct twheel *w)
+{
+	int lvl;
+
+	for (lvl = 0; lvl < TW_LEVELS; lvl++)
+		if (w->used[lvl])
+			return 0;
+	return 1;
+}
+
+/* Sets the date of wheel <w> to <now> if it doesn't hold any timer anymore.
+ * The bits of the slots found empty on the way are cleared, so that the cost
+ * of the check stays proportional to the number of deleted timers. Returns
+ * non-zero if the wheel was empty.
+ */
+static inline int tw_sync(struct twheel *w, unsigned int now)
+{
+	int lvl, slot;
+
+	for (lvl = 0; lvl < TW_LEVELS; lvl++) {
+		for (; w->used[lvl]; w->used[lvl] &= ~(1ULL << slot)) {
+			slot = __builtin_ctzll(w->used[lvl]);
+			if (!LIST_ISEMPTY(&w->slot[lvl][slot]))
+				return 0;
+		}
+	}
+	w->now = now;
+	return 1;
+}
+
+/* Inserts <node> into wheel <w> according to its key. The node must not be in
+ * a wheel yet, and tw_sync() must have been called if the wheel may have been
+ * left empty for a long time.
+ */
+static inline void tw_insert(struct twheel *w, struct tw_node *node)
+{
+	unsigned int key = node->key;
+	unsigned int diff, lvl, slot;
+
+	if ((int)(key - w->now) < 0)
+		key = w->now;
+
+	diff = key ^ w->now;
+	lvl = diff ? (31 - __builtin_clz(diff)) / TW_BITS : 0;
+	slot = (key >> (lvl * TW_BITS)) & TW_MASK;
+	LIST_ADDQ(&w->slot[lvl][slot], &node->list);
+	w->used[lvl] |= 1ULL << slot;
+}
+
+/* Removes <node> from the wheel it's in, if any. */
+static inline void tw_delete(struct tw_node *node)
+{
+	LIST_DEL_INIT(&node->list);
+}
+
+/* Finds the earliest date at which wheel <w> may have to deliver a timer. For
+ * timers in level 0 this is their exact expiration date, for upper levels it
+ * is the beginning of their slot, at which point they'll be cascaded. Returns
+ * non-zero and sets <key> if a date was found, or zero if the wheel is empty.
+ * The wheel is not modified.
+ */
+static inline int tw_next_key(const struct twheel *w, unsigned int *key)
+{
+	unsigned long long m, base;
+	unsigned int lvl, shift, idx, j;
+
+	for (lvl = 0; lvl < TW_LEVELS; lvl++) {
+		shift = lvl * TW_BITS;
+		idx = (w->now >> shift) & TW_MASK;
+		base = (unsigned long long)(w->now >> shift) & ~(unsigned long long)TW_MASK;
+
+		/* the current slot only matters in level 0, the current slot
+		 * of upper levels was already cascaded.
+		 */
+		m = w->used[lvl] & (~0ULL << idx);
+		if (lvl)
+			m &= ~(1ULL << idx);
+		for (; m; m &= m - 1) {
+			j = __builtin_ctzll(m);
+			if (!LIST_ISEMPTY(&w->slot[lvl][j])) {
+				*key = (base + j) << shift;
+				return 1;
+			}
+		}
+
+		/* slots before the current one belong to the next round,
+		 * which only happens when the 32-bit date wraps.
+		 */
+		m = w->used[lvl] & ~(~0ULL << idx);
+		for (; m; m &= m - 1) {
+			j = __builtin_ctzll(m);
+			if (!LIST_ISEMPTY(&w->slot[lvl][j])) {
+				*key = (base + TW_SIZE + j) << shift;
+				return 1;
+			}
+		}
+	}
+	return 0;
+}
+
+/* Redistributes the timers from the upper level slots which start at the
+ * wheel's current date to the lower levels. Only called by tw_pop_expired().
+ */
+static inline void tw_cascade(struct twheel *w)
+{
+	struct tw_node *node;
+	struct list *head;
+	int lvl, slot;
+
+	for (lvl = TW_LEVELS - 1; lvl > 0; lvl--) {
+		if (w->now & ((1U << (lvl * TW_BITS)) - 1))
+			continue;
+
+		slot = (w->now >> (lvl * TW_BITS)) & TW_MASK;
+		if (!(w->used[lvl] & (1ULL << slot)))
+			continue;
+
+		w->used[lvl] &= ~(1ULL << slot);
+		head = &w->slot[lvl][slot];
+		while (!LIST_ISEMPTY(head)) {
+			node = LIST_ELEM(head->n, struct tw_node *, list);
+			LIST_DEL(&node->list);
+			tw_insert(w, node);
+		}
+	}
+}
+
+/* Detaches and returns the next timer of wheel <w> expiring no later than
+ * <now>, or NULL if there is none. The wheel's date is advanced up to <now>+1
+ * on the way, skipping empty periods.
+ */
+static inline struct tw_node *tw_pop_expired(struct twheel *w, unsigned int now)
+{
+	struct tw_node *node;
+	unsigned int idx, next;
+
+	while ((int)(w->now - now) <= 0) {
+		idx = w->now & TW_MASK;
+		if (!idx)
+			tw_cascade(w);
+
+		if (!LIST_ISEMPTY(&w->slot[0][idx])) {
+			node = LIST_ELEM(w->slot[0][idx].n, struct tw_node *, list);
+			LIST_DEL_INIT(&node->list);
+			return node;
+		}
+		w->used[0] &= ~(1ULL << idx);
+
+		/* jump to the next possibly non-empty slot or right after <now> */
+		if (!tw_next_key(w, &next) || (int)(next - now) > 0)
+			next = now + 1;
+		if ((int)(next - w->now) <= 0)
+			next = w->now + 1;
+		w->now = next;
+	}
+	return NULL;
+}
+
+/* Visits the slots of wheel <w> in the order in which their timers will be
+ * delivered, <*pos> being set to zero before the first call. Returns the list
+ * of timers of the next slot which may contain some, or NULL once all of them
+ * were visited. The timers of a slot of an upper level are not sorted. This is
+ * meant to find the earliest timers without delivering them, so the wheel is
+ * not modified, but the caller may delete or insert timers on the way.
+ */
+static inline struct list *tw_next_slot(struct twheel *w, unsigned int *pos)
+{
+	unsigned int round, lvl, slot, idx;
+
+	while (*pos < 2 * TW_LEVELS * TW_SIZE) {
+		round = *pos / (TW_LEVELS * TW_SIZE);
+		lvl = *pos / TW_SIZE % TW_LEVELS;
+		slot = *pos % TW_SIZE;
+		(*pos)++;
+
+		/* slots before the current one belong to the next round */
+		idx = (w->now >> (lvl * TW_BITS)) & TW_MASK;
+		if (round ? slot >= idx : slot < idx)
+			continue;
+
+		if ((w->used[lvl] & (1ULL << slot)) && !LIST_ISEMPTY(&w->slot[lvl][slot]))
+			return &w->slot[lvl][slot];
+	}
+	return NULL;
+}
+
+/* Detaches and returns any timer from wheel <w>, or NULL if it is empty. This
+ * is only meant to be used to purge a wheel.
+ */
+static inline struct tw_node *tw_pop_any(struct twheel *w)
+{
+	struct tw_node *node;
+	int lvl, slot;
+
+	for (lvl = 0; lvl < TW_LEVELS; lvl++) {
+		for (; w->used[lvl]; w->used[lvl] &= ~(1ULL << slot)) {
+			slot = __builtin_ctzll(w->used[lvl]);
+			if (!LIST_ISEMPTY(&w->slot[lvl][slot])) {
+				node = LIST_ELEM(w->slot[lvl][slot].n, struct tw_node *, list);
+				LIST_DEL_INIT(&node->list);
+				return node;
+			}
+		}
+	}
+	return NULL;
+}
+
+#endif /* _COMMON_TWHEEL_H */
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
@@ -28,18 +28,13 @@
 #include <types/activity.h>
 #include <proto/freq_ctr.h>
 
-/* bit fields for "profiling" */
-#define HA_PROF_TASKS_OFF   0x00000000     /* per-task CPU profiling forced disabled */
-#define HA_PROF_TASKS_AUTO  0x00000001     /* per-task CPU profiling automatic */
-#define HA_PROF_TASKS_ON    0x00000002     /* per-task CPU profiling forced enabled */
-#define HA_PROF_TASKS_MASK  0x00000003     /* per-task CPU profiling mask */
-
 extern unsigned int profiling;
 extern unsigned long task_profiling_mask;
 extern struct activity activity[MAX_THREADS];
 
 
 void report_stolen_time(uint64_t stolen);
+void sched_prof_account(const void *func, uint64_t lat, uint64_t cpu);
 
 /* Collect date and time information before calling poll(). This will be used
  * to count the run time of the past loop and the sleep time of the next poll.
@@ -86,13 +81,15 @@ static inline void activity_count_runtime()
 	if (!(task_profiling_mask & tid_bit)) {
 		if (unlikely((profiling & HA_PROF_TASKS_MASK) == HA_PROF_TASKS_ON ||
 			     ((profiling & HA_PROF_TASKS_MASK) == HA_PROF_TASKS_AUTO && run_time >= up))) {
-			if (swrate_avg(activity[tid].avg_loop_us, TIME_STATS_SAMPLES) >= up)
+			if ((profiling & HA_PROF_TASKS_MASK) == HA_PROF_TASKS_ON ||
+			    swrate_avg(activity[tid].avg_loop_us, TIME_STATS_SAMPLES) >= up)
 				_HA_ATOMIC_OR(&task_profiling_mask, tid_bit);
 		}
 	} else {
 		if (unlikely((profiling & HA_PROF_TASKS_MASK) == HA_PROF_TASKS_OFF ||
 			     ((profiling & HA_PROF_TASKS_MASK) == HA_PROF_TASKS_AUTO && run_time <= down))) {
-			if (swrate_avg(activity[tid].avg_loop_us, TIME_STATS_SAMPLES) <= down)
+			if ((profiling & HA_PROF_TASKS_MASK) == HA_PROF_TASKS_OFF ||
+			    swrate_avg(activity[tid].avg_loop_us, TIME_STATS_SAMPLES) <= down)
 				_HA_ATOMIC_AND(&task_profiling_mask, ~tid_bit);
 		}
 	}
@@ -47,6 +47,7 @@ extern THREAD_LOCAL int *fd_updt;  // FD updates list
 extern THREAD_LOCAL int fd_nbupdt; // number of updates in the list
 
 extern int poller_wr_pipe[MAX_THREADS];
+extern volatile unsigned long poller_wake_mask;
 
 extern volatile int ha_used_fds; // Number of FDs we're currently using
 
@@ -449,11 +450,32 @@ static inline unsigned int hap_fd_isset(int fd, unsigned int *evts)
 	return evts[fd / (8*sizeof(*evts))] & (1U << (fd & (8*sizeof(*evts) - 1)));
 }
 
-static inline void wake_thread(int tid)
+/* Wakes up thread <thr> which may be sleeping in its poller. Wakeups are
+ * coalesced: only the first one since the thread last drained its wakeup
+ * channel performs the write, the following ones are only counted, so that
+ * there is at most one syscall per sleep cycle of the target thread.
+ */
+static inline void wake_thread(int thr)
 {
-	char c = 'c';
+	if (HA_ATOMIC_BTS(&poller_wake_mask, thr)) {
+		activity[tid].wake_coalesced++;
+		return;
+	}
+
+	activity[tid].wake_sent++;
+#ifdef USE_EVENTFD
+	{
+		uint64_t c = 1;
 
-	shut_your_big_mouth_gcc(write(poller_wr_pipe[tid], &c, 1));
+		shut_your_big_mouth_gcc(write(poller_wr_pipe[thr], &c, sizeof(c)));
+	}
+#else
+	{
+		char c = 'c';
+
+		shut_your_big_mouth_gcc(write(poller_wr_pipe[thr], &c, 1));
+	}
+#endif
 }
 
 
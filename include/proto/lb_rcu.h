@@ -0,0 +1,40 @@
+/*
+ * include/proto/lb_rcu.h
+ * Lock-free roundrobin and leastconn load balancing algorithms.
+ *
+ * Copyright (C) 2026 agent - agent@local
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, version 2.1
+ * exclusively.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _PROTO_LB_RCU_H
+#define _PROTO_LB_RCU_H
+
+#include <common/config.h>
+#include <types/proxy.h>
+#include <types/server.h>
+
+struct server *rcu_get_next_server_rr(struct proxy *p, struct server *srvtoavoid);
+struct server *rcu_get_next_server_lc(struct proxy *p, struct server *srvtoavoid);
+int rcu_init_server_array(struct proxy *p);
+
+#endif /* _PROTO_LB_RCU_H */
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
@@ -26,6 +26,7 @@
 #include <common/errors.h>
 #include <common/ticks.h>
 #include <common/time.h>
+#include <import/xxhash.h>
 #include <types/stick_table.h>
 #include <types/dict.h>
 
@@ -42,6 +43,8 @@ void stksess_free(struct stktable *t, struct stksess *ts);
 int stksess_kill(struct stktable *t, struct stksess *ts, int decrefcount);
 
 int stktable_init(struct stktable *t);
+void stktable_snapshot_stop(struct stktable *t);
+void stktable_snapshot_flush(struct stktable *t);
 int stktable_parse_type(char **args, int *idx, unsigned long *type, size_t *key_size);
 int parse_stick_table(const char *file, int linenum, char **args,
                       struct stktable *t, char *id, char *nid, struct peers *peers);
@@ -50,6 +53,8 @@ struct stksess *stktable_set_entry(struct stktable *table, struct stksess *nts);
 void stktable_touch_with_exp(struct stktable *t, struct stksess *ts, int decrefcount, int expire);
 void stktable_touch_remote(struct stktable *t, struct stksess *ts, int decrefcnt);
 void stktable_touch_local(struct stktable *t, struct stksess *ts, int decrefccount);
+void stktable_release(struct stktable *t, struct stksess *ts);
+void stktable_sketch_release(struct stktable *t, struct stksess *ts);
 struct stksess *stktable_lookup(struct stktable *t, struct stksess *ts);
 struct stksess *stktable_lookup_key(struct stktable *t, struct stktable_key *key);
 struct stksess *stktable_update_key(struct stktable *table, struct stktable_key *key);
@@ -65,6 +70,36 @@ int stktable_get_data_type(char *name);
 int stktable_trash_oldest(struct stktable *t, int to_batch);
 int __stksess_kill(struct stktable *t, struct stksess *ts);
 
+/* Returns the shard of table <t> holding the entry matching key <key> */
+static inline struct stktable_shard *stktable_key_shard(struct stktable *t, struct stktable_key *key)
+{
+	size_t len;
+
+	if (t->nbshards == 1)
+		return t->shards;
+
+	if (t->type == SMP_T_STR)
+		len = strnlen(key->key, key->key_len + 1 < t->key_size ? key->key_len : t->key_size - 1);
+	else
+		len = t->key_size;
+	return &t->shards[XXH32(key->key, len, 0) % t->nbshards];
+}
+
+/* Returns the shard of table <t> holding entry <ts>, or which will hold it */
+static inline struct stktable_shard *stksess_shard(struct stktable *t, struct stksess *ts)
+{
+	size_t len;
+
+	if (t->nbshards == 1)
+		return t->shards;
+
+	if (t->type == SMP_T_STR)
+		len = strlen((char *)ts->key.key);
+	else
+		len = t->key_size;
+	return &t->shards[XXH32(ts->key.key, len, 0) % t->nbshards];
+}
+
 /* return allocation size for standard data type <type> */
 static inline int stktable_type_size(int type)
 {
@@ -78,6 +113,8 @@ static inline int stktable_type_size(int type)
 		return sizeof(struct freq_ctr_period);
 	case STD_T_DICT:
 		return sizeof(struct dict_entry *);
+	case STD_T_HLL:
+		return sizeof(struct hll);
 	}
 	return 0;
 }
@@ -147,7 +184,9 @@ static inline void *stktable_data_ptr(struct stktable *t, struct stksess *ts, in
 	return __stktable_data_ptr(t, ts, type);
 }
 
-/* kill an entry if it's expired and its ref_cnt is zero */
+/* kill an entry if it's expired and its ref_cnt is zero. The entry's shard
+ * must be locked.
+ */
 static inline int __stksess_kill_if_expired(struct stktable *t, struct stksess *ts)
 {
 	if (t->expire != TICK_ETERNITY && tick_is_expired(ts->expire, now_ms))
@@ -158,15 +197,24 @@ static inline int __stksess_kill_if_expired(struct stktable *t, struct stksess *
 
 static inline void stksess_kill_if_expired(struct stktable *t, struct stksess *ts, int decrefcnt)
 {
-	HA_SPIN_LOCK(STK_TABLE_LOCK, &t->lock);
+	struct stktable_shard *sh;
+
+	if (t->sketch_depth) {
+		if (decrefcnt)
+			stktable_sketch_release(t, ts);
+		return;
+	}
+
+	sh = stksess_shard(t, ts);
+	HA_SPIN_LOCK(STK_TABLE_LOCK, &sh->lock);
 
 	if (decrefcnt)
-		ts->ref_cnt--;
+		HA_ATOMIC_SUB(&ts->ref_cnt, 1);
 
 	if (t->expire != TICK_ETERNITY && tick_is_expired(ts->expire, now_ms))
 		__stksess_kill_if_expired(t, ts);
 
-	HA_SPIN_UNLOCK(STK_TABLE_LOCK, &t->lock);
+	HA_SPIN_UNLOCK(STK_TABLE_LOCK, &sh->lock);
 }
 
 /* sets the stick counter's entry pointer */
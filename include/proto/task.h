@@ -31,6 +31,7 @@
 #include <common/standard.h>
 #include <common/ticks.h>
 #include <common/hathreads.h>
+#include <common/twheel.h>
 
 #include <eb32sctree.h>
 #include <eb32tree.h>
@@ -51,23 +52,21 @@
  * cannot use that to store sorted information because that reference changes
  * all the time.
  *
- * We'll use the fact that the time wraps to sort timers. Timers above <now>
- * are in the future, timers below <now> are in the past. Here, "above" and
- * "below" are to be considered modulo 2^31.
- *
- * Timers are stored sorted in an ebtree. We use the new ability for ebtrees to
- * lookup values starting from X to only expire tasks between <now> - 2^31 and
- * <now>. If the end of the tree is reached while walking over it, we simply
- * loop back to the beginning. That way, we have no problem keeping sorted
- * wrapping timers in a tree, between (now - 24 days) and (now + 24 days). The
- * keys in the tree always reflect their real position, none can be infinite.
- * This reduces the number of checks to be performed.
+ * Timers are stored in hierarchical timer wheels (see common/twheel.h), one
+ * per thread plus a global one for tasks which may run on multiple threads.
+ * Inserting, moving and removing a timer are O(1) operations and the wheel
+ * delivers expired timers in chronological order with a millisecond
+ * resolution, which is all we need. Dates are compared relative to the
+ * wheel's current date so that timers may wrap, between (now - 24 days) and
+ * (now + 24 days). The keys in the wheel always reflect their real position,
+ * none can be infinite. The ebtrees are only used for the run queue, which
+ * needs an exact ordering between tasks.
  *
  * Another nice optimisation is to allow a timer to stay at an old place in the
  * queue as long as it's not further than the real expiration date. That way,
- * we use the tree as a place holder for a minorant of the real expiration
+ * we use the wheel as a place holder for a minorant of the real expiration
  * date. Since we have a very low chance of hitting a timeout anyway, we can
- * bounce the nodes to their right place when we scan the tree if we encounter
+ * bounce the nodes to their right place when we scan the wheel if we encounter
  * a misplaced node once in a while. This even allows us not to remove the
  * infinite timers from the wait queue.
  *
@@ -76,8 +75,8 @@
  *   - timer is the real expiration date (possibly infinite)
  *   - node->key is always before or equal to timer
  *
- * The run queue works similarly to the wait queue except that the current date
- * is replaced by an insertion counter which can also wrap without any problem.
+ * The run queue is an ebtree working similarly, except that the current date is
+ * replaced by an insertion counter which can also wrap without any problem.
  */
 
 /* The farthest we can look back in a timer tree */
@@ -85,7 +84,7 @@
 
 /* a few exported variables */
 extern unsigned int nb_tasks;     /* total number of tasks */
-extern volatile unsigned long global_tasks_mask; /* Mask of threads with tasks in the global runqueue */
+extern volatile unsigned long global_tasks_mask; /* Mask of threads which may find tasks in inbound queues */
 extern unsigned int tasks_run_queue;    /* run queue size */
 extern unsigned int tasks_run_queue_cur;
 extern unsigned int nb_tasks_cur;
@@ -95,14 +94,11 @@ extern struct pool_head *pool_head_tasklet;
 extern struct pool_head *pool_head_notification;
 extern THREAD_LOCAL struct task_per_thread *sched; /* current's thread scheduler context */
 #ifdef USE_THREAD
-extern struct eb_root timers;      /* sorted timers tree, global */
-extern struct eb_root rqueue;      /* tree constituting the run queue */
-extern int global_rqueue_size; /* Number of element sin the global runqueue */
+extern struct twheel timers;       /* timer wheel, global */
 #endif
 
 extern struct task_per_thread task_per_thread[MAX_THREADS];
 
-__decl_hathreads(extern HA_SPINLOCK_T rq_lock);  /* spin lock related to run queue */
 __decl_hathreads(extern HA_RWLOCK_T wq_lock);    /* RW lock related to the wait queue */
 
 static inline struct task *task_unlink_wq(struct task *t);
@@ -112,41 +108,32 @@ static inline void task_queue(struct task *task);
 static inline int task_in_rq(struct task *t)
 {
 	/* Check if leaf_p is NULL, in case he's not in the runqueue, and if
-	 * it's not 0x1, which would mean it's in the tasklet list.
+	 * it's not 0x1, which would mean it's in the tasklet list. A task
+	 * waiting in a thread's inbound queue is in the run queue as well.
 	 */
-	return t->rq.node.leaf_p != NULL;
+	return t->rq.node.leaf_p != NULL || (t->state & TASK_GLOBAL);
 }
 
 /* return 0 if task is in wait queue, otherwise non-zero */
 static inline int task_in_wq(struct task *t)
 {
-	return t->wq.node.leaf_p != NULL;
+	return tw_in_wheel(&t->wq);
 }
 
 /* puts the task <t> in run queue with reason flags <f>, and returns <t> */
 /* This will put the task in the local runqueue if the task is only runnable
- * by the current thread, in the global runqueue otherwies.
+ * by the current thread, in the inbound queue of one of the threads allowed
+ * to run it otherwise.
  */
-void __task_wakeup(struct task *t, struct eb_root *);
+void __task_wakeup(struct task *t);
 static inline void task_wakeup(struct task *t, unsigned int f)
 {
 	unsigned short state;
 
-#ifdef USE_THREAD
-	struct eb_root *root;
-
-	if (t->thread_mask == tid_bit || global.nbthread == 1)
-		root = &sched->rqueue;
-	else
-		root = &rqueue;
-#else
-	struct eb_root *root = &sched->rqueue;
-#endif
-
 	state = _HA_ATOMIC_OR(&t->state, f);
 	while (!(state & (TASK_RUNNING | TASK_QUEUED))) {
 		if (_HA_ATOMIC_CAS(&t->state, &state, state | TASK_QUEUED)) {
-			__task_wakeup(t, root);
+			__task_wakeup(t);
 			break;
 		}
 	}
@@ -178,7 +165,7 @@ static inline void task_set_affinity(struct task *t, unsigned long thread_mask)
  */
 static inline struct task *__task_unlink_wq(struct task *t)
 {
-	eb32_delete(&t->wq);
+	tw_delete(&t->wq);
 	return t;
 }
 
@@ -204,40 +191,41 @@ static inline struct task *task_unlink_wq(struct task *t)
 /*
  * Unlink the task from the run queue. The tasks_run_queue size and number of
  * niced tasks are updated too. A pointer to the task itself is returned. The
- * task *must* already be in the run queue before calling this function. If
- * unsure, use the safer task_unlink_rq() function. Note that the pointer to the
- * next run queue entry is neither checked nor updated.
+ * task *must* already be in the calling thread's local run queue before
+ * calling this function. Note that the pointer to the next run queue entry is
+ * neither checked nor updated.
  */
 static inline struct task *__task_unlink_rq(struct task *t)
 {
 	_HA_ATOMIC_SUB(&tasks_run_queue, 1);
-#ifdef USE_THREAD
-	if (t->state & TASK_GLOBAL) {
-		_HA_ATOMIC_AND(&t->state, ~TASK_GLOBAL);
-		global_rqueue_size--;
-	} else
-#endif
-		sched->rqueue_size--;
+	sched->rqueue_size--;
 	eb32sc_delete(&t->rq);
 	if (likely(t->nice))
 		_HA_ATOMIC_SUB(&niced_tasks, 1);
 	return t;
 }
 
-/* This function unlinks task <t> from the run queue if it is in it. It also
- * takes care of updating the next run queue task if it was this task.
+/* returns the scheduler class (TL_*) of task or tasklet <t> */
+static inline unsigned int task_class(const struct task *t)
+{
+	return (t->state & TASK_CLASS_MASK) >> TASK_CLASS_SHIFT;
+}
+
+/* Sets the scheduler class of task <t> to <cls>, which will be used from its
+ * next wakeup. It may be called at any time, including from the task itself.
  */
-static inline struct task *task_unlink_rq(struct task *t)
+static inline void task_set_class(struct task *t, unsigned int cls)
 {
-	int is_global = t->state & TASK_GLOBAL;
+	unsigned short old = t->state;
 
-	if (is_global)
-		HA_SPIN_LOCK(TASK_RQ_LOCK, &rq_lock);
-	if (likely(task_in_rq(t)))
-		__task_unlink_rq(t);
-	if (is_global)
-		HA_SPIN_UNLOCK(TASK_RQ_LOCK, &rq_lock);
-	return t;
+	while (!_HA_ATOMIC_CAS(&t->state, &old, (old & ~TASK_CLASS_MASK) | (cls << TASK_CLASS_SHIFT)))
+		;
+}
+
+/* same as task_set_class() for tasklets */
+static inline void tasklet_set_class(struct tasklet *tl, unsigned int cls)
+{
+	task_set_class((struct task *)tl, cls);
 }
 
 static inline void tasklet_wakeup(struct tasklet *tl)
@@ -245,7 +233,7 @@ static inline void tasklet_wakeup(struct tasklet *tl)
 	if (likely(tl->tid < 0)) {
 		/* this tasklet runs on the caller thread */
 		if (LIST_ISEMPTY(&tl->list)) {
-			LIST_ADDQ(&task_per_thread[tid].task_list, &tl->list);
+			LIST_ADDQ(&task_per_thread[tid].tasklets[task_class((struct task *)tl)], &tl->list);
 			_HA_ATOMIC_ADD(&tasks_run_queue, 1);
 		}
 	} else {
@@ -267,7 +255,7 @@ static inline void tasklet_wakeup(struct tasklet *tl)
 static inline void tasklet_insert_into_tasklet_list(struct tasklet *tl)
 {
 	_HA_ATOMIC_ADD(&tasks_run_queue, 1);
-	LIST_ADDQ(&sched->task_list, &tl->list);
+	LIST_ADDQ(&sched->tasklets[task_class((struct task *)tl)], &tl->list);
 }
 
 /* Remove the tasklet from the tasklet list. The tasklet MUST already be there.
@@ -296,9 +284,10 @@ static inline void tasklet_remove_from_tasklet_list(struct tasklet *t)
  */
 static inline struct task *task_init(struct task *t, unsigned long thread_mask)
 {
-	t->wq.node.leaf_p = NULL;
+	tw_node_init(&t->wq);
 	t->rq.node.leaf_p = NULL;
-	t->state = TASK_SLEEPING;
+	MT_LIST_INIT(&t->inq);
+	t->state = TASK_SLEEPING | (TL_NORMAL << TASK_CLASS_SHIFT);
 	t->thread_mask = thread_mask;
 	if (atleast2(thread_mask))
 		t->state |= TASK_SHARED_WQ;
@@ -319,7 +308,7 @@ static inline void tasklet_init(struct tasklet *t)
 {
 	t->nice = -32768;
 	t->calls = 0;
-	t->state = 0;
+	t->state = TL_URGENT << TASK_CLASS_SHIFT;
 	t->process = NULL;
 	t->tid = -1;
 	LIST_INIT(&t->list);
@@ -412,7 +401,7 @@ static inline void tasklet_set_tid(struct tasklet *tl, int tid)
 	tl->tid = tid;
 }
 
-void __task_queue(struct task *task, struct eb_root *wq);
+void __task_queue(struct task *task, struct twheel *wq);
 
 /* Place <task> into the wait queue, where it may already be. If the expiration
  * timer is infinite, do nothing and rely on wake_expired_task to clean up.
@@ -579,11 +568,22 @@ static inline int notification_registered(struct list *wake)
 	return !LIST_ISEMPTY(wake);
 }
 
+/* returns non-zero if the thread whose scheduler context is <tt> has tasks or
+ * tasklets in any of its class lists.
+ */
+static inline int sched_has_tasklets(const struct task_per_thread *tt)
+{
+	return (!LIST_ISEMPTY(&tt->tasklets[TL_URGENT]) |
+	        !LIST_ISEMPTY(&tt->tasklets[TL_NORMAL]) |
+	        !LIST_ISEMPTY(&tt->tasklets[TL_BULK]) |
+	        !LIST_ISEMPTY(&tt->tasklets[TL_BACKGROUND]));
+}
+
 static inline int thread_has_tasks(void)
 {
 	return (!!(global_tasks_mask & tid_bit) |
-	        (sched->rqueue_size > 0) |
-	        !LIST_ISEMPTY(&sched->task_list) | !MT_LIST_ISEMPTY(&sched->shared_tasklet_list));
+	        (sched->rqueue_size > 0) | !MT_LIST_ISEMPTY(&sched->inbound) |
+	        sched_has_tasklets(sched) | !MT_LIST_ISEMPTY(&sched->shared_tasklet_list));
 }
 
 /* adds list item <item> to work list <work> and wake up the associated task */
@@ -24,6 +24,56 @@
 
 #include <common/config.h>
 #include <types/freq_ctr.h>
+#include <types/task.h>
+
+/* bit fields for "profiling" */
+#define HA_PROF_TASKS_OFF   0x00000000     /* per-task CPU profiling forced disabled */
+#define HA_PROF_TASKS_AUTO  0x00000001     /* per-task CPU profiling automatic */
+#define HA_PROF_TASKS_ON    0x00000002     /* per-task CPU profiling forced enabled */
+#define HA_PROF_TASKS_MASK  0x00000003     /* per-task CPU profiling mask */
+#define HA_PROF_MEMORY      0x00000004     /* per-call-site pool allocation profiling */
+
+/* number of call sites tracked per thread by memory profiling (power of 2) */
+#define MEMPROF_HASH_BITS    10
+#define MEMPROF_HASH_BUCKETS (1U << MEMPROF_HASH_BITS)
+
+/* per-call-site memory profiling statistics. The pool is part of the key since
+ * a same function may allocate from various pools.
+ */
+struct memprof_stats {
+	const void *caller;             // return address of the call to the pool function
+	const void *pool;               // pool the object was allocated from or released to
+	unsigned long long alloc_calls; // number of allocations
+	unsigned long long free_calls;  // number of releases
+	unsigned long long alloc_tot;   // total bytes allocated
+	unsigned long long free_tot;    // total bytes released
+};
+
+/* number of task handlers tracked per thread by task profiling (power of 2) */
+#define SCHED_PROF_HASH_BITS    7
+#define SCHED_PROF_HASH_BUCKETS (1U << SCHED_PROF_HASH_BITS)
+
+/* number of log2-scaled buckets in task profiling histograms. Bucket 0 counts
+ * durations of 0ns and bucket N counts durations between 2^(N-1) and 2^N-1 ns,
+ * the last one also collecting all longer durations (above ~2s).
+ */
+#define SCHED_PROF_HIST_BUCKETS 32
+
+/* per-handler task profiling statistics. The latency is the time spent in the
+ * run queue between the wakeup and the call. It is not known for tasklets nor
+ * for tasks woken up before profiling was enabled, hence its own call count.
+ */
+struct sched_prof_stats {
+	const void *func;               // task or tasklet handler
+	unsigned long long calls;       // number of measured calls
+	unsigned long long lat_calls;   // number of calls with a known latency
+	unsigned long long cpu_tot;     // total execution time in ns
+	unsigned long long lat_tot;     // total latency in ns
+	unsigned long long cpu_max;     // longest execution time in ns
+	unsigned long long lat_max;     // longest latency in ns
+	unsigned int cpu_hist[SCHED_PROF_HIST_BUCKETS]; // execution time histogram
+	unsigned int lat_hist[SCHED_PROF_HIST_BUCKETS]; // latency histogram
+};
 
 /* per-thread activity reports. It's important that it's aligned on cache lines
  * because some elements will be updated very often. Most counters are OK on
@@ -55,6 +105,14 @@ struct activity {
 	unsigned int accq_full;    // accept queue connection not pushed because full
 	unsigned int pool_fail;    // failed a pool allocation
 	unsigned int buf_wait;     // waited on a buffer allocation
+	unsigned int xgrp_wake;    // task wakeups targeting another thread group
+	unsigned int rq_steal;     // tasks stolen from another thread's inbound queue
+	unsigned int buf_idle_rel; // mux buffers released on idle front connections
+	unsigned int buf_idle_skip;// mux buffer allocations avoided on idle front connections
+	unsigned int buf_idle_kb;  // kB of buffers not held by idle front connections
+	unsigned int sched_run[TL_CLASSES]; // tasks and tasklets run per scheduler class
+	unsigned int wake_sent;    // wakeups sent to other threads' pollers
+	unsigned int wake_coalesced; // wakeups merged into one already pending
 #if defined(DEBUG_DEV)
 	/* keep these ones at the end */
 	unsigned int ctr0;         // general purposee debug counter
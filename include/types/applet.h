@@ -150,6 +150,7 @@ struct appctx {
 			void *target;		/* table we want to dump, or NULL for all */
 			struct stktable *t;	/* table being currently dumped (first if NULL) */
 			struct stksess *entry;	/* last entry we were trying to dump (or first if NULL) */
+			unsigned int shard;	/* shard of the table holding <entry> */
 			long long value;	/* value to compare against */
 			signed char data_type;	/* type of data to compare, or -1 if none */
 			signed char data_op;	/* operator (STD_OP_*) when data_type set */
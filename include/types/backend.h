@@ -26,10 +26,13 @@
 #include <common/hathreads.h>
 
 #include <types/lb_chash.h>
+#include <types/lb_ewma.h>
 #include <types/lb_fas.h>
 #include <types/lb_fwlc.h>
 #include <types/lb_fwrr.h>
+#include <types/lb_maglev.h>
 #include <types/lb_map.h>
+#include <types/lb_rcu.h>
 #include <types/server.h>
 
 /* Parameters for lbprm.algo */
@@ -58,6 +61,7 @@
 /* BE_LB_CB_* is used with BE_LB_KIND_CB */
 #define BE_LB_CB_LC     0x00000  /* least-connections */
 #define BE_LB_CB_FAS    0x00001  /* first available server (opposite of leastconn) */
+#define BE_LB_CB_EWMA   0x00002  /* peak-EWMA of response times times outstanding requests */
 
 #define BE_LB_PARM      0x000FF  /* mask to get/clear the LB param */
 
@@ -84,6 +88,7 @@
 #define BE_LB_ALGO_RND  (BE_LB_KIND_RR | BE_LB_NEED_NONE | BE_LB_RR_RANDOM) /* random value */
 #define BE_LB_ALGO_LC   (BE_LB_KIND_CB | BE_LB_NEED_NONE | BE_LB_CB_LC)    /* least connections */
 #define BE_LB_ALGO_FAS  (BE_LB_KIND_CB | BE_LB_NEED_NONE | BE_LB_CB_FAS)   /* first available server */
+#define BE_LB_ALGO_EWMA (BE_LB_KIND_CB | BE_LB_NEED_NONE | BE_LB_CB_EWMA)  /* peak-EWMA */
 #define BE_LB_ALGO_SRR  (BE_LB_KIND_RR | BE_LB_NEED_NONE | BE_LB_RR_STATIC) /* static round robin */
 #define BE_LB_ALGO_SH	(BE_LB_KIND_HI | BE_LB_NEED_ADDR | BE_LB_HASH_SRC) /* hash: source IP */
 #define BE_LB_ALGO_UH	(BE_LB_KIND_HI | BE_LB_NEED_HTTP | BE_LB_HASH_URI) /* hash: HTTP URI  */
@@ -102,15 +107,20 @@
 #define BE_LB_LKUP_LCTREE 0x30000  /* FWLC tree lookup */
 #define BE_LB_LKUP_CHTREE 0x40000  /* consistent hash  */
 #define BE_LB_LKUP_FSTREE 0x50000  /* FAS tree lookup */
-#define BE_LB_LKUP        0x70000  /* mask to get just the LKUP value */
+#define BE_LB_LKUP_EWMA   0x60000  /* peak-EWMA array lookup */
+#define BE_LB_LKUP_MAGLEV 0x70000  /* maglev table lookup */
+#define BE_LB_LKUP_RCURR  0x80000  /* lock-free roundrobin array lookup */
+#define BE_LB_LKUP_RCULC  0x90000  /* lock-free leastconn array lookup */
+#define BE_LB_LKUP        0xF0000  /* mask to get just the LKUP value */
 
 /* additional properties */
-#define BE_LB_PROP_DYN    0x80000 /* bit to indicate a dynamic algorithm */
+#define BE_LB_PROP_DYN    0x08000 /* bit to indicate a dynamic algorithm */
 
 /* hash types */
 #define BE_LB_HASH_MAP    0x000000 /* map-based hash (default) */
 #define BE_LB_HASH_CONS   0x100000 /* consistent hashbit to indicate a dynamic algorithm */
-#define BE_LB_HASH_TYPE   0x100000 /* get/clear hash types */
+#define BE_LB_HASH_MAGLEV 0x1000000 /* maglev hashing, dynamic as well */
+#define BE_LB_HASH_TYPE   0x1100000 /* get/clear hash types */
 
 /* additional modifier on top of the hash function (only avalanche right now) */
 #define BE_LB_HMOD_AVAL   0x200000  /* avalanche modifier */
@@ -144,6 +154,9 @@ struct lbprm {
 		struct lb_fwlc fwlc;
 		struct lb_chash chash;
 		struct lb_fas fas;
+		struct lb_ewma ewma;
+		struct lb_maglev maglev;
+		struct lb_rcu rcu;
 	};
 	int algo;			/* load balancing algorithm and variants: BE_LB_* */
 	int tot_wact, tot_wbck;		/* total effective weights of active and backup servers */
@@ -166,6 +179,7 @@ struct lbprm {
 	void (*set_server_status_down)(struct server *); /* to be called after status changes to DOWN */
 	void (*server_take_conn)(struct server *);       /* to be called when connection is assigned */
 	void (*server_drop_conn)(struct server *);       /* to be called when connection is dropped */
+	void (*server_response)(struct server *, unsigned int); /* to be called with a server's response time in ms */
 };
 
 #endif /* _TYPES_BACKEND_H */
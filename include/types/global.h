@@ -90,6 +90,7 @@ struct global {
 	int external_check;
 	int nbproc;
 	int nbthread;
+	int nbtgroups;           /* number of thread groups, 0 = unset */
 	unsigned int hard_stop_after;	/* maximum time allowed to perform a soft-stop */
 	int maxconn, hardmaxconn;
 	int maxsslconn;
@@ -141,6 +142,7 @@ struct global {
 		int runqueue_depth;/* max number of tasks to run at once */
 		int recv_enough;   /* how many input bytes at once are "enough" */
 		int bufsize;       /* buffer size in bytes, defaults to BUFSIZE */
+		int bufsize_small; /* small buffer size in bytes, 0 = disabled */
 		int maxrewrite;    /* buffer max rewrite size in bytes, defaults to MAXREWRITE */
 		int reserved_bufs; /* how many buffers can only be allocated for response */
 		int buf_limit;     /* if not null, how many total buffers may only be allocated */
@@ -0,0 +1,51 @@
+/*
+ * include/types/lb_ewma.h
+ * Types for Peak-EWMA load balancing algorithm.
+ *
+ * Copyright (C) 2026 agent - agent@local
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, version 2.1
+ * exclusively.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _TYPES_LB_EWMA_H
+#define _TYPES_LB_EWMA_H
+
+#include <common/config.h>
+
+/* server response times are averaged in 1/1024 ms */
+#define EWMA_SHIFT      10
+#define EWMA_ONE        (1U << EWMA_SHIFT)
+
+/* samples are capped to this value (in ms, about 70 minutes) */
+#define EWMA_MAX_MS     (~0U >> EWMA_SHIFT)
+
+/* maximum number of servers drawn for each pick */
+#define EWMA_MAX_DRAWS  16
+
+struct server;
+
+struct lb_ewma {
+	struct server **srv;	/* usable servers of the group in use */
+	int nbsrv;		/* number of entries in <srv> */
+};
+
+#endif /* _TYPES_LB_EWMA_H */
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
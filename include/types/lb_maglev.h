@@ -0,0 +1,53 @@
+/*
+ * include/types/lb_maglev.h
+ * Types for Maglev hashing load balancing.
+ *
+ * Copyright (C) 2026 agent - agent@local
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, version 2.1
+ * exclusively.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _TYPES_LB_MAGLEV_H
+#define _TYPES_LB_MAGLEV_H
+
+#include <common/config.h>
+#include <common/maglev.h>
+#include <common/qsbr.h>
+
+struct server;
+
+/* Lookup table. It is never modified once published, a new one replaces it. */
+struct lb_maglev_table {
+	struct qsbr_node qsbr;		/* for the deferred release */
+	int slot[0];			/* slot owners, as indexes in lb_maglev's <srv> */
+};
+
+struct lb_maglev {
+	struct lb_maglev_table *table;	/* current lookup table, may only be replaced */
+	struct server **srv;		/* all servers, in the same order as <perm> */
+	struct maglev_perm *perm;	/* servers' slot preferences */
+	unsigned int size;		/* number of slots in <table> (prime) */
+	int nbsrv;			/* number of entries in <srv> and <perm> */
+	unsigned int rr_idx;		/* next slot to be used in round robin mode */
+};
+
+#endif /* _TYPES_LB_MAGLEV_H */
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
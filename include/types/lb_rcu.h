@@ -0,0 +1,59 @@
+/*
+ * include/types/lb_rcu.h
+ * Types for lock-free roundrobin and leastconn load balancing algorithms.
+ *
+ * Copyright (C) 2026 agent - agent@local
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation, version 2.1
+ * exclusively.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _TYPES_LB_RCU_H
+#define _TYPES_LB_RCU_H
+
+#include <common/config.h>
+#include <common/qsbr.h>
+
+struct server;
+
+/* Usable servers of the group in use and their round robin schedule. It is
+ * never modified once published, a new one replaces it.
+ */
+struct lb_rcu_array {
+	struct qsbr_node qsbr;      /* for the deferred release */
+	int nbsrv;                  /* number of entries in <srv> */
+	unsigned int size;          /* number of entries in <sched> */
+	struct server **sched;      /* round robin schedule, follows <srv> */
+	struct server *srv[0];      /* usable servers */
+};
+
+/* per-thread position in the round robin schedule */
+struct lb_rcu_cursor {
+	unsigned int pos;
+	char __end[0] __attribute__((aligned(64)));
+};
+
+struct lb_rcu {
+	struct lb_rcu_array *arr;       /* current array, may only be replaced */
+	struct lb_rcu_cursor *cursor;   /* one per thread */
+};
+
+#endif /* _TYPES_LB_RCU_H */
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
@@ -27,6 +27,10 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 
+#if defined(USE_ZLIB)
+#include <zlib.h>
+#endif
+
 #include <common/config.h>
 #include <common/mini-clist.h>
 #include <common/regex.h>
@@ -49,6 +53,12 @@ struct shared_table {
 	struct shared_table *next;    /* next shared table in list */
 };
 
+/* an entry collected to be taught to a peer, with its update ID at this time */
+struct peer_bulk_entry {
+	struct stksess *ts;
+	unsigned int upd;
+};
+
 struct peer {
 	int local;                    /* proxy state */
 	char *id;
@@ -77,6 +87,16 @@ struct peer {
 	struct shared_table *tables;
 	struct server *srv;
 	struct dcache *dcache;        /* dictionary cache */
+	struct {
+		struct shared_table *st;      /* table the entries below belong to */
+		struct peer_bulk_entry *ents; /* referenced entries collected for a lesson, or NULL */
+		int pos;                      /* next entry to send */
+		int count;                    /* number of entries collected */
+	} bulk;
+#if defined(USE_ZLIB)
+	z_stream *deflate;            /* compression of the batches sent, or NULL */
+	z_stream *inflate;            /* decompression of the batches received, or NULL */
+#endif
 	__decl_hathreads(HA_SPINLOCK_T lock); /* lock used to handle this peer section */
 	struct peer *next;            /* next peer in the list */
 };
@@ -99,6 +119,7 @@ struct peers {
 	unsigned int flags;             /* current peers section resync state */
 	unsigned int resync_timeout;    /* resync timeout timer */
 	int count;                      /* total of peers */
+	int compress;                   /* compress the updates sent to the peers supporting it */
 };
 
 /* LRU cache for dictionaies */
@@ -28,6 +28,7 @@
 #include <arpa/inet.h>
 
 #include <common/chunk.h>
+#include <common/codel.h>
 #include <common/config.h>
 #include <common/http.h>
 #include <common/mini-clist.h>
@@ -146,7 +147,7 @@ enum PR_SRV_STATE_FILE {
 #define PR_O2_H1_ADJ_BUGCLI 0x00008000 /* adjust the case of h1 headers of the response for bogus clients */
 #define PR_O2_H1_ADJ_BUGSRV 0x00004000 /* adjust the case of h1 headers of the request for bogus servers */
 
-/* unused:  0x00010000 */
+#define PR_O2_LB_LOCKFREE 0x00010000    /* lock-free roundrobin/leastconn */
 
 #define PR_O2_NODELAY   0x00020000      /* fully interactive mode, never delay outgoing data */
 #define PR_O2_USE_PXHDR 0x00040000      /* use Proxy-Connection for proxy requests */
@@ -348,6 +349,9 @@ struct proxy {
 	int  capture_len;			/* length of the string to be captured */
 	struct uri_auth *uri_auth;		/* if non-NULL, the (list of) per-URI authentications */
 	int max_ka_queue;			/* 1+maximum requests in queue accepted for reusing a K-A conn (0=none) */
+	unsigned int codel_target;		/* CoDel target queue time in ms (0 = disabled) */
+	unsigned int codel_interval;		/* CoDel interval in ms */
+	struct codel codel;			/* CoDel state of the backend's queue */
 	int monitor_uri_len;			/* length of the string above. 0 if unused */
 	char *monitor_uri;			/* a special URI to which we respond with HTTP/200 OK */
 	struct list mon_fail_cond;              /* list of conditions to fail monitoring requests (chained) */
@@ -33,6 +33,8 @@ struct stream;
 struct pendconn {
 	int            strm_flags; /* stream flags */
 	unsigned int   queue_idx;  /* value of proxy/server queue_idx at time of enqueue */
+	unsigned int   date;       /* date of enqueue, in ms */
+	int            rejected;   /* non-zero if rejected by the queue management */
 	struct stream *strm;
 	struct proxy  *px;
 	struct server *srv;        /* the server we are waiting for, may be NULL if don't care */
@@ -25,6 +25,7 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 
+#include <common/codel.h>
 #include <common/config.h>
 #include <common/mini-clist.h>
 #include <common/hathreads.h>
@@ -166,6 +167,7 @@ enum srv_initaddr {
 #define SRV_UWGHT_MAX   (SRV_UWGHT_RANGE)
 #define SRV_EWGHT_RANGE (SRV_UWGHT_RANGE * BE_WEIGHT_SCALE)
 #define SRV_EWGHT_MAX   (SRV_UWGHT_MAX   * BE_WEIGHT_SCALE)
+#define SRV_ADAPT_SHIFT 8     /* fractional bits of the adaptive maxconn */
 
 #ifdef USE_OPENSSL
 /* server ssl options */
@@ -214,11 +216,16 @@ struct server {
 	unsigned maxconn, minconn;		/* max # of active sessions (0 = unlimited), min# for dynamic limit. */
 	int nbpend;				/* number of pending connections */
 	unsigned int queue_idx;			/* count of pending connections which have been de-queued */
+	unsigned int dequeuing;			/* number of threads wanting to dequeue, only the first one does */
 	int maxqueue;				/* maximum number of pending connections allowed */
+	unsigned int adapt_target;		/* response time above which the adaptive maxconn shrinks, in ms (0 = disabled) */
+	unsigned int adapt_limit;		/* current adaptive maxconn, in 1/(1<<SRV_ADAPT_SHIFT) connections */
+	unsigned int adapt_date;		/* date of the last decrease of <adapt_limit>, in ms */
 	struct freq_ctr sess_per_sec;		/* sessions per second on this server */
 	struct be_counters counters;		/* statistics counters */
 
 	struct eb_root pendconns;		/* pending connections */
+	struct codel codel;			/* CoDel state of the queue */
 	struct list actconns;			/* active connections */
 	struct list *priv_conns;		/* private idle connections attached to stream interfaces */
 	struct list *idle_conns;		/* sharable idle connections attached or not to a stream interface */
@@ -259,6 +266,8 @@ struct server {
 	unsigned lb_nodes_tot;                  /* number of allocated lb_nodes (C-HASH) */
 	unsigned lb_nodes_now;                  /* number of lb_nodes placed in the tree (C-HASH) */
 	struct tree_occ *lb_nodes;              /* lb_nodes_tot * struct tree_occ */
+	unsigned int ewma;                      /* peak-EWMA of response times in 1/1024 ms (PEAK-EWMA) */
+	unsigned int ewma_date;                 /* date of the last update of <ewma> in ms (PEAK-EWMA) */
 
 	const struct netns_entry *netns;        /* contains network namespace name or NULL. Network namespace comes from configuration */
 	/* warning, these structs are huge, keep them at the bottom */
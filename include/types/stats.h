@@ -328,6 +328,12 @@ enum info_field {
 	INF_TOTAL_BYTES_OUT,
 	INF_BYTES_OUT_RATE,
 	INF_DEBUG_COMMANDS_ISSUED,
+	INF_MEM_BUDGET_MB,
+	INF_MEM_PRESSURE,
+	INF_MEM_SHED_COMP,
+	INF_MEM_SHED_CACHE,
+	INF_MEM_SHED_H2,
+	INF_MEM_SHED_ACCEPT,
 
 	/* must always be the last one */
 	INF_TOTAL_FIELDS
@@ -434,6 +440,7 @@ enum stat_field {
 	ST_F_CT_MAX,
 	ST_F_RT_MAX,
 	ST_F_TT_MAX,
+	ST_F_SRV_DLIM,
 
 	/* must always be the last one */
 	ST_F_TOTAL_FIELDS
@@ -29,7 +29,9 @@
 #include <ebtree.h>
 #include <ebmbtree.h>
 #include <eb32tree.h>
+#include <common/hll.h>
 #include <common/memory.h>
+#include <common/twheel.h>
 #include <types/dict.h>
 #include <types/freq_ctr.h>
 #include <types/peers.h>
@@ -57,6 +59,7 @@ enum {
 	STKTABLE_DT_GPC1,         /* General Purpose Counter 1 (unsigned 32-bit integer) */
 	STKTABLE_DT_GPC1_RATE,    /* General Purpose Counter 1's event rate */
 	STKTABLE_DT_SERVER_NAME,  /* The server name */
+	STKTABLE_DT_HLL0,         /* distinct values counter 0 */
 	STKTABLE_STATIC_DATA_TYPES,/* number of types above */
 	/* up to STKTABLE_EXTRA_DATA_TYPES types may be registered here, always
 	 * followed by the number of data types, must always be last.
@@ -71,6 +74,7 @@ enum {
 	STD_T_ULL,                /* data is of type unsigned long long */
 	STD_T_FRQP,               /* data is of type freq_ctr_period */
 	STD_T_DICT,               /* data is of type key of dictionary entry */
+	STD_T_HLL,                /* data is of type hll */
 };
 
 /* The types of optional arguments to stored data */
@@ -88,6 +92,7 @@ union stktable_data {
 	unsigned long long std_t_ull;
 	struct freq_ctr_period std_t_frqp;
 	struct dict_entry *std_t_dict;
+	struct hll std_t_hll;
 
 	/* types of each storable data */
 	int server_id;
@@ -110,6 +115,7 @@ union stktable_data {
 	struct freq_ctr_period bytes_in_rate;
 	unsigned long long bytes_out_cnt;
 	struct freq_ctr_period bytes_out_rate;
+	struct hll hll0;
 };
 
 /* known data types */
@@ -140,13 +146,34 @@ struct stksess {
 	unsigned int expire;      /* session expiration date */
 	unsigned int ref_cnt;     /* reference count, can only purge when zero */
 	__decl_hathreads(HA_RWLOCK_T lock); /* lock related to the table entry */
-	struct eb32_node exp;     /* ebtree node used to hold the session in expiration tree */
+	struct tw_node exp;       /* timer node used to hold the session in expiration wheel */
 	struct eb32_node upd;     /* ebtree node used to hold the update sequence tree */
 	struct ebmb_node key;     /* ebtree node used to hold the session in table */
 	/* WARNING! do not put anything after <keys>, it's used by the key */
 };
 
 
+/* A part of a stick table's entries. Entries are spread over the shards
+ * according to their key's hash so that threads working on different keys
+ * don't wait for each other.
+ */
+struct stktable_shard {
+	struct eb_root keys;      /* head of sticky session tree */
+	struct twheel exps;       /* sticky session expiration wheel */
+	__decl_hathreads(HA_SPINLOCK_T lock); /* protects the trees above and new references to their entries */
+	char __end[0] __attribute__((aligned(64))); /* shards don't share cache lines */
+};
+
+/* An entry of the top-K keys of a table. The tracked data is copied when the
+ * key is seen so that a rate keeps decaying when the key isn't seen anymore.
+ */
+struct stktable_topk_ent {
+	unsigned long long value; /* value of the data when last ranked */
+	struct freq_ctr_period ctr; /* copy of the data if it is a rate */
+	unsigned int pos;         /* position in the top-K's heap */
+	struct ebmb_node key;     /* copy of the key, in the top-K's tree. MUST be last */
+};
+
 /* stick table */
 struct stktable {
 	char *id;		  /* local table id name. */
@@ -159,11 +186,11 @@ struct stktable {
 		int line;             /* The line in this <file> the stick-table is declared. */
 	} conf;
 	struct ebpt_node name;    /* Stick-table are lookup by name here. */
-	struct eb_root keys;      /* head of sticky session tree */
-	struct eb_root exps;      /* head of sticky session expiration tree */
+	struct stktable_shard *shards; /* <nbshards> shards holding the entries */
+	unsigned int nbshards;    /* number of shards, at least 1 */
 	struct eb_root updates;   /* head of sticky updates sequence tree */
 	struct pool_head *pool;   /* pool used to allocate sticky sessions */
-	__decl_hathreads(HA_SPINLOCK_T lock); /* spin lock related to the table */
+	__decl_hathreads(HA_SPINLOCK_T lock); /* protects the updates tree and the expiration date */
 	struct task *exp_task;    /* expiration task */
 	struct task *sync_task;   /* sync task */
 	unsigned int update;
@@ -181,6 +208,9 @@ struct stktable {
 	unsigned int size;        /* maximum number of sticky sessions in table */
 	unsigned int current;     /* number of sticky sessions currently in table */
 	int nopurge;              /* if non-zero, don't purge sticky sessions when full */
+	unsigned int sketch_depth;/* rows of the count-min sketch replacing entries, 0 if none */
+	struct freq_ctr_period *sketch[STKTABLE_DATA_TYPES]; /* <sketch_depth> rows of <size> cells per stored rate */
+	int sketch_ofs[STKTABLE_DATA_TYPES]; /* negative offsets of the rates saved in sketch entries */
 	int exp_next;             /* next expiration date (ticks) */
 	int expire;               /* time to live for sticky sessions (milliseconds) */
 	int data_size;            /* the size of the data that is prepended *before* stksess */
@@ -192,6 +222,26 @@ struct stktable {
 	} data_arg[STKTABLE_DATA_TYPES]; /* optional argument of each data type */
 	struct proxy *proxy;      /* The proxy this stick-table is attached to, if any.*/
 	struct proxy *proxies_list; /* The list of proxies which reference this stick-table. */
+	struct {
+		char *file;           /* file the entries are saved to, or NULL */
+		int period;           /* delay between two snapshots (milliseconds) */
+		struct task *task;    /* task saving the entries */
+		int fd;               /* temporary file being written, -1 if none */
+		unsigned int shard;   /* shard holding <next> */
+		struct stksess *next; /* next entry to save, referenced, or NULL */
+		int last;             /* 1 while saving the last snapshot, 2 once saved */
+	} snap;
+	struct {
+		unsigned int size;    /* number of keys ranked (K), 0 if none */
+		int type;             /* data type the keys are ranked on */
+		unsigned int used;    /* number of entries in use */
+		unsigned long long min; /* lowest value of a full heap, 0 otherwise */
+		unsigned int refresh; /* date of the next refresh of the rates (ticks) */
+		struct eb_root keys;  /* entries in use indexed by their key */
+		struct stktable_topk_ent **heap; /* <size> entries, the <used> first ones being a min-heap */
+		struct stktable_topk_ent **rank; /* <size> entries used to rank them */
+		__decl_hathreads(HA_SPINLOCK_T lock); /* protects the fields above */
+	} topk;
 };
 
 extern struct stktable_data_type stktable_data_types[STKTABLE_DATA_TYPES];
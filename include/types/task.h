@@ -25,17 +25,21 @@
 #include <sys/time.h>
 
 #include <common/config.h>
+#include <common/hathreads.h>
 #include <common/mini-clist.h>
+#include <common/twheel.h>
 #include <eb32sctree.h>
 #include <eb32tree.h>
 
 /* values for task->state */
 #define TASK_SLEEPING     0x0000  /* task sleeping */
 #define TASK_RUNNING      0x0001  /* the task is currently running */
-#define TASK_GLOBAL       0x0002  /* The task is currently in the global runqueue */
+#define TASK_GLOBAL       0x0002  /* The task is currently in a thread's inbound runqueue */
 #define TASK_QUEUED       0x0004  /* The task has been (re-)added to the run queue */
 #define TASK_SHARED_WQ    0x0008  /* The task's expiration may be updated by other
                                    * threads, must be set before first queue/wakeup */
+#define TASK_CLASS_MASK   0x0030  /* scheduler class (TL_*), kept across calls */
+#define TASK_CLASS_SHIFT  4
 
 #define TASK_WOKEN_INIT   0x0100  /* woken up for initialisation purposes */
 #define TASK_WOKEN_TIMER  0x0200  /* woken up because of expired timer */
@@ -50,6 +54,19 @@
                            TASK_WOKEN_IO|TASK_WOKEN_SIGNAL|TASK_WOKEN_MSG| \
                            TASK_WOKEN_RES)
 
+/* Scheduler classes. Each class has its own list of tasks and tasklets to be
+ * run by a thread, and gets a share of each polling loop's budget, as set by
+ * "tune.sched.shares". The unused part of a class' share is given to the other
+ * classes.
+ */
+enum {
+	TL_URGENT = 0,  /* I/O of established connections, default for tasklets */
+	TL_NORMAL,      /* streams and most tasks, default for tasks */
+	TL_BULK,        /* handshakes and other expensive processing */
+	TL_BACKGROUND,  /* health checks and housekeeping */
+	TL_CLASSES      /* must be last */
+};
+
 struct notification {
 	struct list purge_me; /* Part of the list of signals to be purged in the
 	                         case of the LUA execution stack crash. */
@@ -61,13 +78,15 @@ struct notification {
 
 /* force to split per-thread stuff into separate cache lines */
 struct task_per_thread {
-	struct eb_root timers;  /* tree constituting the per-thread wait queue */
 	struct eb_root rqueue;  /* tree constituting the per-thread run queue */
-	struct list task_list;  /* List of tasks to be run, mixing tasks and tasklets */
+	struct list tasklets[TL_CLASSES]; /* Lists of tasks and tasklets to be run, per class */
 	struct mt_list shared_tasklet_list; /* Tasklet to be run, woken up by other threads */
-	int task_list_size;     /* Number of tasks in the task_list */
+	struct mt_list inbound; /* Tasks woken up by other threads, may be stolen by siblings */
+	int task_list_size;     /* Number of tasks in the tasklets lists */
 	int rqueue_size;        /* Number of elements in the per-thread run queue */
+	int inbound_size;       /* Number of tasks in the inbound queue */
 	struct task *current;   /* current task (not tasklet) */
+	struct twheel timers;   /* timer wheel constituting the per-thread wait queue */
 	__attribute__((aligned(64))) char end[0];
 };
 
@@ -87,8 +106,10 @@ struct task_per_thread {
 struct task {
 	TASK_COMMON;			/* must be at the beginning! */
 	struct eb32sc_node rq;		/* ebtree node used to hold the task in the run queue */
-	struct eb32_node wq;		/* ebtree node used to hold the task in the wait queue */
+	struct tw_node wq;		/* timer wheel node used to hold the task in the wait queue */
+	struct mt_list inq;		/* list element in a thread's inbound queue when TASK_GLOBAL */
 	int expire;			/* next expiration date for this task, in ticks */
+	int rq_tid;			/* thread whose inbound queue holds the task when TASK_GLOBAL */
 	unsigned long thread_mask;	/* mask of thread IDs authorized to process the task */
 	uint64_t call_date;		/* date of the last task wakeup or call */
 	uint64_t lat_time;		/* total latency time experienced */
@@ -10,12 +10,21 @@
  *
  */
 
+#ifdef USE_DL
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#endif
+#include <stdlib.h>
+
 #include <common/cfgparse.h>
 #include <common/config.h>
 #include <common/standard.h>
 #include <common/hathreads.h>
 #include <common/initcall.h>
+#include <common/memory.h>
 #include <types/activity.h>
+#include <types/global.h>
+#include <proto/activity.h>
 #include <proto/channel.h>
 #include <proto/cli.h>
 #include <proto/freq_ctr.h>
@@ -29,6 +38,333 @@ unsigned long task_profiling_mask = 0;
 /* One struct per thread containing all collected measurements */
 struct activity activity[MAX_THREADS] __attribute__((aligned(64))) = { };
 
+/* Per-thread memory profiling tables, indexed by a hash of the call site. The
+ * extra last entry collects the calls which could not find a free entry.
+ */
+static struct memprof_stats memprof_stats[MAX_THREADS][MEMPROF_HASH_BUCKETS + 1];
+
+/* The memory profiling statistics are reset by incrementing memprof_gen. Each
+ * thread then clears its own table before using it again, since clearing it
+ * from another thread would race with its updates. Tables whose generation is
+ * not the current one are ignored.
+ */
+static unsigned int memprof_gen;
+static unsigned int memprof_gen_seen[MAX_THREADS];
+
+/* Per-thread task profiling tables, indexed by a hash of the handler. The
+ * extra last entry collects the handlers which could not find a free entry.
+ */
+static struct sched_prof_stats sched_prof_stats[MAX_THREADS][SCHED_PROF_HASH_BUCKETS + 1];
+
+/* The task profiling statistics are reset the same way as the memory ones */
+static unsigned int sched_prof_gen;
+static unsigned int sched_prof_gen_seen[MAX_THREADS];
+
+
+/* Returns the current thread's memory profiling entry for calls from <caller>
+ * on pool <pool>, allocating it if needed. Entries are only ever created by
+ * their own thread so no locking is needed.
+ */
+static struct memprof_stats *memprof_get_bin(const void *caller, const void *pool)
+{
+	struct memprof_stats *tbl = memprof_stats[tid];
+	unsigned int bin, step;
+
+	if (unlikely(memprof_gen_seen[tid] != memprof_gen)) {
+		memset(tbl, 0, sizeof(memprof_stats[tid]));
+		__ha_barrier_store();
+		memprof_gen_seen[tid] = memprof_gen;
+	}
+
+	bin = (((unsigned long long)(uintptr_t)caller ^ (uintptr_t)pool) * 0x9E3779B97F4A7C15ULL) >> (64 - MEMPROF_HASH_BITS);
+	for (step = 0; step < 16; step++, bin = (bin + 1) & (MEMPROF_HASH_BUCKETS - 1)) {
+		if (tbl[bin].caller == caller && tbl[bin].pool == pool)
+			return &tbl[bin];
+		if (!tbl[bin].caller) {
+			tbl[bin].caller = caller;
+			tbl[bin].pool = pool;
+			return &tbl[bin];
+		}
+	}
+	return &tbl[MEMPROF_HASH_BUCKETS];
+}
+
+/* Accounts for an allocation from pool <pool>. It is called from the inlined
+ * pool allocation functions only when memory profiling is enabled, and must
+ * never be inlined so that its return address designates the call site.
+ */
+__attribute__((noinline)) void pool_prof_alloc(const struct pool_head *pool)
+{
+	struct memprof_stats *bin = memprof_get_bin(__builtin_return_address(0), pool);
+
+	bin->alloc_calls++;
+	bin->alloc_tot += pool->size;
+}
+
+/* Accounts for a release to pool <pool>, see pool_prof_alloc() */
+__attribute__((noinline)) void pool_prof_free(const struct pool_head *pool)
+{
+	struct memprof_stats *bin = memprof_get_bin(__builtin_return_address(0), pool);
+
+	bin->free_calls++;
+	bin->free_tot += pool->size;
+}
+
+/* Returns the histogram bucket for a duration of <ns> nanoseconds */
+static inline unsigned int sched_prof_bucket(uint64_t ns)
+{
+	unsigned int b;
+
+	if (!ns)
+		return 0;
+	b = my_flsl(ns);
+	return b < SCHED_PROF_HIST_BUCKETS ? b : SCHED_PROF_HIST_BUCKETS - 1;
+}
+
+/* Accounts for one call to task or tasklet handler <func> which ran for <cpu>
+ * ns after having waited <lat> ns in the run queue. A null <lat> indicates an
+ * unknown latency. It is only called by the scheduler when task profiling is
+ * enabled on the current thread, entries are only ever created by their own
+ * thread so no locking is needed.
+ */
+void sched_prof_account(const void *func, uint64_t lat, uint64_t cpu)
+{
+	struct sched_prof_stats *tbl = sched_prof_stats[tid];
+	struct sched_prof_stats *bin = &tbl[SCHED_PROF_HASH_BUCKETS];
+	unsigned int idx, step;
+
+	if (unlikely(sched_prof_gen_seen[tid] != sched_prof_gen)) {
+		memset(tbl, 0, sizeof(sched_prof_stats[tid]));
+		__ha_barrier_store();
+		sched_prof_gen_seen[tid] = sched_prof_gen;
+	}
+
+	idx = ((unsigned long long)(uintptr_t)func * 0x9E3779B97F4A7C15ULL) >> (64 - SCHED_PROF_HASH_BITS);
+	for (step = 0; step < 16; step++, idx = (idx + 1) & (SCHED_PROF_HASH_BUCKETS - 1)) {
+		if (tbl[idx].func == func) {
+			bin = &tbl[idx];
+			break;
+		}
+		if (!tbl[idx].func) {
+			tbl[idx].func = func;
+			bin = &tbl[idx];
+			break;
+		}
+	}
+
+	bin->calls++;
+	bin->cpu_tot += cpu;
+	if (cpu > bin->cpu_max)
+		bin->cpu_max = cpu;
+	bin->cpu_hist[sched_prof_bucket(cpu)]++;
+
+	if (!lat)
+		return;
+
+	bin->lat_calls++;
+	bin->lat_tot += lat;
+	if (lat > bin->lat_max)
+		bin->lat_max = lat;
+	bin->lat_hist[sched_prof_bucket(lat)]++;
+}
+
+/* Returns an estimate of the <pct> percentile of the durations counted in
+ * histogram <hist> whose longest duration is <max>. It is the upper bound of
+ * the bucket the percentile falls into, which cannot be larger than <max>.
+ */
+static uint64_t sched_prof_pct(const unsigned int *hist, uint64_t max, unsigned int pct)
+{
+	unsigned long long total = 0, cumul = 0;
+	unsigned int b;
+
+	for (b = 0; b < SCHED_PROF_HIST_BUCKETS; b++)
+		total += hist[b];
+
+	total = (total * pct + 99) / 100;
+	for (b = 0; b < SCHED_PROF_HIST_BUCKETS - 1; b++) {
+		cumul += hist[b];
+		if (cumul >= total)
+			break;
+	}
+
+	if (!b)
+		return 0;
+	return ((1ULL << b) - 1) < max ? (1ULL << b) - 1 : max;
+}
+
+/* Appends duration <ns> to buffer <buf> in the most readable unit, right
+ * aligned on 9 chars.
+ */
+static void append_duration(struct buffer *buf, uint64_t ns)
+{
+	char str[24];
+
+	if (ns < 1000ULL)
+		snprintf(str, sizeof(str), "%lluns", (unsigned long long)ns);
+	else if (ns < 1000000ULL)
+		snprintf(str, sizeof(str), "%llu.%03lluus", (unsigned long long)ns / 1000, (unsigned long long)ns % 1000);
+	else if (ns < 1000000000ULL)
+		snprintf(str, sizeof(str), "%llu.%03llums", (unsigned long long)ns / 1000000, (unsigned long long)ns / 1000 % 1000);
+	else
+		snprintf(str, sizeof(str), "%llu.%03llus", (unsigned long long)ns / 1000000000, (unsigned long long)ns / 1000000 % 1000);
+	chunk_appendf(buf, " %9s", str);
+}
+
+/* Appends to buffer <buf> the best possible description of code address
+ * <addr> : "symbol+0xofs" when the symbol is known, otherwise "object+0xofs"
+ * relative to the object's base (usable with addr2line), or the raw address.
+ * Symbol names of the main executable are only known when it exports them
+ * (e.g. linked with -rdynamic).
+ */
+static void resolve_sym_name(struct buffer *buf, const void *addr)
+{
+#ifdef USE_DL
+	const char *fname;
+	Dl_info dli;
+
+	if (dladdr(addr, &dli)) {
+		if (dli.dli_sname && dli.dli_saddr) {
+			chunk_appendf(buf, "%s+%#lx", dli.dli_sname, (long)((char *)addr - (char *)dli.dli_saddr));
+			return;
+		}
+		if (dli.dli_fname && dli.dli_fbase) {
+			fname = strrchr(dli.dli_fname, '/');
+			fname = fname ? fname + 1 : dli.dli_fname;
+			chunk_appendf(buf, "%s+%#lx", fname, (long)((char *)addr - (char *)dli.dli_fbase));
+			return;
+		}
+	}
+#endif
+	chunk_appendf(buf, "%p", addr);
+}
+
+/* sorts memory profiling entries by decreasing total volume */
+static int cmp_memprof_stats(const void *a, const void *b)
+{
+	const struct memprof_stats *l = a, *r = b;
+	unsigned long long lv = l->alloc_tot + l->free_tot;
+	unsigned long long rv = r->alloc_tot + r->free_tot;
+
+	return lv > rv ? -1 : lv < rv ? 1 : 0;
+}
+
+/* sorts memory profiling entries by call site and pool so that the entries of
+ * the same call site from different threads are adjacent.
+ */
+static int cmp_memprof_site(const void *a, const void *b)
+{
+	const struct memprof_stats *l = a, *r = b;
+
+	if (l->caller != r->caller)
+		return (uintptr_t)l->caller < (uintptr_t)r->caller ? -1 : 1;
+	if (l->pool != r->pool)
+		return (uintptr_t)l->pool < (uintptr_t)r->pool ? -1 : 1;
+	return 0;
+}
+
+/* Merges all threads' memory profiling entries into <out> which must have room
+ * for global.nbthread * (MEMPROF_HASH_BUCKETS + 1) entries, sorts them and returns
+ * the number of entries. The entries are first sorted by call site so that
+ * merging them only involves adjacent ones.
+ */
+static int memprof_collect(struct memprof_stats *out)
+{
+	const struct memprof_stats *in;
+	int thr, bin, i, j, nb = 0;
+
+	for (thr = 0; thr < global.nbthread; thr++) {
+		if (memprof_gen_seen[thr] != memprof_gen)
+			continue;
+		__ha_barrier_load();
+		for (bin = 0; bin <= MEMPROF_HASH_BUCKETS; bin++) {
+			in = &memprof_stats[thr][bin];
+			if (in->alloc_calls || in->free_calls)
+				out[nb++] = *in;
+		}
+	}
+
+	qsort(out, nb, sizeof(*out), cmp_memprof_site);
+	for (i = j = 0; j < nb; j++) {
+		if (i && !cmp_memprof_site(&out[i - 1], &out[j])) {
+			out[i - 1].alloc_calls += out[j].alloc_calls;
+			out[i - 1].free_calls  += out[j].free_calls;
+			out[i - 1].alloc_tot   += out[j].alloc_tot;
+			out[i - 1].free_tot    += out[j].free_tot;
+		}
+		else
+			out[i++] = out[j];
+	}
+	nb = i;
+
+	qsort(out, nb, sizeof(*out), cmp_memprof_stats);
+	return nb;
+}
+
+/* sorts task profiling entries by decreasing longest execution time */
+static int cmp_sched_prof_stats(const void *a, const void *b)
+{
+	const struct sched_prof_stats *l = a, *r = b;
+
+	return l->cpu_max > r->cpu_max ? -1 : l->cpu_max < r->cpu_max ? 1 : 0;
+}
+
+/* sorts task profiling entries by handler so that the entries of the same
+ * handler from different threads are adjacent.
+ */
+static int cmp_sched_prof_func(const void *a, const void *b)
+{
+	const struct sched_prof_stats *l = a, *r = b;
+
+	if (l->func != r->func)
+		return (uintptr_t)l->func < (uintptr_t)r->func ? -1 : 1;
+	return 0;
+}
+
+/* Merges all threads' task profiling entries into <out> which must have room
+ * for global.nbthread * (SCHED_PROF_HASH_BUCKETS + 1) entries, sorts them and
+ * returns the number of entries. The entries are first sorted by handler so
+ * that merging them only involves adjacent ones.
+ */
+static int sched_prof_collect(struct sched_prof_stats *out)
+{
+	const struct sched_prof_stats *in;
+	int thr, bin, i, j, b, nb = 0;
+
+	for (thr = 0; thr < global.nbthread; thr++) {
+		if (sched_prof_gen_seen[thr] != sched_prof_gen)
+			continue;
+		__ha_barrier_load();
+		for (bin = 0; bin <= SCHED_PROF_HASH_BUCKETS; bin++) {
+			in = &sched_prof_stats[thr][bin];
+			if (in->calls)
+				out[nb++] = *in;
+		}
+	}
+
+	qsort(out, nb, sizeof(*out), cmp_sched_prof_func);
+	for (i = j = 0; j < nb; j++) {
+		if (!i || out[i - 1].func != out[j].func) {
+			out[i++] = out[j];
+			continue;
+		}
+		out[i - 1].calls     += out[j].calls;
+		out[i - 1].lat_calls += out[j].lat_calls;
+		out[i - 1].cpu_tot   += out[j].cpu_tot;
+		out[i - 1].lat_tot   += out[j].lat_tot;
+		if (out[j].cpu_max > out[i - 1].cpu_max)
+			out[i - 1].cpu_max = out[j].cpu_max;
+		if (out[j].lat_max > out[i - 1].lat_max)
+			out[i - 1].lat_max = out[j].lat_max;
+		for (b = 0; b < SCHED_PROF_HIST_BUCKETS; b++) {
+			out[i - 1].cpu_hist[b] += out[j].cpu_hist[b];
+			out[i - 1].lat_hist[b] += out[j].lat_hist[b];
+		}
+	}
+	nb = i;
+
+	qsort(out, nb, sizeof(*out), cmp_sched_prof_stats);
+	return nb;
+}
 
 /* Updates the current thread's statistics about stolen CPU time. The unit for
  * <stolen> is half-milliseconds.
@@ -61,17 +397,54 @@ static int cfg_parse_prof_tasks(char **args, int section_type, struct proxy *cur
 	return 0;
 }
 
+/* config parser for global "profiling.memory", accepts "on" or "off" */
+static int cfg_parse_prof_memory(char **args, int section_type, struct proxy *curpx,
+                                 struct proxy *defpx, const char *file, int line,
+                                 char **err)
+{
+	if (too_many_args(1, args, err, NULL))
+		return -1;
+
+	if (strcmp(args[1], "on") == 0)
+		profiling |= HA_PROF_MEMORY;
+	else if (strcmp(args[1], "off") == 0)
+		profiling &= ~HA_PROF_MEMORY;
+	else {
+		memprintf(err, "'%s' expects either 'on' or 'off' but got '%s'.", args[0], args[1]);
+		return -1;
+	}
+	return 0;
+}
+
 /* parse a "set profiling" command. It always returns 1. */
 static int cli_parse_set_profiling(char **args, char *payload, struct appctx *appctx, void *private)
 {
 	if (!cli_has_level(appctx, ACCESS_LVL_ADMIN))
 		return 1;
 
+	if (strcmp(args[2], "memory") == 0) {
+		if (strcmp(args[3], "on") == 0) {
+			/* start from fresh statistics */
+			if (!(profiling & HA_PROF_MEMORY))
+				_HA_ATOMIC_ADD(&memprof_gen, 1);
+			_HA_ATOMIC_OR(&profiling, HA_PROF_MEMORY);
+		}
+		else if (strcmp(args[3], "off") == 0)
+			_HA_ATOMIC_AND(&profiling, ~HA_PROF_MEMORY);
+		else
+			return cli_err(appctx, "Expects either 'on' or 'off'.\n");
+		return 1;
+	}
+
 	if (strcmp(args[2], "tasks") != 0)
-		return cli_err(appctx, "Expects 'tasks'.\n");
+		return cli_err(appctx, "Expects either 'tasks' or 'memory'.\n");
 
 	if (strcmp(args[3], "on") == 0) {
 		unsigned int old = profiling;
+
+		/* start from fresh statistics */
+		if ((old & HA_PROF_TASKS_MASK) != HA_PROF_TASKS_ON)
+			_HA_ATOMIC_ADD(&sched_prof_gen, 1);
 		while (!_HA_ATOMIC_CAS(&profiling, &old, (old & ~HA_PROF_TASKS_MASK) | HA_PROF_TASKS_ON))
 			;
 	}
@@ -91,40 +464,158 @@ static int cli_parse_set_profiling(char **args, char *payload, struct appctx *ap
 	return 1;
 }
 
-/* This function dumps all profiling settings. It returns 0 if the output
+/* Parses "show profiling" and takes a snapshot of the merged task and memory
+ * profiling statistics into the CLI context, so that the dump remains stable
+ * and cheap even when it spans multiple calls. ctx.cli.p0 and ctx.cli.o0
+ * hold the task entries and their count, ctx.cli.p1 and ctx.cli.o1 hold the
+ * memory entries and their count. They are released by
+ * cli_release_show_profiling().
+ */
+static int cli_parse_show_profiling(char **args, char *payload, struct appctx *appctx, void *private)
+{
+	struct sched_prof_stats *stmp;
+	struct memprof_stats *tmp;
+
+	stmp = malloc(sizeof(*stmp) * global.nbthread * (SCHED_PROF_HASH_BUCKETS + 1));
+	tmp = malloc(sizeof(*tmp) * global.nbthread * (MEMPROF_HASH_BUCKETS + 1));
+	if (!stmp || !tmp) {
+		free(stmp);
+		free(tmp);
+		return cli_err(appctx, "Out of memory.\n");
+	}
+
+	appctx->ctx.cli.p0 = stmp;
+	appctx->ctx.cli.o0 = sched_prof_collect(stmp);
+	appctx->ctx.cli.p1 = tmp;
+	appctx->ctx.cli.o1 = memprof_collect(tmp);
+	appctx->ctx.cli.i0 = 0;
+	appctx->ctx.cli.i1 = 0;
+	return 0;
+}
+
+/* releases the snapshot taken by cli_parse_show_profiling() */
+static void cli_release_show_profiling(struct appctx *appctx)
+{
+	free(appctx->ctx.cli.p0);
+	free(appctx->ctx.cli.p1);
+	appctx->ctx.cli.p0 = appctx->ctx.cli.p1 = NULL;
+}
+
+/* This function dumps all profiling settings, followed by the task profiling
+ * statistics sorted by decreasing longest execution time, and the memory
+ * profiling statistics sorted by decreasing volume, all taken from the
+ * snapshot built by cli_parse_show_profiling(). It returns 0 if the output
  * buffer is full and it needs to be called again, otherwise non-zero.
+ * ctx.cli.i1 is zero while dumping task statistics and non-zero while dumping
+ * memory statistics, and ctx.cli.i0 holds the index of the next entry to dump.
  */
 static int cli_io_handler_show_profiling(struct appctx *appctx)
 {
 	struct stream_interface *si = appctx->owner;
+	const struct sched_prof_stats *stmp = appctx->ctx.cli.p0;
+	const struct memprof_stats *tmp = appctx->ctx.cli.p1;
+	const struct pool_head *pool;
 	const char *str;
+	int nb, i;
 
 	if (unlikely(si_ic(si)->flags & (CF_WRITE_ERROR|CF_SHUTW)))
 		return 1;
 
 	chunk_reset(&trash);
 
-	switch (profiling & HA_PROF_TASKS_MASK) {
-	case HA_PROF_TASKS_AUTO: str="auto"; break;
-	case HA_PROF_TASKS_ON:   str="on"; break;
-	default:                 str="off"; break;
+	if (!appctx->ctx.cli.i1 && !appctx->ctx.cli.i0) {
+		switch (profiling & HA_PROF_TASKS_MASK) {
+		case HA_PROF_TASKS_AUTO: str="auto"; break;
+		case HA_PROF_TASKS_ON:   str="on"; break;
+		default:                 str="off"; break;
+		}
+
+		chunk_printf(&trash,
+		             "Per-task CPU profiling              : %s      # set profiling tasks {on|auto|off}\n"
+		             "Memory usage profiling              : %s       # set profiling memory {on|off}\n",
+		             str, (profiling & HA_PROF_MEMORY) ? "on " : "off");
 	}
 
-	chunk_printf(&trash,
-	             "Per-task CPU profiling              : %s      # set profiling tasks {on|auto|off}\n",
-	             str);
+	if (appctx->ctx.cli.i1)
+		goto dump_memory;
+
+	nb = appctx->ctx.cli.o0;
+	if (nb && !appctx->ctx.cli.i0)
+		chunk_appendf(&trash, "\n      Calls   CPU p50   CPU p99   CPU max   Lat p50   Lat p99   Lat max  Handler\n");
+
+	for (i = appctx->ctx.cli.i0; i < nb; i++) {
+		chunk_appendf(&trash, "%11llu", stmp[i].calls);
+		append_duration(&trash, sched_prof_pct(stmp[i].cpu_hist, stmp[i].cpu_max, 50));
+		append_duration(&trash, sched_prof_pct(stmp[i].cpu_hist, stmp[i].cpu_max, 99));
+		append_duration(&trash, stmp[i].cpu_max);
+		if (stmp[i].lat_calls) {
+			append_duration(&trash, sched_prof_pct(stmp[i].lat_hist, stmp[i].lat_max, 50));
+			append_duration(&trash, sched_prof_pct(stmp[i].lat_hist, stmp[i].lat_max, 99));
+			append_duration(&trash, stmp[i].lat_max);
+		}
+		else
+			chunk_appendf(&trash, " %9s %9s %9s", "-", "-", "-");
+		chunk_appendf(&trash, "  ");
+		if (stmp[i].func)
+			resolve_sym_name(&trash, stmp[i].func);
+		else
+			chunk_appendf(&trash, "other");
+		chunk_appendf(&trash, "\n");
 
-	if (ci_putchk(si_ic(si), &trash) == -1) {
-		/* failed, try again */
+		if (trash.data >= trash.size / 2 || i == nb - 1) {
+			if (ci_putchk(si_ic(si), &trash) == -1) {
+				/* failed, try again from this entry */
+				si_rx_room_blk(si);
+				return 0;
+			}
+			chunk_reset(&trash);
+			appctx->ctx.cli.i0 = i + 1;
+		}
+	}
+
+	/* flush what remains (e.g. the settings alone) before switching */
+	if (trash.data && ci_putchk(si_ic(si), &trash) == -1) {
 		si_rx_room_blk(si);
 		return 0;
 	}
+	chunk_reset(&trash);
+
+	/* switch to the memory statistics */
+	appctx->ctx.cli.i1 = 1;
+	appctx->ctx.cli.i0 = 0;
+
+ dump_memory:
+	nb = appctx->ctx.cli.o1;
+	if (nb && !appctx->ctx.cli.i0)
+		chunk_appendf(&trash, "\nAlloc calls   Free calls     Alloc bytes      Free bytes  Caller [pool]\n");
+
+	for (i = appctx->ctx.cli.i0; i < nb; i++) {
+		pool = tmp[i].pool;
+		chunk_appendf(&trash, "%11llu  %11llu  %14llu  %14llu  ",
+		              tmp[i].alloc_calls, tmp[i].free_calls, tmp[i].alloc_tot, tmp[i].free_tot);
+		if (tmp[i].caller)
+			resolve_sym_name(&trash, tmp[i].caller);
+		else
+			chunk_appendf(&trash, "other");
+		chunk_appendf(&trash, " [%s]\n", pool ? pool->name : "");
+
+		if (trash.data >= trash.size / 2 || i == nb - 1) {
+			if (ci_putchk(si_ic(si), &trash) == -1) {
+				/* failed, try again from this entry */
+				si_rx_room_blk(si);
+				return 0;
+			}
+			chunk_reset(&trash);
+			appctx->ctx.cli.i0 = i + 1;
+		}
+	}
 	return 1;
 }
 
 /* config keyword parsers */
 static struct cfg_kw_list cfg_kws = {ILH, {
 	{ CFG_GLOBAL, "profiling.tasks",      cfg_parse_prof_tasks      },
+	{ CFG_GLOBAL, "profiling.memory",     cfg_parse_prof_memory     },
 	{ 0, NULL, NULL }
 }};
 
@@ -132,8 +623,8 @@ INITCALL1(STG_REGISTER, cfg_register_keywords, &cfg_kws);
 
 /* register cli keywords */
 static struct cli_kw_list cli_kws = {{ },{
-	{ { "show", "profiling", NULL }, "show profiling : show CPU profiling options",   NULL, cli_io_handler_show_profiling, NULL },
-	{ { "set",  "profiling", NULL }, "set  profiling : enable/disable CPU profiling", cli_parse_set_profiling,  NULL },
+	{ { "show", "profiling", NULL }, "show profiling : show CPU and memory profiling options and statistics",   cli_parse_show_profiling, cli_io_handler_show_profiling, cli_release_show_profiling },
+	{ { "set",  "profiling", NULL }, "set  profiling : enable/disable CPU or memory profiling", cli_parse_set_profiling,  NULL },
 	{{},}
 }};
 
@@ -39,10 +39,13 @@
 #include <proto/frontend.h>
 #include <proto/http_htx.h>
 #include <proto/lb_chash.h>
+#include <proto/lb_ewma.h>
 #include <proto/lb_fas.h>
 #include <proto/lb_fwlc.h>
 #include <proto/lb_fwrr.h>
+#include <proto/lb_maglev.h>
 #include <proto/lb_map.h>
+#include <proto/lb_rcu.h>
 #include <proto/log.h>
 #include <proto/mux_pt.h>
 #include <proto/obj_type.h>
@@ -188,6 +191,8 @@ static struct server *get_server_sh(struct proxy *px, const char *addr, int len,
  hash_done:
 	if ((px->lbprm.algo & BE_LB_LKUP) == BE_LB_LKUP_CHTREE)
 		return chash_get_server_hash(px, h, avoid);
+	else if ((px->lbprm.algo & BE_LB_LKUP) == BE_LB_LKUP_MAGLEV)
+		return maglev_get_server_hash(px, h, avoid);
 	else
 		return map_get_server_hash(px, h);
 }
@@ -243,6 +248,8 @@ static struct server *get_server_uh(struct proxy *px, char *uri, int uri_len, co
  hash_done:
 	if ((px->lbprm.algo & BE_LB_LKUP) == BE_LB_LKUP_CHTREE)
 		return chash_get_server_hash(px, hash, avoid);
+	else if ((px->lbprm.algo & BE_LB_LKUP) == BE_LB_LKUP_MAGLEV)
+		return maglev_get_server_hash(px, hash, avoid);
 	else
 		return map_get_server_hash(px, hash);
 }
@@ -300,6 +307,8 @@ static struct server *get_server_ph(struct proxy *px, const char *uri, int uri_l
 
 				if ((px->lbprm.algo & BE_LB_LKUP) == BE_LB_LKUP_CHTREE)
 					return chash_get_server_hash(px, hash, avoid);
+				else if ((px->lbprm.algo & BE_LB_LKUP) == BE_LB_LKUP_MAGLEV)
+					return maglev_get_server_hash(px, hash, avoid);
 				else
 					return map_get_server_hash(px, hash);
 			}
@@ -380,6 +389,8 @@ static struct server *get_server_ph_post(struct stream *s, const struct server *
 
 				if ((px->lbprm.algo & BE_LB_LKUP) == BE_LB_LKUP_CHTREE)
 					return chash_get_server_hash(px, hash, avoid);
+				else if ((px->lbprm.algo & BE_LB_LKUP) == BE_LB_LKUP_MAGLEV)
+					return maglev_get_server_hash(px, hash, avoid);
 				else
 					return map_get_server_hash(px, hash);
 			}
@@ -475,6 +486,8 @@ static struct server *get_server_hh(struct stream *s, const struct server *avoid
  hash_done:
 	if ((px->lbprm.algo & BE_LB_LKUP) == BE_LB_LKUP_CHTREE)
 		return chash_get_server_hash(px, hash, avoid);
+	else if ((px->lbprm.algo & BE_LB_LKUP) == BE_LB_LKUP_MAGLEV)
+		return maglev_get_server_hash(px, hash, avoid);
 	else
 		return map_get_server_hash(px, hash);
 }
@@ -520,6 +533,8 @@ static struct server *get_server_rch(struct stream *s, const struct server *avoi
  hash_done:
 	if ((px->lbprm.algo & BE_LB_LKUP) == BE_LB_LKUP_CHTREE)
 		return chash_get_server_hash(px, hash, avoid);
+	else if ((px->lbprm.algo & BE_LB_LKUP) == BE_LB_LKUP_MAGLEV)
+		return maglev_get_server_hash(px, hash, avoid);
 	else
 		return map_get_server_hash(px, hash);
 }
@@ -660,7 +675,20 @@ int assign_server(struct stream *s)
 			srv = fwlc_get_next_server(s->be, prev_srv);
 			break;
 
+		case BE_LB_LKUP_EWMA:
+			srv = ewma_get_next_server(s->be, prev_srv);
+			break;
+
+		case BE_LB_LKUP_RCURR:
+			srv = rcu_get_next_server_rr(s->be, prev_srv);
+			break;
+
+		case BE_LB_LKUP_RCULC:
+			srv = rcu_get_next_server_lc(s->be, prev_srv);
+			break;
+
 		case BE_LB_LKUP_CHTREE:
+		case BE_LB_LKUP_MAGLEV:
 		case BE_LB_LKUP_MAP:
 			if ((s->be->lbprm.algo & BE_LB_KIND) == BE_LB_KIND_RR) {
 				if ((s->be->lbprm.algo & BE_LB_PARM) == BE_LB_RR_RANDOM)
@@ -743,6 +771,8 @@ int assign_server(struct stream *s)
 			if (!srv) {
 				if ((s->be->lbprm.algo & BE_LB_LKUP) == BE_LB_LKUP_CHTREE)
 					srv = chash_get_next_server(s->be, prev_srv);
+				else if ((s->be->lbprm.algo & BE_LB_LKUP) == BE_LB_LKUP_MAGLEV)
+					srv = maglev_get_next_server(s->be, prev_srv);
 				else
 					srv = map_get_server_rr(s->be, prev_srv);
 			}
@@ -1780,6 +1810,8 @@ const char *backend_lb_algo_str(int algo) {
 		return "first";
 	else if (algo == BE_LB_ALGO_LC)
 		return "leastconn";
+	else if (algo == BE_LB_ALGO_EWMA)
+		return "peak-ewma";
 	else if (algo == BE_LB_ALGO_SH)
 		return "source";
 	else if (algo == BE_LB_ALGO_UH)
@@ -1854,6 +1886,71 @@ int backend_parse_balance(const char **args, char **err, struct proxy *curproxy)
 			}
 		}
 	}
+	else if (!strncmp(args[0], "peak-ewma", 9)) {
+		int arg = 1;
+
+		curproxy->lbprm.algo &= ~BE_LB_ALGO;
+		curproxy->lbprm.algo |= BE_LB_ALGO_EWMA;
+		curproxy->lbprm.arg_opt1 = 2;     // draws
+		curproxy->lbprm.arg_opt2 = 10000; // decay time in ms
+
+		if (*(args[0] + 9) == '(' && *(args[0] + 10) != ')') { /* number of draws */
+			const char *beg;
+			char *end;
+
+			beg = args[0] + 10;
+			curproxy->lbprm.arg_opt1 = strtol(beg, &end, 0);
+
+			if (*end != ')') {
+				if (!*end)
+					memprintf(err, "peak-ewma : missing closing parenthesis.");
+				else
+					memprintf(err, "peak-ewma : unexpected character '%c' after argument.", *end);
+				return -1;
+			}
+
+			if (curproxy->lbprm.arg_opt1 < 1 || curproxy->lbprm.arg_opt1 > EWMA_MAX_DRAWS) {
+				memprintf(err, "peak-ewma : number of draws must be between 1 and %d.", EWMA_MAX_DRAWS);
+				return -1;
+			}
+		}
+		else if (*(args[0] + 9) && strcmp(args[0] + 9, "()") != 0) {
+			memprintf(err, "peak-ewma : unexpected character '%c' after algorithm name.", *(args[0] + 9));
+			return -1;
+		}
+
+		while (*args[arg]) {
+			if (!strcmp(args[arg], "decay")) {
+				const char *res;
+				unsigned int decay;
+
+				if (!*args[arg+1]) {
+					memprintf(err, "%s : '%s' expects a time value.", args[0], args[arg]);
+					return -1;
+				}
+				res = parse_time_err(args[arg+1], &decay, TIME_UNIT_MS);
+				if (res == PARSE_TIME_OVER) {
+					memprintf(err, "%s : timer overflow in argument <%s> to '%s', maximum value is 2147483647 ms (~24.8 days).",
+						  args[0], args[arg+1], args[arg]);
+					return -1;
+				}
+				else if (res == PARSE_TIME_UNDER || (!res && !decay)) {
+					memprintf(err, "%s : '%s' must be at least 1 ms (got '%s').", args[0], args[arg], args[arg+1]);
+					return -1;
+				}
+				else if (res) {
+					memprintf(err, "%s : unexpected character '%c' in '%s'.", args[0], *res, args[arg]);
+					return -1;
+				}
+				curproxy->lbprm.arg_opt2 = decay;
+				arg += 2;
+			}
+			else {
+				memprintf(err, "%s only accepts parameter 'decay' (got '%s').", args[0], args[arg]);
+				return -1;
+			}
+		}
+	}
 	else if (!strcmp(args[0], "source")) {
 		curproxy->lbprm.algo &= ~BE_LB_ALGO;
 		curproxy->lbprm.algo |= BE_LB_ALGO_SH;
@@ -1972,7 +2069,7 @@ int backend_parse_balance(const char **args, char **err, struct proxy *curproxy)
 		}
 	}
 	else {
-		memprintf(err, "only supports 'roundrobin', 'static-rr', 'leastconn', 'source', 'uri', 'url_param', 'hdr(name)' and 'rdp-cookie(name)' options.");
+		memprintf(err, "only supports 'roundrobin', 'static-rr', 'leastconn', 'peak-ewma', 'source', 'uri', 'url_param', 'hdr(name)' and 'rdp-cookie(name)' options.");
 		return -1;
 	}
 	return 0;
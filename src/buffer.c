@@ -20,7 +20,10 @@
 
 #include <types/global.h>
 
+#include <proto/log.h>
+
 struct pool_head *pool_head_buffer;
+struct pool_head *pool_head_small_buffer;
 
 /* list of objects waiting for at least one buffer */
 struct list buffer_wq = LIST_HEAD_INIT(buffer_wq);
@@ -51,6 +54,22 @@ int init_buffer()
 		return 0;
 
 	pool_free(pool_head_buffer, buffer);
+
+	/* small buffers are only worth it when they're much smaller than the
+	 * large ones, and upgrades rely on a small buffer's contents always
+	 * fitting unwrapped at the same offset in a large one.
+	 */
+	if (global.tune.bufsize_small) {
+		if (global.tune.bufsize_small > global.tune.bufsize / 2) {
+			ha_warning("tune.bufsize.small (%d) must not be larger than half of tune.bufsize (%d), small buffers disabled.\n",
+				   global.tune.bufsize_small, global.tune.bufsize);
+			global.tune.bufsize_small = 0;
+			return 1;
+		}
+		pool_head_small_buffer = create_pool("smallbuf", global.tune.bufsize_small, MEM_F_SHARED|MEM_F_EXACT);
+		if (!pool_head_small_buffer)
+			return 0;
+	}
 	return 1;
 }
 
@@ -577,6 +577,10 @@ enum act_return http_action_store_cache(struct act_rule *rule, struct proxy *px,
 	if (txn->status != 200)
 		goto out;
 
+	/* don't admit new objects under memory pressure */
+	if (mem_pressure_shed_at(MEM_PRESSURE_CACHE))
+		goto out;
+
 	/* Find the corresponding filter instance for the current stream */
 	list_for_each_entry(filter, &s->strm_flt.filters, list) {
 		if (FLT_ID(filter) == cache_store_flt_id  && FLT_CONF(filter) == cconf) {
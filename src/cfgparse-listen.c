@@ -281,6 +281,8 @@ int cfg_parse_listen(const char *file, int linenum, char **args, int kwm)
 			curproxy->conn_retries = defproxy.conn_retries;
 			curproxy->redispatch_after = defproxy.redispatch_after;
 			curproxy->max_ka_queue = defproxy.max_ka_queue;
+			curproxy->codel_target = defproxy.codel_target;
+			curproxy->codel_interval = defproxy.codel_interval;
 
 			if (defproxy.check_req) {
 				curproxy->check_req = calloc(1, defproxy.check_len);
@@ -3322,7 +3324,7 @@ stats_error_parsing:
 	else if (!strcmp(args[0], "hash-type")) { /* set hashing method */
 		/**
 		 * The syntax for hash-type config element is
-		 * hash-type {map-based|consistent} [[<algo>] avalanche]
+		 * hash-type {map-based|consistent|maglev} [[<algo>] avalanche]
 		 *
 		 * The default hash function is sdbm for map-based and sdbm+avalanche for consistent.
 		 */
@@ -3337,13 +3339,16 @@ stats_error_parsing:
 		else if (strcmp(args[1], "map-based") == 0) {	/* use map-based hashing */
 			curproxy->lbprm.algo |= BE_LB_HASH_MAP;
 		}
+		else if (strcmp(args[1], "maglev") == 0) {	/* use maglev hashing */
+			curproxy->lbprm.algo |= BE_LB_HASH_MAGLEV;
+		}
 		else if (strcmp(args[1], "avalanche") == 0) {
 			ha_alert("parsing [%s:%d] : experimental feature '%s %s' is not supported anymore, please use '%s map-based sdbm avalanche' instead.\n", file, linenum, args[0], args[1], args[0]);
 			err_code |= ERR_ALERT | ERR_FATAL;
 			goto out;
 		}
 		else {
-			ha_alert("parsing [%s:%d] : '%s' only supports 'consistent' and 'map-based'.\n", file, linenum, args[0]);
+			ha_alert("parsing [%s:%d] : '%s' only supports 'consistent', 'map-based' and 'maglev'.\n", file, linenum, args[0]);
 			err_code |= ERR_ALERT | ERR_FATAL;
 			goto out;
 		}
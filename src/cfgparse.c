@@ -65,10 +65,13 @@
 #include <proto/frontend.h>
 #include <proto/http_rules.h>
 #include <proto/lb_chash.h>
+#include <proto/lb_ewma.h>
 #include <proto/lb_fas.h>
 #include <proto/lb_fwlc.h>
 #include <proto/lb_fwrr.h>
+#include <proto/lb_maglev.h>
 #include <proto/lb_map.h>
+#include <proto/lb_rcu.h>
 #include <proto/listener.h>
 #include <proto/log.h>
 #include <proto/protocol.h>
@@ -931,6 +934,18 @@ int cfg_parse_peers(const char *file, int linenum, char **args, int kwm)
 	else if (!strcmp(args[0], "enabled")) {  /* enables this peers section (used to revert a disabled default) */
 		curpeers->state = PR_STNEW;
 	}
+	else if (!strcmp(args[0], "compress")) {  /* compresses the updates sent to remote peers */
+		if (alertif_too_many_args(0, file, linenum, args, &err_code))
+			goto out;
+#if defined(USE_ZLIB)
+		curpeers->compress = 1;
+#else
+		ha_alert("parsing [%s:%d] : '%s' requires HAProxy to be built with zlib support.\n",
+		         file, linenum, args[0]);
+		err_code |= ERR_ALERT | ERR_FATAL;
+		goto out;
+#endif
+	}
 	else if (*args[0] != 0) {
 		ha_alert("parsing [%s:%d] : unknown keyword '%s' in '%s' section\n", file, linenum, args[0], cursection);
 		err_code |= ERR_ALERT | ERR_FATAL;
@@ -2320,6 +2335,11 @@ int check_config_validity()
 		goto out;
 	}
 
+	if (thread_groups_init()) {
+		err_code |= ERR_ALERT | ERR_FATAL;
+		goto out;
+	}
+
 	pool_head_requri = create_pool("requri", global.tune.requri_len , MEM_F_SHARED);
 
 	pool_head_capture = create_pool("capture", global.tune.cookie_len, MEM_F_SHARED);
@@ -2731,6 +2751,11 @@ int check_config_validity()
 					 curproxy->id, mrule->table.name);
 				cfgerr++;
 			}
+			else if (target->sketch_depth) {
+				ha_alert("Proxy '%s': stick-table '%s' is a sketch and cannot be used by stick rules.\n",
+					 curproxy->id, target->id);
+				cfgerr++;
+			}
 			else if (!stktable_compatible_sample(mrule->expr,  target->type)) {
 				ha_alert("Proxy '%s': type of fetch not usable with type of stick-table '%s'.\n",
 					 curproxy->id, mrule->table.name ? mrule->table.name : curproxy->id);
@@ -2769,6 +2794,11 @@ int check_config_validity()
 					 curproxy->id, mrule->table.name);
 				cfgerr++;
 			}
+			else if (target->sketch_depth) {
+				ha_alert("Proxy '%s': stick-table '%s' is a sketch and cannot be used by stick rules.\n",
+					 curproxy->id, target->id);
+				cfgerr++;
+			}
 			else if (!stktable_compatible_sample(mrule->expr, target->type)) {
 				ha_alert("Proxy '%s': type of fetch not usable with type of stick-table '%s'.\n",
 					 curproxy->id, mrule->table.name ? mrule->table.name : curproxy->id);
@@ -3198,6 +3228,21 @@ out_uri_auth_compat:
 				newsrv->minconn = newsrv->maxconn;
 			}
 
+			if (newsrv->adapt_target) {
+				if (!newsrv->maxconn) {
+					ha_warning("config : %s '%s' : ignoring 'maxconn-adapt' for server '%s' which has no 'maxconn'.\n",
+						   proxy_type_str(curproxy), curproxy->id, newsrv->id);
+					err_code |= ERR_WARN;
+					newsrv->adapt_target = 0;
+				}
+				else if (newsrv->maxconn > (~0U >> SRV_ADAPT_SHIFT)) {
+					ha_alert("config : %s '%s' : 'maxconn' of server '%s' cannot exceed %u with 'maxconn-adapt'.\n",
+						 proxy_type_str(curproxy), curproxy->id, newsrv->id, ~0U >> SRV_ADAPT_SHIFT);
+					cfgerr++;
+				}
+				newsrv->adapt_limit = newsrv->maxconn << SRV_ADAPT_SHIFT;
+			}
+
 			/* this will also properly set the transport layer for prod and checks */
 			if (newsrv->use_ssl || newsrv->check.use_ssl) {
 				if (xprt_get(XPRT_SSL) && xprt_get(XPRT_SSL)->prepare_srv)
@@ -3324,6 +3369,13 @@ out_uri_auth_compat:
 			} else if ((curproxy->lbprm.algo & BE_LB_PARM) == BE_LB_RR_RANDOM) {
 				curproxy->lbprm.algo |= BE_LB_LKUP_CHTREE | BE_LB_PROP_DYN;
 				chash_init_server_tree(curproxy);
+			} else if (curproxy->options2 & PR_O2_LB_LOCKFREE) {
+				curproxy->lbprm.algo |= BE_LB_LKUP_RCURR | BE_LB_PROP_DYN;
+				if (!rcu_init_server_array(curproxy)) {
+					ha_alert("config : %s '%s' : out of memory while allocating the lock-free server array.\n",
+						 proxy_type_str(curproxy), curproxy->id);
+					cfgerr++;
+				}
 			} else {
 				curproxy->lbprm.algo |= BE_LB_LKUP_RRTREE | BE_LB_PROP_DYN;
 				fwrr_init_server_groups(curproxy);
@@ -3331,9 +3383,24 @@ out_uri_auth_compat:
 			break;
 
 		case BE_LB_KIND_CB:
-			if ((curproxy->lbprm.algo & BE_LB_PARM) == BE_LB_CB_LC) {
+			if ((curproxy->lbprm.algo & BE_LB_PARM) == BE_LB_CB_LC &&
+			    (curproxy->options2 & PR_O2_LB_LOCKFREE)) {
+				curproxy->lbprm.algo |= BE_LB_LKUP_RCULC | BE_LB_PROP_DYN;
+				if (!rcu_init_server_array(curproxy)) {
+					ha_alert("config : %s '%s' : out of memory while allocating the lock-free server array.\n",
+						 proxy_type_str(curproxy), curproxy->id);
+					cfgerr++;
+				}
+			} else if ((curproxy->lbprm.algo & BE_LB_PARM) == BE_LB_CB_LC) {
 				curproxy->lbprm.algo |= BE_LB_LKUP_LCTREE | BE_LB_PROP_DYN;
 				fwlc_init_server_tree(curproxy);
+			} else if ((curproxy->lbprm.algo & BE_LB_PARM) == BE_LB_CB_EWMA) {
+				curproxy->lbprm.algo |= BE_LB_LKUP_EWMA | BE_LB_PROP_DYN;
+				if (!ewma_init_server_array(curproxy)) {
+					ha_alert("config : %s '%s' : out of memory while allocating the peak-ewma server array.\n",
+						 proxy_type_str(curproxy), curproxy->id);
+					cfgerr++;
+				}
 			} else {
 				curproxy->lbprm.algo |= BE_LB_LKUP_FSTREE | BE_LB_PROP_DYN;
 				fas_init_server_tree(curproxy);
@@ -3344,6 +3411,13 @@ out_uri_auth_compat:
 			if ((curproxy->lbprm.algo & BE_LB_HASH_TYPE) == BE_LB_HASH_CONS) {
 				curproxy->lbprm.algo |= BE_LB_LKUP_CHTREE | BE_LB_PROP_DYN;
 				chash_init_server_tree(curproxy);
+			} else if ((curproxy->lbprm.algo & BE_LB_HASH_TYPE) == BE_LB_HASH_MAGLEV) {
+				curproxy->lbprm.algo |= BE_LB_LKUP_MAGLEV | BE_LB_PROP_DYN;
+				if (!maglev_init_server_table(curproxy)) {
+					ha_alert("config : %s '%s' : out of memory while allocating the maglev lookup table.\n",
+						 proxy_type_str(curproxy), curproxy->id);
+					cfgerr++;
+				}
 			} else {
 				curproxy->lbprm.algo |= BE_LB_LKUP_MAP;
 				init_server_map(curproxy);
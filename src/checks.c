@@ -2461,6 +2461,7 @@ static int start_check_task(struct check *check, int mininter,
 	check->task = t;
 	t->process = process_chk;
 	t->context = check;
+	task_set_class(t, TL_BACKGROUND);
 
 	if (mininter < srv_getinter(check))
 		mininter = srv_getinter(check);
@@ -3298,6 +3299,7 @@ const char *init_check(struct check *check, int type)
 	check->wait_list.events = 0;
 	check->wait_list.tasklet->process = event_srv_chk_io;
 	check->wait_list.tasklet->context = check;
+	tasklet_set_class(check->wait_list.tasklet, TL_BACKGROUND);
 	return NULL;
 }
 
@@ -3416,6 +3418,7 @@ int init_email_alert(struct mailers *mls, struct proxy *p, char **err)
 		check->task = t;
 		t->process = process_email_alert;
 		t->context = check;
+		task_set_class(t, TL_BACKGROUND);
 
 		/* check this in one ms */
 		t->expire    = TICK_ETERNITY;
@@ -1145,6 +1145,22 @@ static int cli_io_handler_show_activity(struct appctx *appctx)
 		chunk_appendf(&trash, " ]\n");				\
 	} while (0)
 
+#undef SHOW_GRP
+#define SHOW_GRP(t, x)							\
+	do {								\
+		unsigned int _v[MAX_TGROUPS] = { };			\
+		unsigned int _tot = 0, _g;				\
+		const unsigned int _nbg = global.nbtgroups;		\
+		for (t = 0; t < global.nbthread; t++)			\
+			_v[ha_thread_info[t].tgid] += (x);		\
+		for (_g = 0; _g < _nbg; _g++)				\
+			_tot += _v[_g];					\
+		chunk_appendf(&trash, " %u [", _tot);			\
+		for (_g = 0; _g < _nbg; _g++)				\
+			chunk_appendf(&trash, " %u", _v[_g]);		\
+		chunk_appendf(&trash, " ]\n");				\
+	} while (0)
+
 	chunk_appendf(&trash, "thread_id: %u (%u..%u)\n", tid + 1, 1, global.nbthread);
 	chunk_appendf(&trash, "date_now: %lu.%06lu\n", (long)now.tv_sec, (long)now.tv_usec);
 	chunk_appendf(&trash, "loops:");        SHOW_TOT(thr, activity[thr].loops);
@@ -1159,8 +1175,15 @@ static int cli_io_handler_show_activity(struct appctx *appctx)
 	chunk_appendf(&trash, "stream:");       SHOW_TOT(thr, activity[thr].stream);
 	chunk_appendf(&trash, "pool_fail:");    SHOW_TOT(thr, activity[thr].pool_fail);
 	chunk_appendf(&trash, "buf_wait:");     SHOW_TOT(thr, activity[thr].buf_wait);
+	chunk_appendf(&trash, "buf_idle_rel:"); SHOW_TOT(thr, activity[thr].buf_idle_rel);
+	chunk_appendf(&trash, "buf_idle_skip:");SHOW_TOT(thr, activity[thr].buf_idle_skip);
+	chunk_appendf(&trash, "buf_idle_kb:");  SHOW_TOT(thr, activity[thr].buf_idle_kb);
 	chunk_appendf(&trash, "empty_rq:");     SHOW_TOT(thr, activity[thr].empty_rq);
 	chunk_appendf(&trash, "long_rq:");      SHOW_TOT(thr, activity[thr].long_rq);
+	chunk_appendf(&trash, "run_urgent:");   SHOW_TOT(thr, activity[thr].sched_run[TL_URGENT]);
+	chunk_appendf(&trash, "run_normal:");   SHOW_TOT(thr, activity[thr].sched_run[TL_NORMAL]);
+	chunk_appendf(&trash, "run_bulk:");     SHOW_TOT(thr, activity[thr].sched_run[TL_BULK]);
+	chunk_appendf(&trash, "run_bg:");       SHOW_TOT(thr, activity[thr].sched_run[TL_BACKGROUND]);
 	chunk_appendf(&trash, "ctxsw:");        SHOW_TOT(thr, activity[thr].ctxsw);
 	chunk_appendf(&trash, "tasksw:");       SHOW_TOT(thr, activity[thr].tasksw);
 	chunk_appendf(&trash, "cpust_ms_tot:"); SHOW_TOT(thr, activity[thr].cpust_total / 2);
@@ -1174,6 +1197,32 @@ static int cli_io_handler_show_activity(struct appctx *appctx)
 	chunk_appendf(&trash, "accq_ring:");    SHOW_TOT(thr, (accept_queue_rings[thr].tail - accept_queue_rings[thr].head + ACCEPT_QUEUE_SIZE) % ACCEPT_QUEUE_SIZE);
 #endif
 
+	chunk_appendf(&trash, "xgrp_wake:");    SHOW_TOT(thr, activity[thr].xgrp_wake);
+	chunk_appendf(&trash, "rq_steal:");     SHOW_TOT(thr, activity[thr].rq_steal);
+	chunk_appendf(&trash, "wake_sent:");    SHOW_TOT(thr, activity[thr].wake_sent);
+	chunk_appendf(&trash, "wake_coalesced:"); SHOW_TOT(thr, activity[thr].wake_coalesced);
+
+#ifdef USE_THREAD
+	/* per thread group statistics, only when there are multiple groups */
+	if (global.nbtgroups > 1) {
+		int grp;
+
+		chunk_appendf(&trash, "tgroups: %d\n", global.nbtgroups);
+		chunk_appendf(&trash, "grp_node:");
+		for (grp = 0; grp < global.nbtgroups; grp++)
+			chunk_appendf(&trash, " %d", ha_tgroup_info[grp].node);
+		chunk_appendf(&trash, "\n");
+		chunk_appendf(&trash, "grp_threads:");  SHOW_GRP(thr, 1);
+		chunk_appendf(&trash, "grp_loops:");    SHOW_GRP(thr, activity[thr].loops);
+		chunk_appendf(&trash, "grp_ctxsw:");    SHOW_GRP(thr, activity[thr].ctxsw);
+		chunk_appendf(&trash, "grp_tasksw:");   SHOW_GRP(thr, activity[thr].tasksw);
+		chunk_appendf(&trash, "grp_accepted:"); SHOW_GRP(thr, activity[thr].accepted);
+		chunk_appendf(&trash, "grp_xgrp_wake:"); SHOW_GRP(thr, activity[thr].xgrp_wake);
+		chunk_appendf(&trash, "grp_inbound:");  SHOW_GRP(thr, task_per_thread[thr].inbound_size);
+		chunk_appendf(&trash, "grp_rq_steal:"); SHOW_GRP(thr, activity[thr].rq_steal);
+	}
+#endif
+
 #if defined(DEBUG_DEV)
 	/* keep these ones at the end */
 	chunk_appendf(&trash, "ctr0:");         SHOW_TOT(thr, activity[thr].ctr0);
@@ -1187,6 +1236,7 @@ static int cli_io_handler_show_activity(struct appctx *appctx)
 		si_rx_room_blk(si);
 	}
 
+#undef SHOW_GRP
 #undef SHOW_AVG
 #undef SHOW_TOT
 	/* dump complete */
@@ -61,10 +61,10 @@ void ha_thread_dump(struct buffer *buf, int thr, int calling_tid)
 	              (thr == calling_tid) ? '*' : ' ', stuck ? '>' : ' ', thr + 1,
 		      thread_has_tasks(),
 	              !!(global_tasks_mask & thr_bit),
-	              !eb_is_empty(&task_per_thread[thr].timers),
+	              !tw_is_empty(&task_per_thread[thr].timers),
 	              !eb_is_empty(&task_per_thread[thr].rqueue),
-	              !(LIST_ISEMPTY(&task_per_thread[thr].task_list) |
-		        MT_LIST_ISEMPTY(&task_per_thread[thr].shared_tasklet_list)),
+	              sched_has_tasklets(&task_per_thread[thr]) |
+		        !MT_LIST_ISEMPTY(&task_per_thread[thr].shared_tasklet_list),
 	              task_per_thread[thr].task_list_size,
 	              task_per_thread[thr].rqueue_size,
 	              stuck,
@@ -82,6 +82,10 @@
 #include <sys/resource.h>
 #include <sys/uio.h>
 
+#ifdef USE_EVENTFD
+#include <sys/eventfd.h>
+#endif
+
 #if defined(USE_POLL)
 #include <poll.h>
 #include <errno.h>
@@ -110,8 +114,9 @@ volatile struct fdlist update_list; // Global update list
 
 THREAD_LOCAL int *fd_updt  = NULL;  // FD updates list
 THREAD_LOCAL int  fd_nbupdt = 0;   // number of updates in the list
-THREAD_LOCAL int poller_rd_pipe = -1; // Pipe to wake the thread
-int poller_wr_pipe[MAX_THREADS]; // Pipe to wake the threads
+THREAD_LOCAL int poller_rd_pipe = -1; // Pipe or eventfd to wake the thread
+int poller_wr_pipe[MAX_THREADS]; // Pipe or eventfd to wake the threads
+volatile unsigned long poller_wake_mask = 0; // Threads with a pending wakeup
 
 volatile int ha_used_fds = 0; // Number of FD we're currently using
 
@@ -525,8 +530,16 @@ void disable_poller(const char *poller_name)
 void poller_pipe_io_handler(int fd)
 {
 	char buf[1024];
-	/* Flush the pipe */
+	/* Flush the pipe or reset the eventfd counter, then accept new
+	 * wakeups. The flag must only be cleared once the channel is empty,
+	 * otherwise a wakeup sent in between could be consumed here while
+	 * the flag remains set, and all subsequent ones would be lost. A
+	 * wakeup coalesced between the read and the flag reset is harmless
+	 * since the thread is awake and will check its run queues before
+	 * sleeping again.
+	 */
 	while (read(fd, buf, sizeof(buf)) > 0);
+	_HA_ATOMIC_AND(&poller_wake_mask, ~tid_bit);
 	fd_cant_recv(fd);
 }
 
@@ -544,7 +557,15 @@ static int init_pollers_per_thread()
 {
 	int mypipe[2];
 
-	if (pipe(mypipe) < 0)
+	_HA_ATOMIC_AND(&poller_wake_mask, ~tid_bit);
+
+	mypipe[0] = mypipe[1] = -1;
+#ifdef USE_EVENTFD
+	/* a single fd serves both sides, and its counter never fills up */
+	mypipe[0] = mypipe[1] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+#endif
+	/* fall back to a pipe when eventfd is not available */
+	if (mypipe[0] < 0 && pipe(mypipe) < 0)
 		return 0;
 
 	poller_rd_pipe = mypipe[0];
@@ -562,9 +583,11 @@ static void deinit_pollers_per_thread()
 	/* rd and wr are init at the same place, but only rd is init to -1, so
 	  we rely to rd to close.   */
 	if (poller_rd_pipe > -1) {
+		/* both are the same with eventfd */
+		if (poller_wr_pipe[tid] != poller_rd_pipe)
+			close(poller_wr_pipe[tid]);
 		close(poller_rd_pipe);
 		poller_rd_pipe = -1;
-		close(poller_wr_pipe[tid]);
 		poller_wr_pipe[tid] = -1;
 	}
 }
@@ -571,6 +571,10 @@ select_compression_response_header(struct comp_state *st, struct stream *s, stru
 	if (ti->idle_pct < compress_min_idle)
 		goto fail;
 
+	/* limit memory usage */
+	if (mem_pressure_shed_at(MEM_PRESSURE_COMP))
+		goto fail;
+
 	/* initialize compression */
 	if (st->comp_algo->init(&st->comp_ctx, global.tune.comp_maxlevel) < 0)
 		goto fail;
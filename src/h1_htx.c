@@ -10,6 +10,7 @@
  *
  */
 
+#include <common/buffer.h>
 #include <common/config.h>
 #include <common/debug.h>
 #include <common/cfgparse.h>
@@ -352,8 +353,9 @@ int h1_parse_msg_hdrs(struct h1m *h1m, union h1_sl *h1sl, struct htx *dsthtx,
 		/* Incomplete or invalid message. If the input buffer only
 		 * contains headers and is full, which is detected by it being
 		 * full and the offset to be zero, it's an error because
-		 * headers are too large to be handled by the parser. */
-		if (ret < 0 || (!ret && !ofs && !buf_room_for_htx_data(srcbuf)))
+		 * headers are too large to be handled by the parser. A full
+		 * small buffer will be upgraded by the mux instead. */
+		if (ret < 0 || (!ret && !ofs && !buf_room_for_htx_data(srcbuf) && !b_is_small(srcbuf)))
 			goto error;
 		goto end;
 	}
@@ -410,11 +412,13 @@ static int h1_copy_msg_data(struct htx **dsthtx, struct buffer *srcbuf, size_t o
 	 *   - htx is empty and points to <htxbuf>
 	 *   - ret == srcbuf->data
 	 *   - srcbuf->head == sizeof(struct htx)
+	 *   - both buffers have the same size (i.e. srcbuf is not small)
 	 *   => we can swap the buffers and place an htx header into
 	 *      the target buffer instead
 	 */
 	if (unlikely(htx_is_empty(tmp_htx) && count == b_data(srcbuf) &&
-		     !ofs && b_head_ofs(srcbuf) == sizeof(struct htx))) {
+		     !ofs && b_head_ofs(srcbuf) == sizeof(struct htx) &&
+		     b_size(srcbuf) == b_size(htxbuf))) {
 		void *raw_area = srcbuf->area;
 		void *htx_area = htxbuf->area;
 		struct htx_blk *blk;
@@ -578,7 +582,7 @@ int h1_parse_msg_tlrs(struct h1m *h1m, struct htx *dsthtx,
 		 * contains trailers and is full, which is detected by it being
 		 * full and the offset to be zero, it's an error because
 		 * trailers are too large to be handled by the parser. */
-		if (ret < 0 || (!ret && !ofs && !buf_room_for_htx_data(srcbuf)))
+		if (ret < 0 || (!ret && !ofs && !buf_room_for_htx_data(srcbuf) && !b_is_small(srcbuf)))
 			goto error;
 		goto end;
 	}
@@ -89,6 +89,7 @@
 #include <common/mini-clist.h>
 #include <common/namespace.h>
 #include <common/openssl-compat.h>
+#include <common/qsbr.h>
 #include <common/regex.h>
 #include <common/standard.h>
 #include <common/time.h>
@@ -2325,9 +2326,15 @@ void deinit(void)
 	struct post_deinit_fct *pdf;
 	struct proxy_deinit_fct *pxdf;
 	struct server_deinit_fct *srvdf;
+	struct stktable *t;
 	int i;
 
 	deinit_signals();
+
+	/* save the last state of the tables before releasing them */
+	for (t = stktables_list; t; t = t->next)
+		stktable_snapshot_flush(t);
+
 	while (p) {
 		free(p->conf.file);
 		free(p->id);
@@ -2348,6 +2355,18 @@ void deinit(void)
 		free(p->conf.uif_file);
 		if ((p->lbprm.algo & BE_LB_LKUP) == BE_LB_LKUP_MAP)
 			free(p->lbprm.map.srv);
+		else if ((p->lbprm.algo & BE_LB_LKUP) == BE_LB_LKUP_EWMA)
+			free(p->lbprm.ewma.srv);
+		else if ((p->lbprm.algo & BE_LB_LKUP) == BE_LB_LKUP_RCURR ||
+		         (p->lbprm.algo & BE_LB_LKUP) == BE_LB_LKUP_RCULC) {
+			free(p->lbprm.rcu.arr);
+			free(p->lbprm.rcu.cursor);
+		}
+		else if ((p->lbprm.algo & BE_LB_LKUP) == BE_LB_LKUP_MAGLEV) {
+			free(p->lbprm.maglev.table);
+			free(p->lbprm.maglev.srv);
+			free(p->lbprm.maglev.perm);
+		}
 
 		if (p->conf.logformat_sd_string != default_rfc5424_sd_log_format)
 			free(p->conf.logformat_sd_string);
@@ -2544,8 +2563,14 @@ void deinit(void)
 
 		pool_destroy(p->req_cap_pool);
 		pool_destroy(p->rsp_cap_pool);
-		if (p->table)
+		if (p->table) {
 			pool_destroy(p->table->pool);
+			free(p->table->shards);
+			for (i = 0; i < STKTABLE_DATA_TYPES; i++)
+				free(p->table->sketch[i]);
+			free(p->table->snap.file);
+			free(p->table->topk.heap);
+		}
 
 		p0 = p;
 		p = p->next;
@@ -2660,6 +2685,9 @@ static void run_poll_loop()
 		/* The poller will ensure it returns around <next> */
 		cur_poller.poll(&cur_poller, next, wake);
 
+		/* objects retired before this point are not used anymore */
+		qsbr_quiescent();
+
 		activity[tid].loops++;
 	}
 }
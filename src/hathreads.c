@@ -11,6 +11,7 @@
  */
 
 #define _GNU_SOURCE
+#include <ctype.h>
 #include <unistd.h>
 #include <stdlib.h>
 #include <fcntl.h>
@@ -31,6 +32,10 @@
 
 struct thread_info ha_thread_info[MAX_THREADS] = { };
 THREAD_LOCAL struct thread_info *ti = &ha_thread_info[0];
+struct tgroup_info ha_tgroup_info[MAX_TGROUPS] = { };
+
+/* set by "thread-groups auto" to map thread groups to NUMA nodes */
+static int tgroups_auto = 0;
 
 #ifdef USE_THREAD
 
@@ -249,3 +254,176 @@ int parse_nbthread(const char *arg, char **err)
 #endif
 	return nbthread;
 }
+
+#if defined(USE_THREAD) && defined(USE_CPU_AFFINITY) && defined(__linux__)
+/* Reads a CPU or node list in the Linux sysfs format (eg: "0-7,16-23") from
+ * file <path> and returns it as a bit field. Only the first LONGBITS entries
+ * are considered. Zero is returned if the file cannot be read.
+ */
+static unsigned long numa_read_list(const char *path)
+{
+	unsigned long mask = 0;
+	char buf[1024], *p;
+	unsigned int low, high;
+	ssize_t len;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return 0;
+	len = read(fd, buf, sizeof(buf) - 1);
+	close(fd);
+	if (len <= 0)
+		return 0;
+	buf[len] = 0;
+
+	p = buf;
+	while (isdigit((unsigned char)*p)) {
+		low = high = strtoul(p, &p, 10);
+		if (*p == '-')
+			high = strtoul(p + 1, &p, 10);
+		while (low <= high && low < LONGBITS)
+			mask |= 1UL << low++;
+		if (*p != ',')
+			break;
+		p++;
+	}
+	return mask;
+}
+
+/* Assigns NUMA nodes to thread groups for "thread-groups auto". The number of
+ * groups is the number of online nodes the process may run on, limited by the
+ * number of threads. Threads which have no explicit "cpu-map" entry are bound
+ * to the CPUs of their group's node. Returns the number of groups.
+ */
+static int numa_map_tgroups(void)
+{
+	unsigned long nodes, node_cpus[LONGBITS];
+	unsigned long allowed = ~0UL;
+	char path[64];
+	int node, nb = 0;
+	int grp, thr;
+	cpu_set_t cpus;
+
+	if (sched_getaffinity(0, sizeof(cpus), &cpus) == 0) {
+		allowed = 0;
+		for (thr = 0; thr < LONGBITS; thr++)
+			if (CPU_ISSET(thr, &cpus))
+				allowed |= 1UL << thr;
+	}
+
+	nodes = numa_read_list("/sys/devices/system/node/online");
+	for (node = 0; nodes && node < LONGBITS; node++) {
+		if (!(nodes & (1UL << node)))
+			continue;
+		snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+		node_cpus[node] = numa_read_list(path) & allowed;
+		if (!node_cpus[node])
+			nodes &= ~(1UL << node);
+		else
+			nb++;
+	}
+
+	if (nb > global.nbthread)
+		nb = global.nbthread;
+	if (nb > MAX_TGROUPS)
+		nb = MAX_TGROUPS;
+	if (nb <= 1)
+		return 1;
+
+	for (grp = 0; grp < nb; grp++) {
+		node = my_ffsl(nodes) - 1;
+		nodes &= nodes - 1;
+		ha_tgroup_info[grp].node = node;
+		for (thr = grp * global.nbthread / nb; thr < (grp + 1) * global.nbthread / nb; thr++) {
+			if (!global.cpu_map.thread[thr])
+				global.cpu_map.thread[thr] = node_cpus[node];
+		}
+	}
+	return nb;
+}
+#endif
+
+/* Splits the configured threads into thread groups of contiguous threads and
+ * sets each thread's group information. This is called from the config
+ * checks as soon as the number of threads is known, so that tasks created
+ * later during the checks are queued in the right group. It returns the
+ * number of errors encountered.
+ */
+int thread_groups_init()
+{
+	int grp, thr, first, last;
+
+	if (global.nbtgroups > global.nbthread) {
+		ha_alert("config : 'thread-groups' (%d) cannot exceed the number of threads (%d).\n",
+			 global.nbtgroups, global.nbthread);
+		return 1;
+	}
+
+	for (grp = 0; grp < MAX_TGROUPS; grp++)
+		ha_tgroup_info[grp].node = -1;
+
+	if (!global.nbtgroups) {
+		global.nbtgroups = 1;
+#if defined(USE_THREAD) && defined(USE_CPU_AFFINITY) && defined(__linux__)
+		if (tgroups_auto)
+			global.nbtgroups = numa_map_tgroups();
+#endif
+	}
+
+	for (grp = 0; grp < global.nbtgroups; grp++) {
+		first = grp * global.nbthread / global.nbtgroups;
+		last  = (grp + 1) * global.nbthread / global.nbtgroups;
+
+		ha_tgroup_info[grp].base  = first;
+		ha_tgroup_info[grp].count = last - first;
+		ha_tgroup_info[grp].threads_mask = nbits(last) & ~nbits(first);
+
+		for (thr = first; thr < last; thr++) {
+			ha_thread_info[thr].tgid = grp;
+			ha_thread_info[thr].tg_mask = ha_tgroup_info[grp].threads_mask;
+		}
+	}
+	return 0;
+}
+
+/* config parser for global "thread-groups", accepts a number or "auto" */
+static int cfg_parse_thread_groups(char **args, int section_type, struct proxy *curpx,
+                                   struct proxy *defpx, const char *file, int line,
+                                   char **err)
+{
+	long nbtgroups;
+	char *errptr;
+
+	if (too_many_args(1, args, err, NULL))
+		return -1;
+
+	if (strcmp(args[1], "auto") == 0) {
+		tgroups_auto = 1;
+		global.nbtgroups = 0;
+		return 0;
+	}
+
+	nbtgroups = strtol(args[1], &errptr, 10);
+	if (!*args[1] || *errptr) {
+		memprintf(err, "'%s' passed a missing or unparsable integer value in '%s'", args[0], args[1]);
+		return -1;
+	}
+
+	if (nbtgroups < 1 || nbtgroups > MAX_TGROUPS) {
+		memprintf(err, "'%s' value must be between 1 and %d (was %ld)", args[0], MAX_TGROUPS, nbtgroups);
+		return -1;
+	}
+
+	tgroups_auto = 0;
+	global.nbtgroups = nbtgroups;
+	return 0;
+}
+
+/* config keyword parsers */
+static struct cfg_kw_list cfg_kws = {ILH, {
+	{ CFG_GLOBAL, "thread-groups", cfg_parse_thread_groups },
+	{ 0, NULL, NULL }
+}};
+
+INITCALL1(STG_REGISTER, cfg_register_keywords, &cfg_kws);
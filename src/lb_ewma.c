@@ -0,0 +1,325 @@
+/*
+ * Peak-EWMA load balancing algorithm.
+ *
+ * Each server's response time is tracked as an exponentially weighted moving
+ * average which immediately follows any higher measure (the "peak") and only
+ * decays towards lower ones as time passes. The cost of a server is this
+ * average multiplied by its number of outstanding requests plus one, divided
+ * by its weight. A few servers are drawn at random and the least costly one is
+ * picked, which is much cheaper than ordering all servers and avoids sending
+ * bursts to the same "best" server whose measures are not updated yet. This is
+ * the Power of Two Random Choices described here :
+ *
+ *    http://www.eecs.harvard.edu/~michaelm/postscripts/handbook2001.pdf
+ *
+ * Copyright 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ *
+ */
+
+#include <stdlib.h>
+
+#include <common/compat.h>
+#include <common/config.h>
+#include <common/debug.h>
+#include <common/time.h>
+
+#include <types/global.h>
+#include <types/server.h>
+
+#include <proto/backend.h>
+#include <proto/lb_ewma.h>
+#include <proto/queue.h>
+
+/* precision of the decay ratios */
+#define EWMA_RATIO_SHIFT 20
+#define EWMA_RATIO_ONE   (1U << EWMA_RATIO_SHIFT)
+
+/* outstanding requests above this are not distinguished */
+#define EWMA_MAX_LOAD    65535
+
+/* Returns the ratio in 1/EWMA_RATIO_ONE to apply to an average aged <elapsed>
+ * ms for a decay time of <decay> ms. 1/(1+x) is used as a cheap approximation
+ * of exp(-x). It decays slower over long periods but never reaches zero.
+ */
+static inline unsigned int ewma_ratio(int elapsed, unsigned int decay)
+{
+	if (elapsed <= 0)
+		return EWMA_RATIO_ONE;
+	return ((unsigned long long)decay << EWMA_RATIO_SHIFT) / ((unsigned long long)decay + elapsed);
+}
+
+/* Returns the cost of server <srv> for decay time <decay>. The average is
+ * decayed as if a null response time was measured now, so that a server which
+ * was slow once is tried again after a while if it doesn't receive traffic.
+ * One millisecond is added so that the outstanding requests always count.
+ */
+static inline unsigned long long ewma_cost(const struct server *srv, unsigned int decay)
+{
+	unsigned long long lat;
+	unsigned int load;
+
+	lat = ((unsigned long long)srv->ewma * ewma_ratio(now_ms - srv->ewma_date, decay)) >> EWMA_RATIO_SHIFT;
+	load = srv->served + srv->nbpend;
+	if (load > EWMA_MAX_LOAD)
+		load = EWMA_MAX_LOAD;
+	return ((lat + EWMA_ONE) * (load + 1) * BE_WEIGHT_SCALE) / (srv->cur_eweight ? srv->cur_eweight : 1);
+}
+
+/* Accounts a response time of <ms> milliseconds for server <srv>. Higher
+ * values replace the average, lower ones are merged into it depending on the
+ * time elapsed since the previous update. No lock is needed.
+ */
+static void ewma_server_response(struct server *srv, unsigned int ms)
+{
+	unsigned int decay = srv->proxy->lbprm.arg_opt2;
+	unsigned long long sample;
+	unsigned int old, new, ratio;
+
+	if (ms > EWMA_MAX_MS)
+		ms = EWMA_MAX_MS;
+	sample = (unsigned long long)ms << EWMA_SHIFT;
+	ratio = ewma_ratio(now_ms - srv->ewma_date, decay);
+
+	old = srv->ewma;
+	do {
+		new = sample;
+		if (sample < old)
+			new = ((unsigned long long)old * ratio + sample * (EWMA_RATIO_ONE - ratio) +
+			       EWMA_RATIO_ONE / 2) >> EWMA_RATIO_SHIFT;
+	} while (!_HA_ATOMIC_CAS(&srv->ewma, &old, new));
+	srv->ewma_date = now_ms;
+}
+
+/* Rebuilds the array of servers to pick from, made of all usable active
+ * servers, or of the usable backup servers when no active server is usable
+ * (only the first one unless "option allbackups" is set). The backend's
+ * weights are updated as well.
+ *
+ * The array is read without lock by ewma_get_next_server(). It is rewritten
+ * in place, which is fine since it never shrinks below the servers list's size
+ * and only ever contains valid server pointers : a concurrent reader may only
+ * see a mix of the old and new servers. The entries are written before the
+ * number of servers so that a reader never goes past the initialized ones.
+ *
+ * The lbprm's lock must be held.
+ */
+static void ewma_update_servers(struct proxy *p)
+{
+	struct server *srv;
+	int flag, nb = 0;
+
+	recount_servers(p);
+	update_backend_weight(p);
+
+	if (p->srv_act)
+		flag = 0;
+	else if (p->lbprm.fbck) {
+		p->lbprm.ewma.srv[nb++] = p->lbprm.fbck;
+		goto out;
+	}
+	else
+		flag = SRV_F_BACKUP;
+
+	for (srv = p->srv; srv; srv = srv->next) {
+		if ((srv->flags & SRV_F_BACKUP) == flag && srv_willbe_usable(srv))
+			p->lbprm.ewma.srv[nb++] = srv;
+	}
+ out:
+	__ha_barrier_store();
+	p->lbprm.ewma.nbsrv = nb;
+}
+
+/* This function updates the server array according to server <srv>'s new
+ * state. It should be called when server <srv>'s status changes to down.
+ *
+ * The server's lock must be held. The lbprm's lock will be used.
+ */
+static void ewma_set_server_status_down(struct server *srv)
+{
+	struct proxy *p = srv->proxy;
+
+	if (!srv_lb_status_changed(srv))
+		return;
+
+	if (srv_willbe_usable(srv))
+		goto out_update_state;
+
+	HA_SPIN_LOCK(LBPRM_LOCK, &p->lbprm.lock);
+	ewma_update_servers(p);
+	HA_SPIN_UNLOCK(LBPRM_LOCK, &p->lbprm.lock);
+ out_update_state:
+	srv_lb_commit_status(srv);
+}
+
+/* This function updates the server array according to server <srv>'s new
+ * state. It should be called when server <srv>'s status changes to up. The
+ * server's past measures are forgotten.
+ *
+ * The server's lock must be held. The lbprm's lock will be used.
+ */
+static void ewma_set_server_status_up(struct server *srv)
+{
+	struct proxy *p = srv->proxy;
+
+	if (!srv_lb_status_changed(srv))
+		return;
+
+	if (!srv_willbe_usable(srv))
+		goto out_update_state;
+
+	srv->ewma = 0;
+	srv->ewma_date = now_ms;
+
+	HA_SPIN_LOCK(LBPRM_LOCK, &p->lbprm.lock);
+	ewma_update_servers(p);
+	HA_SPIN_UNLOCK(LBPRM_LOCK, &p->lbprm.lock);
+ out_update_state:
+	srv_lb_commit_status(srv);
+}
+
+/* This function must be called after an update to server <srv>'s effective
+ * weight. It may be called after a state change too. The weight is read when
+ * computing the cost so only the backend's totals need to be updated.
+ *
+ * The server's lock must be held. The lbprm's lock will be used.
+ */
+static void ewma_update_server_weight(struct server *srv)
+{
+	int old_state, new_state;
+	struct proxy *p = srv->proxy;
+
+	if (!srv_lb_status_changed(srv))
+		return;
+
+	old_state = srv_currently_usable(srv);
+	new_state = srv_willbe_usable(srv);
+
+	if (!old_state && !new_state) {
+		srv_lb_commit_status(srv);
+		return;
+	}
+	else if (!old_state && new_state) {
+		ewma_set_server_status_up(srv);
+		return;
+	}
+	else if (old_state && !new_state) {
+		ewma_set_server_status_down(srv);
+		return;
+	}
+
+	HA_SPIN_LOCK(LBPRM_LOCK, &p->lbprm.lock);
+	ewma_update_servers(p);
+	HA_SPIN_UNLOCK(LBPRM_LOCK, &p->lbprm.lock);
+
+	srv_lb_commit_status(srv);
+}
+
+/* This function is responsible for building the server array for the
+ * Peak-EWMA algorithm. It also sets p->lbprm.wdiv to the eweight to uweight
+ * ratio. It should be called only once per proxy, at config time. It returns
+ * 0 if the array could not be allocated, otherwise non-zero.
+ */
+int ewma_init_server_array(struct proxy *p)
+{
+	struct server *srv;
+	int nb = 0;
+
+	p->lbprm.set_server_status_up   = ewma_set_server_status_up;
+	p->lbprm.set_server_status_down = ewma_set_server_status_down;
+	p->lbprm.update_server_eweight  = ewma_update_server_weight;
+	p->lbprm.server_response        = ewma_server_response;
+
+	p->lbprm.wdiv = BE_WEIGHT_SCALE;
+	for (srv = p->srv; srv; srv = srv->next) {
+		srv->next_eweight = (srv->uweight * p->lbprm.wdiv + p->lbprm.wmult - 1) / p->lbprm.wmult;
+		srv->ewma = 0;
+		srv->ewma_date = now_ms;
+		srv_lb_commit_status(srv);
+		nb++;
+	}
+
+	/* this is the largest array we will ever need for this servers list */
+	p->lbprm.ewma.srv = calloc(nb ? nb : 1, sizeof(struct server *));
+	if (!p->lbprm.ewma.srv)
+		return 0;
+	ewma_update_servers(p);
+	return 1;
+}
+
+/* Returns the least costly non-full server among <draws> distinct randomly
+ * picked ones, <draws> being taken from the proxy's LB arguments. If all of
+ * them were full or <srvtoavoid>, the other servers are checked, and as a last
+ * resort <srvtoavoid> is returned if it was not full. Otherwise NULL is
+ * returned so that the request is queued in the backend.
+ *
+ * No lock is used, the shared array is only read (see ewma_update_servers()).
+ * The distinct draws use Floyd's sampling algorithm, which picks <draws>
+ * positions out of <nbsrv> in exactly <draws> random draws without modifying
+ * the array.
+ */
+struct server *ewma_get_next_server(struct proxy *p, struct server *srvtoavoid)
+{
+	struct server *srv, *best, *avoided;
+	unsigned long long cost, best_cost;
+	unsigned int decay = p->lbprm.arg_opt2;
+	int drawn[EWMA_MAX_DRAWS];
+	int draws = p->lbprm.arg_opt1;
+	int nbsrv, i, j, k;
+
+	best = avoided = NULL;
+	best_cost = 0;
+
+	nbsrv = p->lbprm.ewma.nbsrv;
+	__ha_barrier_load();
+	if (draws > nbsrv)
+		draws = nbsrv;
+
+	for (i = 0; i < draws + nbsrv; i++) {
+		if (i < draws) {
+			/* Floyd: pick in [0..n] with n growing up to nbsrv-1,
+			 * and take n itself if the pick was already drawn.
+			 */
+			j = nbsrv - draws + i;
+			drawn[i] = ha_random() % (j + 1);
+			for (k = 0; k < i; k++) {
+				if (drawn[k] == drawn[i]) {
+					drawn[i] = j;
+					break;
+				}
+			}
+			srv = p->lbprm.ewma.srv[drawn[i]];
+		}
+		else if (best)
+			break;
+		else
+			srv = p->lbprm.ewma.srv[i - draws];
+
+		if (srv->maxconn && (srv->nbpend || srv->served >= srv_dynamic_maxconn(srv)))
+			continue;
+
+		if (srv == srvtoavoid) {
+			avoided = srv;
+			continue;
+		}
+
+		cost = ewma_cost(srv, decay);
+		if (!best || cost < best_cost) {
+			best = srv;
+			best_cost = cost;
+		}
+	}
+
+	return best ? best : avoided;
+}
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
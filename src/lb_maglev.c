@@ -0,0 +1,328 @@
+/*
+ * Maglev hashing load balancing.
+ *
+ * This is an alternative to the consistent hashing tree for hash-based
+ * algorithms ("hash-type maglev"). A fixed size lookup table is filled with
+ * the usable servers according to their preferences and weights, and a hash
+ * is mapped to a server with a single table access instead of a tree lookup.
+ * A server's preferences only depend on its ID, so that a change of state or
+ * of weight of one server only moves a small fraction of the slots. See
+ * include/common/maglev.h for the details.
+ *
+ * Lookups don't take any lock : the table is never modified once published.
+ * A change rebuilds a new table under the lbprm's lock and replaces the
+ * current one, which is released once no thread may use it anymore (see
+ * common/qsbr.h).
+ *
+ * Copyright 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ *
+ */
+
+#include <common/compat.h>
+#include <common/config.h>
+#include <common/debug.h>
+#include <common/maglev.h>
+#include <common/qsbr.h>
+#include <common/standard.h>
+
+#include <types/global.h>
+#include <types/server.h>
+
+#include <proto/backend.h>
+#include <proto/lb_chash.h>
+#include <proto/lb_maglev.h>
+#include <proto/queue.h>
+
+static void maglev_release_table(struct qsbr_node *node)
+{
+	free(container_of(node, struct lb_maglev_table, qsbr));
+}
+
+/* Recomputes the backend's weights and publishes a new lookup table filled
+ * with the usable servers of the group in use : the active servers, or the
+ * backup servers when no active server is usable (only the first one unless
+ * "option allbackups" is set). Other servers get a null weight, which keeps
+ * their preferences for when they come back. The previous table is released
+ * once no thread uses it anymore. If the new table cannot be allocated, the
+ * previous one is kept, and 0 is returned. Otherwise non-zero is returned.
+ *
+ * The lbprm's lock must be held.
+ */
+static int maglev_update_table(struct proxy *p)
+{
+	struct lb_maglev_table *table, *old;
+	struct server *srv;
+	int flag, i;
+
+	recount_servers(p);
+	update_backend_weight(p);
+
+	flag = p->srv_act ? 0 : SRV_F_BACKUP;
+	for (i = 0; i < p->lbprm.maglev.nbsrv; i++) {
+		srv = p->lbprm.maglev.srv[i];
+		p->lbprm.maglev.perm[i].weight = 0;
+		if (p->lbprm.fbck ? srv != p->lbprm.fbck : (srv->flags & SRV_F_BACKUP) != flag)
+			continue;
+		if (srv_willbe_usable(srv))
+			p->lbprm.maglev.perm[i].weight = srv->next_eweight;
+	}
+
+	table = malloc(sizeof(*table) + p->lbprm.maglev.size * sizeof(*table->slot));
+	if (!table)
+		return 0;
+
+	maglev_populate(table->slot, p->lbprm.maglev.size,
+	                p->lbprm.maglev.perm, p->lbprm.maglev.nbsrv);
+
+	old = p->lbprm.maglev.table;
+	__ha_barrier_store();
+	p->lbprm.maglev.table = table;
+	if (old)
+		qsbr_retire(&old->qsbr, maglev_release_table);
+	return 1;
+}
+
+/* This function updates the lookup table according to server <srv>'s new
+ * state. It should be called when server <srv>'s status changes to down.
+ *
+ * The server's lock must be held. The lbprm's lock will be used.
+ */
+static void maglev_set_server_status_down(struct server *srv)
+{
+	struct proxy *p = srv->proxy;
+
+	if (!srv_lb_status_changed(srv))
+		return;
+
+	if (srv_willbe_usable(srv))
+		goto out_update_state;
+
+	HA_SPIN_LOCK(LBPRM_LOCK, &p->lbprm.lock);
+	maglev_update_table(p);
+	HA_SPIN_UNLOCK(LBPRM_LOCK, &p->lbprm.lock);
+ out_update_state:
+	srv_lb_commit_status(srv);
+}
+
+/* This function updates the lookup table according to server <srv>'s new
+ * state. It should be called when server <srv>'s status changes to up.
+ *
+ * The server's lock must be held. The lbprm's lock will be used.
+ */
+static void maglev_set_server_status_up(struct server *srv)
+{
+	struct proxy *p = srv->proxy;
+
+	if (!srv_lb_status_changed(srv))
+		return;
+
+	if (!srv_willbe_usable(srv))
+		goto out_update_state;
+
+	HA_SPIN_LOCK(LBPRM_LOCK, &p->lbprm.lock);
+	maglev_update_table(p);
+	HA_SPIN_UNLOCK(LBPRM_LOCK, &p->lbprm.lock);
+ out_update_state:
+	srv_lb_commit_status(srv);
+}
+
+/* This function must be called after an update to server <srv>'s effective
+ * weight. It may be called after a state change too.
+ *
+ * The server's lock must be held. The lbprm's lock will be used.
+ */
+static void maglev_update_server_weight(struct server *srv)
+{
+	int old_state, new_state;
+	struct proxy *p = srv->proxy;
+
+	if (!srv_lb_status_changed(srv))
+		return;
+
+	old_state = srv_currently_usable(srv);
+	new_state = srv_willbe_usable(srv);
+
+	if (!old_state && !new_state) {
+		srv_lb_commit_status(srv);
+		return;
+	}
+	else if (!old_state && new_state) {
+		maglev_set_server_status_up(srv);
+		return;
+	}
+	else if (old_state && !new_state) {
+		maglev_set_server_status_down(srv);
+		return;
+	}
+
+	HA_SPIN_LOCK(LBPRM_LOCK, &p->lbprm.lock);
+	maglev_update_table(p);
+	HA_SPIN_UNLOCK(LBPRM_LOCK, &p->lbprm.lock);
+
+	srv_lb_commit_status(srv);
+}
+
+/* Returns the current lookup table of backend <p>. It remains valid until the
+ * calling thread goes back to its polling loop.
+ */
+static inline struct lb_maglev_table *maglev_table(const struct proxy *p)
+{
+	struct lb_maglev_table *table = *(struct lb_maglev_table * volatile *)&p->lbprm.maglev.table;
+
+	__ha_barrier_load();
+	return table;
+}
+
+/* Returns the server owning slot <slot> of lookup table <table> of proxy <p>,
+ * or NULL if the table is empty.
+ */
+static inline struct server *maglev_slot_server(const struct proxy *p, const struct lb_maglev_table *table,
+                                                unsigned int slot)
+{
+	int idx = table->slot[slot];
+
+	return idx == MAGLEV_EMPTY ? NULL : p->lbprm.maglev.srv[idx];
+}
+
+/* This function returns the running server owning the slot designated by
+ * <hash> in the lookup table. If this server is <avoid> or is not eligible
+ * due to "hash-balance-factor", the following slots are checked, just like the
+ * next nodes are checked with consistent hashing. If no valid server is found,
+ * NULL is returned.
+ *
+ * No lock is used.
+ */
+struct server *maglev_get_server_hash(struct proxy *p, unsigned int hash, const struct server *avoid)
+{
+	const struct lb_maglev_table *table;
+	struct server *srv;
+	unsigned int slot, loop;
+
+	if (!p->lbprm.tot_used)
+		return NULL;
+
+	table = maglev_table(p);
+	slot = hash % p->lbprm.maglev.size;
+	srv = maglev_slot_server(p, table, slot);
+	if (!srv || p->lbprm.tot_used == 1)
+		return srv;
+
+	for (loop = 1; loop < p->lbprm.maglev.size; loop++) {
+		if (srv != avoid && (!p->lbprm.hash_balance_factor || chash_server_is_eligible(srv)))
+			break;
+		if (++slot == p->lbprm.maglev.size)
+			slot = 0;
+		srv = maglev_slot_server(p, table, slot);
+	}
+
+	return srv;
+}
+
+/* Returns the next server from the lookup table of backend <p> in round robin
+ * order, which respects the weights. This is used when the hashing key is not
+ * found. Saturated servers are skipped, and <srvtoavoid> is only returned if
+ * no other server is available. If the table is empty, NULL is returned.
+ *
+ * No lock is used. The round robin position is shared by all threads and
+ * updated without any atomic operation, which at worst makes concurrent picks
+ * start from the same slot.
+ */
+struct server *maglev_get_next_server(struct proxy *p, struct server *srvtoavoid)
+{
+	const struct lb_maglev_table *table;
+	struct server *srv, *avoided;
+	unsigned int slot, stop;
+
+	avoided = NULL;
+
+	if (!p->lbprm.tot_used)
+		goto out;
+
+	table = maglev_table(p);
+	slot = stop = p->lbprm.maglev.rr_idx;
+	if (slot >= p->lbprm.maglev.size)
+		slot = stop = 0;
+
+	do {
+		srv = maglev_slot_server(p, table, slot);
+		if (++slot == p->lbprm.maglev.size)
+			slot = 0;
+
+		if (!srv)
+			break;
+
+		if (!srv->maxconn || (!srv->nbpend && srv->served < srv_dynamic_maxconn(srv))) {
+			if (srv != srvtoavoid) {
+				p->lbprm.maglev.rr_idx = slot;
+				avoided = srv;
+				goto out;
+			}
+			/* remember it in case it's the only one */
+			avoided = srv;
+		}
+	} while (slot != stop);
+
+ out:
+	return avoided;
+}
+
+/* This function is responsible for building the lookup table for Maglev
+ * hashing, and allocates the servers' preferences. It also sets
+ * p->lbprm.wdiv to the eweight to uweight ratio. It should be called only
+ * once per proxy, at config time. It returns 0 if an allocation failed,
+ * otherwise non-zero.
+ */
+int maglev_init_server_table(struct proxy *p)
+{
+	struct server *srv;
+	unsigned int h;
+	int nb;
+
+	p->lbprm.set_server_status_up   = maglev_set_server_status_up;
+	p->lbprm.set_server_status_down = maglev_set_server_status_down;
+	p->lbprm.update_server_eweight  = maglev_update_server_weight;
+	p->lbprm.server_take_conn = NULL;
+	p->lbprm.server_drop_conn = NULL;
+
+	p->lbprm.wdiv = BE_WEIGHT_SCALE;
+	nb = 0;
+	for (srv = p->srv; srv; srv = srv->next) {
+		srv->next_eweight = (srv->uweight * p->lbprm.wdiv + p->lbprm.wmult - 1) / p->lbprm.wmult;
+		srv_lb_commit_status(srv);
+		nb++;
+	}
+
+	p->lbprm.maglev.size = maglev_size(nb ? nb : 1);
+	p->lbprm.maglev.nbsrv = nb;
+	p->lbprm.maglev.rr_idx = 0;
+	p->lbprm.maglev.table = NULL;
+	p->lbprm.maglev.srv = calloc(nb ? nb : 1, sizeof(*p->lbprm.maglev.srv));
+	p->lbprm.maglev.perm = calloc(nb ? nb : 1, sizeof(*p->lbprm.maglev.perm));
+	if (!p->lbprm.maglev.srv || !p->lbprm.maglev.perm)
+		return 0;
+
+	/* the preferences only depend on the server's ID so that they are the
+	 * same after a reload.
+	 */
+	nb = 0;
+	for (srv = p->srv; srv; srv = srv->next) {
+		h = full_hash(srv->puid);
+		p->lbprm.maglev.srv[nb] = srv;
+		maglev_perm_init(&p->lbprm.maglev.perm[nb], p->lbprm.maglev.size, h, full_hash(h));
+		nb++;
+	}
+
+	return maglev_update_table(p);
+}
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
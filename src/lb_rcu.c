@@ -0,0 +1,433 @@
+/*
+ * Lock-free roundrobin and leastconn load balancing algorithms.
+ *
+ * With "option lb-lockfree", the usable servers of the group in use and a
+ * weighted round robin schedule of them are stored in an array which is never
+ * modified : a new one is built and published under the lbprm's lock when a
+ * server changes, and the old one is released once all threads went through
+ * their polling loop (see common/qsbr.h). Picking a server thus doesn't take
+ * any lock nor writes to any shared location :
+ *   - roundrobin : each thread walks over the schedule with its own cursor,
+ *     starting at a different place, so that the global distribution follows
+ *     the weights just as with a single cursor ;
+ *   - leastconn : the servers' connection counts are read without lock. The
+ *     least loaded one is picked among all of them in small farms, otherwise
+ *     among two randomly drawn ones (the power of two random choices), which
+ *     approaches leastconn's distribution without scanning the whole farm.
+ *
+ * Copyright 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ *
+ */
+
+#include <stdlib.h>
+
+#include <common/compat.h>
+#include <common/config.h>
+#include <common/debug.h>
+#include <common/qsbr.h>
+#include <common/standard.h>
+
+#include <types/global.h>
+#include <types/server.h>
+
+#include <proto/backend.h>
+#include <proto/lb_rcu.h>
+#include <proto/queue.h>
+
+/* above this number of servers, leastconn compares two random servers only */
+#define RCU_LC_SCAN_MAX   8
+
+/* maximum number of entries in the round robin schedule, weights are scaled
+ * down if needed.
+ */
+#define RCU_SCHED_MAX     16384
+
+/* a schedule entry being sorted */
+struct rcu_entry {
+	unsigned long long key;   /* position of the entry in [0..1[ << 32 */
+	int idx;                  /* server's index in the array */
+};
+
+static THREAD_LOCAL unsigned int rcu_rnd_state;
+
+/* per-thread xorshift, random() takes a lock */
+static inline unsigned int rcu_rnd()
+{
+	unsigned int x = rcu_rnd_state;
+
+	if (!x)
+		x = (tid + 1) * 2654435761U ^ now_ms ^ 0x5bd1e995;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	rcu_rnd_state = x;
+	return x;
+}
+
+static int rcu_entry_cmp(const void *a, const void *b)
+{
+	const struct rcu_entry *ea = a, *eb = b;
+
+	if (ea->key != eb->key)
+		return ea->key < eb->key ? -1 : 1;
+	return ea->idx - eb->idx;
+}
+
+static void rcu_release_array(struct qsbr_node *node)
+{
+	free(container_of(node, struct lb_rcu_array, qsbr));
+}
+
+/* Returns a new array made of all usable active servers, or of the usable
+ * backup servers when no active server is usable (only the first one unless
+ * "option allbackups" is set), and of their round robin schedule, or NULL if
+ * out of memory. Each server appears in the schedule proportionally to its
+ * weight, and its entries are evenly spread.
+ *
+ * The lbprm's lock must be held.
+ */
+static struct lb_rcu_array *rcu_build_array(struct proxy *p)
+{
+	struct lb_rcu_array *arr = NULL;
+	struct rcu_entry *ent = NULL;
+	struct server *srv;
+	unsigned long long tot;
+	unsigned int div, w, k, size;
+	int flag, nb, i;
+
+	nb = 0;
+	for (srv = p->srv; srv; srv = srv->next)
+		nb++;
+
+	/* the largest schedule we may build */
+	ent = calloc(MAX(nb, RCU_SCHED_MAX) + nb, sizeof(*ent));
+	arr = calloc(1, sizeof(*arr) + (nb + MAX(nb, RCU_SCHED_MAX) + nb) * sizeof(*arr->srv));
+	if (!ent || !arr)
+		goto fail;
+
+	nb = 0;
+	if (p->srv_act)
+		flag = 0;
+	else if (p->lbprm.fbck) {
+		arr->srv[nb++] = p->lbprm.fbck;
+		goto built;
+	}
+	else
+		flag = SRV_F_BACKUP;
+
+	for (srv = p->srv; srv; srv = srv->next) {
+		if ((srv->flags & SRV_F_BACKUP) == flag && srv_willbe_usable(srv))
+			arr->srv[nb++] = srv;
+	}
+ built:
+	arr->nbsrv = nb;
+	arr->sched = arr->srv + nb;
+
+	/* reduce the weights by their GCD, and scale them down if the
+	 * schedule would be too large.
+	 */
+	div = 0;
+	tot = 0;
+	for (i = 0; i < nb; i++) {
+		unsigned int a = div, b = arr->srv[i]->next_eweight;
+
+		while (b) {
+			unsigned int t = a % b;
+			a = b;
+			b = t;
+		}
+		div = a;
+		tot += arr->srv[i]->next_eweight;
+	}
+
+	size = 0;
+	for (i = 0; i < nb; i++) {
+		w = arr->srv[i]->next_eweight / div;
+		if (tot / div > MAX(nb, RCU_SCHED_MAX))
+			w = MAX(1, (unsigned long long)arr->srv[i]->next_eweight * RCU_SCHED_MAX / tot);
+
+		for (k = 0; k < w; k++) {
+			ent[size].key = ((2ULL * k + 1) << 32) / (2ULL * w);
+			ent[size].idx = i;
+			size++;
+		}
+	}
+
+	qsort(ent, size, sizeof(*ent), rcu_entry_cmp);
+	for (k = 0; k < size; k++)
+		arr->sched[k] = arr->srv[ent[k].idx];
+	arr->size = size;
+
+	free(ent);
+	return arr;
+ fail:
+	free(ent);
+	free(arr);
+	return NULL;
+}
+
+/* Recomputes the backend's weights and publishes a new array of servers. The
+ * previous array is released once no thread uses it anymore. If the new array
+ * cannot be allocated, the previous one is kept.
+ *
+ * The lbprm's lock must be held.
+ */
+static void rcu_update_array(struct proxy *p)
+{
+	struct lb_rcu_array *arr, *old;
+
+	recount_servers(p);
+	update_backend_weight(p);
+
+	arr = rcu_build_array(p);
+	if (!arr)
+		return;
+
+	old = p->lbprm.rcu.arr;
+	__ha_barrier_store();
+	p->lbprm.rcu.arr = arr;
+	if (old)
+		qsbr_retire(&old->qsbr, rcu_release_array);
+}
+
+/* This function updates the server array according to server <srv>'s new
+ * state. It should be called when server <srv>'s status changes to down.
+ *
+ * The server's lock must be held. The lbprm's lock will be used.
+ */
+static void rcu_set_server_status_down(struct server *srv)
+{
+	struct proxy *p = srv->proxy;
+
+	if (!srv_lb_status_changed(srv))
+		return;
+
+	if (srv_willbe_usable(srv))
+		goto out_update_state;
+
+	HA_SPIN_LOCK(LBPRM_LOCK, &p->lbprm.lock);
+	rcu_update_array(p);
+	HA_SPIN_UNLOCK(LBPRM_LOCK, &p->lbprm.lock);
+ out_update_state:
+	srv_lb_commit_status(srv);
+}
+
+/* This function updates the server array according to server <srv>'s new
+ * state. It should be called when server <srv>'s status changes to up.
+ *
+ * The server's lock must be held. The lbprm's lock will be used.
+ */
+static void rcu_set_server_status_up(struct server *srv)
+{
+	struct proxy *p = srv->proxy;
+
+	if (!srv_lb_status_changed(srv))
+		return;
+
+	if (!srv_willbe_usable(srv))
+		goto out_update_state;
+
+	HA_SPIN_LOCK(LBPRM_LOCK, &p->lbprm.lock);
+	rcu_update_array(p);
+	HA_SPIN_UNLOCK(LBPRM_LOCK, &p->lbprm.lock);
+ out_update_state:
+	srv_lb_commit_status(srv);
+}
+
+/* This function must be called after an update to server <srv>'s effective
+ * weight. It may be called after a state change too.
+ *
+ * The server's lock must be held. The lbprm's lock will be used.
+ */
+static void rcu_update_server_weight(struct server *srv)
+{
+	int old_state, new_state;
+	struct proxy *p = srv->proxy;
+
+	if (!srv_lb_status_changed(srv))
+		return;
+
+	old_state = srv_currently_usable(srv);
+	new_state = srv_willbe_usable(srv);
+
+	if (!old_state && !new_state) {
+		srv_lb_commit_status(srv);
+		return;
+	}
+	else if (!old_state && new_state) {
+		rcu_set_server_status_up(srv);
+		return;
+	}
+	else if (old_state && !new_state) {
+		rcu_set_server_status_down(srv);
+		return;
+	}
+
+	HA_SPIN_LOCK(LBPRM_LOCK, &p->lbprm.lock);
+	rcu_update_array(p);
+	HA_SPIN_UNLOCK(LBPRM_LOCK, &p->lbprm.lock);
+
+	srv_lb_commit_status(srv);
+}
+
+/* Returns non-zero if server <srv> cannot accept a new connection */
+static inline int rcu_srv_full(const struct server *srv)
+{
+	return srv->maxconn && (srv->nbpend || srv->served >= srv_dynamic_maxconn(srv));
+}
+
+/* Returns the current array of backend <p>. It remains valid until the
+ * calling thread goes back to its polling loop.
+ */
+static inline struct lb_rcu_array *rcu_array(const struct proxy *p)
+{
+	struct lb_rcu_array *arr = *(struct lb_rcu_array * volatile *)&p->lbprm.rcu.arr;
+
+	__ha_barrier_load();
+	return arr;
+}
+
+/* Returns the next non-full server of the round robin schedule of backend <p>
+ * for the current thread. <srvtoavoid> is only returned if no other server is
+ * available. NULL is returned if all servers are full so that the request is
+ * queued in the backend.
+ *
+ * No lock is used.
+ */
+struct server *rcu_get_next_server_rr(struct proxy *p, struct server *srvtoavoid)
+{
+	struct lb_rcu_array *arr = rcu_array(p);
+	struct lb_rcu_cursor *cur = &p->lbprm.rcu.cursor[tid];
+	struct server *srv, *avoided = NULL;
+	unsigned int start, n;
+
+	if (!arr->size)
+		return NULL;
+
+	/* threads start at evenly spread places */
+	start = cur->pos + (unsigned long long)tid * arr->size / global.nbthread;
+
+	for (n = 0; n < arr->size; n++) {
+		srv = arr->sched[(start + n) % arr->size];
+		if (rcu_srv_full(srv))
+			continue;
+
+		if (srv != srvtoavoid) {
+			cur->pos += n + 1;
+			return srv;
+		}
+		avoided = srv;
+	}
+
+	cur->pos++;
+	return avoided;
+}
+
+/* Returns the server of backend <p> with the lowest number of connections
+ * relative to its weight, among all servers in small farms and among two
+ * random ones otherwise. Full servers are skipped, and if both random ones are
+ * full or are <srvtoavoid>, all servers are checked. <srvtoavoid> is only
+ * returned if no other server is available. NULL is returned if all servers
+ * are full so that the request is queued in the backend.
+ *
+ * No lock is used.
+ */
+struct server *rcu_get_next_server_lc(struct proxy *p, struct server *srvtoavoid)
+{
+	struct lb_rcu_array *arr = rcu_array(p);
+	struct lb_rcu_cursor *cur = &p->lbprm.rcu.cursor[tid];
+	struct server *srv, *best = NULL, *avoided = NULL;
+	unsigned int key, best_key = 0;
+	int nb = arr->nbsrv;
+	int i, n, draws, start, step;
+
+	if (!nb)
+		return NULL;
+
+	if (nb <= RCU_LC_SCAN_MAX) {
+		/* rotate the starting point so that equally loaded servers
+		 * are used in turn.
+		 */
+		draws = nb;
+		start = cur->pos++ % nb;
+		step = 1;
+	}
+	else {
+		draws = 2;
+		start = rcu_rnd() % nb;
+		step = 1 + rcu_rnd() % (nb - 1);
+	}
+
+	for (n = 0, i = start; n < nb; n++) {
+		if (n == draws) {
+			if (best)
+				break;
+			/* both were unusable, check all the others */
+			step = 1;
+		}
+
+		srv = arr->srv[i];
+		i += step;
+		if (i >= nb)
+			i -= nb;
+
+		if (rcu_srv_full(srv))
+			continue;
+
+		if (srv == srvtoavoid) {
+			avoided = srv;
+			continue;
+		}
+
+		key = srv->served ? (srv->served + 1) * SRV_EWGHT_MAX / (srv->cur_eweight ? srv->cur_eweight : 1) : 0;
+		if (!best || key < best_key) {
+			best = srv;
+			best_key = key;
+		}
+	}
+
+	return best ? best : avoided;
+}
+
+/* This function is responsible for building the server array and allocating
+ * the per-thread cursors for the lock-free algorithms. It also sets
+ * p->lbprm.wdiv to the eweight to uweight ratio. It should be called only once
+ * per proxy, at config time. It returns 0 if out of memory, otherwise 1.
+ */
+int rcu_init_server_array(struct proxy *p)
+{
+	struct server *srv;
+
+	p->lbprm.set_server_status_up   = rcu_set_server_status_up;
+	p->lbprm.set_server_status_down = rcu_set_server_status_down;
+	p->lbprm.update_server_eweight  = rcu_update_server_weight;
+	p->lbprm.server_take_conn = NULL;
+	p->lbprm.server_drop_conn = NULL;
+
+	p->lbprm.wdiv = BE_WEIGHT_SCALE;
+	for (srv = p->srv; srv; srv = srv->next) {
+		srv->next_eweight = (srv->uweight * p->lbprm.wdiv + p->lbprm.wmult - 1) / p->lbprm.wmult;
+		srv_lb_commit_status(srv);
+	}
+
+	recount_servers(p);
+	update_backend_weight(p);
+
+	p->lbprm.rcu.cursor = calloc(global.nbthread, sizeof(*p->lbprm.rcu.cursor));
+	p->lbprm.rcu.arr = rcu_build_array(p);
+	if (!p->lbprm.rcu.cursor || !p->lbprm.rcu.arr)
+		return 0;
+	return 1;
+}
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
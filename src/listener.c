@@ -715,6 +715,12 @@ void listener_accept(int fd)
 			max_accept = max;
 	}
 #endif
+	if (!(l->options & LI_O_UNLIMITED) && mem_pressure_shed_at(MEM_PRESSURE_ACCEPT)) {
+		/* too much memory in use, stop accepting for a while */
+		expire = tick_add(now_ms, 100);
+		goto limit_global;
+	}
+
 	if (p && p->fe_sps_lim) {
 		int max = freq_ctr_remain(&p->fe_sess_per_sec, p->fe_sps_lim, 0);
 
@@ -897,6 +903,14 @@ void listener_accept(int fd)
 
 #if defined(USE_THREAD)
 		mask = thread_mask(l->bind_conf->bind_thread) & all_threads_mask;
+
+		/* keep the connection within the current thread group when it
+		 * is allowed to run there, so that its memory and tasks remain
+		 * local to the group.
+		 */
+		if (mask & ti->tg_mask)
+			mask &= ti->tg_mask;
+
 		if (atleast2(mask) && (global.tune.options & GTUNE_LISTENER_MQ)) {
 			struct accept_queue_ring *ring;
 			unsigned int t, t0, t1, t2;
@@ -1191,6 +1205,12 @@ static struct task *manage_global_listener_queue(struct task *t, void *context,
 	if (unlikely(actconn >= global.maxconn))
 		goto out;
 
+	/* Under memory pressure, listeners are only retried once in a while */
+	if (unlikely(mem_pressure >= MEM_PRESSURE_ACCEPT)) {
+		t->expire = tick_add(now_ms, 100);
+		return t;
+	}
+
 	/* We should periodically try to enable listeners waiting for a global
 	 * resource here, because it is possible, though very unlikely, that
 	 * they have been blocked by a temporary lack of global resource such
@@ -10,6 +10,7 @@
  *
  */
 #include <errno.h>
+#include <sys/mman.h>
 
 #include <types/applet.h>
 #include <types/cli.h>
@@ -33,6 +34,7 @@
 #include <proto/log.h>
 #include <proto/stream_interface.h>
 #include <proto/stats.h>
+#include <proto/task.h>
 
 /* These are the most common pools, expected to be initialized first. These
  * ones are allocated from an array, allowing to map them to an index.
@@ -49,11 +51,391 @@ THREAD_LOCAL size_t pool_cache_count = 0;                /* #cache objects   */
 static struct list pools = LIST_HEAD_INIT(pools);
 int mem_poison_byte = -1;
 
+/* Memory budget in megabytes (0=none), current pressure level, and number of
+ * times each level's action was applied. The watermarks are expressed in
+ * percent of the budget and indexed by pressure level.
+ */
+unsigned int mem_budget = 0;
+unsigned int mem_pressure = MEM_PRESSURE_NONE;
+unsigned int mem_pressure_shed[MEM_PRESSURE_LEVELS] = { };
+static unsigned int mem_watermark[MEM_PRESSURE_LEVELS] = { 0, 75, 85, 90, 95 };
+static struct task *mem_pressure_task = NULL;
+
 #ifdef DEBUG_FAIL_ALLOC
 static int mem_fail_rate = 0;
 static int mem_should_fail(const struct pool_head *);
 #endif
 
+/* Slab back-end for pools, enabled by "tune.memory.slab". Objects of pools
+ * using it are carved from 2MB arenas dedicated to a size class, possibly
+ * backed by huge pages, instead of being individually allocated by malloc().
+ * Arenas are aligned on their size so that the arena of any object is found by
+ * masking its address. Each thread keeps a small magazine of free objects per
+ * class in front of the arenas so that the class lock is only taken once every
+ * few operations. Arenas which become empty are returned to the system, except
+ * a few per class which are kept to absorb oscillations. These ones are also
+ * released by pool_gc() under memory pressure, which also asks all threads to
+ * flush their magazines since these may pin otherwise empty arenas.
+ */
+#define SLAB_ARENA_SIZE   (2UL * 1024 * 1024)
+#define SLAB_MAX_OBJ      (SLAB_ARENA_SIZE / 8)  /* larger objects use malloc() */
+#define SLAB_SMALL_STEP   32                      /* class step for small objects */
+#define SLAB_SMALL_MAX    512                     /* linear classes up to this size */
+#define SLAB_NB_CLASSES   (SLAB_SMALL_MAX / SLAB_SMALL_STEP + 4 * 9) /* then 4 per power of two */
+#define SLAB_MAG_SIZE     16                      /* objects per thread magazine */
+#define SLAB_KEEP_EMPTY   1                       /* empty arenas kept per class */
+
+/* values for slab_mode */
+#define SLAB_MODE_OFF     0  /* pools use malloc() */
+#define SLAB_MODE_ON      1  /* 2MB arenas, transparent huge pages when possible */
+#define SLAB_MODE_HUGETLB 2  /* same, but try the hugetlb pool first */
+
+struct slab_arena {
+	struct list list;          /* in the class' partial or empty list, detached when full */
+	struct slab_class *class;  /* class this arena belongs to */
+	void *free;                /* singly-linked list of free objects */
+	char *next;                /* first object never allocated yet */
+	char *end;                 /* end of the usable area */
+	unsigned int used;         /* objects currently allocated from this arena */
+	unsigned int hugetlb;      /* non-zero if mapped from the hugetlb pool */
+};
+
+struct slab_class {
+	__decl_hathreads(HA_SPINLOCK_T lock);
+	unsigned int size;         /* object size in this class */
+	unsigned int arenas;       /* number of arenas */
+	unsigned int empty;        /* number of empty arenas */
+	unsigned int used;         /* objects allocated from arenas, including magazines */
+	struct list partial;       /* arenas having free objects */
+	struct list empty_list;    /* arenas having no allocated object */
+};
+
+struct slab_mag {
+	unsigned int count;        /* number of objects in the magazine */
+	void *obj[SLAB_MAG_SIZE];  /* free objects */
+};
+
+static struct slab_class slab_classes[SLAB_NB_CLASSES];
+static struct slab_mag slab_mags[MAX_THREADS][SLAB_NB_CLASSES];
+static struct tasklet *slab_flush_tl[MAX_THREADS]; /* per-thread tasklets flushing the magazines */
+static int slab_mode = SLAB_MODE_OFF;
+static int slab_ready = 0; /* set once pools may be attached to classes */
+
+/* Returns the slab class for objects of size <size>, or NULL if the object is
+ * too large to be allocated from an arena.
+ */
+static struct slab_class *slab_get_class(size_t size)
+{
+	unsigned int k, idx;
+
+	if (size > SLAB_MAX_OBJ)
+		return NULL;
+
+	if (size <= SLAB_SMALL_MAX)
+		idx = (size + SLAB_SMALL_STEP - 1) / SLAB_SMALL_STEP - 1;
+	else {
+		/* size is in ]2^k, 2^(k+1)], split into 4 steps of 2^(k-2) */
+		k = my_flsl(size - 1) - 1;
+		idx = SLAB_SMALL_MAX / SLAB_SMALL_STEP + (k - 9) * 4 +
+		      (size - (1UL << k) + (1UL << (k - 2)) - 1) / (1UL << (k - 2)) - 1;
+	}
+	return &slab_classes[idx];
+}
+
+/* Maps a new arena for class <class> and returns it, or NULL if the system
+ * has no more memory. The arena is not attached to any list.
+ */
+static struct slab_arena *slab_arena_new(struct slab_class *class)
+{
+	struct slab_arena *arena;
+	char *area = MAP_FAILED;
+	size_t ofs;
+	int hugetlb = 0;
+
+#ifdef MAP_HUGETLB
+	if (slab_mode == SLAB_MODE_HUGETLB) {
+		/* huge pages are naturally aligned on their size */
+		area = mmap(NULL, SLAB_ARENA_SIZE, PROT_READ|PROT_WRITE,
+		            MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB, -1, 0);
+		hugetlb = (area != MAP_FAILED);
+	}
+#endif
+	if (area == MAP_FAILED) {
+		/* map twice the size and trim it to get an aligned arena */
+		area = mmap(NULL, 2 * SLAB_ARENA_SIZE, PROT_READ|PROT_WRITE,
+		            MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+		if (area == MAP_FAILED)
+			return NULL;
+
+		ofs = -(uintptr_t)area & (SLAB_ARENA_SIZE - 1);
+		if (ofs)
+			munmap(area, ofs);
+		munmap(area + ofs + SLAB_ARENA_SIZE, SLAB_ARENA_SIZE - ofs);
+		area += ofs;
+#ifdef MADV_HUGEPAGE
+		madvise(area, SLAB_ARENA_SIZE, MADV_HUGEPAGE);
+#endif
+	}
+
+	arena = (struct slab_arena *)area;
+	LIST_INIT(&arena->list);
+	arena->class   = class;
+	arena->free    = NULL;
+	arena->next    = area + ((sizeof(*arena) + 63) & -64);
+	arena->end     = area + SLAB_ARENA_SIZE;
+	arena->used    = 0;
+	arena->hugetlb = hugetlb;
+	return arena;
+}
+
+/* Returns the arenas attached to list <list> to the system */
+static void slab_release_arenas(struct list *list)
+{
+	struct slab_arena *arena, *back;
+
+	list_for_each_entry_safe(arena, back, list, list) {
+		LIST_DEL(&arena->list);
+		munmap(arena, SLAB_ARENA_SIZE);
+	}
+}
+
+/* Takes one object from the arenas of class <class>, or returns NULL if none
+ * is available. The class must be locked.
+ */
+static void *__slab_get_obj(struct slab_class *class)
+{
+	struct slab_arena *arena;
+	void *obj;
+
+	if (LIST_ISEMPTY(&class->partial)) {
+		if (LIST_ISEMPTY(&class->empty_list))
+			return NULL;
+		arena = LIST_NEXT(&class->empty_list, struct slab_arena *, list);
+		LIST_DEL(&arena->list);
+		LIST_ADD(&class->partial, &arena->list);
+		class->empty--;
+	}
+
+	arena = LIST_NEXT(&class->partial, struct slab_arena *, list);
+	if (arena->free) {
+		obj = arena->free;
+		arena->free = *(void **)obj;
+	}
+	else {
+		obj = arena->next;
+		arena->next += class->size;
+	}
+	arena->used++;
+	class->used++;
+
+	/* full arenas are detached until one of their objects is released */
+	if (!arena->free && arena->next + class->size > arena->end)
+		LIST_DEL_INIT(&arena->list);
+	return obj;
+}
+
+/* Returns object <obj> to its arena in class <class>. If the arena becomes
+ * empty and enough empty arenas are already kept, it is moved to list
+ * <release> so that the caller returns it to the system once the lock is
+ * released. The class must be locked.
+ */
+static void __slab_put_obj(struct slab_class *class, void *obj, struct list *release)
+{
+	struct slab_arena *arena;
+
+	arena = (struct slab_arena *)((uintptr_t)obj & ~(SLAB_ARENA_SIZE - 1));
+	if (!arena->free && arena->next + class->size > arena->end)
+		LIST_ADD(&class->partial, &arena->list);
+
+	*(void **)obj = arena->free;
+	arena->free = obj;
+	arena->used--;
+	class->used--;
+
+	if (!arena->used) {
+		LIST_DEL(&arena->list);
+		if (class->empty < SLAB_KEEP_EMPTY) {
+			LIST_ADD(&class->empty_list, &arena->list);
+			class->empty++;
+		}
+		else {
+			LIST_ADD(release, &arena->list);
+			class->arenas--;
+		}
+	}
+}
+
+/* Allocates an object from class <class>, from the thread's magazine when
+ * possible, otherwise by refilling half of the magazine from the arenas, and
+ * by mapping a new arena if none has any object left. Returns NULL if the
+ * system has no more memory.
+ */
+static void *slab_alloc(struct slab_class *class)
+{
+	struct slab_mag *mag = &slab_mags[tid][class - slab_classes];
+	struct slab_arena *arena = NULL;
+	void *obj;
+
+	if (likely(mag->count))
+		return mag->obj[--mag->count];
+
+	while (1) {
+		HA_SPIN_LOCK(POOL_LOCK, &class->lock);
+		if (arena) {
+			LIST_ADD(&class->partial, &arena->list);
+			class->arenas++;
+		}
+		while (mag->count < SLAB_MAG_SIZE / 2 && (obj = __slab_get_obj(class)) != NULL)
+			mag->obj[mag->count++] = obj;
+		HA_SPIN_UNLOCK(POOL_LOCK, &class->lock);
+
+		if (mag->count)
+			return mag->obj[--mag->count];
+
+		/* no more objects, map a new arena out of the lock */
+		arena = slab_arena_new(class);
+		if (!arena)
+			return NULL;
+	}
+}
+
+/* Releases object <obj> to class <class>, into the thread's magazine when
+ * possible, otherwise half of the magazine is returned to the arenas.
+ */
+static void slab_free(struct slab_class *class, void *obj)
+{
+	struct slab_mag *mag = &slab_mags[tid][class - slab_classes];
+	struct list release = LIST_HEAD_INIT(release);
+
+	if (likely(mag->count < SLAB_MAG_SIZE)) {
+		mag->obj[mag->count++] = obj;
+		return;
+	}
+
+	HA_SPIN_LOCK(POOL_LOCK, &class->lock);
+	__slab_put_obj(class, obj, &release);
+	while (mag->count > SLAB_MAG_SIZE / 2)
+		__slab_put_obj(class, mag->obj[--mag->count], &release);
+	HA_SPIN_UNLOCK(POOL_LOCK, &class->lock);
+	slab_release_arenas(&release);
+}
+
+/* Flushes the current thread's magazines and returns all empty arenas to the
+ * system.
+ */
+static void slab_flush()
+{
+	struct list release = LIST_HEAD_INIT(release);
+	struct slab_class *class;
+	struct slab_arena *arena;
+	struct slab_mag *mag;
+
+	for (class = slab_classes; class < slab_classes + SLAB_NB_CLASSES; class++) {
+		mag = &slab_mags[tid][class - slab_classes];
+		if (!class->arenas)
+			continue;
+
+		HA_SPIN_LOCK(POOL_LOCK, &class->lock);
+		while (mag->count)
+			__slab_put_obj(class, mag->obj[--mag->count], &release);
+
+		while (!LIST_ISEMPTY(&class->empty_list)) {
+			arena = LIST_NEXT(&class->empty_list, struct slab_arena *, list);
+			LIST_DEL(&arena->list);
+			LIST_ADD(&release, &arena->list);
+			class->empty--;
+			class->arenas--;
+		}
+		HA_SPIN_UNLOCK(POOL_LOCK, &class->lock);
+	}
+	slab_release_arenas(&release);
+}
+
+/* Tasklet flushing the magazines of the thread it runs on, see slab_gc() */
+static struct task *slab_flush_io(struct task *t, void *context, unsigned short state)
+{
+	slab_flush();
+	return NULL;
+}
+
+/* Flushes the current thread's magazines and returns all empty arenas to the
+ * system. The magazines are only accessed by their own thread, so the other
+ * threads are asked to flush theirs by waking their flush tasklet up. The
+ * arenas pinned by their objects are thus released shortly after, once these
+ * threads get back to their scheduler. This is used under memory pressure.
+ */
+static void slab_gc()
+{
+	int thr;
+
+	if (!slab_ready)
+		return;
+
+	slab_flush();
+	for (thr = 0; thr < global.nbthread; thr++) {
+		if (thr != tid && slab_flush_tl[thr])
+			tasklet_wakeup(slab_flush_tl[thr]);
+	}
+}
+
+/* Allocates the current thread's tasklet used to flush its magazines */
+static int slab_alloc_flush_tasklet()
+{
+	struct tasklet *tl;
+
+	if (slab_mode == SLAB_MODE_OFF)
+		return 1;
+
+	tl = tasklet_new();
+	if (!tl)
+		return 0;
+
+	tl->process = slab_flush_io;
+	tl->context = NULL;
+	tasklet_set_tid(tl, tid);
+	slab_flush_tl[tid] = tl;
+	return 1;
+}
+
+static void slab_free_flush_tasklet()
+{
+	if (slab_flush_tl[tid])
+		tasklet_free(slab_flush_tl[tid]);
+	slab_flush_tl[tid] = NULL;
+}
+
+REGISTER_PER_THREAD_ALLOC(slab_alloc_flush_tasklet);
+REGISTER_PER_THREAD_FREE(slab_free_flush_tasklet);
+
+/* Allocates the storage for a new object of pool <pool>, either from its slab
+ * class or from the system. Returns NULL on failure.
+ */
+static inline void *pool_alloc_obj(struct pool_head *pool)
+{
+	if (pool->slab)
+		return slab_alloc(pool->slab);
+#ifdef CONFIG_HAP_LOCKLESS_POOLS
+	return malloc(pool->size + POOL_EXTRA);
+#else
+	return pool_alloc_area(pool->size + POOL_EXTRA);
+#endif
+}
+
+/* Releases the storage of object <ptr> from pool <pool> to where it was
+ * allocated from.
+ */
+static inline void pool_free_obj(struct pool_head *pool, void *ptr)
+{
+	if (pool->slab)
+		slab_free(pool->slab, ptr);
+	else
+#ifdef CONFIG_HAP_LOCKLESS_POOLS
+		free(ptr);
+#else
+		pool_free_area(ptr, pool->size + POOL_EXTRA);
+#endif
+}
+
 /* Try to find an existing shared pool with the same characteristics and
  * returns it, otherwise creates this one. NULL is returned if no memory
  * is available for a new creation. Two flags are supported :
@@ -131,6 +513,8 @@ struct pool_head *create_pool(char *name, unsigned int size, unsigned int flags)
 			strlcpy2(pool->name, name, sizeof(pool->name));
 		pool->size = size;
 		pool->flags = flags;
+		if (slab_ready)
+			pool->slab = slab_get_class(size + POOL_EXTRA);
 		LIST_ADDQ(start, &pool->list);
 
 		/* update per-thread pool cache if necessary */
@@ -158,9 +542,9 @@ struct pool_head *create_pool(char *name, unsigned int size, unsigned int flags)
  */
 void *__pool_refill_alloc(struct pool_head *pool, unsigned int avail)
 {
+	struct pool_tg_free_list *fl = &pool->free_lists[ti->tgid];
 	void *ptr = NULL, **free_list;
 	int failed = 0;
-	int size = pool->size;
 	int limit = pool->limit;
 	int allocated = pool->allocated, allocated_orig = allocated;
 
@@ -174,7 +558,7 @@ void *__pool_refill_alloc(struct pool_head *pool, unsigned int avail)
 			return NULL;
 		}
 
-		ptr = malloc(size + POOL_EXTRA);
+		ptr = pool_alloc_obj(pool);
 		if (!ptr) {
 			_HA_ATOMIC_ADD(&pool->failed, 1);
 			if (failed) {
@@ -188,11 +572,11 @@ void *__pool_refill_alloc(struct pool_head *pool, unsigned int avail)
 		if (++allocated > avail)
 			break;
 
-		free_list = pool->free_list;
+		free_list = fl->free_list;
 		do {
 			*POOL_LINK(pool, ptr) = free_list;
 			__ha_barrier_store();
-		} while (_HA_ATOMIC_CAS(&pool->free_list, &free_list, ptr) == 0);
+		} while (_HA_ATOMIC_CAS(&fl->free_list, &free_list, ptr) == 0);
 	}
 	__ha_barrier_atomic_store();
 
@@ -213,26 +597,32 @@ void *pool_refill_alloc(struct pool_head *pool, unsigned int avail)
 	return ptr;
 }
 /*
- * This function frees whatever can be freed in pool <pool>.
+ * This function frees whatever can be freed in pool <pool>, from the free
+ * lists of all thread groups.
  */
 void pool_flush(struct pool_head *pool)
 {
 	void **next, *temp;
 	int removed = 0;
+	int grp;
 
 	if (!pool)
 		return;
-	do {
-		next = pool->free_list;
-	} while (!_HA_ATOMIC_CAS(&pool->free_list, &next, NULL));
-	__ha_barrier_atomic_store();
-	while (next) {
-		temp = next;
-		next = *POOL_LINK(pool, temp);
-		removed++;
-		free(temp);
+
+	for (grp = 0; grp < MAX_TGROUPS; grp++) {
+		struct pool_tg_free_list *fl = &pool->free_lists[grp];
+
+		do {
+			next = fl->free_list;
+		} while (!_HA_ATOMIC_CAS(&fl->free_list, &next, NULL));
+		__ha_barrier_atomic_store();
+		while (next) {
+			temp = next;
+			next = *POOL_LINK(pool, temp);
+			removed++;
+			pool_free_obj(pool, temp);
+		}
 	}
-	pool->free_list = next;
 	_HA_ATOMIC_SUB(&pool->allocated, removed);
 	/* here, we should have pool->allocate == pool->used */
 }
@@ -254,24 +644,31 @@ void pool_gc(struct pool_head *pool_ctx)
 		return;
 
 	list_for_each_entry(entry, &pools, list) {
-		while ((int)((volatile int)entry->allocated - (volatile int)entry->used) > (int)entry->minavail) {
-			struct pool_free_list cmp, new;
-
-			cmp.seq = entry->seq;
-			__ha_barrier_load();
-			cmp.free_list = entry->free_list;
-			__ha_barrier_load();
-			if (cmp.free_list == NULL)
-				break;
-			new.free_list = *POOL_LINK(entry, cmp.free_list);
-			new.seq = cmp.seq + 1;
-			if (HA_ATOMIC_DWCAS(&entry->free_list, &cmp, &new) == 0)
-				continue;
-			free(cmp.free_list);
-			_HA_ATOMIC_SUB(&entry->allocated, 1);
+		int grp;
+
+		for (grp = 0; grp < MAX_TGROUPS; grp++) {
+			struct pool_tg_free_list *fl = &entry->free_lists[grp];
+
+			while ((int)((volatile int)entry->allocated - (volatile int)entry->used) > (int)entry->minavail) {
+				struct pool_free_list cmp, new;
+
+				cmp.seq = fl->seq;
+				__ha_barrier_load();
+				cmp.free_list = fl->free_list;
+				__ha_barrier_load();
+				if (cmp.free_list == NULL)
+					break;
+				new.free_list = *POOL_LINK(entry, cmp.free_list);
+				new.seq = cmp.seq + 1;
+				if (HA_ATOMIC_DWCAS(&fl->free_list, &cmp, &new) == 0)
+					continue;
+				pool_free_obj(entry, cmp.free_list);
+				_HA_ATOMIC_SUB(&entry->allocated, 1);
+			}
 		}
 	}
 
+	slab_gc();
 	_HA_ATOMIC_STORE(&recurse, 0);
 }
 
@@ -336,7 +733,7 @@ void *__pool_refill_alloc(struct pool_head *pool, unsigned int avail)
 		}
 
 		HA_SPIN_UNLOCK(POOL_LOCK, &pool->lock);
-		ptr = pool_alloc_area(pool->size + POOL_EXTRA);
+		ptr = pool_alloc_obj(pool);
 #ifdef DEBUG_MEMORY_POOLS
 		/* keep track of where the element was allocated from. This
 		 * is done out of the lock so that the system really allocates
@@ -394,7 +791,7 @@ void pool_flush(struct pool_head *pool)
 		pool->free_list = *POOL_LINK(pool, temp);
 		pool->allocated--;
 		HA_SPIN_UNLOCK(POOL_LOCK, &pool->lock);
-		pool_free_area(temp, pool->size + POOL_EXTRA);
+		pool_free_obj(pool, temp);
 	}
 	/* here, we should have pool->allocated == pool->used */
 }
@@ -430,7 +827,7 @@ void pool_gc(struct pool_head *pool_ctx)
 			entry->allocated--;
 			if (entry != pool_ctx)
 				HA_SPIN_UNLOCK(POOL_LOCK, &entry->lock);
-			pool_free_area(temp, entry->size + POOL_EXTRA);
+			pool_free_obj(entry, temp);
 			if (entry != pool_ctx)
 				HA_SPIN_LOCK(POOL_LOCK, &entry->lock);
 		}
@@ -439,6 +836,7 @@ void pool_gc(struct pool_head *pool_ctx)
 			HA_SPIN_UNLOCK(POOL_LOCK, &entry->lock);
 	}
 
+	slab_gc();
 	_HA_ATOMIC_STORE(&recurse, 0);
 }
 #endif
@@ -484,6 +882,7 @@ void pool_destroy_all()
 void dump_pools_to_trash()
 {
 	struct pool_head *entry;
+	struct slab_class *class;
 	unsigned long allocated, used;
 	int nbpools;
 
@@ -493,11 +892,12 @@ void dump_pools_to_trash()
 #ifndef CONFIG_HAP_LOCKLESS_POOLS
 		HA_SPIN_LOCK(POOL_LOCK, &entry->lock);
 #endif
-		chunk_appendf(&trash, "  - Pool %s (%d bytes) : %d allocated (%u bytes), %d used, %d failures, %d users, @%p=%02d%s\n",
+		chunk_appendf(&trash, "  - Pool %s (%d bytes) : %d allocated (%u bytes), %d used, %d failures, %d users, @%p=%02d%s%s\n",
 			 entry->name, entry->size, entry->allocated,
 		         entry->size * entry->allocated, entry->used, entry->failed,
 			 entry->users, entry, (int)pool_get_index(entry),
-			 (entry->flags & MEM_F_SHARED) ? " [SHARED]" : "");
+			 (entry->flags & MEM_F_SHARED) ? " [SHARED]" : "",
+			 entry->slab ? " [SLAB]" : "");
 
 		allocated += entry->allocated * entry->size;
 		used += entry->used * entry->size;
@@ -508,6 +908,14 @@ void dump_pools_to_trash()
 	}
 	chunk_appendf(&trash, "Total: %d pools, %lu bytes allocated, %lu used.\n",
 		 nbpools, allocated, used);
+
+	for (class = slab_classes; slab_ready && class < slab_classes + SLAB_NB_CLASSES; class++) {
+		if (!class->arenas)
+			continue;
+		chunk_appendf(&trash, "  - Slab class %u bytes : %u arenas (%lu bytes), %u empty, %u objects used\n",
+			      class->size, class->arenas, class->arenas * SLAB_ARENA_SIZE,
+			      class->empty, class->used);
+	}
 }
 
 /* Dump statistics on pools usage. */
@@ -592,10 +1000,115 @@ static void init_pools()
 		}
 		LIST_INIT(&pool_lru_head[thr]);
 	}
+
+	for (idx = 0; idx < SLAB_NB_CLASSES; idx++) {
+		struct slab_class *class = &slab_classes[idx];
+
+		if (idx < SLAB_SMALL_MAX / SLAB_SMALL_STEP)
+			class->size = (idx + 1) * SLAB_SMALL_STEP;
+		else {
+			thr = idx - SLAB_SMALL_MAX / SLAB_SMALL_STEP;
+			class->size = (SLAB_SMALL_MAX << (thr / 4)) * (4 + thr % 4 + 1) / 4;
+		}
+		HA_SPIN_INIT(&class->lock);
+		LIST_INIT(&class->partial);
+		LIST_INIT(&class->empty_list);
+	}
 }
 
 INITCALL0(STG_PREPARE, init_pools);
 
+/* Attaches the pools which did not allocate anything yet to their slab class
+ * once the configuration is known, and makes pools created later use it as
+ * well. Pools which already hold objects keep using malloc().
+ */
+static int pool_slab_init()
+{
+	struct pool_head *entry;
+
+	if (slab_mode == SLAB_MODE_OFF)
+		return 0;
+
+	list_for_each_entry(entry, &pools, list) {
+		if (!entry->allocated)
+			entry->slab = slab_get_class(entry->size + POOL_EXTRA);
+	}
+	slab_ready = 1;
+	return 0;
+}
+
+REGISTER_CONFIG_POSTPARSER("memory slabs", pool_slab_init);
+
+/* Periodically compares the memory used by the pools to the configured
+ * budget and updates the memory pressure level accordingly. The level rises
+ * as soon as a watermark is crossed but only drops once the usage is 2% of the
+ * budget below the watermark, in order not to flap around it.
+ */
+static struct task *mem_pressure_update(struct task *t, void *context, unsigned short state)
+{
+	unsigned long long used = pool_total_used();
+	unsigned long long budget = (unsigned long long)mem_budget * 1048576ULL;
+	unsigned int level, old = mem_pressure;
+
+	for (level = MEM_PRESSURE_LEVELS - 1; level > MEM_PRESSURE_NONE; level--) {
+		unsigned int pct = mem_watermark[level];
+
+		if (level <= old && pct >= 2)
+			pct -= 2;
+		if (used * 100 >= budget * pct)
+			break;
+	}
+
+	if (level != old) {
+		mem_pressure = level;
+		send_log(NULL, level > old ? LOG_WARNING : LOG_NOTICE,
+		         "Memory pressure level changed from %u to %u (%llu/%u MB used).\n",
+		         old, level, used / 1048576ULL, mem_budget);
+	}
+
+	t->expire = tick_add(now_ms, MS_TO_TICKS(100));
+	return t;
+}
+
+/* Starts the memory pressure task when a memory budget is set. The budget
+ * defaults to the per-process memory limit set with "-m" if any.
+ */
+static int mem_pressure_init()
+{
+	int i;
+
+	if (!mem_budget)
+		mem_budget = global.rlimit_memmax;
+	if (!mem_budget)
+		return 0;
+
+	for (i = MEM_PRESSURE_NONE + 2; i < MEM_PRESSURE_LEVELS; i++) {
+		if (mem_watermark[i] < mem_watermark[i - 1]) {
+			ha_alert("tune.memory.watermarks: watermarks must be in ascending order.\n");
+			return ERR_ALERT | ERR_FATAL;
+		}
+	}
+
+	mem_pressure_task = task_new(MAX_THREADS_MASK);
+	if (!mem_pressure_task) {
+		ha_alert("Out of memory while initializing the memory pressure task.\n");
+		return ERR_ALERT | ERR_FATAL;
+	}
+	mem_pressure_task->process = mem_pressure_update;
+	mem_pressure_task->context = NULL;
+	task_wakeup(mem_pressure_task, TASK_WOKEN_INIT);
+	return 0;
+}
+
+static void mem_pressure_deinit()
+{
+	task_destroy(mem_pressure_task);
+	mem_pressure_task = NULL;
+}
+
+REGISTER_CONFIG_POSTPARSER("memory pressure", mem_pressure_init);
+REGISTER_POST_DEINIT(mem_pressure_deinit);
+
 /* register cli keywords */
 static struct cli_kw_list cli_kws = {{ },{
 	{ { "show", "pools",  NULL }, "show pools     : report information about the memory pools usage", NULL, cli_io_handler_dump_pools },
@@ -658,11 +1171,85 @@ static int mem_parse_global_fail_alloc(char **args, int section_type, struct pro
 }
 #endif
 
+/* config parser for global "tune.memory.slab" */
+static int mem_parse_global_slab(char **args, int section_type, struct proxy *curpx,
+                                 struct proxy *defpx, const char *file, int line,
+                                 char **err)
+{
+	if (too_many_args(1, args, err, NULL))
+		return -1;
+
+	if (strcmp(args[1], "off") == 0)
+		slab_mode = SLAB_MODE_OFF;
+	else if (strcmp(args[1], "on") == 0)
+		slab_mode = SLAB_MODE_ON;
+	else if (strcmp(args[1], "hugetlb") == 0)
+		slab_mode = SLAB_MODE_HUGETLB;
+	else {
+		memprintf(err, "'%s' expects 'on', 'off' or 'hugetlb'.", args[0]);
+		return -1;
+	}
+#ifdef DEBUG_UAF
+	if (slab_mode != SLAB_MODE_OFF) {
+		memprintf(err, "'%s' is not supported when built with DEBUG_UAF, ignoring.", args[0]);
+		slab_mode = SLAB_MODE_OFF;
+		return 1;
+	}
+#endif
+	return 0;
+}
+
+/* config parser for global "tune.memory.budget" */
+static int mem_parse_global_budget(char **args, int section_type, struct proxy *curpx,
+                                   struct proxy *defpx, const char *file, int line,
+                                   char **err)
+{
+	char *stop;
+
+	if (too_many_args(1, args, err, NULL))
+		return -1;
+
+	mem_budget = strtoul(args[1], &stop, 10);
+	if (!*args[1] || *stop) {
+		memprintf(err, "'%s' expects a size in megabytes.", args[0]);
+		return -1;
+	}
+	return 0;
+}
+
+/* config parser for global "tune.memory.watermarks" */
+static int mem_parse_global_watermarks(char **args, int section_type, struct proxy *curpx,
+                                       struct proxy *defpx, const char *file, int line,
+                                       char **err)
+{
+	int i;
+
+	if (too_many_args(MEM_PRESSURE_LEVELS - 1, args, err, NULL))
+		return -1;
+
+	for (i = MEM_PRESSURE_NONE + 1; i < MEM_PRESSURE_LEVELS; i++) {
+		char *stop;
+		unsigned long pct;
+
+		pct = strtoul(args[i], &stop, 10);
+		if (!*args[i] || *stop || pct > 100) {
+			memprintf(err, "'%s' expects %d percentages of the memory budget.",
+			          args[0], MEM_PRESSURE_LEVELS - 1);
+			return -1;
+		}
+		mem_watermark[i] = pct;
+	}
+	return 0;
+}
+
 /* register global config keywords */
 static struct cfg_kw_list mem_cfg_kws = {ILH, {
 #ifdef DEBUG_FAIL_ALLOC
 	{ CFG_GLOBAL, "tune.fail-alloc", mem_parse_global_fail_alloc },
 #endif
+	{ CFG_GLOBAL, "tune.memory.budget", mem_parse_global_budget },
+	{ CFG_GLOBAL, "tune.memory.slab", mem_parse_global_slab },
+	{ CFG_GLOBAL, "tune.memory.watermarks", mem_parse_global_watermarks },
 	{ 0, NULL, NULL }
 }};
 
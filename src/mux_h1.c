@@ -45,6 +45,7 @@
 #define H1C_F_IN_ALLOC       0x00000010 /* mux is blocked on lack of input buffer */
 #define H1C_F_IN_FULL        0x00000020 /* mux is blocked on input buffer full */
 #define H1C_F_IN_BUSY        0x00000040 /* mux is blocked on input waiting the other side */
+#define H1C_F_IN_UPGRADE     0x00000080 /* mux is waiting for a large buffer to upgrade its full small one */
 /* 0x00000040 - 0x00000800 unused */
 
 /* Flags indicating the connection state */
@@ -386,7 +387,7 @@ static int h1_buf_available(void *target)
 {
 	struct h1c *h1c = target;
 
-	if ((h1c->flags & H1C_F_IN_ALLOC) && b_alloc_margin(&h1c->ibuf, 0)) {
+	if ((h1c->flags & H1C_F_IN_ALLOC) && b_alloc_small_margin(&h1c->ibuf, 0)) {
 		TRACE_STATE("unblocking h1c, ibuf allocated", H1_EV_H1C_RECV|H1_EV_H1C_BLK|H1_EV_H1C_WAKE, h1c->conn);
 		h1c->flags &= ~H1C_F_IN_ALLOC;
 		if (h1_recv_allowed(h1c))
@@ -394,6 +395,15 @@ static int h1_buf_available(void *target)
 		return 1;
 	}
 
+	if ((h1c->flags & H1C_F_IN_UPGRADE) &&
+	    (!b_is_small(&h1c->ibuf) || b_upgrade(&h1c->ibuf))) {
+		TRACE_STATE("unblocking h1c, ibuf upgraded", H1_EV_H1C_RECV|H1_EV_H1C_BLK|H1_EV_H1C_WAKE, h1c->conn);
+		h1c->flags &= ~(H1C_F_IN_UPGRADE|H1C_F_IN_FULL);
+		if (h1_recv_allowed(h1c))
+			tasklet_wakeup(h1c->wait_event.tasklet);
+		return 1;
+	}
+
 	if ((h1c->flags & H1C_F_OUT_ALLOC) && b_alloc_margin(&h1c->obuf, 0)) {
 		TRACE_STATE("unblocking h1s, obuf allocated", H1_EV_TX_DATA|H1_EV_H1S_BLK|H1_EV_STRM_WAKE, h1c->conn, h1c->h1s);
 		h1c->flags &= ~H1C_F_OUT_ALLOC;
@@ -406,15 +416,32 @@ static int h1_buf_available(void *target)
 	return 0;
 }
 
+/* Returns non-zero if <h1c> is a frontend connection sitting between two
+ * requests, i.e. either without any H1 stream or with a new stream created
+ * for the next request which did not receive anything yet. Such connections
+ * are not supposed to hold any buffer.
+ */
+static inline int h1c_is_idle_front(const struct h1c *h1c)
+{
+	const struct h1s *h1s = h1c->h1s;
+
+	if (conn_is_back(h1c->conn) || b_data(&h1c->ibuf))
+		return 0;
+	if (!h1s)
+		return !!(h1c->flags & H1C_F_CS_IDLE);
+	return (h1s->flags & H1S_F_NOT_FIRST) && h1s->req.state == H1_MSG_RQBEFORE;
+}
+
 /*
- * Allocate a buffer. If if fails, it adds the mux in buffer wait queue.
+ * Allocate a buffer. If if fails, it adds the mux in buffer wait queue. The
+ * input buffer starts as a small buffer if possible, it is upgraded once full.
  */
 static inline struct buffer *h1_get_buf(struct h1c *h1c, struct buffer *bptr)
 {
 	struct buffer *buf = NULL;
 
 	if (likely(LIST_ISEMPTY(&h1c->buf_wait.list)) &&
-	    unlikely((buf = b_alloc_margin(bptr, 0)) == NULL)) {
+	    unlikely((buf = (bptr == &h1c->ibuf ? b_alloc_small_margin(bptr, 0) : b_alloc_margin(bptr, 0))) == NULL)) {
 		h1c->buf_wait.target = h1c;
 		h1c->buf_wait.wakeup_cb = h1_buf_available;
 		HA_SPIN_LOCK(BUF_WQ_LOCK, &buffer_wq_lock);
@@ -425,6 +452,28 @@ static inline struct buffer *h1_get_buf(struct h1c *h1c, struct buffer *bptr)
 	return buf;
 }
 
+/*
+ * Upgrade the full small input buffer to a large one. If it fails, it adds the
+ * mux in buffer wait queue so that the upgrade is retried once a buffer is
+ * released. Returns non-zero on success.
+ */
+static int h1_upgrade_ibuf(struct h1c *h1c)
+{
+	if (b_upgrade(&h1c->ibuf))
+		return 1;
+
+	h1c->flags |= H1C_F_IN_UPGRADE;
+	if (LIST_ISEMPTY(&h1c->buf_wait.list)) {
+		h1c->buf_wait.target = h1c;
+		h1c->buf_wait.wakeup_cb = h1_buf_available;
+		HA_SPIN_LOCK(BUF_WQ_LOCK, &buffer_wq_lock);
+		LIST_ADDQ(&buffer_wq, &h1c->buf_wait.list);
+		HA_SPIN_UNLOCK(BUF_WQ_LOCK, &buffer_wq_lock);
+	}
+	TRACE_STATE("waiting for h1c ibuf upgrade", H1_EV_H1C_RECV|H1_EV_H1C_BLK, h1c->conn);
+	return 0;
+}
+
 /*
  * Release a buffer, if any, and try to wake up entities waiting in the buffer
  * wait queue.
@@ -432,6 +481,10 @@ static inline struct buffer *h1_get_buf(struct h1c *h1c, struct buffer *bptr)
 static inline void h1_release_buf(struct h1c *h1c, struct buffer *bptr)
 {
 	if (bptr->size) {
+		if (h1c_is_idle_front(h1c)) {
+			activity[tid].buf_idle_rel++;
+			activity[tid].buf_idle_kb += bptr->size >> 10;
+		}
 		b_free(bptr);
 		offer_buffers(h1c->buf_wait.target, tasks_run_queue);
 	}
@@ -1473,8 +1526,13 @@ static size_t h1_process_input(struct h1c *h1c, struct buffer *buf, size_t count
   end:
 	htx_to_buf(htx, buf);
 	ret = htx->data - data;
-	if ((h1c->flags & H1C_F_IN_FULL) && buf_room_for_htx_data(&h1c->ibuf)) {
-		h1c->flags &= ~H1C_F_IN_FULL;
+	/* a full small input buffer is upgraded to a large one so that larger
+	 * messages may still be received. If no large buffer is available, the
+	 * upgrade is retried from h1_buf_available().
+	 */
+	if ((h1c->flags & H1C_F_IN_FULL) &&
+	    (buf_room_for_htx_data(&h1c->ibuf) || (b_is_small(&h1c->ibuf) && h1_upgrade_ibuf(h1c)))) {
+		h1c->flags &= ~(H1C_F_IN_FULL|H1C_F_IN_UPGRADE);
 		TRACE_STATE("h1c ibuf not full anymore", H1_EV_RX_DATA|H1_EV_H1C_BLK|H1_EV_H1C_WAKE);
 		tasklet_wakeup(h1c->wait_event.tasklet);
 	}
@@ -1992,6 +2050,20 @@ static int h1_recv(struct h1c *h1c)
 		goto end;
 	}
 
+	/* An idle frontend connection waiting for its next request does not
+	 * get an input buffer until the poller reports it as readable. This
+	 * only works for the raw transport, whose readiness is the FD's one.
+	 */
+	if (!b_size(&h1c->ibuf) && conn->xprt == xprt_get(XPRT_RAW) &&
+	    conn_ctrl_ready(conn) && !fd_recv_ready(conn->handle.fd) &&
+	    h1c_is_idle_front(h1c)) {
+		activity[tid].buf_idle_skip++;
+		activity[tid].buf_idle_kb += (global.tune.bufsize_small ? global.tune.bufsize_small : global.tune.bufsize) >> 10;
+		TRACE_STATE("idle connection not readable, subscribing without a buffer", H1_EV_H1C_RECV, h1c->conn);
+		conn->xprt->subscribe(conn, conn->xprt_ctx, SUB_RETRY_RECV, &h1c->wait_event);
+		goto end;
+	}
+
 	if (!h1_get_buf(h1c, &h1c->ibuf)) {
 		h1c->flags |= H1C_F_IN_ALLOC;
 		TRACE_STATE("waiting for h1c ibuf allocation", H1_EV_H1C_RECV|H1_EV_H1C_BLK, h1c->conn);
@@ -58,6 +58,7 @@ static const struct h2s *h2_idle_stream;
 #define H2_CF_DEM_SFULL         0x00000080  // demux blocked on stream request buffer full
 #define H2_CF_DEM_TOOMANY       0x00000100  // demux blocked waiting for some conn_streams to leave
 #define H2_CF_DEM_BLOCK_ANY     0x000001F0  // aggregate of the demux flags above except DALLOC/DFULL
+#define H2_CF_DEM_DUPGRADE      0x00000200  // demux waiting for a large buffer to upgrade its full small one
 
 /* other flags */
 #define H2_CF_GOAWAY_SENT       0x00001000  // a GOAWAY frame was successfully sent
@@ -651,12 +652,19 @@ static int h2_buf_available(void *target)
 	struct h2c *h2c = target;
 	struct h2s *h2s;
 
-	if ((h2c->flags & H2_CF_DEM_DALLOC) && b_alloc_margin(&h2c->dbuf, 0)) {
+	if ((h2c->flags & H2_CF_DEM_DALLOC) && b_alloc_small_margin(&h2c->dbuf, 0)) {
 		h2c->flags &= ~H2_CF_DEM_DALLOC;
 		h2c_restart_reading(h2c, 1);
 		return 1;
 	}
 
+	if ((h2c->flags & H2_CF_DEM_DUPGRADE) &&
+	    (!b_is_small(&h2c->dbuf) || b_upgrade(&h2c->dbuf))) {
+		h2c->flags &= ~(H2_CF_DEM_DUPGRADE|H2_CF_DEM_DFULL);
+		h2c_restart_reading(h2c, 1);
+		return 1;
+	}
+
 	if ((h2c->flags & H2_CF_MUX_MALLOC) && b_alloc_margin(br_tail(h2c->mbuf), 0)) {
 		h2c->flags &= ~H2_CF_MUX_MALLOC;
 
@@ -694,9 +702,63 @@ static inline struct buffer *h2_get_buf(struct h2c *h2c, struct buffer *bptr)
 	return buf;
 }
 
+/* Same as h2_get_buf() but preferably allocates a small buffer. This is only
+ * used for the demux buffer, which is upgraded to a large one once full.
+ */
+static inline struct buffer *h2_get_small_buf(struct h2c *h2c, struct buffer *bptr)
+{
+	struct buffer *buf = NULL;
+
+	if (likely(!LIST_ADDED(&h2c->buf_wait.list)) &&
+	    unlikely((buf = b_alloc_small_margin(bptr, 0)) == NULL)) {
+		h2c->buf_wait.target = h2c;
+		h2c->buf_wait.wakeup_cb = h2_buf_available;
+		HA_SPIN_LOCK(BUF_WQ_LOCK, &buffer_wq_lock);
+		LIST_ADDQ(&buffer_wq, &h2c->buf_wait.list);
+		HA_SPIN_UNLOCK(BUF_WQ_LOCK, &buffer_wq_lock);
+		__conn_xprt_stop_recv(h2c->conn);
+	}
+	return buf;
+}
+
+/* Upgrades the full small demux buffer to a large one. If it fails, it adds the
+ * mux in buffer wait queue so that the upgrade is retried once a buffer is
+ * released. Returns non-zero on success.
+ */
+static int h2_upgrade_dbuf(struct h2c *h2c)
+{
+	if (b_upgrade(&h2c->dbuf))
+		return 1;
+
+	h2c->flags |= H2_CF_DEM_DUPGRADE;
+	if (!LIST_ADDED(&h2c->buf_wait.list)) {
+		h2c->buf_wait.target = h2c;
+		h2c->buf_wait.wakeup_cb = h2_buf_available;
+		HA_SPIN_LOCK(BUF_WQ_LOCK, &buffer_wq_lock);
+		LIST_ADDQ(&buffer_wq, &h2c->buf_wait.list);
+		HA_SPIN_UNLOCK(BUF_WQ_LOCK, &buffer_wq_lock);
+	}
+	return 0;
+}
+
+/* Returns non-zero if <h2c> is a frontend connection past its preface which
+ * has no stream and nothing pending in its demux buffer.
+ */
+static inline int h2c_is_idle_front(const struct h2c *h2c)
+{
+	return !(h2c->flags & H2_CF_IS_BACK) &&
+	       h2c->st0 >= H2_CS_FRAME_H && h2c->st0 < H2_CS_ERROR &&
+	       eb_is_empty(&h2c->streams_by_id) &&
+	       !b_data(&h2c->dbuf);
+}
+
 static inline void h2_release_buf(struct h2c *h2c, struct buffer *bptr)
 {
 	if (bptr->size) {
+		if (bptr == &h2c->dbuf && h2c_is_idle_front(h2c)) {
+			activity[tid].buf_idle_rel++;
+			activity[tid].buf_idle_kb += bptr->size >> 10;
+		}
 		b_free(bptr);
 		offer_buffers(NULL, tasks_run_queue);
 	}
@@ -1366,6 +1428,12 @@ static struct h2s *h2c_frt_stream_new(struct h2c *h2c, int id)
 	if (h2c->nb_streams >= h2_settings_max_concurrent_streams)
 		goto out;
 
+	/* under memory pressure, new streams are refused so that the client
+	 * may retry them later or elsewhere.
+	 */
+	if (mem_pressure_shed_at(MEM_PRESSURE_H2))
+		goto out;
+
 	h2s = h2s_new(h2c, id);
 	if (!h2s)
 		goto out;
@@ -3243,6 +3311,15 @@ static void h2_process_demux(struct h2c *h2c)
 		h2c_unblock_sfctl(h2c);
 	}
 
+	/* a full small demux buffer is upgraded to a large one so that frames
+	 * larger than the small buffer may be received. If no large buffer is
+	 * available, the upgrade is retried from h2_buf_available().
+	 */
+	if (b_is_small(&h2c->dbuf) && b_full(&h2c->dbuf) && h2_upgrade_dbuf(h2c)) {
+		TRACE_STATE("demux buffer upgraded", H2_EV_H2C_RECV|H2_EV_H2C_BLK, h2c->conn);
+		h2c->flags &= ~(H2_CF_DEM_DFULL|H2_CF_DEM_DUPGRADE);
+	}
+
 	h2c_restart_reading(h2c, 0);
  out:
 	TRACE_LEAVE(H2_EV_H2C_WAKE, h2c->conn);
@@ -3372,7 +3449,22 @@ static int h2_recv(struct h2c *h2c)
 		return 1;
 	}
 
-	buf = h2_get_buf(h2c, &h2c->dbuf);
+	/* An idle frontend connection does not get a demux buffer until the
+	 * poller reports it as readable. This only works for the raw
+	 * transport, whose readiness is the FD's one.
+	 */
+	if (!b_size(&h2c->dbuf) && conn->xprt == xprt_get(XPRT_RAW) &&
+	    conn_ctrl_ready(conn) && !fd_recv_ready(conn->handle.fd) &&
+	    h2c_is_idle_front(h2c)) {
+		activity[tid].buf_idle_skip++;
+		activity[tid].buf_idle_kb += (global.tune.bufsize_small ? global.tune.bufsize_small : global.tune.bufsize) >> 10;
+		TRACE_DEVEL("idle connection not readable, subscribing without a buffer", H2_EV_H2C_RECV, h2c->conn);
+		conn->xprt->subscribe(conn, conn->xprt_ctx, SUB_RETRY_RECV, &h2c->wait_event);
+		TRACE_LEAVE(H2_EV_H2C_RECV, h2c->conn);
+		return (conn->flags & CO_FL_ERROR || conn_xprt_read0_pending(conn));
+	}
+
+	buf = h2_get_small_buf(h2c, &h2c->dbuf);
 	if (!buf) {
 		h2c->flags |= H2_CF_DEM_DALLOC;
 		TRACE_DEVEL("leaving on !alloc", H2_EV_H2C_RECV, h2c->conn);
@@ -4452,8 +4544,8 @@ next_frame:
 		b_sub(&h2c->dbuf, hole);
 	}
 
-	if (b_full(&h2c->dbuf) && h2c->dfl >= b_data(&h2c->dbuf)) {
-		/* too large frames */
+	if (b_full(&h2c->dbuf) && h2c->dfl >= b_data(&h2c->dbuf) && !b_is_small(&h2c->dbuf)) {
+		/* too large frames (small buffers are upgraded instead) */
 		h2c_error(h2c, H2_ERR_INTERNAL_ERROR);
 		ret = -1;
 	}
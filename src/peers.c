@@ -84,6 +84,8 @@
 #define PEER_F_TEACH_COMPLETE       0x00000010 /* All that we know already taught to current peer, used only for a local peer */
 #define PEER_F_LEARN_ASSIGN         0x00000100 /* Current peer was assigned for a lesson */
 #define PEER_F_LEARN_NOTUP2DATE     0x00000200 /* Learn from peer finished but peer is not up to date */
+#define PEER_F_BATCH                0x00000400 /* Peer accepts batches of updates */
+#define PEER_F_INFLATE              0x00000800 /* Peer accepts compressed batches of updates */
 #define PEER_F_ALIVE                0x20000000 /* Used to flag a peer a alive. */
 #define PEER_F_HEARTBEAT            0x40000000 /* Heartbeat message to send. */
 #define PEER_F_DWNGRD               0x80000000 /* When this flag is enabled, we must downgrade the supported version announced during peer sessions. */
@@ -130,6 +132,9 @@ struct peer_prep_params {
 	struct {
 		struct peer *peer;
 	} hello;
+	struct {
+		struct peer *peer;
+	} status;
 	struct {
 		unsigned int st1;
 	} error_status;
@@ -141,6 +146,13 @@ struct peer_prep_params {
 		int use_timed;
 		struct peer *peer;
 	} updt;
+	struct {
+		struct peer *peer;
+		const char *data;
+		size_t len;
+		size_t max;
+		int flags;
+	} batch;
 	struct {
 		struct shared_table *shared_table;
 	} swtch;
@@ -167,6 +179,7 @@ struct peer_prep_params {
 #define PEER_MSG_STKT_ACK              0x84
 #define PEER_MSG_STKT_UPDATE_TIMED     0x85
 #define PEER_MSG_STKT_INCUPDATE_TIMED  0x86
+#define PEER_MSG_STKT_BATCH            0x87
 /* All the stick-table message identifiers abova have the #7 bit set */
 #define PEER_MSG_STKT_BIT                 7
 #define PEER_MSG_STKT_BIT_MASK         (1 << PEER_MSG_STKT_BIT)
@@ -204,6 +217,43 @@ struct peer_prep_params {
 
 #define PEER_STKT_CACHE_MAX_ENTRIES       128
 
+/* Batches of updates (PEER_MSG_STKT_BATCH) start with a flags byte, followed
+ * by the updates, compressed as a raw deflate block terminated by a sync flush
+ * when PEER_BATCH_F_DEFLATE is set. The updates start with the 32-bit update
+ * ID preceding the first one. Each update then contains :
+ *   - the difference with the previous update ID ;
+ *   - with PEER_BATCH_F_TIMED, the difference with the previous expiration
+ *     delay, zigzag-encoded (the first one being relative to 0) ;
+ *   - the number of leading bytes shared with the previous key, followed by
+ *     the length of the remaining bytes and the bytes themselves. String keys
+ *     don't contain their trailing zero, integer keys are in network order ;
+ *   - the data, encoded as in update messages.
+ * All numbers but the first update ID are encoded as variable-length integers.
+ * Batches are only sent to peers having announced the "batch" capability in
+ * their hello or status message, and compressed for the ones having announced
+ * "deflate". Both sides keep their compression context for the whole session.
+ */
+#define PEER_BATCH_F_DEFLATE              0x01
+#define PEER_BATCH_F_TIMED                0x02
+
+/* Room reserved in a batch message for its headers and for a possible
+ * expansion of its compressed data.
+ */
+#define PEER_BATCH_RESERVE                (PEER_MSG_HEADER_LEN + PEER_MSG_ENC_LENGTH_MAXLEN + 1 + 64)
+
+/* Maximum number of entries collected at once when teaching a lesson */
+#define PEER_BULK_ENTRIES                 256
+
+#define PEER_CAP_BATCH                    "batch"
+#define PEER_CAP_DEFLATE                  "deflate"
+
+/* capabilities announced to the remote peers */
+#if defined(USE_ZLIB)
+#define PEER_LOCAL_CAPS                   PEER_CAP_BATCH "," PEER_CAP_DEFLATE
+#else
+#define PEER_LOCAL_CAPS                   PEER_CAP_BATCH
+#endif
+
 /**********************************/
 /* Peer Session IO handler states */
 /**********************************/
@@ -248,6 +298,7 @@ enum {
 static size_t proto_len = sizeof(PEER_SESSION_PROTO_NAME) - 1;
 struct peers *cfg_peers = NULL;
 static void peer_session_forceshutdown(struct peer *peer);
+static void peer_bulk_reset(struct peer *p);
 
 static struct ebpt_node *dcache_tx_insert(struct dcache *dc,
                                           struct dcache_tx_entry *i);
@@ -354,9 +405,10 @@ static int peer_prepare_hellomsg(char *msg, size_t size, struct peer_prep_params
 
 	peer = p->hello.peer;
 	min_ver = (peer->flags & PEER_F_DWNGRD) ? PEER_DWNGRD_MINOR_VER : PEER_MINOR_VER;
-	/* Prepare headers */
-	ret = snprintf(msg, size, PEER_SESSION_PROTO_NAME " %u.%u\n%s\n%s %d %d\n",
-	              PEER_MAJOR_VER, min_ver, peer->id, localpeer, (int)getpid(), relative_pid);
+	/* Prepare headers, the capabilities are ignored by older peers */
+	ret = snprintf(msg, size, PEER_SESSION_PROTO_NAME " %u.%u\n%s\n%s %d %d %s\n",
+	              PEER_MAJOR_VER, min_ver, peer->id, localpeer, (int)getpid(), relative_pid,
+	              PEER_LOCAL_CAPS);
 	if (ret >= size)
 		return 0;
 
@@ -372,7 +424,11 @@ static int peer_prepare_status_successmsg(char *msg, size_t size, struct peer_pr
 {
 	int ret;
 
-	ret = snprintf(msg, size, "%d\n", PEER_SESS_SC_SUCCESSCODE);
+	/* peers which announced capabilities expect ours after the status code */
+	if (p->status.peer->flags & PEER_F_BATCH)
+		ret = snprintf(msg, size, "%d %s\n", PEER_SESS_SC_SUCCESSCODE, PEER_LOCAL_CAPS);
+	else
+		ret = snprintf(msg, size, "%d\n", PEER_SESS_SC_SUCCESSCODE);
 	if (ret >= size)
 		return 0;
 
@@ -416,73 +472,16 @@ static inline void peer_set_update_msg_type(char *msg_type, int use_identifier,
 			*msg_type = PEER_MSG_STKT_INCUPDATE;
 	}
 }
-/*
- * This prepare the data update message on the stick session <ts>, <st> is the considered
- * stick table.
- *  <msg> is a buffer of <size> to receive data message content
- * If function returns 0, the caller should consider we were unable to encode this message (TODO:
- * check size)
+
+/* Encodes the data of entry <ts> of shared table <st> sent to peer <peer> at
+ * <cursor>, in the order of the data types. Returns the position following
+ * them.
  */
-static int peer_prepare_updatemsg(char *msg, size_t size, struct peer_prep_params *p)
+static char *peer_encode_stksess_data(char *cursor, struct shared_table *st, struct stksess *ts,
+                                      struct peer *peer)
 {
-	uint32_t netinteger;
-	unsigned short datalen;
-	char *cursor, *datamsg;
 	unsigned int data_type;
 	void *data_ptr;
-	struct stksess *ts;
-	struct shared_table *st;
-	unsigned int updateid;
-	int use_identifier;
-	int use_timed;
-	struct peer *peer;
-
-	ts = p->updt.stksess;
-	st = p->updt.shared_table;
-	updateid = p->updt.updateid;
-	use_identifier = p->updt.use_identifier;
-	use_timed = p->updt.use_timed;
-	peer = p->updt.peer;
-
-	cursor = datamsg = msg + PEER_MSG_HEADER_LEN + PEER_MSG_ENC_LENGTH_MAXLEN;
-
-	/* construct message */
-
-	/* check if we need to send the update identifer */
-	if (!st->last_pushed || updateid < st->last_pushed || ((updateid - st->last_pushed) != 1)) {
-		use_identifier = 1;
-	}
-
-	/* encode update identifier if needed */
-	if (use_identifier)  {
-		netinteger = htonl(updateid);
-		memcpy(cursor, &netinteger, sizeof(netinteger));
-		cursor += sizeof(netinteger);
-	}
-
-	if (use_timed) {
-		netinteger = htonl(tick_remain(now_ms, ts->expire));
-		memcpy(cursor, &netinteger, sizeof(netinteger));
-		cursor += sizeof(netinteger);
-	}
-
-	/* encode the key */
-	if (st->table->type == SMP_T_STR) {
-		int stlen = strlen((char *)ts->key.key);
-
-		intencode(stlen, &cursor);
-		memcpy(cursor, ts->key.key, stlen);
-		cursor += stlen;
-	}
-	else if (st->table->type == SMP_T_SINT) {
-		netinteger = htonl(*((uint32_t *)ts->key.key));
-		memcpy(cursor, &netinteger, sizeof(netinteger));
-		cursor += sizeof(netinteger);
-	}
-	else {
-		memcpy(cursor, ts->key.key, st->table->key_size);
-		cursor += st->table->key_size;
-	}
 
 	HA_RWLOCK_RDLOCK(STK_SESS_LOCK, &ts->lock);
 	/* encode values */
@@ -566,11 +565,259 @@ static int peer_prepare_updatemsg(char *msg, size_t size, struct peer_prep_param
 					}
 					break;
 				}
+				case STD_T_HLL: {
+					struct hll *hll;
+					size_t len;
+
+					/* registers are sent up to the last non-null one */
+					hll = &stktable_data_cast(data_ptr, std_t_hll);
+					for (len = HLL_REGS; len && !hll->reg[len - 1]; len--)
+						;
+					intencode(len, &cursor);
+					memcpy(cursor, hll->reg, len);
+					cursor += len;
+					break;
+				}
 			}
 		}
 	}
 	HA_RWLOCK_RDUNLOCK(STK_SESS_LOCK, &ts->lock);
 
+	return cursor;
+}
+
+/* Returns the zigzag encoding of signed integer <v>, so that values close to
+ * zero are encoded on a few bytes whatever their sign.
+ */
+static inline unsigned int peer_zigzag(int v)
+{
+	return ((unsigned int)v << 1) ^ (unsigned int)(v >> 31);
+}
+
+/* Returns the signed integer zigzag-encoded as <v> */
+static inline int peer_unzigzag(unsigned int v)
+{
+	return (int)(v >> 1) ^ -(int)(v & 1);
+}
+
+/* Returns the maximum size of an update of shared table <st> in a batch */
+static size_t peer_batch_update_max(struct shared_table *st)
+{
+	unsigned int data_type;
+	size_t size;
+
+	/* update ID, expiration delay, key prefix and length, then the key */
+	size = 4 * PEER_MSG_ENC_LENGTH_MAXLEN + st->table->key_size;
+
+	for (data_type = 0 ; data_type < STKTABLE_DATA_TYPES ; data_type++) {
+		if (!st->table->data_ofs[data_type])
+			continue;
+
+		switch (stktable_data_types[data_type].std_type) {
+		case STD_T_FRQP:
+			size += 3 * 10;
+			break;
+		case STD_T_DICT:
+			/* dictionary entries are server names */
+			size += 3 * PEER_MSG_ENC_LENGTH_MAXLEN + LINESIZE;
+			break;
+		case STD_T_HLL:
+			size += PEER_MSG_ENC_LENGTH_MAXLEN + HLL_REGS;
+			break;
+		default:
+			size += 10;
+			break;
+		}
+	}
+
+	return size;
+}
+
+/* Encodes at <cursor> the update of entry <ts> of shared table <st> in a batch
+ * sent to peer <peer>, <delta> being the difference between its update ID and
+ * the previous one. If <prev_exp> is not NULL, the expiration delay is encoded
+ * relative to <*prev_exp>, which is updated. The key is encoded relative to the
+ * previous one, stored in <prev>, which is updated too. Returns the position
+ * following the update.
+ */
+static char *peer_encode_batch_update(char *cursor, struct shared_table *st, struct stksess *ts,
+                                      struct peer *peer, unsigned int delta, int *prev_exp,
+                                      struct buffer *prev)
+{
+	uint32_t netinteger;
+	const char *key;
+	size_t len, common;
+	int expire;
+
+	intencode(delta, &cursor);
+
+	if (prev_exp) {
+		expire = tick_remain(now_ms, ts->expire);
+		intencode(peer_zigzag(expire - *prev_exp), &cursor);
+		*prev_exp = expire;
+	}
+
+	if (st->table->type == SMP_T_STR) {
+		key = (const char *)ts->key.key;
+		len = strlen(key);
+	}
+	else if (st->table->type == SMP_T_SINT) {
+		netinteger = htonl(*((uint32_t *)ts->key.key));
+		key = (const char *)&netinteger;
+		len = sizeof(netinteger);
+	}
+	else {
+		key = (const char *)ts->key.key;
+		len = st->table->key_size;
+	}
+
+	for (common = 0; common < len && common < prev->data; common++)
+		if (key[common] != prev->area[common])
+			break;
+
+	intencode(common, &cursor);
+	intencode(len - common, &cursor);
+	memcpy(cursor, key + common, len - common);
+	cursor += len - common;
+	chunk_memcpy(prev, key, len);
+
+	return peer_encode_stksess_data(cursor, st, ts, peer);
+}
+
+#if defined(USE_ZLIB)
+/* Allocates the context compressing the batches sent to peer <peer> if not
+ * done yet. Returns 1 if succeeded, 0 if not.
+ */
+static int peer_init_deflate(struct peer *peer)
+{
+	z_stream *strm;
+
+	if (peer->deflate)
+		return 1;
+
+	strm = calloc(1, sizeof(*strm));
+	if (!strm)
+		return 0;
+
+	if (deflateInit2(strm, Z_BEST_SPEED, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+		free(strm);
+		return 0;
+	}
+
+	peer->deflate = strm;
+	return 1;
+}
+
+/* Allocates the context decompressing the batches received from peer <peer>
+ * if not done yet. Returns 1 if succeeded, 0 if not.
+ */
+static int peer_init_inflate(struct peer *peer)
+{
+	z_stream *strm;
+
+	if (peer->inflate)
+		return 1;
+
+	strm = calloc(1, sizeof(*strm));
+	if (!strm)
+		return 0;
+
+	if (inflateInit2(strm, -MAX_WBITS) != Z_OK) {
+		free(strm);
+		return 0;
+	}
+
+	peer->inflate = strm;
+	return 1;
+}
+
+/* Releases the compression contexts of peer <peer>, which are only valid for
+ * the session they were created for.
+ */
+static void peer_free_zstreams(struct peer *peer)
+{
+	if (peer->deflate) {
+		deflateEnd(peer->deflate);
+		free(peer->deflate);
+		peer->deflate = NULL;
+	}
+
+	if (peer->inflate) {
+		inflateEnd(peer->inflate);
+		free(peer->inflate);
+		peer->inflate = NULL;
+	}
+}
+#endif
+
+/*
+ * This prepare the data update message on the stick session <ts>, <st> is the considered
+ * stick table.
+ *  <msg> is a buffer of <size> to receive data message content
+ * If function returns 0, the caller should consider we were unable to encode this message (TODO:
+ * check size)
+ */
+static int peer_prepare_updatemsg(char *msg, size_t size, struct peer_prep_params *p)
+{
+	uint32_t netinteger;
+	unsigned short datalen;
+	char *cursor, *datamsg;
+	struct stksess *ts;
+	struct shared_table *st;
+	unsigned int updateid;
+	int use_identifier;
+	int use_timed;
+	struct peer *peer;
+
+	ts = p->updt.stksess;
+	st = p->updt.shared_table;
+	updateid = p->updt.updateid;
+	use_identifier = p->updt.use_identifier;
+	use_timed = p->updt.use_timed;
+	peer = p->updt.peer;
+
+	cursor = datamsg = msg + PEER_MSG_HEADER_LEN + PEER_MSG_ENC_LENGTH_MAXLEN;
+
+	/* construct message */
+
+	/* check if we need to send the update identifer */
+	if (!st->last_pushed || updateid < st->last_pushed || ((updateid - st->last_pushed) != 1)) {
+		use_identifier = 1;
+	}
+
+	/* encode update identifier if needed */
+	if (use_identifier)  {
+		netinteger = htonl(updateid);
+		memcpy(cursor, &netinteger, sizeof(netinteger));
+		cursor += sizeof(netinteger);
+	}
+
+	if (use_timed) {
+		netinteger = htonl(tick_remain(now_ms, ts->expire));
+		memcpy(cursor, &netinteger, sizeof(netinteger));
+		cursor += sizeof(netinteger);
+	}
+
+	/* encode the key */
+	if (st->table->type == SMP_T_STR) {
+		int stlen = strlen((char *)ts->key.key);
+
+		intencode(stlen, &cursor);
+		memcpy(cursor, ts->key.key, stlen);
+		cursor += stlen;
+	}
+	else if (st->table->type == SMP_T_SINT) {
+		netinteger = htonl(*((uint32_t *)ts->key.key));
+		memcpy(cursor, &netinteger, sizeof(netinteger));
+		cursor += sizeof(netinteger);
+	}
+	else {
+		memcpy(cursor, ts->key.key, st->table->key_size);
+		cursor += st->table->key_size;
+	}
+
+	cursor = peer_encode_stksess_data(cursor, st, ts, peer);
+
 	/* Compute datalen */
 	datalen = (cursor - datamsg);
 
@@ -587,6 +834,62 @@ static int peer_prepare_updatemsg(char *msg, size_t size, struct peer_prep_param
 	return (cursor - msg) + datalen;
 }
 
+/*
+ * Build a batch of stick-table updates message from the <len> bytes of updates
+ * at <data>, compressing them with the deflate context of the peer if
+ * PEER_BATCH_F_DEFLATE is set in <flags>. The message is limited to <max> bytes
+ * since a compressed batch may not be sent later.
+ * Return the number of written bytes if succeeded, 0 if not.
+ */
+static int peer_prepare_batchmsg(char *msg, size_t size, struct peer_prep_params *p)
+{
+	char *cursor, *datamsg;
+	size_t datalen;
+
+	size = MIN(size, p->batch.max);
+	if (size < p->batch.len + PEER_BATCH_RESERVE)
+		return 0;
+
+	cursor = datamsg = msg + PEER_MSG_HEADER_LEN + PEER_MSG_ENC_LENGTH_MAXLEN;
+	*cursor++ = p->batch.flags;
+
+	if (p->batch.flags & PEER_BATCH_F_DEFLATE) {
+#if defined(USE_ZLIB)
+		z_stream *strm = p->batch.peer->deflate;
+
+		strm->next_in = (Bytef *)p->batch.data;
+		strm->avail_in = p->batch.len;
+		strm->next_out = (Bytef *)cursor;
+		strm->avail_out = msg + size - cursor;
+		if (deflate(strm, Z_SYNC_FLUSH) != Z_OK || strm->avail_in || !strm->avail_out) {
+			return 0;
+		}
+		cursor = (char *)strm->next_out;
+#else
+		return 0;
+#endif
+	}
+	else {
+		memcpy(cursor, p->batch.data, p->batch.len);
+		cursor += p->batch.len;
+	}
+
+	/* Compute datalen */
+	datalen = (cursor - datamsg);
+
+	/*  prepare message header */
+	msg[0] = PEER_MSG_CLASS_STICKTABLE;
+	msg[1] = PEER_MSG_STKT_BATCH;
+	cursor = &msg[2];
+	intencode(datalen, &cursor);
+
+	/* move data after header */
+	memmove(cursor, datamsg, datalen);
+
+	/* return header size + data_len */
+	return (cursor - msg) + datalen;
+}
+
 /*
  * This prepare the switch table message to targeted share table <st>.
  *  <msg> is a buffer of <size> to receive data message content
@@ -634,6 +937,7 @@ static int peer_prepare_switchmsg(char *msg, size_t size, struct peer_prep_param
 				case STD_T_UINT:
 				case STD_T_ULL:
 				case STD_T_DICT:
+				case STD_T_HLL:
 					data |= 1 << data_type;
 					break;
 				case STD_T_FRQP:
@@ -739,6 +1043,12 @@ void __peer_session_deinit(struct peer *peer)
 	HA_ATOMIC_SUB(&active_peers, 1);
 
 	flush_dcache(peer);
+	peer_bulk_reset(peer);
+	free(peer->bulk.ents);
+	peer->bulk.ents = NULL;
+#if defined(USE_ZLIB)
+	peer_free_zstreams(peer);
+#endif
 
 	/* Re-init current table pointers to force announcement on re-connect */
 	peer->remote_table = peer->last_local_table = NULL;
@@ -779,6 +1089,29 @@ static void peer_session_release(struct appctx *appctx)
 	}
 }
 
+/* Returns the PEER_F_BATCH and PEER_F_INFLATE flags matching the comma-separated
+ * list of capabilities <str> announced by a remote peer. Unknown capabilities
+ * are ignored.
+ */
+static unsigned int peer_parse_caps(const char *str)
+{
+	unsigned int flags = 0;
+	size_t len;
+
+	while (*str) {
+		len = strcspn(str, ",");
+		if (len == strlen(PEER_CAP_BATCH) && strncmp(str, PEER_CAP_BATCH, len) == 0)
+			flags |= PEER_F_BATCH;
+		else if (len == strlen(PEER_CAP_DEFLATE) && strncmp(str, PEER_CAP_DEFLATE, len) == 0)
+			flags |= PEER_F_INFLATE;
+		str += len;
+		if (*str)
+			str++;
+	}
+
+	return flags;
+}
+
 /* Retrieve the major and minor versions of peers protocol
  * announced by a remote peer. <str> is a null-terminated
  * string with the following format: "<maj_ver>.<min_ver>".
@@ -896,9 +1229,13 @@ static inline int peer_send_hellomsg(struct appctx *appctx, struct peer *peer)
  * any other negative returned value must  be considered as an error with an appcxt st0
  * returned value equal to PEER_SESS_ST_END.
  */
-static inline int peer_send_status_successmsg(struct appctx *appctx)
+static inline int peer_send_status_successmsg(struct appctx *appctx, struct peer *peer)
 {
-	return peer_send_msg(appctx, peer_prepare_status_successmsg, NULL);
+	struct peer_prep_params p = {
+		.status.peer = peer,
+	};
+
+	return peer_send_msg(appctx, peer_prepare_status_successmsg, &p);
 }
 
 /*
@@ -1164,6 +1501,289 @@ static inline struct stksess *peer_teach_stage2_stksess_lookup(struct shared_tab
 	return eb32_entry(eb, struct stksess, upd);
 }
 
+/*
+ * Function to emit batches of updates for <st> stick-table to the peer <p>
+ * which supports them, the updates being found by <peer_stksess_lookup>. The
+ * expiration delays are sent if <use_timed> is set.
+ * <locked> must be set to 1 if the shared table <st> is already locked when entering
+ * this function, 0 if not.
+ *
+ * Each batch is built with the table unlocked while encoding each entry, and
+ * only contains the updates which fit in the room left in the channel, so that
+ * it may always be sent once compressed.
+ *
+ * Return 0 if any message could not be built modifying the appcxt st0 to PEER_SESS_ST_END value.
+ * Returns -1 if there was not enough room left to send the message,
+ * any other negative returned value must  be considered as an error with an appcxt st0
+ * returned value equal to PEER_SESS_ST_END.
+ * If it returns 0 or -1, this function leave <st> locked if already locked when entering this function
+ * unlocked if not already locked when entering this function.
+ */
+static int peer_send_teach_batches(struct appctx *appctx, struct peer *p,
+                                   struct stksess *(*peer_stksess_lookup)(struct shared_table *),
+                                   struct shared_table *st, int locked, int use_timed)
+{
+	struct stream_interface *si = appctx->owner;
+	struct peers *peers = strm_fe(si_strm(si))->parent;
+	struct peer_prep_params params = { };
+	struct buffer *raw, *prev;
+	struct stksess *ts;
+	char *cursor, *first, *end;
+	unsigned int updateid, prev_id;
+	uint32_t netinteger;
+	size_t update_max;
+	int ret, prev_exp;
+
+	raw = alloc_trash_chunk();
+	prev = alloc_trash_chunk();
+	if (!raw || !prev) {
+		appctx->st0 = PEER_SESS_ST_END;
+		ret = 0;
+		goto out;
+	}
+
+	params.batch.peer = p;
+	params.batch.data = raw->area;
+	params.batch.flags = use_timed ? PEER_BATCH_F_TIMED : 0;
+#if defined(USE_ZLIB)
+	/* compressing the updates sent to the local peer is useless */
+	if (peers->compress && (p->flags & PEER_F_INFLATE) && !p->local && peer_init_deflate(p))
+		params.batch.flags |= PEER_BATCH_F_DEFLATE;
+#endif
+	update_max = peer_batch_update_max(st);
+
+	if (!locked)
+		HA_SPIN_LOCK(STK_TABLE_LOCK, &st->table->lock);
+
+	while (1) {
+		params.batch.max = MIN(channel_recv_max(si_ic(si)), trash.size);
+		end = raw->area + params.batch.max - PEER_BATCH_RESERVE;
+		first = cursor = raw->area + sizeof(netinteger);
+		prev_id = prev_exp = 0;
+		prev->data = 0;
+
+		while ((ts = peer_stksess_lookup(st)) && cursor + update_max <= end) {
+			updateid = ts->upd.key;
+			if (cursor == first) {
+				/* the batch starts with the ID preceding the first update */
+				prev_id = updateid - 1;
+				netinteger = htonl(prev_id);
+				memcpy(raw->area, &netinteger, sizeof(netinteger));
+			}
+
+			HA_ATOMIC_ADD(&ts->ref_cnt, 1);
+			HA_SPIN_UNLOCK(STK_TABLE_LOCK, &st->table->lock);
+
+			cursor = peer_encode_batch_update(cursor, st, ts, p, updateid - prev_id,
+			                                  use_timed ? &prev_exp : NULL, prev);
+
+			HA_SPIN_LOCK(STK_TABLE_LOCK, &st->table->lock);
+			HA_ATOMIC_SUB(&ts->ref_cnt, 1);
+			st->last_pushed = prev_id = updateid;
+		}
+
+		if (cursor == first) {
+			ret = 1;
+			if (ts) {
+				/* not enough room for a single update */
+				si_rx_room_blk(si);
+				ret = -1;
+			}
+			break;
+		}
+
+		HA_SPIN_UNLOCK(STK_TABLE_LOCK, &st->table->lock);
+		params.batch.len = cursor - raw->area;
+		ret = peer_send_msg(appctx, peer_prepare_batchmsg, &params);
+		HA_SPIN_LOCK(STK_TABLE_LOCK, &st->table->lock);
+		if (ret <= 0) {
+			/* the room was checked and the updates were consumed, the session must be closed. */
+			appctx->st0 = PEER_SESS_ST_END;
+			ret = 0;
+			break;
+		}
+
+		if (peer_stksess_lookup == peer_teach_process_stksess_lookup &&
+		    (int)(st->last_pushed - st->table->commitupdate) > 0)
+			st->table->commitupdate = st->last_pushed;
+
+		if (!ts) {
+			ret = 1;
+			break;
+		}
+	}
+
+	if (!locked)
+		HA_SPIN_UNLOCK(STK_TABLE_LOCK, &st->table->lock);
+ out:
+	free_trash_chunk(raw);
+	free_trash_chunk(prev);
+	return ret;
+}
+
+/* Collects into the bulk of peer <p> up to PEER_BULK_ENTRIES entries of shared
+ * table <st> found by <peer_stksess_lookup>, and references them so that they
+ * may be encoded without holding the table lock. The lock must be held. Returns
+ * the number of entries collected, or -1 on memory allocation failure.
+ */
+static int peer_bulk_collect(struct peer *p, struct shared_table *st,
+                             struct stksess *(*peer_stksess_lookup)(struct shared_table *))
+{
+	struct stksess *ts;
+
+	if (!p->bulk.ents) {
+		p->bulk.ents = calloc(PEER_BULK_ENTRIES, sizeof(*p->bulk.ents));
+		if (!p->bulk.ents)
+			return -1;
+	}
+
+	p->bulk.st = st;
+	p->bulk.pos = p->bulk.count = 0;
+	while (p->bulk.count < PEER_BULK_ENTRIES && (ts = peer_stksess_lookup(st))) {
+		HA_ATOMIC_ADD(&ts->ref_cnt, 1);
+		p->bulk.ents[p->bulk.count].ts = ts;
+		p->bulk.ents[p->bulk.count].upd = ts->upd.key;
+		st->last_pushed = ts->upd.key;
+		p->bulk.count++;
+	}
+
+	return p->bulk.count;
+}
+
+/* Releases the entries of the bulk of peer <p> from index <from> to the next
+ * one to send.
+ */
+static void peer_bulk_release(struct peer *p, int from)
+{
+	struct stktable *t = p->bulk.st->table;
+
+	HA_SPIN_LOCK(STK_TABLE_LOCK, &t->lock);
+	for (; from < p->bulk.pos; from++)
+		HA_ATOMIC_SUB(&p->bulk.ents[from].ts->ref_cnt, 1);
+	HA_SPIN_UNLOCK(STK_TABLE_LOCK, &t->lock);
+}
+
+/* Drops all the entries collected for a lesson to peer <p> */
+static void peer_bulk_reset(struct peer *p)
+{
+	if (p->bulk.pos < p->bulk.count) {
+		int from = p->bulk.pos;
+
+		p->bulk.pos = p->bulk.count;
+		peer_bulk_release(p, from);
+	}
+
+	p->bulk.pos = p->bulk.count = 0;
+	p->bulk.st = NULL;
+}
+
+/*
+ * Function to emit batches of updates for <st> stick-table when a lesson must
+ * be taught to the peer <p> which supports them. The entries are collected by
+ * groups from <peer_stksess_lookup> under a single table lock, then encoded
+ * without it, so that a large resync doesn't slow down the local updates. When
+ * <peer_stksess_lookup> is NULL, only the entries already collected are sent.
+ * The expiration delays are sent if <use_timed> is set.
+ *
+ * Returns 1 once all the entries were sent, -1 if there was not enough room
+ * left to send them, leaving the remaining ones in the bulk of <p>, or 0 if a
+ * message could not be built, with the appctx st0 set to PEER_SESS_ST_END.
+ */
+static int peer_send_teach_bulk(struct appctx *appctx, struct peer *p,
+                                struct stksess *(*peer_stksess_lookup)(struct shared_table *),
+                                struct shared_table *st, int use_timed)
+{
+	struct stream_interface *si = appctx->owner;
+	struct peers *peers = strm_fe(si_strm(si))->parent;
+	struct peer_prep_params params = { };
+	struct peer_bulk_entry *ent;
+	struct buffer *raw, *prev;
+	char *cursor, *first, *end;
+	unsigned int prev_id;
+	uint32_t netinteger;
+	size_t update_max;
+	int ret, prev_exp, from;
+
+	raw = alloc_trash_chunk();
+	prev = alloc_trash_chunk();
+	if (!raw || !prev) {
+		appctx->st0 = PEER_SESS_ST_END;
+		ret = 0;
+		goto out;
+	}
+
+	params.batch.peer = p;
+	params.batch.data = raw->area;
+	params.batch.flags = use_timed ? PEER_BATCH_F_TIMED : 0;
+#if defined(USE_ZLIB)
+	if (peers->compress && (p->flags & PEER_F_INFLATE) && !p->local && peer_init_deflate(p))
+		params.batch.flags |= PEER_BATCH_F_DEFLATE;
+#endif
+	update_max = peer_batch_update_max(st);
+
+	while (1) {
+		if (p->bulk.pos == p->bulk.count) {
+			ret = 1;
+			if (!peer_stksess_lookup)
+				break;
+
+			HA_SPIN_LOCK(STK_TABLE_LOCK, &st->table->lock);
+			ret = peer_bulk_collect(p, st, peer_stksess_lookup);
+			HA_SPIN_UNLOCK(STK_TABLE_LOCK, &st->table->lock);
+			if (ret <= 0) {
+				if (ret < 0)
+					appctx->st0 = PEER_SESS_ST_END;
+				ret = !ret;
+				break;
+			}
+		}
+
+		params.batch.max = MIN(channel_recv_max(si_ic(si)), trash.size);
+		end = raw->area + params.batch.max - PEER_BATCH_RESERVE;
+		first = cursor = raw->area + sizeof(netinteger);
+		prev_id = prev_exp = 0;
+		prev->data = 0;
+		from = p->bulk.pos;
+
+		while (p->bulk.pos < p->bulk.count && cursor + update_max <= end) {
+			ent = &p->bulk.ents[p->bulk.pos];
+			if (cursor == first) {
+				/* the batch starts with the ID preceding the first update */
+				prev_id = ent->upd - 1;
+				netinteger = htonl(prev_id);
+				memcpy(raw->area, &netinteger, sizeof(netinteger));
+			}
+
+			cursor = peer_encode_batch_update(cursor, st, ent->ts, p, ent->upd - prev_id,
+			                                  use_timed ? &prev_exp : NULL, prev);
+			prev_id = ent->upd;
+			p->bulk.pos++;
+		}
+
+		if (cursor == first) {
+			/* not enough room for a single update */
+			si_rx_room_blk(si);
+			ret = -1;
+			break;
+		}
+
+		params.batch.len = cursor - raw->area;
+		ret = peer_send_msg(appctx, peer_prepare_batchmsg, &params);
+		peer_bulk_release(p, from);
+		if (ret <= 0) {
+			/* the room was checked and the updates were consumed, the session must be closed. */
+			appctx->st0 = PEER_SESS_ST_END;
+			ret = 0;
+			break;
+		}
+	}
+
+ out:
+	free_trash_chunk(raw);
+	free_trash_chunk(prev);
+	return ret;
+}
+
 /*
  * Generic function to emit update messages for <st> stick-table when a lesson must
  * be taught to the peer <p>.
@@ -1199,6 +1819,14 @@ static inline int peer_send_teachmsgs(struct appctx *appctx, struct peer *p,
 	if (peer_stksess_lookup != peer_teach_process_stksess_lookup)
 		use_timed = !(p->flags & PEER_F_DWNGRD);
 
+	/* updates too large for a batch are sent one at a time */
+	if ((p->flags & PEER_F_BATCH) &&
+	    peer_batch_update_max(st) + PEER_BATCH_RESERVE + sizeof(uint32_t) <= trash.size) {
+		if (peer_stksess_lookup != peer_teach_process_stksess_lookup)
+			return peer_send_teach_bulk(appctx, p, peer_stksess_lookup, st, use_timed);
+		return peer_send_teach_batches(appctx, p, peer_stksess_lookup, st, locked, use_timed);
+	}
+
 	/* We force new pushed to 1 to force identifier in update message */
 	new_pushed = 1;
 
@@ -1215,20 +1843,20 @@ static inline int peer_send_teachmsgs(struct appctx *appctx, struct peer *p,
 			break;
 
 		updateid = ts->upd.key;
-		ts->ref_cnt++;
+		HA_ATOMIC_ADD(&ts->ref_cnt, 1);
 		HA_SPIN_UNLOCK(STK_TABLE_LOCK, &st->table->lock);
 
 		ret = peer_send_updatemsg(st, appctx, ts, updateid, new_pushed, use_timed);
 		if (ret <= 0) {
 			HA_SPIN_LOCK(STK_TABLE_LOCK, &st->table->lock);
-			ts->ref_cnt--;
+			HA_ATOMIC_SUB(&ts->ref_cnt, 1);
 			if (!locked)
 				HA_SPIN_UNLOCK(STK_TABLE_LOCK, &st->table->lock);
 			return ret;
 		}
 
 		HA_SPIN_LOCK(STK_TABLE_LOCK, &st->table->lock);
-		ts->ref_cnt--;
+		HA_ATOMIC_SUB(&ts->ref_cnt, 1);
 		st->last_pushed = updateid;
 
 		if (peer_stksess_lookup == peer_teach_process_stksess_lookup &&
@@ -1294,101 +1922,24 @@ static inline int peer_send_teach_stage2_msgs(struct appctx *appctx, struct peer
 
 
 /*
- * Function used to parse a stick-table update message after it has been received
- * by <p> peer with <msg_cur> as address of the pointer to the position in the
- * receipt buffer with <msg_end> being position of the end of the stick-table message.
- * Update <msg_curr> accordingly to the peer protocol specs if no peer protocol error
- * was encountered.
- * <exp> must be set if the stick-table entry expires.
- * <updt> must be set for  PEER_MSG_STKT_UPDATE or PEER_MSG_STKT_UPDATE_TIMED stick-table
- * messages, in this case the stick-table udpate message is received with a stick-table
- * update ID.
- * <totl> is the length of the stick-table update message computed upon receipt.
+ * Stores entry <newts> received from peer <p> into the table of shared table
+ * <st>, or updates the existing entry with the same key, in which case <newts>
+ * is freed. The data are decoded from <*msg_cur>, which is updated, <msg_end>
+ * being the end of the message, and the entry will expire in <expire> ticks.
+ * Returns 1 if succeeded, 0 if the data were malformed.
  */
-static int peer_treat_updatemsg(struct appctx *appctx, struct peer *p, int updt, int exp,
-                                char **msg_cur, char *msg_end, int msg_len, int totl)
+static int peer_store_update(struct peer *p, struct shared_table *st, struct stksess *newts,
+                             int expire, char **msg_cur, char *msg_end)
 {
-	struct stream_interface *si = appctx->owner;
-	struct shared_table *st = p->remote_table;
-	struct stksess *ts, *newts;
-	uint32_t update;
-	int expire;
+	struct stksess *ts;
 	unsigned int data_type;
 	void *data_ptr;
-
-	/* Here we have data message */
-	if (!st)
-		goto ignore_msg;
-
-	expire = MS_TO_TICKS(st->table->expire);
-
-	if (updt) {
-		if (msg_len < sizeof(update))
-			goto malformed_exit;
-
-		memcpy(&update, *msg_cur, sizeof(update));
-		*msg_cur += sizeof(update);
-		st->last_get = htonl(update);
-	}
-	else {
-		st->last_get++;
-	}
-
-	if (exp) {
-		size_t expire_sz = sizeof expire;
-
-		if (*msg_cur + expire_sz > msg_end)
-			goto malformed_exit;
-
-		memcpy(&expire, *msg_cur, expire_sz);
-		*msg_cur += expire_sz;
-		expire = ntohl(expire);
-	}
-
-	newts = stksess_new(st->table, NULL);
-	if (!newts)
-		goto ignore_msg;
-
-	if (st->table->type == SMP_T_STR) {
-		unsigned int to_read, to_store;
-
-		to_read = intdecode(msg_cur, msg_end);
-		if (!*msg_cur)
-			goto malformed_free_newts;
-
-		to_store = MIN(to_read, st->table->key_size - 1);
-		if (*msg_cur + to_store > msg_end)
-			goto malformed_free_newts;
-
-		memcpy(newts->key.key, *msg_cur, to_store);
-		newts->key.key[to_store] = 0;
-		*msg_cur += to_read;
-	}
-	else if (st->table->type == SMP_T_SINT) {
-		unsigned int netinteger;
-
-		if (*msg_cur + sizeof(netinteger) > msg_end)
-			goto malformed_free_newts;
-
-		memcpy(&netinteger, *msg_cur, sizeof(netinteger));
-		netinteger = ntohl(netinteger);
-		memcpy(newts->key.key, &netinteger, sizeof(netinteger));
-		*msg_cur += sizeof(netinteger);
-	}
-	else {
-		if (*msg_cur + st->table->key_size > msg_end)
-			goto malformed_free_newts;
-
-		memcpy(newts->key.key, *msg_cur, st->table->key_size);
-		*msg_cur += st->table->key_size;
-	}
+	int ret = 0;
 
 	/* lookup for existing entry */
 	ts = stktable_set_entry(st->table, newts);
-	if (ts != newts) {
+	if (ts != newts)
 		stksess_free(st->table, newts);
-		newts = NULL;
-	}
 
 	HA_RWLOCK_WRLOCK(STK_SESS_LOCK, &ts->lock);
 
@@ -1400,7 +1951,7 @@ static int peer_treat_updatemsg(struct appctx *appctx, struct peer *p, int updt,
 
 		decoded_int = intdecode(msg_cur, msg_end);
 		if (!*msg_cur)
-			goto malformed_unlock;
+			goto malformed;
 
 		switch (stktable_data_types[data_type].std_type) {
 		case STD_T_SINT:
@@ -1432,11 +1983,11 @@ static int peer_treat_updatemsg(struct appctx *appctx, struct peer *p, int updt,
 			data.curr_tick = tick_add(now_ms, -decoded_int) & ~0x1;
 			data.curr_ctr = intdecode(msg_cur, msg_end);
 			if (!*msg_cur)
-				goto malformed_unlock;
+				goto malformed;
 
 			data.prev_ctr = intdecode(msg_cur, msg_end);
 			if (!*msg_cur)
-				goto malformed_unlock;
+				goto malformed;
 
 			data_ptr = stktable_data_ptr(st->table, ts, data_type);
 			if (data_ptr)
@@ -1457,7 +2008,7 @@ static int peer_treat_updatemsg(struct appctx *appctx, struct peer *p, int updt,
 			}
 			data_len = decoded_int;
 			if (*msg_cur + data_len > msg_end)
-				goto malformed_unlock;
+				goto malformed;
 
 			/* Compute the end of the current data, <msg_end> being at the end of
 			 * the entire message.
@@ -1465,7 +2016,7 @@ static int peer_treat_updatemsg(struct appctx *appctx, struct peer *p, int updt,
 			end = *msg_cur + data_len;
 			id = intdecode(msg_cur, end);
 			if (!*msg_cur || !id)
-				goto malformed_unlock;
+				goto malformed;
 
 			dc = p->dcache;
 			if (*msg_cur == end) {
@@ -1480,7 +2031,7 @@ static int peer_treat_updatemsg(struct appctx *appctx, struct peer *p, int updt,
 				value_len = intdecode(msg_cur, end);
 				if (!*msg_cur || *msg_cur + value_len > end ||
 					unlikely(value_len + 1 >= chunk->size))
-					goto malformed_unlock;
+					goto malformed;
 
 				chunk_memcpy(chunk, *msg_cur, value_len);
 				chunk->area[chunk->data] = '\0';
@@ -1496,13 +2047,125 @@ static int peer_treat_updatemsg(struct appctx *appctx, struct peer *p, int updt,
 			}
 			break;
 		}
+		case STD_T_HLL: {
+			struct hll hll = { };
+
+			/* registers are merged, not replaced, so that values seen
+			 * by several peers are only counted once.
+			 */
+			if (decoded_int > HLL_REGS || *msg_cur + decoded_int > msg_end)
+				goto malformed;
+
+			memcpy(hll.reg, *msg_cur, decoded_int);
+			*msg_cur += decoded_int;
+
+			data_ptr = stktable_data_ptr(st->table, ts, data_type);
+			if (data_ptr)
+				hll_merge(&stktable_data_cast(data_ptr, std_t_hll), &hll);
+			break;
+		}
 		}
 	}
 	/* Force new expiration */
 	ts->expire = tick_add(now_ms, expire);
+	ret = 1;
 
+ malformed:
 	HA_RWLOCK_WRUNLOCK(STK_SESS_LOCK, &ts->lock);
 	stktable_touch_remote(st->table, ts, 1);
+	return ret;
+}
+
+/*
+ * Function used to parse a stick-table update message after it has been received
+ * by <p> peer with <msg_cur> as address of the pointer to the position in the
+ * receipt buffer with <msg_end> being position of the end of the stick-table message.
+ * Update <msg_curr> accordingly to the peer protocol specs if no peer protocol error
+ * was encountered.
+ * <exp> must be set if the stick-table entry expires.
+ * <updt> must be set for  PEER_MSG_STKT_UPDATE or PEER_MSG_STKT_UPDATE_TIMED stick-table
+ * messages, in this case the stick-table udpate message is received with a stick-table
+ * update ID.
+ * <totl> is the length of the stick-table update message computed upon receipt.
+ */
+static int peer_treat_updatemsg(struct appctx *appctx, struct peer *p, int updt, int exp,
+                                char **msg_cur, char *msg_end, int msg_len, int totl)
+{
+	struct stream_interface *si = appctx->owner;
+	struct shared_table *st = p->remote_table;
+	struct stksess *newts;
+	uint32_t update;
+	int expire;
+
+	/* Here we have data message */
+	if (!st)
+		goto ignore_msg;
+
+	expire = MS_TO_TICKS(st->table->expire);
+
+	if (updt) {
+		if (msg_len < sizeof(update))
+			goto malformed_exit;
+
+		memcpy(&update, *msg_cur, sizeof(update));
+		*msg_cur += sizeof(update);
+		st->last_get = htonl(update);
+	}
+	else {
+		st->last_get++;
+	}
+
+	if (exp) {
+		size_t expire_sz = sizeof expire;
+
+		if (*msg_cur + expire_sz > msg_end)
+			goto malformed_exit;
+
+		memcpy(&expire, *msg_cur, expire_sz);
+		*msg_cur += expire_sz;
+		expire = ntohl(expire);
+	}
+
+	newts = stksess_new(st->table, NULL);
+	if (!newts)
+		goto ignore_msg;
+
+	if (st->table->type == SMP_T_STR) {
+		unsigned int to_read, to_store;
+
+		to_read = intdecode(msg_cur, msg_end);
+		if (!*msg_cur)
+			goto malformed_free_newts;
+
+		to_store = MIN(to_read, st->table->key_size - 1);
+		if (*msg_cur + to_store > msg_end)
+			goto malformed_free_newts;
+
+		memcpy(newts->key.key, *msg_cur, to_store);
+		newts->key.key[to_store] = 0;
+		*msg_cur += to_read;
+	}
+	else if (st->table->type == SMP_T_SINT) {
+		unsigned int netinteger;
+
+		if (*msg_cur + sizeof(netinteger) > msg_end)
+			goto malformed_free_newts;
+
+		memcpy(&netinteger, *msg_cur, sizeof(netinteger));
+		netinteger = ntohl(netinteger);
+		memcpy(newts->key.key, &netinteger, sizeof(netinteger));
+		*msg_cur += sizeof(netinteger);
+	}
+	else {
+		if (*msg_cur + st->table->key_size > msg_end)
+			goto malformed_free_newts;
+
+		memcpy(newts->key.key, *msg_cur, st->table->key_size);
+		*msg_cur += st->table->key_size;
+	}
+
+	if (!peer_store_update(p, st, newts, expire, msg_cur, msg_end))
+		goto malformed_exit;
 	return 1;
 
  ignore_msg:
@@ -1510,19 +2173,160 @@ static int peer_treat_updatemsg(struct appctx *appctx, struct peer *p, int updt,
 	co_skip(si_oc(si), totl);
 	return 0;
 
- malformed_unlock:
+ malformed_free_newts:
 	/* malformed message */
-	HA_RWLOCK_WRUNLOCK(STK_SESS_LOCK, &ts->lock);
-	stktable_touch_remote(st->table, ts, 1);
+	stksess_free(st->table, newts);
+ malformed_exit:
 	appctx->st0 = PEER_SESS_ST_ERRPROTO;
 	return 0;
+}
+
+/*
+ * Function used to parse a batch of stick-table updates after it has been received
+ * by <p> peer with <msg_cur> as address of the pointer to the position in the
+ * receipt buffer with <msg_end> being position of the end of the stick-table message.
+ * Update <msg_curr> accordingly to the peer protocol specs if no peer protocol error
+ * was encountered.
+ * <totl> is the length of the stick-table batch message computed upon receipt.
+ * Return 1 if succeeded, 0 if not with the appctx state st0 set to PEER_SESS_ST_ERRPROTO,
+ * or if the message was ignored.
+ */
+static int peer_treat_batchmsg(struct appctx *appctx, struct peer *p,
+                               char **msg_cur, char *msg_end, int totl)
+{
+	struct stream_interface *si = appctx->owner;
+	struct shared_table *st = p->remote_table;
+	struct buffer *raw = NULL, *prev = NULL;
+	struct stksess *newts = NULL;
+	unsigned int update, prefix, len, to_store;
+	uint32_t netinteger;
+	char *cur, *end;
+	int flags, expire, prev_exp = 0;
+	int ret = 0;
+
+	if (!st) {
+		/* skip consumed message */
+		co_skip(si_oc(si), totl);
+		return 0;
+	}
+
+	if (*msg_cur >= msg_end)
+		goto malformed;
+
+	flags = (unsigned char)*(*msg_cur)++;
+	cur = *msg_cur;
+	end = msg_end;
+	*msg_cur = msg_end;
+
+	raw = alloc_trash_chunk();
+	prev = alloc_trash_chunk();
+	if (!raw || !prev) {
+		appctx->st0 = PEER_SESS_ST_END;
+		goto out;
+	}
+
+	if (flags & PEER_BATCH_F_DEFLATE) {
+#if defined(USE_ZLIB)
+		z_stream *strm;
+
+		if (!peer_init_inflate(p)) {
+			appctx->st0 = PEER_SESS_ST_END;
+			goto out;
+		}
+
+		/* the whole batch must be decompressed at once */
+		strm = p->inflate;
+		strm->next_in = (Bytef *)cur;
+		strm->avail_in = end - cur;
+		strm->next_out = (Bytef *)raw->area;
+		strm->avail_out = raw->size;
+		if (inflate(strm, Z_SYNC_FLUSH) != Z_OK || strm->avail_in || !strm->avail_out)
+			goto malformed;
+
+		cur = raw->area;
+		end = (char *)strm->next_out;
+#else
+		goto malformed;
+#endif
+	}
+
+	if (end - cur < sizeof(netinteger))
+		goto malformed;
+
+	memcpy(&netinteger, cur, sizeof(netinteger));
+	cur += sizeof(netinteger);
+	update = ntohl(netinteger);
+
+	while (cur < end) {
+		update += intdecode(&cur, end);
+		if (!cur)
+			goto malformed;
+
+		expire = MS_TO_TICKS(st->table->expire);
+		if (flags & PEER_BATCH_F_TIMED) {
+			prev_exp += peer_unzigzag(intdecode(&cur, end));
+			if (!cur)
+				goto malformed;
+			expire = prev_exp;
+		}
+
+		/* the key shares its first <prefix> bytes with the previous one */
+		prefix = intdecode(&cur, end);
+		if (!cur)
+			goto malformed;
+
+		len = intdecode(&cur, end);
+		if (!cur || prefix > prev->data || len > end - cur || prefix + len > prev->size)
+			goto malformed;
+
+		prev->data = prefix;
+		chunk_memcat(prev, cur, len);
+		cur += len;
+
+		st->last_get = update;
+
+		newts = stksess_new(st->table, NULL);
+		if (!newts) {
+			/* ignore the remaining updates */
+			break;
+		}
+
+		if (st->table->type == SMP_T_STR) {
+			to_store = MIN(prev->data, st->table->key_size - 1);
+			memcpy(newts->key.key, prev->area, to_store);
+			newts->key.key[to_store] = 0;
+		}
+		else if (st->table->type == SMP_T_SINT) {
+			if (prev->data != sizeof(netinteger))
+				goto malformed_free_newts;
+
+			memcpy(&netinteger, prev->area, sizeof(netinteger));
+			netinteger = ntohl(netinteger);
+			memcpy(newts->key.key, &netinteger, sizeof(netinteger));
+		}
+		else {
+			if (prev->data != st->table->key_size)
+				goto malformed_free_newts;
+
+			memcpy(newts->key.key, prev->area, st->table->key_size);
+		}
+
+		if (!peer_store_update(p, st, newts, expire, &cur, end))
+			goto malformed;
+	}
+	ret = 1;
+
+ out:
+	free_trash_chunk(raw);
+	free_trash_chunk(prev);
+	return ret;
 
  malformed_free_newts:
 	/* malformed message */
 	stksess_free(st->table, newts);
- malformed_exit:
+ malformed:
 	appctx->st0 = PEER_SESS_ST_ERRPROTO;
-	return 0;
+	goto out;
 }
 
 /*
@@ -1701,8 +2505,8 @@ static inline int peer_recv_msg(struct appctx *appctx, char *msg_head, size_t ms
 
 	*totl += reql;
 
-	if ((unsigned int)msg_head[2] < PEER_ENC_2BYTES_MIN) {
-		*msg_len = msg_head[2];
+	if ((unsigned char)msg_head[2] < PEER_ENC_2BYTES_MIN) {
+		*msg_len = (unsigned char)msg_head[2];
 	}
 	else {
 		int i;
@@ -1777,6 +2581,9 @@ static inline int peer_treat_awaited_msg(struct appctx *appctx, struct peer *pee
 			struct shared_table *st;
 			/* Reset message: remote need resync */
 
+			/* forget the entries collected for a previous lesson */
+			peer_bulk_reset(peer);
+
 			/* prepare tables fot a global push */
 			for (st = peer->tables; st; st = st->next) {
 				st->teaching_origin = st->last_pushed = st->table->update;
@@ -1853,6 +2660,10 @@ static inline int peer_treat_awaited_msg(struct appctx *appctx, struct peer *pee
 				return 0;
 
 		}
+		else if (msg_head[1] == PEER_MSG_STKT_BATCH) {
+			if (!peer_treat_batchmsg(appctx, peer, msg_cur, msg_end, totl))
+				return 0;
+		}
 		else if (msg_head[1] == PEER_MSG_STKT_ACK) {
 			if (!peer_treat_ackmsg(appctx, peer, msg_cur, msg_end))
 				return 0;
@@ -1897,6 +2708,13 @@ static inline int peer_send_msgs(struct appctx *appctx, struct peer *peer)
 		struct shared_table *st;
 		struct shared_table *last_local_table;
 
+		/* the entries already collected for a lesson must be sent first */
+		if (peer->bulk.pos < peer->bulk.count) {
+			repl = peer_send_teachmsgs(appctx, peer, NULL, peer->bulk.st, 0);
+			if (repl <= 0)
+				return repl;
+		}
+
 		last_local_table = peer->last_local_table;
 		if (!last_local_table)
 			last_local_table = peer->tables;
@@ -2032,11 +2850,13 @@ static inline int peer_getline_host(struct appctx *appctx)
  * Read and parse a last line of a "hello" peer protocol message.
  * Returns 0 if could not read a character, -1 if there was a read error or
  * the line is malformed, 1 if succeeded.
- * Set <curpeer> accordingly (the remote peer sending the "hello" message).
+ * Set <curpeer> accordingly (the remote peer sending the "hello" message), and
+ * <caps> to the PEER_F_* flags of the capabilities it announced.
  */
-static inline int peer_getline_last(struct appctx *appctx, struct peer **curpeer)
+static inline int peer_getline_last(struct appctx *appctx, struct peer **curpeer,
+                                    unsigned int *caps)
 {
-	char *p;
+	char *p, *c;
 	int reql;
 	struct peer *peer;
 	struct stream_interface *si = appctx->owner;
@@ -2050,7 +2870,7 @@ static inline int peer_getline_last(struct appctx *appctx, struct peer **curpeer
 	if (reql < 0)
 		return -1;
 
-	/* parse line "<peer name> <pid> <relative_pid>" */
+	/* parse line "<peer name> <pid> <relative_pid> [<capabilities>]" */
 	p = strchr(trash.area, ' ');
 	if (!p) {
 		appctx->st0 = PEER_SESS_ST_EXIT;
@@ -2059,6 +2879,11 @@ static inline int peer_getline_last(struct appctx *appctx, struct peer **curpeer
 	}
 	*p = 0;
 
+	c = strchr(p + 1, ' ');
+	if (c)
+		c = strchr(c + 1, ' ');
+	*caps = c ? peer_parse_caps(c + 1) : 0;
+
 	/* lookup known peer */
 	for (peer = peers->remote; peer; peer = peer->next) {
 		if (strcmp(peer->id, trash.area) == 0)
@@ -2083,6 +2908,11 @@ static inline void init_accepted_peer(struct peer *peer, struct peers *peers)
 {
 	struct shared_table *st;
 
+#if defined(USE_ZLIB)
+	/* the compressed batches restart from scratch with each session */
+	peer_free_zstreams(peer);
+#endif
+
 	/* Register status code */
 	peer->statuscode = PEER_SESS_SC_SUCCESSCODE;
 
@@ -2128,6 +2958,11 @@ static inline void init_connected_peer(struct peer *peer, struct peers *peers)
 {
 	struct shared_table *st;
 
+#if defined(USE_ZLIB)
+	/* the compressed batches restart from scratch with each session */
+	peer_free_zstreams(peer);
+#endif
+
 	/* Init cursors */
 	for (st = peer->tables; st ; st = st->next) {
 		st->last_get = st->last_acked = 0;
@@ -2168,7 +3003,8 @@ static void peer_io_handler(struct appctx *appctx)
 	struct peer *curpeer = NULL;
 	int reql = 0;
 	int repl = 0;
-	unsigned int maj_ver, min_ver;
+	unsigned int maj_ver, min_ver, caps;
+	char *p;
 	int prev_state;
 
 	/* Check if the input buffer is available. */
@@ -2211,7 +3047,7 @@ switchstate:
 				/* fall through */
 			case PEER_SESS_ST_GETPEER: {
 				prev_state = appctx->st0;
-				reql = peer_getline_last(appctx, &curpeer);
+				reql = peer_getline_last(appctx, &curpeer, &caps);
 				if (reql <= 0) {
 					if (!reql)
 						goto out;
@@ -2242,6 +3078,8 @@ switchstate:
 						curpeer->flags &= ~PEER_F_DWNGRD;
 					}
 				}
+				curpeer->flags &= ~(PEER_F_BATCH|PEER_F_INFLATE);
+				curpeer->flags |= caps;
 				curpeer->appctx = appctx;
 				appctx->ctx.peers.ptr = curpeer;
 				appctx->st0 = PEER_SESS_ST_SENDSUCCESS;
@@ -2259,7 +3097,7 @@ switchstate:
 					}
 				}
 
-				repl = peer_send_status_successmsg(appctx);
+				repl = peer_send_status_successmsg(appctx, curpeer);
 				if (repl <= 0) {
 					if (repl == -1)
 						goto out;
@@ -2319,6 +3157,12 @@ switchstate:
 				/* Register status code */
 				curpeer->statuscode = atoi(trash.area);
 
+				/* it may be followed by the remote capabilities */
+				curpeer->flags &= ~(PEER_F_BATCH|PEER_F_INFLATE);
+				p = strchr(trash.area, ' ');
+				if (p)
+					curpeer->flags |= peer_parse_caps(p + 1);
+
 				/* Awake main task */
 				task_wakeup(curpeers->sync_task, TASK_WOKEN_MSG);
 
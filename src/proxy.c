@@ -110,6 +110,7 @@ const struct cfg_opt cfg_opts2[] =
 	{ "http-pretend-keepalive",       PR_O2_FAKE_KA,   PR_CAP_BE, 0, PR_MODE_HTTP },
 	{ "http-no-delay",                PR_O2_NODELAY,   PR_CAP_FE|PR_CAP_BE, 0, PR_MODE_HTTP },
 	{ "http-use-htx",                 0,               PR_CAP_FE|PR_CAP_BE, 0, 0 }, // deprecated
+	{ "lb-lockfree",                  PR_O2_LB_LOCKFREE, PR_CAP_BE, 0, 0 },
 
 	{"h1-case-adjust-bogus-client",   PR_O2_H1_ADJ_BUGCLI, PR_CAP_FE, 0, PR_MODE_HTTP },
 	{"h1-case-adjust-bogus-server",   PR_O2_H1_ADJ_BUGSRV, PR_CAP_BE, 0, PR_MODE_HTTP },
@@ -413,6 +414,87 @@ static int proxy_parse_max_ka_queue(char **args, int section, struct proxy *prox
 	return retval;
 }
 
+/* This function parses a "queue-codel" statement in a proxy section. It
+ * returns -1 if there is any error, 1 for a warning, otherwise zero. If it
+ * does not return zero, it will write an error or warning message into a
+ * preallocated buffer returned at <err>. The function must be called with
+ * <args> pointing to the first command line word, with <proxy> pointing to
+ * the proxy being parsed, and <defpx> to the default proxy or NULL.
+ */
+static int proxy_parse_queue_codel(char **args, int section, struct proxy *proxy,
+                                   struct proxy *defpx, const char *file, int line,
+                                   char **err)
+{
+	unsigned int target, interval;
+	const char *res;
+	int retval, cur_arg;
+
+	retval = 0;
+
+	if (*args[1] == 0) {
+		memprintf(err, "'%s' expects a target queue time (in milliseconds), or 'off'", args[0]);
+		return -1;
+	}
+
+	if (strcmp(args[1], "off") == 0) {
+		proxy->codel_target = 0;
+		return 0;
+	}
+
+	res = parse_time_err(args[1], &target, TIME_UNIT_MS);
+	if (res == PARSE_TIME_OVER) {
+		memprintf(err, "timer overflow in argument '%s' to '%s' (maximum value is 2147483647 ms or ~24.8 days)",
+			  args[1], args[0]);
+		return -1;
+	}
+	else if (res == PARSE_TIME_UNDER || (!res && !target)) {
+		memprintf(err, "timer underflow in argument '%s' to '%s' (minimum value is 1 ms)",
+			  args[1], args[0]);
+		return -1;
+	}
+	else if (res) {
+		memprintf(err, "unexpected character '%c' in '%s'", *res, args[0]);
+		return -1;
+	}
+
+	/* the target is usually 5 to 10% of the interval */
+	interval = target * 20;
+	if (interval / 20 != target)
+		interval = ~0U >> 1;
+
+	for (cur_arg = 2; *args[cur_arg]; cur_arg += 2) {
+		if (strcmp(args[cur_arg], "interval") != 0) {
+			memprintf(err, "'%s' only supports the 'interval' option (got '%s')", args[0], args[cur_arg]);
+			return -1;
+		}
+
+		res = parse_time_err(args[cur_arg + 1], &interval, TIME_UNIT_MS);
+		if (res == PARSE_TIME_OVER) {
+			memprintf(err, "timer overflow in argument '%s' to '%s %s' (maximum value is 2147483647 ms or ~24.8 days)",
+				  args[cur_arg + 1], args[0], args[cur_arg]);
+			return -1;
+		}
+		else if (res == PARSE_TIME_UNDER || (!res && !interval)) {
+			memprintf(err, "'%s %s' expects a non-null time (in milliseconds)", args[0], args[cur_arg]);
+			return -1;
+		}
+		else if (res) {
+			memprintf(err, "unexpected character '%c' in '%s %s'", *res, args[0], args[cur_arg]);
+			return -1;
+		}
+	}
+
+	if (!(proxy->cap & PR_CAP_BE)) {
+		memprintf(err, "%s will be ignored because %s '%s' has no backend capability",
+		          args[0], proxy_type_str(proxy), proxy->id);
+		retval = 1;
+	}
+
+	proxy->codel_target = target;
+	proxy->codel_interval = interval;
+	return retval;
+}
+
 /* This function parses a "declare" statement in a proxy section. It returns -1
  * if there is any error, 1 for warning, otherwise 0. If it does not return zero,
  * it will write an error or warning message into a preallocated buffer returned
@@ -1113,6 +1195,7 @@ void soft_stop(void)
 {
 	struct proxy *p;
 	struct peers *prs;
+	struct stktable *t;
 	struct task *task;
 
 	stopping = 1;
@@ -1161,6 +1244,10 @@ void soft_stop(void)
 		p = p->next;
 	}
 
+	/* tables may need to save their entries before they are purged */
+	for (t = stktables_list; t; t = t->next)
+		stktable_snapshot_stop(t);
+
 	prs = cfg_peers;
 	while (prs) {
 		if (prs->peers_fe)
@@ -1679,6 +1766,7 @@ static struct cfg_kw_list cfg_kws = {ILH, {
 	{ CFG_LISTEN, "srvtimeout", proxy_parse_timeout }, /* This keyword actually fails to parse, this line remains for better error messages. */
 	{ CFG_LISTEN, "rate-limit", proxy_parse_rate_limit },
 	{ CFG_LISTEN, "max-keep-alive-queue", proxy_parse_max_ka_queue },
+	{ CFG_LISTEN, "queue-codel", proxy_parse_queue_codel },
 	{ CFG_LISTEN, "declare", proxy_parse_declare },
 	{ CFG_LISTEN, "retry-on", proxy_parse_retry_on },
 	{ 0, NULL, NULL },
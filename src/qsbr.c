@@ -0,0 +1,105 @@
+/*
+ * Quiescent-state based reclamation of shared objects.
+ *
+ * Copyright 2026 agent <agent@local>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version
+ * 2 of the License, or (at your option) any later version.
+ *
+ */
+
+#include <common/config.h>
+#include <common/hathreads.h>
+#include <common/initcall.h>
+#include <common/qsbr.h>
+
+#include <types/global.h>
+
+volatile unsigned long qsbr_gen = 0;                /* last generation retired */
+volatile unsigned long qsbr_oldest = 0;             /* oldest pending generation, 0 if none */
+volatile unsigned long qsbr_seen[MAX_THREADS] = { }; /* last generation seen per thread */
+
+static struct qsbr_node *qsbr_list = NULL;          /* pending objects, newest first */
+__decl_aligned_spinlock(qsbr_lock);
+
+/* Retires object <node>, which must not be reachable anymore by threads
+ * looking for it. <release> will be called once no thread may still use it.
+ */
+void qsbr_retire(struct qsbr_node *node, void (*release)(struct qsbr_node *))
+{
+	__ha_barrier_store();
+
+	HA_SPIN_LOCK(QSBR_LOCK, &qsbr_lock);
+	node->release = release;
+	node->gen = ++qsbr_gen;
+	node->next = qsbr_list;
+	qsbr_list = node;
+	if (!qsbr_oldest)
+		qsbr_oldest = node->gen;
+	HA_SPIN_UNLOCK(QSBR_LOCK, &qsbr_lock);
+}
+
+/* Releases the retired objects which all threads are done with. */
+void qsbr_reclaim()
+{
+	struct qsbr_node *node, **prev, *done = NULL;
+	unsigned long mask, min, oldest;
+	int thr;
+
+	/* threads sleeping in the poller reference nothing */
+	mask = all_threads_mask & ~threads_harmless_mask & ~tid_bit;
+	__ha_barrier_load();
+
+	min = qsbr_seen[tid];
+	for (thr = 0; mask; thr++, mask >>= 1) {
+		if ((mask & 1) && (long)(qsbr_seen[thr] - min) < 0)
+			min = qsbr_seen[thr];
+	}
+
+	if ((long)(min - qsbr_oldest) < 0)
+		return;
+
+	HA_SPIN_LOCK(QSBR_LOCK, &qsbr_lock);
+	oldest = 0;
+	for (prev = &qsbr_list; (node = *prev); ) {
+		if ((long)(min - node->gen) >= 0) {
+			*prev = node->next;
+			node->next = done;
+			done = node;
+		}
+		else {
+			oldest = node->gen;
+			prev = &node->next;
+		}
+	}
+	qsbr_oldest = oldest;
+	HA_SPIN_UNLOCK(QSBR_LOCK, &qsbr_lock);
+
+	while ((node = done)) {
+		done = node->next;
+		node->release(node);
+	}
+}
+
+/* Releases the objects still pending at exit, no thread uses them anymore */
+static void qsbr_deinit()
+{
+	struct qsbr_node *node;
+
+	while ((node = qsbr_list)) {
+		qsbr_list = node->next;
+		node->release(node);
+	}
+	qsbr_oldest = 0;
+}
+
+REGISTER_POST_DEINIT(qsbr_deinit);
+
+/*
+ * Local variables:
+ *  c-indent-level: 8
+ *  c-basic-offset: 8
+ * End:
+ */
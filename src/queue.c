@@ -67,8 +67,13 @@
  *     pendconn_dequeue() which sets it on strm->target).
  *
  *   - a pendconn doesn't switch between queues, it stays where it is.
+ *
+ *   - a single thread at a time dequeues pendconns for a given server (see
+ *     process_srv_queue()), the other ones delegate this work to it instead
+ *     of waiting for the locks.
  */
 
+#include <common/codel.h>
 #include <common/config.h>
 #include <common/initcall.h>
 #include <common/memory.h>
@@ -98,6 +103,7 @@ DECLARE_POOL(pool_head_pendconn, "pendconn", sizeof(struct pendconn));
 /* returns the effective dynamic maxconn for a server, considering the minconn
  * and the proxy's usage relative to its dynamic connections limit. It is
  * expected that 0 < s->minconn <= s->maxconn when this is called. If the
+ * server uses an adaptive maxconn, it caps the resulting value. If the
  * server is currently warming up, the slowstart is also applied to the
  * resulting value, which can be lower than minconn in this case, but never
  * less than 1.
@@ -115,6 +121,9 @@ unsigned int srv_dynamic_maxconn(const struct server *s)
 	else max = MAX(s->minconn,
 		       s->proxy->beconn * s->maxconn / s->proxy->fullconn);
 
+	if (s->adapt_target)
+		max = MIN(max, MAX(1, s->adapt_limit >> SRV_ADAPT_SHIFT));
+
 	if ((s->cur_state == SRV_ST_STARTING) &&
 	    now.tv_sec < s->last_change + s->slowstart &&
 	    now.tv_sec >= s->last_change) {
@@ -125,6 +134,48 @@ unsigned int srv_dynamic_maxconn(const struct server *s)
 	return max;
 }
 
+/* Adjusts the adaptive maxconn of server <s> after a response which took <ms>
+ * milliseconds, or after a failure if <failed> is non-zero. This is an AIMD
+ * scheme: each response faster than the server's target adds one slot per
+ * limit's worth of responses, and a slow response or a failure removes one
+ * eighth of the slots. Decreases happen at most once per target period so that
+ * the requests which were sent before a decrease don't shrink the limit again.
+ * The limit stays between 1 and maxconn. No lock is needed.
+ */
+void srv_adapt_maxconn(struct server *s, unsigned int ms, int failed)
+{
+	unsigned int old, new, max, date;
+
+	if (!s->maxconn)
+		return;
+
+	max = s->maxconn << SRV_ADAPT_SHIFT;
+	old = s->adapt_limit;
+
+	if (!failed && ms <= s->adapt_target) {
+		do {
+			if (old >= max)
+				new = max;
+			else
+				new = MIN(max, old + (1U << (2 * SRV_ADAPT_SHIFT)) / old);
+			if (new == old)
+				return;
+		} while (!_HA_ATOMIC_CAS(&s->adapt_limit, &old, new));
+		return;
+	}
+
+	date = s->adapt_date;
+	if (now_ms - date < s->adapt_target ||
+	    !_HA_ATOMIC_CAS(&s->adapt_date, &date, now_ms))
+		return;
+
+	do {
+		new = MIN(max, old - old / 8);
+		if (new < (1U << SRV_ADAPT_SHIFT))
+			new = 1U << SRV_ADAPT_SHIFT;
+	} while (!_HA_ATOMIC_CAS(&s->adapt_limit, &old, new));
+}
+
 /* Remove the pendconn from the server/proxy queue. At this stage, the
  * connection is not really dequeued. It will be done during the
  * process_stream. It also decreases the pending count.
@@ -226,12 +277,18 @@ static struct pendconn *pendconn_first(struct eb_root *pendconns)
  * immediately marked as "assigned", and both its <srv> and <srv_conn> are set
  * to <srv>.
  *
- * This function must only be called if the server queue _AND_ the proxy queue
- * are locked. Today it is only called by process_srv_queue. When a pending
+ * If the backend uses "queue-codel" and the queue the pending connection comes
+ * from has been holding connections for too long, it is rejected instead and
+ * its stream is woken up to report the error. 1 is returned in this case too
+ * so that the next one is processed.
+ *
+ * This function must only be called if the server queue is locked. The proxy
+ * queue is only considered if <px_locked> is non-zero, indicating that it is
+ * locked as well. Today it is only called by process_srv_queue. When a pending
  * connection is dequeued, this function returns 1 if the pending connection can
  * be handled by the current thread, else it returns 2.
  */
-static int pendconn_process_next_strm(struct server *srv, struct proxy *px)
+static int pendconn_process_next_strm(struct server *srv, struct proxy *px, int px_locked)
 {
 	struct pendconn *p = NULL;
 	struct pendconn *pp = NULL;
@@ -247,7 +304,7 @@ static int pendconn_process_next_strm(struct server *srv, struct proxy *px)
 		p = pendconn_first(&srv->pendconns);
 
 	pp = NULL;
-	if (srv_currently_usable(rsrv) && px->nbpend &&
+	if (px_locked && srv_currently_usable(rsrv) && px->nbpend &&
 	    (!(srv->flags & SRV_F_BACKUP) ||
 	     (!px->srv_act &&
 	      (srv == px->lbprm.fbck || (px->options & PR_O_USE_ALL_BK)))))
@@ -284,6 +341,15 @@ static int pendconn_process_next_strm(struct server *srv, struct proxy *px)
 	/* Let's switch from the server pendconn to the proxy pendconn */
 	p = pp;
  use_p:
+	if (px->codel_target &&
+	    codel_must_drop(p == pp ? &px->codel : &srv->codel, now_ms, now_ms - p->date,
+	                    px->codel_target, px->codel_interval)) {
+		__pendconn_unlink(p);
+		p->rejected = 1;
+		task_wakeup(p->strm->task, TASK_WOKEN_RES);
+		return 1;
+	}
+
 	__pendconn_unlink(p);
 	p->strm_flags |= SF_ASSIGNED;
 	p->target = srv;
@@ -307,22 +373,44 @@ static int pendconn_process_next_strm(struct server *srv, struct proxy *px)
 
 /* Manages a server's connection queue. This function will try to dequeue as
  * many pending streams as possible, and wake them up.
+ *
+ * All threads releasing a connection on a saturated server call it, but only
+ * one of them at a time does the job : the other ones only count themselves
+ * in <s>->dequeuing and leave without touching any lock. The thread doing the
+ * job checks the queues again when this counter changed while it was working,
+ * so that no released slot is missed. The proxy's lock is only taken when the
+ * proxy's queue is not empty.
  */
 void process_srv_queue(struct server *s)
 {
 	struct proxy  *p = s->proxy;
-	int maxconn;
+	unsigned int busy;
+	int maxconn, px_lock;
 
+	if (HA_ATOMIC_ADD(&s->dequeuing, 1) != 1)
+		return;
+
+ again:
+	px_lock = !!p->nbpend;
 	HA_SPIN_LOCK(SERVER_LOCK, &s->lock);
-	HA_SPIN_LOCK(PROXY_LOCK,  &p->lock);
+	if (px_lock)
+		HA_SPIN_LOCK(PROXY_LOCK,  &p->lock);
 	maxconn = srv_dynamic_maxconn(s);
 	while (s->served < maxconn) {
-		int ret = pendconn_process_next_strm(s, p);
+		int ret = pendconn_process_next_strm(s, p, px_lock);
 		if (!ret)
 			break;
 	}
-	HA_SPIN_UNLOCK(PROXY_LOCK,  &p->lock);
+	if (px_lock)
+		HA_SPIN_UNLOCK(PROXY_LOCK,  &p->lock);
 	HA_SPIN_UNLOCK(SERVER_LOCK, &s->lock);
+
+	busy = 1;
+	if (!HA_ATOMIC_CAS(&s->dequeuing, &busy, 0)) {
+		/* other threads came in the mean time */
+		HA_ATOMIC_STORE(&s->dequeuing, 1);
+		goto again;
+	}
 }
 
 /* Adds the stream <strm> to the pending connection queue of server <strm>->srv
@@ -366,6 +454,8 @@ struct pendconn *pendconn_add(struct stream *strm)
 	p->px         = px;
 	p->strm       = strm;
 	p->strm_flags = strm->flags;
+	p->date       = now_ms;
+	p->rejected   = 0;
 
 	pendconn_queue_lock(p);
 
@@ -463,9 +553,10 @@ int pendconn_grab_from_px(struct server *s)
 
 /* Try to dequeue pending connection attached to the stream <strm>. It must
  * always exists here. If the pendconn is still linked to the server or the
- * proxy queue, nothing is done and the function returns 1. Otherwise,
- * <strm>->flags and <strm>->target are updated, the pendconn is released and 0
- * is returned.
+ * proxy queue, nothing is done and the function returns 1. If it was rejected
+ * by the queue management, the pendconn is released and -1 is returned.
+ * Otherwise, <strm>->flags and <strm>->target are updated, the pendconn is
+ * released and 0 is returned.
  *
  * This function must be called by the stream itself, so in the context of
  * process_stream.
@@ -501,6 +592,12 @@ int pendconn_dequeue(struct stream *strm)
 	/* the pendconn is not queued anymore and will not be so we're safe
 	 * to proceed.
 	 */
+	if (p->rejected) {
+		strm->pend_pos = NULL;
+		pool_free(pool_head_pendconn, p);
+		return -1;
+	}
+
 	if (p->target)
 		strm->target = &p->target->obj_type;
 
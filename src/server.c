@@ -1519,6 +1519,9 @@ const char *server_parse_maxconn_change_request(struct server *sv,
 		sv->maxconn = v;
 	}
 
+	/* the adaptive maxconn starts again from the new limit */
+	sv->adapt_limit = sv->maxconn << SRV_ADAPT_SHIFT;
+
 	if (may_dequeue_tasks(sv, sv->proxy))
 		process_srv_queue(sv);
 
@@ -1766,6 +1769,7 @@ static void srv_settings_cpy(struct server *srv, struct server *src, int srv_tmp
 	srv->maxqueue                 = src->maxqueue;
 	srv->minconn                  = src->minconn;
 	srv->maxconn                  = src->maxconn;
+	srv->adapt_target             = src->adapt_target;
 	srv->slowstart                = src->slowstart;
 	srv->observe                  = src->observe;
 	srv->onerror                  = src->onerror;
@@ -2694,6 +2698,30 @@ int parse_server(const char *file, int linenum, char **args, struct proxy *curpr
 				newsrv->maxqueue = atol(args[cur_arg + 1]);
 				cur_arg += 2;
 			}
+			else if (!strcmp(args[cur_arg], "maxconn-adapt")) {
+				const char *err = parse_time_err(args[cur_arg + 1], &val, TIME_UNIT_MS);
+
+				if (err == PARSE_TIME_OVER) {
+					ha_alert("parsing [%s:%d]: timer overflow in argument <%s> to <%s> of server %s, maximum value is 2147483647 ms (~24.8 days).\n",
+						 file, linenum, args[cur_arg+1], args[cur_arg], newsrv->id);
+					err_code |= ERR_ALERT | ERR_FATAL;
+					goto out;
+				}
+				else if (err == PARSE_TIME_UNDER) {
+					ha_alert("parsing [%s:%d]: timer underflow in argument <%s> to <%s> of server %s, minimum non-null value is 1 ms.\n",
+						 file, linenum, args[cur_arg+1], args[cur_arg], newsrv->id);
+					err_code |= ERR_ALERT | ERR_FATAL;
+					goto out;
+				}
+				else if (err) {
+					ha_alert("parsing [%s:%d] : unexpected character '%c' in 'maxconn-adapt' argument of server %s.\n",
+					      file, linenum, *err, newsrv->id);
+					err_code |= ERR_ALERT | ERR_FATAL;
+					goto out;
+				}
+				newsrv->adapt_target = val;
+				cur_arg += 2;
+			}
 			else if (!strcmp(args[cur_arg], "slowstart")) {
 				/* slowstart is stored in seconds */
 				const char *err = parse_time_err(args[cur_arg + 1], &val, TIME_UNIT_MS);
@@ -5127,6 +5155,10 @@ static void srv_update_status(struct server *s)
 			if (s->next_state == SRV_ST_STARTING)
 				task_schedule(s->warmup, tick_add(now_ms, MS_TO_TICKS(MAX(1000, s->slowstart / 20))));
 
+			/* forget the adaptive maxconn learned before the failure */
+			if (s->cur_state == SRV_ST_STOPPED)
+				s->adapt_limit = s->maxconn << SRV_ADAPT_SHIFT;
+
 			server_recalc_eweight(s, 0);
 			/* now propagate the status change to any LB algorithms */
 			if (px->lbprm.update_server_eweight)
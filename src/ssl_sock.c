@@ -5884,6 +5884,8 @@ static int ssl_sock_init(struct connection *conn, void **xprt_ctx)
 	}
 	ctx->wait_event.tasklet->process = ssl_sock_io_cb;
 	ctx->wait_event.tasklet->context = ctx;
+	/* handshakes are expensive, the tasklet becomes urgent once done */
+	tasklet_set_class(ctx->wait_event.tasklet, TL_BULK);
 	ctx->wait_event.events = 0;
 	ctx->sent_early_data = 0;
 	ctx->early_buf = BUF_NULL;
@@ -6443,8 +6445,11 @@ static struct task *ssl_sock_io_cb(struct task *t, void *context, unsigned short
 	struct ssl_sock_ctx *ctx = context;
 
 	/* First if we're doing an handshake, try that */
-	if (ctx->conn->flags & CO_FL_SSL_WAIT_HS)
+	if (ctx->conn->flags & CO_FL_SSL_WAIT_HS) {
 		ssl_sock_handshake(ctx->conn, CO_FL_SSL_WAIT_HS);
+		if (!(ctx->conn->flags & CO_FL_SSL_WAIT_HS))
+			tasklet_set_class(ctx->wait_event.tasklet, TL_URGENT);
+	}
 	/* If we had an error, or the handshake is done and I/O is available,
 	 * let the upper layer know.
 	 * If no mux was set up yet, and nobody subscribed, then call
@@ -58,6 +58,9 @@ THREAD_LOCAL int itoa_idx = 0; /* index of next itoa_str to use */
 THREAD_LOCAL char quoted_str[NB_QSTR][QSTR_SIZE + 1];
 THREAD_LOCAL int quoted_idx = 0;
 
+/* state of each thread's ha_random() generator, seeded on first use */
+THREAD_LOCAL unsigned int ha_random_state = 0;
+
 /*
  * unsigned long long ASCII representation
  *
@@ -4023,6 +4026,18 @@ unsigned char utf8_next(const char *s, int len, unsigned int *c)
 	return code | ((p-(unsigned char *)s)&0x0f);
 }
 
+/* Returns a non-null seed for the calling thread's ha_random() generator. The
+ * state's address differs between threads so that they don't all produce the
+ * same sequence.
+ */
+unsigned int ha_random_seed()
+{
+	unsigned int x;
+
+	x = random() ^ (unsigned int)(unsigned long)&ha_random_state ^ (unsigned int)rdtsc();
+	return x ? x : 0x5bd1e995;
+}
+
 /* append a copy of string <str> (in a wordlist) at the end of the list <li>
  * On failure : return 0 and <err> filled with an error message.
  * The caller is responsible for freeing the <err> and <str> copy
@@ -63,6 +63,7 @@
 #include <proto/listener.h>
 #include <proto/map.h>
 #include <proto/proxy.h>
+#include <proto/queue.h>
 #include <proto/sample.h>
 #include <proto/session.h>
 #include <proto/ssl_sock.h>
@@ -153,6 +154,12 @@ const struct name_desc info_fields[INF_TOTAL_FIELDS] = {
 	[INF_TOTAL_BYTES_OUT]                = { .name = "TotalBytesOut",               .desc = "Total number of bytes emitted by current worker process since started" },
 	[INF_BYTES_OUT_RATE]                 = { .name = "BytesOutRate",                .desc = "Number of bytes emitted by current worker process over the last second" },
 	[INF_DEBUG_COMMANDS_ISSUED]          = { .name = "DebugCommandsIssued",         .desc = "Number of debug commands issued on this process (anything > 0 is unsafe)" },
+	[INF_MEM_BUDGET_MB]                  = { .name = "MemBudget_MB",                .desc = "Memory budget for pools in megabytes (tune.memory.budget), 0=none" },
+	[INF_MEM_PRESSURE]                   = { .name = "MemPressure",                 .desc = "Current memory pressure level, from 0 (none) to 4 (accept paused)" },
+	[INF_MEM_SHED_COMP]                  = { .name = "MemShedComp",                 .desc = "Total number of responses not compressed because of memory pressure" },
+	[INF_MEM_SHED_CACHE]                 = { .name = "MemShedCache",                .desc = "Total number of objects not stored into caches because of memory pressure" },
+	[INF_MEM_SHED_H2]                    = { .name = "MemShedH2",                   .desc = "Total number of H2 streams refused because of memory pressure" },
+	[INF_MEM_SHED_ACCEPT]                = { .name = "MemShedAccept",               .desc = "Total number of times listeners were paused because of memory pressure" },
 };
 
 const struct name_desc stat_fields[ST_F_TOTAL_FIELDS] = {
@@ -250,6 +257,7 @@ const struct name_desc stat_fields[ST_F_TOTAL_FIELDS] = {
 	[ST_F_CT_MAX]                        = { .name = "ctime_max",                   .desc = "Maximum observed time spent waiting for a connection to complete, in milliseconds (backend/server)" },
 	[ST_F_RT_MAX]                        = { .name = "rtime_max",                   .desc = "Maximum observed time spent waiting for a server response, in milliseconds (backend/server)" },
 	[ST_F_TT_MAX]                        = { .name = "ttime_max",                   .desc = "Maximum observed total request+response time (request+queue+connect+response+processing), in milliseconds (backend/server)" },
+	[ST_F_SRV_DLIM]                      = { .name = "srv_dlim",                    .desc = "Current limit on the number of concurrent sessions on this server, after applying minconn/fullconn, slowstart and maxconn-adapt" },
 };
 
 /* one line of info */
@@ -1666,8 +1674,10 @@ int stats_fill_sv_stats(struct proxy *px, struct server *sv, int flags,
 	stats[ST_F_SCUR]     = mkf_u32(0, sv->cur_sess);
 	stats[ST_F_SMAX]     = mkf_u32(FN_MAX, sv->counters.cur_sess_max);
 
-	if (sv->maxconn)
+	if (sv->maxconn) {
 		stats[ST_F_SLIM] = mkf_u32(FO_CONFIG|FN_LIMIT, sv->maxconn);
+		stats[ST_F_SRV_DLIM] = mkf_u32(FN_LIMIT, srv_dynamic_maxconn(sv));
+	}
 
 	stats[ST_F_SRV_ICUR] = mkf_u32(0, sv->curr_idle_conns);
 	if (sv->max_idle_conns != -1)
@@ -3485,6 +3495,12 @@ int stats_fill_info(struct field *info, int len)
 	info[INF_TOTAL_BYTES_OUT]                = mkf_u64(0, global.out_bytes);
 	info[INF_BYTES_OUT_RATE]                 = mkf_u64(FN_RATE, (unsigned long long)read_freq_ctr(&global.out_32bps) * 32);
 	info[INF_DEBUG_COMMANDS_ISSUED]          = mkf_u32(0, debug_commands_issued);
+	info[INF_MEM_BUDGET_MB]                  = mkf_u32(FO_CONFIG|FN_LIMIT, mem_budget);
+	info[INF_MEM_PRESSURE]                   = mkf_u32(0, mem_pressure);
+	info[INF_MEM_SHED_COMP]                  = mkf_u32(FN_COUNTER, mem_pressure_shed[MEM_PRESSURE_COMP]);
+	info[INF_MEM_SHED_CACHE]                 = mkf_u32(FN_COUNTER, mem_pressure_shed[MEM_PRESSURE_CACHE]);
+	info[INF_MEM_SHED_H2]                    = mkf_u32(FN_COUNTER, mem_pressure_shed[MEM_PRESSURE_H2]);
+	info[INF_MEM_SHED_ACCEPT]                = mkf_u32(FN_COUNTER, mem_pressure_shed[MEM_PRESSURE_ACCEPT]);
 
 	return 1;
 }
@@ -12,7 +12,11 @@
  */
 
 #include <string.h>
+#include <ctype.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <unistd.h>
 
 #include <common/config.h>
 #include <common/cfgparse.h>
@@ -31,6 +35,7 @@
 
 #include <proto/arg.h>
 #include <proto/cli.h>
+#include <proto/dict.h>
 #include <proto/http_rules.h>
 #include <proto/log.h>
 #include <proto/http_ana.h>
@@ -52,6 +57,12 @@ struct eb_root stktable_by_name = EB_ROOT;
 
 #define round_ptr_size(i) (((i) + (sizeof(void *) - 1)) &~ (sizeof(void *) - 1))
 
+/* delay before checking again an expired entry which couldn't be purged (ms) */
+#define STKTABLE_EXP_RETRY     1000
+
+/* delay after which the lowest value of a top-K is refreshed (ms) */
+#define STKTABLE_TOPK_REFRESH  1000
+
 /* This function inserts stktable <t> into the tree of known stick-table.
  * The stick-table ID is used as the storing key so it must already have
  * been initialized.
@@ -83,32 +94,57 @@ struct stktable *stktable_find_by_name(const char *name)
  */
 void __stksess_free(struct stktable *t, struct stksess *ts)
 {
-	t->current--;
+	HA_ATOMIC_SUB(&t->current, 1);
 	pool_free(t->pool, (void *)ts - round_ptr_size(t->data_size));
 }
 
 /*
  * Free an allocated sticky session <ts>, and decrease sticky sessions counter
- * in table <t>.
- * This function locks the table
+ * in table <t>. No lock is needed since <ts> is not in the table.
  */
 void stksess_free(struct stktable *t, struct stksess *ts)
 {
-	HA_SPIN_LOCK(STK_TABLE_LOCK, &t->lock);
 	__stksess_free(t, ts);
+}
+
+/*
+ * Remove <ts> from the updates tree of table <t>, unless it is referenced.
+ * Peers may reference entries found in this tree with only the table's lock
+ * held, so the reference count is checked again under this lock. Returns 0 if
+ * the entry is referenced, otherwise non-zero. The entry's shard must be
+ * locked.
+ */
+static int __stksess_unlink_upd(struct stktable *t, struct stksess *ts)
+{
+	int ret = 1;
+
+	if (!t->sync_task) {
+		eb32_delete(&ts->upd);
+		return 1;
+	}
+
+	HA_SPIN_LOCK(STK_TABLE_LOCK, &t->lock);
+	if (ts->ref_cnt)
+		ret = 0;
+	else
+		eb32_delete(&ts->upd);
 	HA_SPIN_UNLOCK(STK_TABLE_LOCK, &t->lock);
+	return ret;
 }
 
 /*
- * Kill an stksess (only if its ref_cnt is zero).
+ * Kill an stksess (only if its ref_cnt is zero). The entry's shard must be
+ * locked.
  */
 int __stksess_kill(struct stktable *t, struct stksess *ts)
 {
 	if (ts->ref_cnt)
 		return 0;
 
-	eb32_delete(&ts->exp);
-	eb32_delete(&ts->upd);
+	if (!__stksess_unlink_upd(t, ts))
+		return 0;
+
+	tw_delete(&ts->exp);
 	ebmb_delete(&ts->key);
 	__stksess_free(t, ts);
 	return 1;
@@ -117,17 +153,25 @@ int __stksess_kill(struct stktable *t, struct stksess *ts)
 /*
  * Decrease the refcount if decrefcnt is not 0.
  * and try to kill the stksess
- * This function locks the table
+ * This function locks the entry's shard
  */
 int stksess_kill(struct stktable *t, struct stksess *ts, int decrefcnt)
 {
+	struct stktable_shard *sh;
 	int ret;
 
-	HA_SPIN_LOCK(STK_TABLE_LOCK, &t->lock);
+	if (t->sketch_depth) {
+		if (decrefcnt)
+			stktable_sketch_release(t, ts);
+		return 1;
+	}
+
+	sh = stksess_shard(t, ts);
+	HA_SPIN_LOCK(STK_TABLE_LOCK, &sh->lock);
 	if (decrefcnt)
-		ts->ref_cnt--;
+		HA_ATOMIC_SUB(&ts->ref_cnt, 1);
 	ret = __stksess_kill(t, ts);
-	HA_SPIN_UNLOCK(STK_TABLE_LOCK, &t->lock);
+	HA_SPIN_UNLOCK(STK_TABLE_LOCK, &sh->lock);
 
 	return ret;
 }
@@ -156,7 +200,7 @@ static struct stksess *__stksess_init(struct stktable *t, struct stksess * ts)
 	memset((void *)ts - t->data_size, 0, t->data_size);
 	ts->ref_cnt = 0;
 	ts->key.node.leaf_p = NULL;
-	ts->exp.node.leaf_p = NULL;
+	tw_node_init(&ts->exp);
 	ts->upd.node.leaf_p = NULL;
 	ts->expire = tick_add(now_ms, MS_TO_TICKS(t->expire));
 	HA_RWLOCK_INIT(&ts->lock);
@@ -164,104 +208,119 @@ static struct stksess *__stksess_init(struct stktable *t, struct stksess * ts)
 }
 
 /*
- * Trash oldest <to_batch> sticky sessions from table <t>
+ * Trash oldest <to_batch> sticky sessions from shard <sh> of table <t>, which
+ * must be locked. The entries are visited in the order of their expiration
+ * slot, without waiting for them to expire.
  * Returns number of trashed sticky sessions.
  */
-int __stktable_trash_oldest(struct stktable *t, int to_batch)
+int __stktable_trash_oldest(struct stktable *t, struct stktable_shard *sh, int to_batch)
 {
-	struct stksess *ts;
-	struct eb32_node *eb;
+	struct stksess *ts, *back;
+	struct list *slot;
+	unsigned int pos = 0;
 	int batched = 0;
-	int looped = 0;
 
-	eb = eb32_lookup_ge(&t->exps, now_ms - TIMER_LOOK_BACK);
-
-	while (batched < to_batch) {
-
-		if (unlikely(!eb)) {
-			/* we might have reached the end of the tree, typically because
-			 * <now_ms> is in the first half and we're first scanning the last
-			 * half. Let's loop back to the beginning of the tree now if we
-			 * have not yet visited it.
-			 */
-			if (looped)
+	while (batched < to_batch && (slot = tw_next_slot(&sh->exps, &pos))) {
+		list_for_each_entry_safe(ts, back, slot, exp.list) {
+			if (batched >= to_batch)
 				break;
-			looped = 1;
-			eb = eb32_first(&t->exps);
-			if (likely(!eb))
-				break;
-		}
 
-		/* timer looks expired, detach it from the queue */
-		ts = eb32_entry(eb, struct stksess, exp);
-		eb = eb32_next(eb);
+			/* don't delete an entry which is currently referenced */
+			if (ts->ref_cnt)
+				continue;
 
-		/* don't delete an entry which is currently referenced */
-		if (ts->ref_cnt)
-			continue;
+			if (ts->expire != ts->exp.key) {
+				/* touched since queued, requeue it at its new date,
+				 * it will be visited again if it's still among the
+				 * oldest ones.
+				 */
+				tw_delete(&ts->exp);
+				if (!tick_isset(ts->expire))
+					continue;
 
-		eb32_delete(&ts->exp);
+				ts->exp.key = ts->expire;
+				tw_insert(&sh->exps, &ts->exp);
+				continue;
+			}
 
-		if (ts->expire != ts->exp.key) {
-			if (!tick_isset(ts->expire))
+			/* session expired, trash it */
+			if (!__stksess_unlink_upd(t, ts))
 				continue;
+			tw_delete(&ts->exp);
+			ebmb_delete(&ts->key);
+			__stksess_free(t, ts);
+			batched++;
+		}
+	}
 
-			ts->exp.key = ts->expire;
-			eb32_insert(&t->exps, &ts->exp);
+	return batched;
+}
 
-			if (!eb || eb->key > ts->exp.key)
-				eb = &ts->exp;
+/*
+ * Trash oldest <to_batch> sticky sessions from table <t>, starting with shard
+ * <locked> if not NULL, which the caller holds. In this case, the other shards
+ * are only visited if their lock is immediately available, so that two threads
+ * doing the same cannot wait for each other.
+ * Returns number of trashed sticky sessions.
+ */
+static int stktable_trash_shards(struct stktable *t, struct stktable_shard *locked, int to_batch)
+{
+	struct stktable_shard *sh;
+	unsigned int first, i;
+	int batched = 0;
 
+	first = locked ? locked - t->shards : now_ms % t->nbshards;
+	for (i = 0; i < t->nbshards && batched < to_batch; i++) {
+		sh = &t->shards[(first + i) % t->nbshards];
+		if (sh == locked) {
+			batched += __stktable_trash_oldest(t, sh, to_batch - batched);
 			continue;
 		}
 
-		/* session expired, trash it */
-		ebmb_delete(&ts->key);
-		eb32_delete(&ts->upd);
-		__stksess_free(t, ts);
-		batched++;
+		if (!locked)
+			HA_SPIN_LOCK(STK_TABLE_LOCK, &sh->lock);
+		else if (HA_SPIN_TRYLOCK(STK_TABLE_LOCK, &sh->lock) != 0)
+			continue;
+		batched += __stktable_trash_oldest(t, sh, to_batch - batched);
+		HA_SPIN_UNLOCK(STK_TABLE_LOCK, &sh->lock);
 	}
-
 	return batched;
 }
 
 /*
  * Trash oldest <to_batch> sticky sessions from table <t>
  * Returns number of trashed sticky sessions.
- * This function locks the table
+ * This function locks the table's shards one at a time
  */
 int stktable_trash_oldest(struct stktable *t, int to_batch)
 {
-	int ret;
-
-	HA_SPIN_LOCK(STK_TABLE_LOCK, &t->lock);
-	ret = __stktable_trash_oldest(t, to_batch);
-	HA_SPIN_UNLOCK(STK_TABLE_LOCK, &t->lock);
-
-	return ret;
+	return stktable_trash_shards(t, NULL, to_batch);
 }
+
 /*
  * Allocate and initialise a new sticky session.
  * The new sticky session is returned or NULL in case of lack of memory.
  * Sticky sessions should only be allocated this way, and must be freed using
  * stksess_free(). Table <t>'s sticky session counter is increased. If <key>
- * is not NULL, it is assigned to the new session.
+ * is not NULL, it is assigned to the new session. If the table is full, the
+ * oldest entries are purged, preferably from shard <sh> which the caller
+ * holds, if not NULL.
  */
-struct stksess *__stksess_new(struct stktable *t, struct stktable_key *key)
+static struct stksess *__stksess_new(struct stktable *t, struct stktable_shard *sh, struct stktable_key *key)
 {
 	struct stksess *ts;
 
-	if (unlikely(t->current == t->size)) {
+	if (unlikely(t->current >= t->size)) {
 		if ( t->nopurge )
 			return NULL;
 
-		if (!__stktable_trash_oldest(t, (t->size >> 8) + 1))
+		if (!stktable_trash_shards(t, sh, (t->size >> 8) + 1))
 			return NULL;
 	}
 
 	ts = pool_alloc(t->pool);
 	if (ts) {
-		t->current++;
+		HA_ATOMIC_ADD(&t->current, 1);
 		ts = (void *)ts + round_ptr_size(t->data_size);
 		__stksess_init(t, ts);
 		if (key)
@@ -276,31 +335,434 @@ struct stksess *__stksess_new(struct stktable *t, struct stktable_key *key)
  * Sticky sessions should only be allocated this way, and must be freed using
  * stksess_free(). Table <t>'s sticky session counter is increased. If <key>
  * is not NULL, it is assigned to the new session.
- * This function locks the table
+ * This function doesn't need any lock
  */
 struct stksess *stksess_new(struct stktable *t, struct stktable_key *key)
+{
+	return __stksess_new(t, NULL, key);
+}
+
+/*
+ * Tables declared with "sketch" don't store their entries. Instead, each
+ * stored rate is a count-min sketch made of <sketch_depth> rows of <size>
+ * cells, and each key maps to one cell per row. Events are added to all the
+ * cells of the key, whose estimate is the lowest of them : it may only be
+ * over-estimated when other keys share all of its cells. Lookups return
+ * detached entries which are freed once unreferenced. Their data are loaded
+ * with the estimates of their key, and the events counted there are added to
+ * the sketch each time the entry is touched. For this, the rates loaded are
+ * saved in the entry, after its data, at the offsets found in <sketch_ofs>.
+ */
+
+/* Returns the hash of the key of entry <ts> of sketch table <t> */
+static inline unsigned long long stktable_sketch_hash(struct stktable *t, struct stksess *ts)
+{
+	size_t len;
+
+	if (t->type == SMP_T_STR)
+		len = strlen((char *)ts->key.key);
+	else
+		len = t->key_size;
+	return XXH64(ts->key.key, len, 0);
+}
+
+/* Returns the cell of row <row> matching <hash> for data type <type> in sketch
+ * table <t>. Rows use distinct combinations of the two halves of the hash.
+ */
+static inline struct freq_ctr_period *stktable_sketch_cell(struct stktable *t, int type,
+                                                           unsigned int row, unsigned long long hash)
+{
+	unsigned int col = ((unsigned int)hash + row * ((unsigned int)(hash >> 32) | 1)) % t->size;
+
+	return &t->sketch[type][(size_t)row * t->size + col];
+}
+
+/* Returns the copy of rate <type> saved when detached entry <ts> of sketch
+ * table <t> was last loaded.
+ */
+static inline struct freq_ctr_period *stktable_sketch_saved(struct stktable *t, struct stksess *ts, int type)
+{
+	return (void *)ts + t->sketch_ofs[type];
+}
+
+/* Copies sketch cell <cell> to <copy>. The cell is locked like in
+ * update_freq_ctr_period(), using the lowest bit of its date, so that a
+ * period rotation is not seen half-done. Its counter may still be increased
+ * meanwhile, but it's read at once.
+ */
+static inline void stktable_sketch_read_cell(struct freq_ctr_period *cell, struct freq_ctr_period *copy)
+{
+	unsigned int curr_tick = cell->curr_tick;
+
+	do {
+		curr_tick &= ~1;
+	} while (!_HA_ATOMIC_CAS(&cell->curr_tick, &curr_tick, curr_tick | 0x1));
+	__ha_barrier_atomic_store();
+
+	copy->curr_tick = curr_tick;
+	copy->prev_ctr  = cell->prev_ctr;
+	copy->curr_ctr  = cell->curr_ctr;
+
+	_HA_ATOMIC_STORE(&cell->curr_tick, curr_tick);
+}
+
+/* Loads the estimates of the key of detached entry <ts> of sketch table <t>
+ * into its data, and saves them. The entry's lock must be held or the entry
+ * not shared yet. Returns non-zero if any estimate is not null.
+ */
+static int stktable_sketch_load(struct stktable *t, struct stksess *ts, unsigned long long hash)
+{
+	struct freq_ctr_period cell, *data;
+	unsigned int row, rate, min;
+	int type, ret = 0;
+
+	for (type = 0; type < STKTABLE_DATA_TYPES; type++) {
+		if (!t->sketch[type])
+			continue;
+
+		/* there is always at least one row */
+		data = __stktable_data_ptr(t, ts, type);
+		stktable_sketch_read_cell(stktable_sketch_cell(t, type, 0, hash), data);
+		min = read_freq_ctr_period(data, t->data_arg[type].u);
+		for (row = 1; row < t->sketch_depth; row++) {
+			stktable_sketch_read_cell(stktable_sketch_cell(t, type, row, hash), &cell);
+			rate = read_freq_ctr_period(&cell, t->data_arg[type].u);
+			if (rate < min) {
+				*data = cell;
+				min = rate;
+			}
+		}
+
+		*stktable_sketch_saved(t, ts, type) = *data;
+		ret |= !!min;
+	}
+	return ret;
+}
+
+/* Adds to sketch table <t> the events counted on its detached entry <ts>
+ * since it was loaded, then loads it again. Counters are only updated once
+ * between touches, and a period rotation clears the counter before it is
+ * increased, so the events are found by comparing with the saved data.
+ */
+static void stktable_sketch_fold(struct stktable *t, struct stksess *ts)
+{
+	unsigned long long hash = stktable_sketch_hash(t, ts);
+	struct freq_ctr_period *data, *saved;
+	unsigned int row, inc;
+	int type;
+
+	HA_RWLOCK_WRLOCK(STK_SESS_LOCK, &ts->lock);
+	for (type = 0; type < STKTABLE_DATA_TYPES; type++) {
+		if (!t->sketch[type])
+			continue;
+
+		data = __stktable_data_ptr(t, ts, type);
+		saved = stktable_sketch_saved(t, ts, type);
+		if (data->curr_tick == saved->curr_tick)
+			inc = data->curr_ctr - saved->curr_ctr;
+		else
+			inc = data->curr_ctr;
+
+		if (!inc)
+			continue;
+
+		for (row = 0; row < t->sketch_depth; row++)
+			update_freq_ctr_period(stktable_sketch_cell(t, type, row, hash),
+			                       t->data_arg[type].u, inc);
+	}
+	stktable_sketch_load(t, ts, hash);
+	HA_RWLOCK_WRUNLOCK(STK_SESS_LOCK, &ts->lock);
+}
+
+/* Returns a detached entry of sketch table <t> for key <key>, loaded with the
+ * key's estimates and referenced once, or NULL if it could not be allocated.
+ * If <lookup> is set, NULL is also returned when all estimates are null.
+ */
+static struct stksess *stktable_sketch_entry(struct stktable *t, struct stktable_key *key, int lookup)
 {
 	struct stksess *ts;
 
-	HA_SPIN_LOCK(STK_TABLE_LOCK, &t->lock);
-	ts = __stksess_new(t, key);
-	HA_SPIN_UNLOCK(STK_TABLE_LOCK, &t->lock);
+	ts = pool_alloc(t->pool);
+	if (!ts)
+		return NULL;
 
+	ts = (void *)ts + round_ptr_size(t->data_size);
+	__stksess_init(t, ts);
+	stksess_setkey(t, ts, key);
+	if (!stktable_sketch_load(t, ts, stktable_sketch_hash(t, ts)) && lookup) {
+		pool_free(t->pool, (void *)ts - round_ptr_size(t->data_size));
+		return NULL;
+	}
+	ts->ref_cnt = 1;
 	return ts;
 }
 
+/* Releases a reference to detached entry <ts> of sketch table <t>, which is
+ * freed once unreferenced.
+ */
+void stktable_sketch_release(struct stktable *t, struct stksess *ts)
+{
+	if (!HA_ATOMIC_SUB(&ts->ref_cnt, 1))
+		pool_free(t->pool, (void *)ts - round_ptr_size(t->data_size));
+}
+
 /*
- * Looks in table <t> for a sticky session matching key <key>.
+ * Tables declared with "topk" keep the K keys having the highest value for a
+ * data type, using a space-saving scheme : a fixed set of K entries holding a
+ * copy of their key and data is updated each time an entry of the table is
+ * touched. A key already present gets its value updated, otherwise it takes
+ * the place of the lowest entry if its value is higher. The entries are
+ * indexed by their key in a tree, and ordered by value in a min-heap whose
+ * root is the lowest entry, so that an update costs O(log(K)). Most keys are
+ * below the lowest entry, so its value is cached to check them without
+ * taking the top-K's lock. Since the values are copies and not increments, an
+ * update may simply be skipped when the lock is already held, the next one
+ * carrying the latest value. The values of the rates decay, so they are all
+ * refreshed and the heap is rebuilt every STKTABLE_TOPK_REFRESH only. Ranking
+ * only involves the K entries, whatever the size of the table.
+ */
+
+/* Returns the value of data <ptr> of the type ranking the top-K of table <t>.
+ * If the type is a rate, it is copied into <ctr>.
+ */
+static unsigned long long stktable_topk_read(const struct stktable *t, void *ptr, struct freq_ctr_period *ctr)
+{
+	int type = t->topk.type;
+
+	switch (stktable_data_types[type].std_type) {
+	case STD_T_SINT:
+		return MAX(stktable_data_cast(ptr, std_t_sint), 0);
+	case STD_T_UINT:
+		return stktable_data_cast(ptr, std_t_uint);
+	case STD_T_ULL:
+		return stktable_data_cast(ptr, std_t_ull);
+	case STD_T_FRQP:
+		*ctr = stktable_data_cast(ptr, std_t_frqp);
+		return read_freq_ctr_period(ctr, t->data_arg[type].u);
+	}
+	return 0;
+}
+
+/* Returns the size of a top-K entry of table <t>, including its key */
+static inline size_t stktable_topk_ent_size(const struct stktable *t)
+{
+	return (sizeof(struct stktable_topk_ent) + t->key_size + sizeof(void *) - 1) & -sizeof(void *);
+}
+
+/* Moves entry <ent> of the top-K heap of table <t> towards the leaves while
+ * it's higher than one of its children. The top-K's lock must be held.
+ */
+static void stktable_topk_sift_down(struct stktable *t, struct stktable_topk_ent *ent)
+{
+	struct stktable_topk_ent **heap = t->topk.heap;
+	unsigned int pos = ent->pos, child;
+
+	while ((child = 2 * pos + 1) < t->topk.used) {
+		if (child + 1 < t->topk.used && heap[child + 1]->value < heap[child]->value)
+			child++;
+		if (ent->value <= heap[child]->value)
+			break;
+		heap[pos] = heap[child];
+		heap[pos]->pos = pos;
+		pos = child;
+	}
+
+	heap[pos] = ent;
+	ent->pos = pos;
+}
+
+/* Places entry <ent> of the top-K heap of table <t> depending on its value,
+ * towards the root if it's lower than its parent, otherwise towards the
+ * leaves. The top-K's lock must be held.
+ */
+static void stktable_topk_place(struct stktable *t, struct stktable_topk_ent *ent)
+{
+	struct stktable_topk_ent **heap = t->topk.heap;
+	unsigned int pos = ent->pos;
+
+	while (pos && ent->value < heap[(pos - 1) / 2]->value) {
+		heap[pos] = heap[(pos - 1) / 2];
+		heap[pos]->pos = pos;
+		pos = (pos - 1) / 2;
+	}
+
+	heap[pos] = ent;
+	ent->pos = pos;
+	stktable_topk_sift_down(t, ent);
+}
+
+/* Updates the cached lowest value of the top-K of table <t>. The top-K's lock
+ * must be held.
+ */
+static inline void stktable_topk_set_min(struct stktable *t)
+{
+	t->topk.min = t->topk.used == t->topk.size ? t->topk.heap[0]->value : 0;
+}
+
+/* Updates the values of the top-K entries of table <t> if they are rates, and
+ * rebuilds the heap. The top-K's lock must be held.
+ */
+static void stktable_topk_refresh(struct stktable *t)
+{
+	struct stktable_topk_ent *ent;
+	int type = t->topk.type;
+	unsigned int i;
+
+	if (stktable_data_types[type].std_type != STD_T_FRQP)
+		return;
+
+	for (i = 0; i < t->topk.used; i++) {
+		ent = t->topk.heap[i];
+		ent->value = read_freq_ctr_period(&ent->ctr, t->data_arg[type].u);
+	}
+
+	for (i = t->topk.used / 2; i-- > 0; )
+		stktable_topk_sift_down(t, t->topk.heap[i]);
+
+	stktable_topk_set_min(t);
+	t->topk.refresh = tick_add(now_ms, MS_TO_TICKS(STKTABLE_TOPK_REFRESH));
+}
+
+/* Accounts for entry <ts> of table <t> in the table's top-K. The entry must
+ * not be locked.
+ */
+static void stktable_topk_update(struct stktable *t, struct stksess *ts)
+{
+	struct stktable_topk_ent *ent;
+	struct freq_ctr_period ctr = { 0 };
+	struct ebmb_node *node;
+	unsigned long long value;
+
+	HA_RWLOCK_RDLOCK(STK_SESS_LOCK, &ts->lock);
+	value = stktable_topk_read(t, stktable_data_ptr(t, ts, t->topk.type), &ctr);
+	HA_RWLOCK_RDUNLOCK(STK_SESS_LOCK, &ts->lock);
+
+	/* most keys are not heavy hitters, and a key which is already ranked
+	 * and is below the lowest one doesn't change the ranking.
+	 */
+	if (value <= t->topk.min && !tick_is_expired(t->topk.refresh, now_ms))
+		return;
+
+	if (HA_SPIN_TRYLOCK(STK_TABLE_LOCK, &t->topk.lock) != 0)
+		return;
+
+	if (tick_is_expired(t->topk.refresh, now_ms))
+		stktable_topk_refresh(t);
+
+	if (t->type == SMP_T_STR)
+		node = ebst_lookup(&t->topk.keys, (char *)ts->key.key);
+	else
+		node = ebmb_lookup(&t->topk.keys, ts->key.key, t->key_size);
+
+	if (node) {
+		ent = ebmb_entry(node, struct stktable_topk_ent, key);
+		goto update;
+	}
+
+	if (!value)
+		goto out;
+
+	if (t->topk.used < t->topk.size) {
+		ent = t->topk.heap[t->topk.used];
+		ent->pos = t->topk.used++;
+	}
+	else {
+		/* take the place of the lowest entry */
+		ent = t->topk.heap[0];
+		if (value <= ent->value)
+			goto out;
+		ebmb_delete(&ent->key);
+	}
+
+	memcpy(ent->key.key, ts->key.key, t->key_size);
+	if (t->type == SMP_T_STR)
+		ebst_insert(&t->topk.keys, &ent->key);
+	else
+		ebmb_insert(&t->topk.keys, &ent->key, t->key_size);
+
+	if (!tick_isset(t->topk.refresh) && stktable_data_types[t->topk.type].std_type == STD_T_FRQP)
+		t->topk.refresh = tick_add(now_ms, MS_TO_TICKS(STKTABLE_TOPK_REFRESH));
+ update:
+	ent->value = value;
+	ent->ctr = ctr;
+	stktable_topk_place(t, ent);
+	stktable_topk_set_min(t);
+ out:
+	HA_SPIN_UNLOCK(STK_TABLE_LOCK, &t->topk.lock);
+}
+
+/* Swaps top-K entries <a> and <b> */
+static inline void stktable_topk_swap(struct stktable_topk_ent **a, struct stktable_topk_ent **b)
+{
+	struct stktable_topk_ent *tmp = *a;
+
+	*a = *b;
+	*b = tmp;
+}
+
+/* Copies the top-K entries of table <t> to its rank array, and reorders them
+ * there so that the one of rank <rank>, starting at zero, is at this place,
+ * with higher entries before it and lower ones after. It is returned. Values
+ * must be up to date, and the top-K's lock must be held.
+ */
+static struct stktable_topk_ent *stktable_topk_select(struct stktable *t, unsigned int rank)
+{
+	struct stktable_topk_ent **ents = t->topk.rank;
+	unsigned int left = 0, right = t->topk.used - 1, i, store;
+
+	memcpy(ents, t->topk.heap, t->topk.used * sizeof(*ents));
+	while (left < right) {
+		/* partition around the middle entry, moved to the right */
+		stktable_topk_swap(&ents[(left + right) / 2], &ents[right]);
+		for (store = i = left; i < right; i++) {
+			if (ents[i]->value > ents[right]->value)
+				stktable_topk_swap(&ents[i], &ents[store++]);
+		}
+		stktable_topk_swap(&ents[store], &ents[right]);
+
+		if (store == rank)
+			break;
+		else if (store > rank)
+			right = store - 1;
+		else
+			left = store + 1;
+	}
+	return ents[rank];
+}
+
+/* Allocates the top-K entries of table <t>. Returns 0 on failure. */
+static int stktable_topk_init(struct stktable *t)
+{
+	size_t ent_size = stktable_topk_ent_size(t);
+	char *ents;
+	unsigned int i;
+
+	t->topk.heap = calloc(t->topk.size, 2 * sizeof(*t->topk.heap) + ent_size);
+	if (!t->topk.heap)
+		return 0;
+
+	t->topk.rank = t->topk.heap + t->topk.size;
+	ents = (char *)(t->topk.rank + t->topk.size);
+	for (i = 0; i < t->topk.size; i++)
+		t->topk.heap[i] = (struct stktable_topk_ent *)(ents + i * ent_size);
+	t->topk.keys = EB_ROOT_UNIQUE;
+	t->topk.refresh = TICK_ETERNITY;
+	HA_SPIN_INIT(&t->topk.lock);
+	return 1;
+}
+
+/*
+ * Looks in shard <sh> of table <t> for a sticky session matching key <key>.
  * Returns pointer on requested sticky session or NULL if none was found.
  */
-struct stksess *__stktable_lookup_key(struct stktable *t, struct stktable_key *key)
+struct stksess *__stktable_lookup_key(struct stktable *t, struct stktable_shard *sh, struct stktable_key *key)
 {
 	struct ebmb_node *eb;
 
 	if (t->type == SMP_T_STR)
-		eb = ebst_lookup_len(&t->keys, key->key, key->key_len+1 < t->key_size ? key->key_len : t->key_size-1);
+		eb = ebst_lookup_len(&sh->keys, key->key, key->key_len+1 < t->key_size ? key->key_len : t->key_size-1);
 	else
-		eb = ebmb_lookup(&t->keys, key->key, t->key_size);
+		eb = ebmb_lookup(&sh->keys, key->key, t->key_size);
 
 	if (unlikely(!eb)) {
 		/* no session found */
@@ -314,33 +776,38 @@ struct stksess *__stktable_lookup_key(struct stktable *t, struct stktable_key *k
  * Looks in table <t> for a sticky session matching key <key>.
  * Returns pointer on requested sticky session or NULL if none was found.
  * The refcount of the found entry is increased and this function
- * is protected using the table lock
+ * is protected using the shard's lock
  */
 struct stksess *stktable_lookup_key(struct stktable *t, struct stktable_key *key)
 {
+	struct stktable_shard *sh;
 	struct stksess *ts;
 
-	HA_SPIN_LOCK(STK_TABLE_LOCK, &t->lock);
-	ts = __stktable_lookup_key(t, key);
+	if (t->sketch_depth)
+		return stktable_sketch_entry(t, key, 1);
+
+	sh = stktable_key_shard(t, key);
+	HA_SPIN_LOCK(STK_TABLE_LOCK, &sh->lock);
+	ts = __stktable_lookup_key(t, sh, key);
 	if (ts)
-		ts->ref_cnt++;
-	HA_SPIN_UNLOCK(STK_TABLE_LOCK, &t->lock);
+		HA_ATOMIC_ADD(&ts->ref_cnt, 1);
+	HA_SPIN_UNLOCK(STK_TABLE_LOCK, &sh->lock);
 
 	return ts;
 }
 
 /*
- * Looks in table <t> for a sticky session with same key as <ts>.
+ * Looks in shard <sh> of table <t> for a sticky session with same key as <ts>.
  * Returns pointer on requested sticky session or NULL if none was found.
  */
-struct stksess *__stktable_lookup(struct stktable *t, struct stksess *ts)
+struct stksess *__stktable_lookup(struct stktable *t, struct stktable_shard *sh, struct stksess *ts)
 {
 	struct ebmb_node *eb;
 
 	if (t->type == SMP_T_STR)
-		eb = ebst_lookup(&(t->keys), (char *)ts->key.key);
+		eb = ebst_lookup(&(sh->keys), (char *)ts->key.key);
 	else
-		eb = ebmb_lookup(&(t->keys), ts->key.key, t->key_size);
+		eb = ebmb_lookup(&(sh->keys), ts->key.key, t->key_size);
 
 	if (unlikely(!eb))
 		return NULL;
@@ -352,25 +819,37 @@ struct stksess *__stktable_lookup(struct stktable *t, struct stksess *ts)
  * Looks in table <t> for a sticky session with same key as <ts>.
  * Returns pointer on requested sticky session or NULL if none was found.
  * The refcount of the found entry is increased and this function
- * is protected using the table lock
+ * is protected using the shard's lock
  */
 struct stksess *stktable_lookup(struct stktable *t, struct stksess *ts)
 {
+	struct stktable_shard *sh = stksess_shard(t, ts);
 	struct stksess *lts;
 
-	HA_SPIN_LOCK(STK_TABLE_LOCK, &t->lock);
-	lts = __stktable_lookup(t, ts);
+	HA_SPIN_LOCK(STK_TABLE_LOCK, &sh->lock);
+	lts = __stktable_lookup(t, sh, ts);
 	if (lts)
-		lts->ref_cnt++;
-	HA_SPIN_UNLOCK(STK_TABLE_LOCK, &t->lock);
+		HA_ATOMIC_ADD(&lts->ref_cnt, 1);
+	HA_SPIN_UNLOCK(STK_TABLE_LOCK, &sh->lock);
 
 	return lts;
 }
 
+/* Returns non-zero if the table's lock is needed to account for an entry
+ * expiring at <expire> in table <t>, which is when the table is synchronized
+ * with peers or when the expiration task must be brought forward.
+ */
+static inline int stktable_touch_needs_lock(const struct stktable *t, int expire)
+{
+	return t->sync_task ||
+	       (t->expire && tick_first(expire, t->exp_next) != t->exp_next);
+}
+
 /* Update the expiration timer for <ts> but do not touch its expiration node.
  * The table's expiration timer is updated if set.
  * The node will be also inserted into the update tree if needed, at a position
- * depending if the update is a local or coming from a remote node
+ * depending if the update is a local or coming from a remote node.
+ * The table's lock must be held.
  */
 void __stktable_touch_with_exp(struct stktable *t, struct stksess *ts, int local, int expire)
 {
@@ -422,11 +901,15 @@ void __stktable_touch_with_exp(struct stktable *t, struct stksess *ts, int local
  */
 void stktable_touch_remote(struct stktable *t, struct stksess *ts, int decrefcnt)
 {
-	HA_SPIN_LOCK(STK_TABLE_LOCK, &t->lock);
-	__stktable_touch_with_exp(t, ts, 0, ts->expire);
+	if (stktable_touch_needs_lock(t, ts->expire)) {
+		HA_SPIN_LOCK(STK_TABLE_LOCK, &t->lock);
+		__stktable_touch_with_exp(t, ts, 0, ts->expire);
+		HA_SPIN_UNLOCK(STK_TABLE_LOCK, &t->lock);
+	}
+	if (t->topk.size)
+		stktable_topk_update(t, ts);
 	if (decrefcnt)
-		ts->ref_cnt--;
-	HA_SPIN_UNLOCK(STK_TABLE_LOCK, &t->lock);
+		HA_ATOMIC_SUB(&ts->ref_cnt, 1);
 }
 
 /* Update the expiration timer for <ts> but do not touch its expiration node.
@@ -439,194 +922,816 @@ void stktable_touch_local(struct stktable *t, struct stksess *ts, int decrefcnt)
 {
 	int expire = tick_add(now_ms, MS_TO_TICKS(t->expire));
 
-	HA_SPIN_LOCK(STK_TABLE_LOCK, &t->lock);
-	__stktable_touch_with_exp(t, ts, 1, expire);
+	if (t->sketch_depth) {
+		stktable_sketch_fold(t, ts);
+		if (t->topk.size)
+			stktable_topk_update(t, ts);
+		if (decrefcnt)
+			stktable_sketch_release(t, ts);
+		return;
+	}
+
+	if (stktable_touch_needs_lock(t, expire)) {
+		HA_SPIN_LOCK(STK_TABLE_LOCK, &t->lock);
+		__stktable_touch_with_exp(t, ts, 1, expire);
+		HA_SPIN_UNLOCK(STK_TABLE_LOCK, &t->lock);
+	}
+	else
+		ts->expire = expire;
+
+	if (t->topk.size)
+		stktable_topk_update(t, ts);
+
 	if (decrefcnt)
-		ts->ref_cnt--;
-	HA_SPIN_UNLOCK(STK_TABLE_LOCK, &t->lock);
+		HA_ATOMIC_SUB(&ts->ref_cnt, 1);
 }
 /* Just decrease the ref_cnt of the current session. Does nothing if <ts> is NULL */
-static void stktable_release(struct stktable *t, struct stksess *ts)
+void stktable_release(struct stktable *t, struct stksess *ts)
 {
 	if (!ts)
 		return;
-	HA_SPIN_LOCK(STK_TABLE_LOCK, &t->lock);
-	ts->ref_cnt--;
-	HA_SPIN_UNLOCK(STK_TABLE_LOCK, &t->lock);
+	if (t->sketch_depth) {
+		stktable_sketch_release(t, ts);
+		return;
+	}
+	HA_ATOMIC_SUB(&ts->ref_cnt, 1);
 }
 
-/* Insert new sticky session <ts> in the table. It is assumed that it does not
- * yet exist (the caller must check this). The table's timeout is updated if it
- * is set. <ts> is returned.
+/* Insert new sticky session <ts> in shard <sh> of the table, which must be
+ * locked. It is assumed that it does not yet exist (the caller must check
+ * this). The table's timeout is updated if it is set. <ts> is returned.
  */
-void __stktable_store(struct stktable *t, struct stksess *ts)
+void __stktable_store(struct stktable *t, struct stktable_shard *sh, struct stksess *ts)
 {
 
-	ebmb_insert(&t->keys, &ts->key, t->key_size);
+	ebmb_insert(&sh->keys, &ts->key, t->key_size);
 	ts->exp.key = ts->expire;
-	eb32_insert(&t->exps, &ts->exp);
-	if (t->expire) {
+	/* the wheel is only advanced by the expire task, so if the shard was
+	 * left empty for a long time its date may be too old for the key.
+	 */
+	tw_sync(&sh->exps, now_ms);
+	tw_insert(&sh->exps, &ts->exp);
+	if (t->expire && tick_first(ts->expire, t->exp_next) != t->exp_next) {
+		HA_SPIN_LOCK(STK_TABLE_LOCK, &t->lock);
 		t->exp_task->expire = t->exp_next = tick_first(ts->expire, t->exp_next);
 		task_queue(t->exp_task);
+		HA_SPIN_UNLOCK(STK_TABLE_LOCK, &t->lock);
 	}
 }
 
 /* Returns a valid or initialized stksess for the specified stktable_key in the
  * specified table, or NULL if the key was NULL, or if no entry was found nor
- * could be created. The entry's expiration is updated.
+ * could be created. The entry's expiration is updated. Shard <sh> must be the
+ * key's one, and must be locked.
  */
-struct stksess *__stktable_get_entry(struct stktable *table, struct stktable_key *key)
+struct stksess *__stktable_get_entry(struct stktable *table, struct stktable_shard *sh, struct stktable_key *key)
 {
 	struct stksess *ts;
 
 	if (!key)
 		return NULL;
 
-	ts = __stktable_lookup_key(table, key);
+	ts = __stktable_lookup_key(table, sh, key);
 	if (ts == NULL) {
 		/* entry does not exist, initialize a new one */
-		ts = __stksess_new(table, key);
+		ts = __stksess_new(table, sh, key);
 		if (!ts)
 			return NULL;
-		__stktable_store(table, ts);
+		__stktable_store(table, sh, ts);
 	}
 	return ts;
 }
 /* Returns a valid or initialized stksess for the specified stktable_key in the
  * specified table, or NULL if the key was NULL, or if no entry was found nor
  * could be created. The entry's expiration is updated.
- * This function locks the table, and the refcount of the entry is increased.
+ * This function locks the key's shard, and the refcount of the entry is increased.
  */
 struct stksess *stktable_get_entry(struct stktable *table, struct stktable_key *key)
 {
+	struct stktable_shard *sh;
 	struct stksess *ts;
 
-	HA_SPIN_LOCK(STK_TABLE_LOCK, &table->lock);
-	ts = __stktable_get_entry(table, key);
+	if (!key)
+		return NULL;
+
+	if (table->sketch_depth)
+		return stktable_sketch_entry(table, key, 0);
+
+	sh = stktable_key_shard(table, key);
+	HA_SPIN_LOCK(STK_TABLE_LOCK, &sh->lock);
+	ts = __stktable_get_entry(table, sh, key);
 	if (ts)
-		ts->ref_cnt++;
-	HA_SPIN_UNLOCK(STK_TABLE_LOCK, &table->lock);
+		HA_ATOMIC_ADD(&ts->ref_cnt, 1);
+	HA_SPIN_UNLOCK(STK_TABLE_LOCK, &sh->lock);
 
 	return ts;
 }
 
 /* Lookup for an entry with the same key and store the submitted
- * stksess if not found.
+ * stksess if not found. Shard <sh> must be the entry's one, and must be
+ * locked.
  */
-struct stksess *__stktable_set_entry(struct stktable *table, struct stksess *nts)
+struct stksess *__stktable_set_entry(struct stktable *table, struct stktable_shard *sh, struct stksess *nts)
 {
 	struct stksess *ts;
 
-	ts = __stktable_lookup(table, nts);
+	ts = __stktable_lookup(table, sh, nts);
 	if (ts == NULL) {
 		ts = nts;
-		__stktable_store(table, ts);
+		__stktable_store(table, sh, ts);
 	}
 	return ts;
 }
 
-/* Lookup for an entry with the same key and store the submitted
- * stksess if not found.
- * This function locks the table, and the refcount of the entry is increased.
+/* Lookup for an entry with the same key and store the submitted
+ * stksess if not found.
+ * This function locks the entry's shard, and the refcount of the entry is increased.
+ */
+struct stksess *stktable_set_entry(struct stktable *table, struct stksess *nts)
+{
+	struct stktable_shard *sh = stksess_shard(table, nts);
+	struct stksess *ts;
+
+	HA_SPIN_LOCK(STK_TABLE_LOCK, &sh->lock);
+	ts = __stktable_set_entry(table, sh, nts);
+	HA_ATOMIC_ADD(&ts->ref_cnt, 1);
+	HA_SPIN_UNLOCK(STK_TABLE_LOCK, &sh->lock);
+
+	return ts;
+}
+/*
+ * Trash expired sticky sessions from shard <sh> of table <t>, which must be
+ * locked. The next expiration date in this shard is returned.
+ */
+static int __stktable_trash_expired(struct stktable *t, struct stktable_shard *sh)
+{
+	struct stksess *ts;
+	struct tw_node *node;
+	unsigned int key;
+
+	while ((node = tw_pop_expired(&sh->exps, now_ms))) {
+		/* timer looks expired and was detached from the wheel */
+		ts = tw_entry(node, struct stksess, exp);
+
+		/* Touching an entry only updates its expiration date, so that
+		 * hot entries don't move in the wheel all the time. It is moved
+		 * to its new date when its old one is reached instead, which is
+		 * necessarily in the future so it will not be visited again
+		 * during this round.
+		 */
+		if (!tick_is_expired(ts->expire, now_ms)) {
+			if (!tick_isset(ts->expire))
+				continue;
+
+			ts->exp.key = ts->expire;
+			tw_insert(&sh->exps, &ts->exp);
+			continue;
+		}
+
+		/* don't delete an entry which is currently referenced, check it
+		 * again later.
+		 */
+		if (ts->ref_cnt || !__stksess_unlink_upd(t, ts)) {
+			ts->exp.key = tick_add(now_ms, MS_TO_TICKS(STKTABLE_EXP_RETRY));
+			tw_insert(&sh->exps, &ts->exp);
+			continue;
+		}
+
+		/* session expired, trash it */
+		ebmb_delete(&ts->key);
+		__stksess_free(t, ts);
+	}
+
+	if (!tw_next_key(&sh->exps, &key))
+		return TICK_ETERNITY;
+
+	/* a date of zero is a valid one for the wheel but not for a tick */
+	return key ? key : key - 1;
+}
+
+/*
+ * Trash expired sticky sessions from table <t>. The next expiration date is
+ * returned.
+ */
+static int stktable_trash_expired(struct stktable *t)
+{
+	struct stktable_shard *sh;
+	unsigned int shard;
+	int next = TICK_ETERNITY;
+
+	/* entries stored in a shard already visited will bring the date
+	 * forward again.
+	 */
+	HA_SPIN_LOCK(STK_TABLE_LOCK, &t->lock);
+	t->exp_next = TICK_ETERNITY;
+	HA_SPIN_UNLOCK(STK_TABLE_LOCK, &t->lock);
+
+	for (shard = 0; shard < t->nbshards; shard++) {
+		sh = &t->shards[shard];
+		HA_SPIN_LOCK(STK_TABLE_LOCK, &sh->lock);
+		next = tick_first(next, __stktable_trash_expired(t, sh));
+		HA_SPIN_UNLOCK(STK_TABLE_LOCK, &sh->lock);
+	}
+
+	HA_SPIN_LOCK(STK_TABLE_LOCK, &t->lock);
+	next = t->exp_next = tick_first(next, t->exp_next);
+	HA_SPIN_UNLOCK(STK_TABLE_LOCK, &t->lock);
+	return next;
+}
+
+/*
+ * Task processing function to trash expired sticky sessions. A pointer to the
+ * task itself is returned since it never dies.
+ */
+static struct task *process_table_expire(struct task *task, void *context, unsigned short state)
+{
+	struct stktable *t = context;
+
+	task->expire = stktable_trash_expired(t);
+	return task;
+}
+
+/*
+ * Tables declared with "snapshot" are periodically saved to a file, which is
+ * loaded again when the process starts. The file starts with a header made of
+ * the magic, the table's type and key size, the date of the snapshot, and the
+ * mask of the data types stored followed by their standard type. Then each
+ * entry is saved as its remaining time to live, its key, and its data. Dates
+ * are saved relative to the snapshot date so that they can be adjusted for
+ * the time elapsed on load. Numbers are saved in host byte order. The file is
+ * written under a temporary name and renamed once complete, so that a
+ * snapshot in progress never replaces the last complete one. Entries are
+ * saved in batches of about STKTABLE_SNAP_BATCH bytes, with only the lock of
+ * their shard held, and the task yields between batches. The file is written
+ * with blocking calls from the event loop, so the batches are kept small to
+ * limit the time the thread stays blocked on slow storage.
+ */
+#define STKTABLE_SNAP_MAGIC    "HAPSTKT1"
+#define STKTABLE_SNAP_BUFSIZE  (1024 * 1024)
+#define STKTABLE_SNAP_BATCH    4096
+
+/* Returns the size of data of standard type <std_type> in a snapshot, or the
+ * maximum size if it is variable.
+ */
+static inline size_t stktable_snapshot_data_size(int std_type)
+{
+	switch (std_type) {
+	case STD_T_SINT:
+	case STD_T_UINT:
+		return sizeof(uint32_t);
+	case STD_T_ULL:
+		return sizeof(uint64_t);
+	case STD_T_FRQP:
+		return 3 * sizeof(uint32_t);
+	case STD_T_DICT:
+		return 1 + 255;
+	case STD_T_HLL:
+		return HLL_REGS;
+	}
+	return 0;
+}
+
+/* Returns the maximum size of an entry of table <t> in a snapshot */
+static size_t stktable_snapshot_rec_size(struct stktable *t)
+{
+	size_t size = sizeof(uint32_t) + t->key_size;
+	int type;
+
+	for (type = 0; type < STKTABLE_DATA_TYPES; type++) {
+		if (t->data_ofs[type])
+			size += stktable_snapshot_data_size(stktable_data_types[type].std_type);
+	}
+	return size;
+}
+
+/* Appends the header of a snapshot of table <t> to <out> */
+static void stktable_snapshot_put_head(struct stktable *t, struct buffer *out)
+{
+	uint64_t mask = 0;
+	uint32_t u32;
+	int type;
+
+	for (type = 0; type < STKTABLE_DATA_TYPES; type++) {
+		if (t->data_ofs[type])
+			mask |= 1ULL << type;
+	}
+
+	chunk_memcat(out, STKTABLE_SNAP_MAGIC, 8);
+	u32 = t->type;
+	chunk_memcat(out, (char *)&u32, sizeof(u32));
+	u32 = t->key_size;
+	chunk_memcat(out, (char *)&u32, sizeof(u32));
+	u32 = date.tv_sec;
+	chunk_memcat(out, (char *)&u32, sizeof(u32));
+	chunk_memcat(out, (char *)&mask, sizeof(mask));
+	for (type = 0; type < STKTABLE_DATA_TYPES; type++) {
+		if (t->data_ofs[type])
+			chunk_memcat(out, (char *)&stktable_data_types[type].std_type, 1);
+	}
+}
+
+/* Appends entry <ts> of table <t> to <out>, which must have room for it. The
+ * entry must be locked.
+ */
+static void stktable_snapshot_put(struct stktable *t, struct stksess *ts, struct buffer *out)
+{
+	struct freq_ctr_period *frqp;
+	struct dict_entry *de;
+	unsigned char len;
+	uint32_t u32[3];
+	uint64_t u64;
+	void *ptr;
+	int type;
+
+	u32[0] = t->expire ? tick_remain(now_ms, ts->expire) : 0;
+	chunk_memcat(out, (char *)u32, sizeof(*u32));
+	chunk_memcat(out, (char *)ts->key.key, t->key_size);
+
+	for (type = 0; type < STKTABLE_DATA_TYPES; type++) {
+		ptr = stktable_data_ptr(t, ts, type);
+		if (!ptr)
+			continue;
+
+		switch (stktable_data_types[type].std_type) {
+		case STD_T_SINT:
+		case STD_T_UINT:
+			u32[0] = stktable_data_cast(ptr, std_t_uint);
+			chunk_memcat(out, (char *)u32, sizeof(*u32));
+			break;
+		case STD_T_ULL:
+			u64 = stktable_data_cast(ptr, std_t_ull);
+			chunk_memcat(out, (char *)&u64, sizeof(u64));
+			break;
+		case STD_T_FRQP:
+			frqp = &stktable_data_cast(ptr, std_t_frqp);
+			u32[0] = now_ms - frqp->curr_tick;
+			u32[1] = frqp->curr_ctr;
+			u32[2] = frqp->prev_ctr;
+			chunk_memcat(out, (char *)u32, sizeof(u32));
+			break;
+		case STD_T_DICT:
+			de = stktable_data_cast(ptr, std_t_dict);
+			len = de ? MIN(de->len, 255) : 0;
+			chunk_memcat(out, (char *)&len, 1);
+			if (len)
+				chunk_memcat(out, de->value.key, len);
+			break;
+		case STD_T_HLL:
+			chunk_memcat(out, (char *)stktable_data_cast(ptr, std_t_hll).reg, HLL_REGS);
+			break;
+		}
+	}
+}
+
+/* Builds the temporary name of the snapshot of table <t> into <name> */
+static void stktable_snapshot_tmpname(struct stktable *t, char *name)
+{
+	snprintf(name, PATH_MAX, "%s.%d.tmp", t->snap.file, (int)getpid());
+}
+
+/* References the next entry of table <t> to save as t->snap.next, starting at
+ * shard t->snap.shard, or sets it to NULL if there are no more entries.
+ */
+static void stktable_snapshot_next_shard(struct stktable *t)
+{
+	struct stktable_shard *sh;
+	struct ebmb_node *eb;
+
+	t->snap.next = NULL;
+	for (; t->snap.shard < t->nbshards; t->snap.shard++) {
+		sh = &t->shards[t->snap.shard];
+		HA_SPIN_LOCK(STK_TABLE_LOCK, &sh->lock);
+		eb = ebmb_first(&sh->keys);
+		if (eb) {
+			t->snap.next = ebmb_entry(eb, struct stksess, key);
+			HA_ATOMIC_ADD(&t->snap.next->ref_cnt, 1);
+			HA_SPIN_UNLOCK(STK_TABLE_LOCK, &sh->lock);
+			return;
+		}
+		HA_SPIN_UNLOCK(STK_TABLE_LOCK, &sh->lock);
+	}
+}
+
+/* Aborts the snapshot of table <t> in progress and removes its file */
+static void stktable_snapshot_abort(struct stktable *t)
+{
+	char name[PATH_MAX];
+
+	if (t->snap.next)
+		stksess_kill_if_expired(t, t->snap.next, 1);
+	t->snap.next = NULL;
+	if (t->snap.fd >= 0)
+		close(t->snap.fd);
+	t->snap.fd = -1;
+	stktable_snapshot_tmpname(t, name);
+	unlink(name);
+}
+
+/* Writes <len> bytes from <buf> to the snapshot of table <t>. Returns 0 on
+ * error, otherwise non-zero.
+ */
+static int stktable_snapshot_write(struct stktable *t, const char *buf, size_t len)
+{
+	ssize_t ret;
+
+	while (len) {
+		ret = write(t->snap.fd, buf, len);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+			return 0;
+		}
+		buf += ret;
+		len -= ret;
+	}
+	return 1;
+}
+
+/* Saves the next batch of entries of table <t> to its snapshot, starting a new
+ * snapshot if none is in progress. The entries are first copied to <out>,
+ * which must be empty, until it holds STKTABLE_SNAP_BATCH bytes or is full. Returns 0 if the snapshot is not complete yet,
+ * otherwise non-zero, including on error.
+ */
+static int stktable_snapshot_step(struct stktable *t, struct buffer *out)
+{
+	char name[PATH_MAX];
+	struct stktable_shard *sh;
+	struct stksess *ts;
+	struct ebmb_node *eb;
+	size_t rec_size = stktable_snapshot_rec_size(t);
+	int err;
+
+	if (t->snap.fd < 0) {
+		stktable_snapshot_tmpname(t, name);
+		t->snap.fd = open(name, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+		if (t->snap.fd < 0)
+			goto fail;
+		stktable_snapshot_put_head(t, out);
+		t->snap.shard = 0;
+		stktable_snapshot_next_shard(t);
+	}
+
+	while (t->snap.next && b_room(out) >= rec_size && b_data(out) < STKTABLE_SNAP_BATCH) {
+		sh = &t->shards[t->snap.shard];
+		HA_SPIN_LOCK(STK_TABLE_LOCK, &sh->lock);
+		ts = t->snap.next;
+		do {
+			HA_RWLOCK_RDLOCK(STK_SESS_LOCK, &ts->lock);
+			stktable_snapshot_put(t, ts, out);
+			HA_RWLOCK_RDUNLOCK(STK_SESS_LOCK, &ts->lock);
+			eb = ebmb_next(&ts->key);
+			ts = eb ? ebmb_entry(eb, struct stksess, key) : NULL;
+		} while (ts && b_room(out) >= rec_size && b_data(out) < STKTABLE_SNAP_BATCH);
+
+		HA_ATOMIC_SUB(&t->snap.next->ref_cnt, 1);
+		__stksess_kill_if_expired(t, t->snap.next);
+		t->snap.next = ts;
+		if (ts) {
+			HA_ATOMIC_ADD(&ts->ref_cnt, 1);
+			HA_SPIN_UNLOCK(STK_TABLE_LOCK, &sh->lock);
+			break;
+		}
+		HA_SPIN_UNLOCK(STK_TABLE_LOCK, &sh->lock);
+
+		t->snap.shard++;
+		stktable_snapshot_next_shard(t);
+	}
+
+	if (!stktable_snapshot_write(t, b_orig(out), b_data(out)))
+		goto fail;
+
+	if (t->snap.next)
+		return 0;
+
+	/* complete, replace the previous snapshot */
+	close(t->snap.fd);
+	t->snap.fd = -1;
+	stktable_snapshot_tmpname(t, name);
+	if (rename(name, t->snap.file) < 0)
+		goto fail;
+	return 1;
+
+ fail:
+	err = errno;
+	ha_warning("Table '%s': cannot save snapshot to '%s' : %s.\n", t->id, t->snap.file, strerror(err));
+	send_log(NULL, LOG_WARNING, "Table '%s': cannot save snapshot to '%s' : %s.\n", t->id, t->snap.file, strerror(err));
+	stktable_snapshot_abort(t);
+	return 1;
+}
+
+/*
+ * Task processing function to save the entries of a table. A pointer to the
+ * task itself is returned since it never dies. Once woken up by
+ * stktable_snapshot_stop(), a last snapshot is saved.
+ */
+static struct task *process_table_snapshot(struct task *task, void *context, unsigned short state)
+{
+	struct stktable *t = context;
+
+	if ((state & TASK_WOKEN_SIGNAL) && !t->snap.last) {
+		t->snap.last = 1;
+		if (t->snap.fd >= 0)
+			stktable_snapshot_abort(t);
+	}
+
+	if (t->snap.last == 2) {
+		task->expire = TICK_ETERNITY;
+		return task;
+	}
+
+	if (!stktable_snapshot_step(t, get_trash_chunk())) {
+		/* more entries to save, let other tasks run first */
+		task_wakeup(task, TASK_WOKEN_OTHER);
+		return task;
+	}
+
+	if (t->snap.last) {
+		t->snap.last = 2;
+		HA_ATOMIC_SUB(&t->syncing, 1);
+		_HA_ATOMIC_SUB(&jobs, 1);
+		task->expire = TICK_ETERNITY;
+		return task;
+	}
+	task->expire = tick_add(now_ms, MS_TO_TICKS(t->snap.period));
+	return task;
+}
+
+/* Makes table <t> save its last snapshot upon soft stop. Until it is saved, the
+ * table is protected against the purge of stopped proxies, and the process
+ * doesn't exit.
+ */
+void stktable_snapshot_stop(struct stktable *t)
+{
+	if (!t->snap.task)
+		return;
+
+	_HA_ATOMIC_ADD(&jobs, 1);
+	HA_ATOMIC_ADD(&t->syncing, 1);
+	task_wakeup(t->snap.task, TASK_WOKEN_SIGNAL);
+}
+
+/* Saves all the entries of table <t> to its snapshot at once, replacing any
+ * snapshot in progress, unless the last one was already saved. It is meant to
+ * be called when the process exits.
+ */
+void stktable_snapshot_flush(struct stktable *t)
+{
+	struct buffer *out;
+
+	if (!t->snap.file || !t->shards || t->snap.last == 2)
+		return;
+
+	/* the trash may not be available anymore */
+	out = alloc_trash_chunk();
+	if (!out)
+		return;
+
+	if (t->snap.fd >= 0)
+		stktable_snapshot_abort(t);
+	while (!stktable_snapshot_step(t, out))
+		chunk_reset(out);
+	free_trash_chunk(out);
+}
+
+/* Reads the next entry of snapshot <buf> of length <len> into entry <ts> of
+ * table <t>. The snapshot stores the data types in <mask> with their standard
+ * type in <std_type>, and was taken <elapsed> milliseconds ago. Returns the
+ * number of bytes read, or 0 if the entry is truncated.
  */
-struct stksess *stktable_set_entry(struct stktable *table, struct stksess *nts)
+static size_t stktable_snapshot_get(struct stktable *t, struct stksess *ts, const char *buf, size_t len,
+                                    uint64_t mask, const unsigned char *std_type, unsigned int elapsed)
 {
-	struct stksess *ts;
+	const char *p = buf, *end = buf + len;
+	struct freq_ctr_period *frqp;
+	char name[256];
+	uint32_t u32[3];
+	uint64_t u64;
+	unsigned char dlen;
+	void *ptr;
+	size_t size;
+	int type;
 
-	HA_SPIN_LOCK(STK_TABLE_LOCK, &table->lock);
-	ts = __stktable_set_entry(table, nts);
-	ts->ref_cnt++;
-	HA_SPIN_UNLOCK(STK_TABLE_LOCK, &table->lock);
+	if (end - p < sizeof(*u32) + t->key_size)
+		return 0;
 
-	return ts;
+	memcpy(u32, p, sizeof(*u32));
+	p += sizeof(*u32);
+	if (t->expire) {
+		if (u32[0] > t->expire)
+			u32[0] = t->expire;
+		ts->expire = tick_add(now_ms, MS_TO_TICKS(u32[0] > elapsed ? u32[0] - elapsed : 0));
+	}
+
+	memcpy(ts->key.key, p, t->key_size);
+	if (t->type == SMP_T_STR)
+		ts->key.key[t->key_size - 1] = 0;
+	p += t->key_size;
+
+	for (type = 0; type < STKTABLE_DATA_TYPES; type++) {
+		if (!(mask & (1ULL << type)))
+			continue;
+
+		size = stktable_snapshot_data_size(*std_type);
+		if (*std_type == STD_T_DICT) {
+			if (p >= end)
+				return 0;
+			size = 1 + (unsigned char)*p;
+		}
+		if (end - p < size)
+			return 0;
+
+		ptr = stktable_data_ptr(t, ts, type);
+		if (ptr && *std_type == stktable_data_types[type].std_type) {
+			switch (*std_type) {
+			case STD_T_SINT:
+			case STD_T_UINT:
+				memcpy(u32, p, sizeof(*u32));
+				stktable_data_cast(ptr, std_t_uint) = u32[0];
+				break;
+			case STD_T_ULL:
+				memcpy(&u64, p, sizeof(u64));
+				stktable_data_cast(ptr, std_t_ull) = u64;
+				break;
+			case STD_T_FRQP:
+				memcpy(u32, p, sizeof(u32));
+				frqp = &stktable_data_cast(ptr, std_t_frqp);
+				/* periods older than the previous one are empty */
+				if ((unsigned long long)u32[0] + elapsed < 2ULL * t->data_arg[type].u) {
+					frqp->curr_tick = tick_add(now_ms, -(u32[0] + elapsed)) & ~0x1;
+					frqp->curr_ctr = u32[1];
+					frqp->prev_ctr = u32[2];
+				}
+				break;
+			case STD_T_DICT:
+				dlen = *p;
+				if (dlen) {
+					memcpy(name, p + 1, dlen);
+					name[dlen] = 0;
+					stktable_data_cast(ptr, std_t_dict) = dict_insert(&server_name_dict, name);
+				}
+				break;
+			case STD_T_HLL:
+				memcpy(stktable_data_cast(ptr, std_t_hll).reg, p, HLL_REGS);
+				break;
+			}
+		}
+		p += size;
+		std_type++;
+	}
+	return p - buf;
 }
-/*
- * Trash expired sticky sessions from table <t>. The next expiration date is
- * returned.
+
+/* Loads the entries of table <t> from its snapshot, if any. A warning is
+ * emitted if the snapshot cannot be loaded completely, in which case the
+ * entries read so far are kept. It may only be called during startup.
  */
-static int stktable_trash_expired(struct stktable *t)
+static void stktable_snapshot_load(struct stktable *t)
 {
+	unsigned char std_type[STKTABLE_DATA_TYPES];
+	struct stktable_shard *sh;
 	struct stksess *ts;
-	struct eb32_node *eb;
-	int looped = 0;
+	const char *msg = NULL;
+	char *buf = NULL;
+	size_t len = 0, pos = 0, rec_size, size;
+	uint32_t u32[3];
+	uint64_t mask = 0;
+	unsigned int elapsed = 0;
+	ssize_t ret;
+	int type, types = 0;
+	int fd, eof = 0, head = 0;
+
+	fd = open(t->snap.file, O_RDONLY);
+	if (fd < 0) {
+		if (errno != ENOENT)
+			msg = strerror(errno);
+		goto out;
+	}
 
-	HA_SPIN_LOCK(STK_TABLE_LOCK, &t->lock);
-	eb = eb32_lookup_ge(&t->exps, now_ms - TIMER_LOOK_BACK);
+	buf = malloc(STKTABLE_SNAP_BUFSIZE);
+	if (!buf) {
+		msg = "out of memory";
+		goto out;
+	}
 
 	while (1) {
-		if (unlikely(!eb)) {
-			/* we might have reached the end of the tree, typically because
-			 * <now_ms> is in the first half and we're first scanning the last
-			 * half. Let's loop back to the beginning of the tree now if we
-			 * have not yet visited it.
-			 */
-			if (looped)
-				break;
-			looped = 1;
-			eb = eb32_first(&t->exps);
-			if (likely(!eb))
-				break;
+		/* keep the buffer filled with at least one complete entry */
+		if (!eof && len - pos < STKTABLE_SNAP_BUFSIZE / 2) {
+			memmove(buf, buf + pos, len - pos);
+			len -= pos;
+			pos = 0;
+			ret = read(fd, buf + len, STKTABLE_SNAP_BUFSIZE - len);
+			if (ret < 0) {
+				if (errno == EINTR)
+					continue;
+				msg = strerror(errno);
+				goto out;
+			}
+			eof = !ret;
+			len += ret;
+			continue;
 		}
 
-		if (likely(tick_is_lt(now_ms, eb->key))) {
-			/* timer not expired yet, revisit it later */
-			t->exp_next = eb->key;
-			goto out_unlock;
+		if (!head) {
+			/* parse the header */
+			if (len < 28 || memcmp(buf, STKTABLE_SNAP_MAGIC, 8) != 0) {
+				msg = "not a stick-table snapshot";
+				goto out;
+			}
+			memcpy(u32, buf + 8, sizeof(u32));
+			memcpy(&mask, buf + 20, sizeof(mask));
+			if (u32[0] != t->type || u32[1] != t->key_size) {
+				msg = "table type or key size differ";
+				goto out;
+			}
+			elapsed = date.tv_sec > u32[2] ? date.tv_sec - u32[2] : 0;
+			elapsed = elapsed < INT_MAX / 1000 ? elapsed * 1000 : INT_MAX;
+			pos = 28;
+			rec_size = sizeof(*u32) + t->key_size;
+			for (type = 0; type < STKTABLE_DATA_TYPES; type++) {
+				if (!(mask & (1ULL << type)))
+					continue;
+				if (pos >= len) {
+					msg = "truncated";
+					goto out;
+				}
+				std_type[types++] = buf[pos++];
+				rec_size += stktable_snapshot_data_size(buf[pos - 1]);
+			}
+			if (mask >> STKTABLE_DATA_TYPES || rec_size > STKTABLE_SNAP_BUFSIZE / 2) {
+				msg = "unknown data types";
+				goto out;
+			}
+			head = 1;
 		}
 
-		/* timer looks expired, detach it from the queue */
-		ts = eb32_entry(eb, struct stksess, exp);
-		eb = eb32_next(eb);
-
-		/* don't delete an entry which is currently referenced */
-		if (ts->ref_cnt)
-			continue;
-
-		eb32_delete(&ts->exp);
+		if (pos == len)
+			break;
 
-		if (!tick_is_expired(ts->expire, now_ms)) {
-			if (!tick_isset(ts->expire))
-				continue;
+		if (t->current >= t->size) {
+			msg = "table full";
+			goto out;
+		}
 
-			ts->exp.key = ts->expire;
-			eb32_insert(&t->exps, &ts->exp);
+		ts = stksess_new(t, NULL);
+		if (!ts) {
+			msg = "out of memory";
+			goto out;
+		}
 
-			if (!eb || eb->key > ts->exp.key)
-				eb = &ts->exp;
-			continue;
+		size = stktable_snapshot_get(t, ts, buf + pos, len - pos, mask, std_type, elapsed);
+		if (!size) {
+			__stksess_free(t, ts);
+			msg = "truncated";
+			goto out;
 		}
+		pos += size;
 
-		/* session expired, trash it */
-		ebmb_delete(&ts->key);
-		eb32_delete(&ts->upd);
-		__stksess_free(t, ts);
+		sh = stksess_shard(t, ts);
+		if ((t->expire && tick_is_expired(ts->expire, now_ms)) || __stktable_lookup(t, sh, ts))
+			__stksess_free(t, ts);
+		else
+			__stktable_store(t, sh, ts);
 	}
 
-	/* We have found no task to expire in any tree */
-	t->exp_next = TICK_ETERNITY;
-out_unlock:
-	HA_SPIN_UNLOCK(STK_TABLE_LOCK, &t->lock);
-	return t->exp_next;
-}
-
-/*
- * Task processing function to trash expired sticky sessions. A pointer to the
- * task itself is returned since it never dies.
- */
-static struct task *process_table_expire(struct task *task, void *context, unsigned short state)
-{
-	struct stktable *t = context;
-
-	task->expire = stktable_trash_expired(t);
-	return task;
+ out:
+	if (msg)
+		ha_warning("Table '%s': cannot load snapshot '%s' : %s.\n", t->id, t->snap.file, msg);
+	free(buf);
+	if (fd >= 0)
+		close(fd);
 }
 
 /* Perform minimal stick table intializations, report 0 in case of error, 1 if OK. */
 int stktable_init(struct stktable *t)
 {
+	unsigned int shard;
+	int type;
+
 	if (t->size) {
-		t->keys = EB_ROOT_UNIQUE;
-		memset(&t->exps, 0, sizeof(t->exps));
+		if (t->sketch_depth) {
+			for (type = 0; type < STKTABLE_DATA_TYPES; type++) {
+				if (!t->data_ofs[type])
+					continue;
+				t->sketch[type] = calloc((size_t)t->size * t->sketch_depth, sizeof(*t->sketch[type]));
+				if (!t->sketch[type])
+					return 0;
+
+				/* room to save the rate loaded into detached entries */
+				t->data_size += sizeof(struct freq_ctr_period);
+				t->sketch_ofs[type] = -t->data_size;
+			}
+		}
+
+		if (!t->nbshards)
+			t->nbshards = 1;
+		t->shards = calloc(t->nbshards, sizeof(*t->shards));
+		if (!t->shards)
+			return 0;
+		for (shard = 0; shard < t->nbshards; shard++) {
+			t->shards[shard].keys = EB_ROOT_UNIQUE;
+			tw_init(&t->shards[shard].exps, now_ms);
+			HA_SPIN_INIT(&t->shards[shard].lock);
+		}
 		t->updates = EB_ROOT_UNIQUE;
 		HA_SPIN_INIT(&t->lock);
 
@@ -644,7 +1749,32 @@ int stktable_init(struct stktable *t)
 			peers_register_table(t->peers.p, t);
 		}
 
-		return t->pool != NULL;
+		if (!t->pool)
+			return 0;
+
+		if (t->topk.size && !stktable_topk_init(t))
+			return 0;
+
+		t->snap.fd = -1;
+		if (t->snap.file) {
+			if (stktable_snapshot_rec_size(t) > global.tune.bufsize) {
+				ha_alert("Table '%s': entries too large to be saved to snapshots, tune.bufsize must be at least %d.\n",
+					 t->id, (int)stktable_snapshot_rec_size(t));
+				return 0;
+			}
+
+			if (!(global.mode & MODE_CHECK))
+				stktable_snapshot_load(t);
+
+			t->snap.task = task_new(MAX_THREADS_MASK);
+			if (!t->snap.task)
+				return 0;
+			t->snap.task->process = process_table_snapshot;
+			t->snap.task->context = (void *)t;
+			t->snap.task->expire = tick_add(now_ms, MS_TO_TICKS(t->snap.period));
+			task_queue(t->snap.task);
+		}
+		return 1;
 	}
 	return 1;
 }
@@ -790,10 +1920,117 @@ int parse_stick_table(const char *file, int linenum, char **args,
 			t->expire = val;
 			idx++;
 		}
+		else if (strcmp(args[idx], "snapshot") == 0) {
+			idx++;
+			if (!*(args[idx])) {
+				ha_alert("parsing [%s:%d] : %s: missing argument after '%s'.\n",
+					 file, linenum, args[0], args[idx-1]);
+				err_code |= ERR_ALERT | ERR_FATAL;
+				goto out;
+			}
+			free(t->snap.file);
+			t->snap.file = strdup(args[idx]);
+			idx++;
+		}
+		else if (strcmp(args[idx], "snapshot-period") == 0) {
+			idx++;
+			if (!*(args[idx])) {
+				ha_alert("parsing [%s:%d] : %s: missing argument after '%s'.\n",
+					 file, linenum, args[0], args[idx-1]);
+				err_code |= ERR_ALERT | ERR_FATAL;
+				goto out;
+			}
+			err = parse_time_err(args[idx], &val, TIME_UNIT_MS);
+			if (err == PARSE_TIME_OVER) {
+				ha_alert("parsing [%s:%d]: %s: timer overflow in argument <%s> to <%s>, maximum value is 2147483647 ms (~24.8 days).\n",
+					 file, linenum, args[0], args[idx], args[idx-1]);
+				err_code |= ERR_ALERT | ERR_FATAL;
+				goto out;
+			}
+			else if (err == PARSE_TIME_UNDER || (!err && !val)) {
+				ha_alert("parsing [%s:%d]: %s: timer underflow in argument <%s> to <%s>, minimum non-null value is 1 ms.\n",
+					 file, linenum, args[0], args[idx], args[idx-1]);
+				err_code |= ERR_ALERT | ERR_FATAL;
+				goto out;
+			}
+			else if (err) {
+				ha_alert("parsing [%s:%d] : %s: unexpected character '%c' in argument of '%s'.\n",
+					 file, linenum, args[0], *err, args[idx-1]);
+				err_code |= ERR_ALERT | ERR_FATAL;
+				goto out;
+			}
+			t->snap.period = val;
+			idx++;
+		}
 		else if (strcmp(args[idx], "nopurge") == 0) {
 			t->nopurge = 1;
 			idx++;
 		}
+		else if (strcmp(args[idx], "sketch") == 0) {
+			idx++;
+			if (!*(args[idx])) {
+				ha_alert("parsing [%s:%d] : %s: missing argument after '%s'.\n",
+					 file, linenum, args[0], args[idx-1]);
+				err_code |= ERR_ALERT | ERR_FATAL;
+				goto out;
+			}
+			val = atoi(args[idx]);
+			if (val < 1 || val > 16) {
+				ha_alert("parsing [%s:%d] : %s: '%s' expects a number of rows between 1 and 16.\n",
+					 file, linenum, args[0], args[idx-1]);
+				err_code |= ERR_ALERT | ERR_FATAL;
+				goto out;
+			}
+			t->sketch_depth = val;
+			idx++;
+		}
+		else if (strcmp(args[idx], "topk") == 0) {
+			idx++;
+			if (!*(args[idx])) {
+				ha_alert("parsing [%s:%d] : %s: missing argument after '%s'.\n",
+					 file, linenum, args[0], args[idx-1]);
+				err_code |= ERR_ALERT | ERR_FATAL;
+				goto out;
+			}
+			t->topk.type = stktable_get_data_type(args[idx]);
+			if (t->topk.type < 0) {
+				ha_alert("parsing [%s:%d] : %s: unknown data type '%s' after '%s'.\n",
+					 file, linenum, args[0], args[idx], args[idx-1]);
+				err_code |= ERR_ALERT | ERR_FATAL;
+				goto out;
+			}
+			idx++;
+			t->topk.size = 10;
+			if (isdigit((unsigned char)*args[idx])) {
+				val = atoi(args[idx]);
+				if (val < 1 || val > 1000) {
+					ha_alert("parsing [%s:%d] : %s: 'topk' expects a number of keys between 1 and 1000.\n",
+						 file, linenum, args[0]);
+					err_code |= ERR_ALERT | ERR_FATAL;
+					goto out;
+				}
+				t->topk.size = val;
+				idx++;
+			}
+		}
+		else if (strcmp(args[idx], "shards") == 0) {
+			idx++;
+			if (!*(args[idx])) {
+				ha_alert("parsing [%s:%d] : %s: missing argument after '%s'.\n",
+					 file, linenum, args[0], args[idx-1]);
+				err_code |= ERR_ALERT | ERR_FATAL;
+				goto out;
+			}
+			val = atoi(args[idx]);
+			if (val < 1 || val > MAX_THREADS * 4) {
+				ha_alert("parsing [%s:%d] : %s: '%s' expects a number of shards between 1 and %d.\n",
+					 file, linenum, args[0], args[idx-1], MAX_THREADS * 4);
+				err_code |= ERR_ALERT | ERR_FATAL;
+				goto out;
+			}
+			t->nbshards = val;
+			idx++;
+		}
 		else if (strcmp(args[idx], "type") == 0) {
 			idx++;
 			if (stktable_parse_type(args, &idx, &t->type, &t->key_size) != 0) {
@@ -893,6 +2130,53 @@ int parse_stick_table(const char *file, int linenum, char **args,
 		goto out;
 	}
 
+	if (t->snap.file && !t->snap.period)
+		t->snap.period = 60000;
+
+	if (t->topk.size) {
+		if (!t->data_ofs[t->topk.type]) {
+			ha_alert("parsing [%s:%d] : %s: 'topk' data type '%s' is not stored in the table.\n",
+				 file, linenum, args[0], stktable_data_types[t->topk.type].name);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
+
+		if (stktable_data_types[t->topk.type].std_type == STD_T_DICT ||
+		    stktable_data_types[t->topk.type].std_type == STD_T_HLL) {
+			ha_alert("parsing [%s:%d] : %s: 'topk' only supports counters and rates, not '%s'.\n",
+				 file, linenum, args[0], stktable_data_types[t->topk.type].name);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
+	}
+
+	if (t->sketch_depth) {
+		int type;
+
+		if (t->snap.file) {
+			ha_alert("parsing [%s:%d] : %s: sketch tables cannot be saved to snapshots.\n",
+				 file, linenum, args[0]);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
+
+		if (t->peers.p) {
+			ha_alert("parsing [%s:%d] : %s: sketch tables cannot be synchronized with peers.\n",
+				 file, linenum, args[0]);
+			err_code |= ERR_ALERT | ERR_FATAL;
+			goto out;
+		}
+
+		for (type = 0; type < STKTABLE_DATA_TYPES; type++) {
+			if (t->data_ofs[type] && stktable_data_types[type].std_type != STD_T_FRQP) {
+				ha_alert("parsing [%s:%d] : %s: sketch tables may only store rates, not '%s'.\n",
+					 file, linenum, args[0], stktable_data_types[type].name);
+				err_code |= ERR_ALERT | ERR_FATAL;
+				goto out;
+			}
+		}
+	}
+
  out:
 	return err_code;
 }
@@ -1043,6 +2327,7 @@ struct stktable_data_type stktable_data_types[STKTABLE_DATA_TYPES] = {
 	[STKTABLE_DT_GPC1]          = { .name = "gpc1",           .std_type = STD_T_UINT  },
 	[STKTABLE_DT_GPC1_RATE]     = { .name = "gpc1_rate",      .std_type = STD_T_FRQP, .arg_type = ARG_T_DELAY  },
 	[STKTABLE_DT_SERVER_NAME]   = { .name = "server_name",    .std_type = STD_T_DICT  },
+	[STKTABLE_DT_HLL0]          = { .name = "hll0",           .std_type = STD_T_HLL   },
 };
 
 /* Registers stick-table extra data type with index <idx>, name <name>, type
@@ -1235,7 +2520,44 @@ static int sample_conv_table_conn_cur(const struct arg *arg_p, struct sample *sm
  * be easily performed. If the inspected parameter is not stored in the table,
  * <not found> is returned.
  */
-static int sample_conv_table_conn_rate(const struct arg *arg_p, struct sample *smp, void *private)
+static int sample_conv_table_conn_rate(const struct arg *arg_p, struct sample *smp, void *private)
+{
+	struct stktable *t;
+	struct stktable_key *key;
+	struct stksess *ts;
+	void *ptr;
+
+	t = arg_p[0].data.t;
+
+	key = smp_to_stkey(smp, t);
+	if (!key)
+		return 0;
+
+	ts = stktable_lookup_key(t, key);
+
+	smp->flags = SMP_F_VOL_TEST;
+	smp->data.type = SMP_T_SINT;
+	smp->data.u.sint = 0;
+
+	if (!ts) /* key not present */
+		return 1;
+
+	ptr = stktable_data_ptr(t, ts, STKTABLE_DT_CONN_RATE);
+	if (ptr)
+		smp->data.u.sint = read_freq_ctr_period(&stktable_data_cast(ptr, conn_rate),
+                                                       t->data_arg[STKTABLE_DT_CONN_RATE].u);
+
+	stktable_release(t, ts);
+	return !!ptr;
+}
+
+/* Casts sample <smp> to the type of the table specified in arg(0), and looks
+ * it up into this table. Returns the data rate sent to clients in bytes/s
+ * if the key is present in the table, otherwise zero, so that comparisons can
+ * be easily performed. If the inspected parameter is not stored in the table,
+ * <not found> is returned.
+ */
+static int sample_conv_table_bytes_out_rate(const struct arg *arg_p, struct sample *smp, void *private)
 {
 	struct stktable *t;
 	struct stktable_key *key;
@@ -1257,22 +2579,22 @@ static int sample_conv_table_conn_rate(const struct arg *arg_p, struct sample *s
 	if (!ts) /* key not present */
 		return 1;
 
-	ptr = stktable_data_ptr(t, ts, STKTABLE_DT_CONN_RATE);
+	ptr = stktable_data_ptr(t, ts, STKTABLE_DT_BYTES_OUT_RATE);
 	if (ptr)
-		smp->data.u.sint = read_freq_ctr_period(&stktable_data_cast(ptr, conn_rate),
-                                                       t->data_arg[STKTABLE_DT_CONN_RATE].u);
+		smp->data.u.sint = read_freq_ctr_period(&stktable_data_cast(ptr, bytes_out_rate),
+                                                       t->data_arg[STKTABLE_DT_BYTES_OUT_RATE].u);
 
 	stktable_release(t, ts);
 	return !!ptr;
 }
 
 /* Casts sample <smp> to the type of the table specified in arg(0), and looks
- * it up into this table. Returns the data rate sent to clients in bytes/s
- * if the key is present in the table, otherwise zero, so that comparisons can
+ * it up into this table. Returns the value of the GPT0 tag for the key
+ * if the key is present in the table, otherwise false, so that comparisons can
  * be easily performed. If the inspected parameter is not stored in the table,
  * <not found> is returned.
  */
-static int sample_conv_table_bytes_out_rate(const struct arg *arg_p, struct sample *smp, void *private)
+static int sample_conv_table_gpt0(const struct arg *arg_p, struct sample *smp, void *private)
 {
 	struct stktable *t;
 	struct stktable_key *key;
@@ -1294,22 +2616,21 @@ static int sample_conv_table_bytes_out_rate(const struct arg *arg_p, struct samp
 	if (!ts) /* key not present */
 		return 1;
 
-	ptr = stktable_data_ptr(t, ts, STKTABLE_DT_BYTES_OUT_RATE);
+	ptr = stktable_data_ptr(t, ts, STKTABLE_DT_GPT0);
 	if (ptr)
-		smp->data.u.sint = read_freq_ctr_period(&stktable_data_cast(ptr, bytes_out_rate),
-                                                       t->data_arg[STKTABLE_DT_BYTES_OUT_RATE].u);
+		smp->data.u.sint = stktable_data_cast(ptr, gpt0);
 
 	stktable_release(t, ts);
 	return !!ptr;
 }
 
 /* Casts sample <smp> to the type of the table specified in arg(0), and looks
- * it up into this table. Returns the value of the GPT0 tag for the key
- * if the key is present in the table, otherwise false, so that comparisons can
- * be easily performed. If the inspected parameter is not stored in the table,
- * <not found> is returned.
+ * it up into this table. Returns the estimated number of distinct values added
+ * to the HLL0 counter for the key if the key is present in the table, otherwise
+ * zero, so that comparisons can be easily performed. If the inspected parameter
+ * is not stored in the table, <not found> is returned.
  */
-static int sample_conv_table_gpt0(const struct arg *arg_p, struct sample *smp, void *private)
+static int sample_conv_table_hll0(const struct arg *arg_p, struct sample *smp, void *private)
 {
 	struct stktable *t;
 	struct stktable_key *key;
@@ -1331,9 +2652,12 @@ static int sample_conv_table_gpt0(const struct arg *arg_p, struct sample *smp, v
 	if (!ts) /* key not present */
 		return 1;
 
-	ptr = stktable_data_ptr(t, ts, STKTABLE_DT_GPT0);
-	if (ptr)
-		smp->data.u.sint = stktable_data_cast(ptr, gpt0);
+	ptr = stktable_data_ptr(t, ts, STKTABLE_DT_HLL0);
+	if (ptr) {
+		HA_RWLOCK_RDLOCK(STK_SESS_LOCK, &ts->lock);
+		smp->data.u.sint = hll_count(&stktable_data_cast(ptr, hll0));
+		HA_RWLOCK_RDUNLOCK(STK_SESS_LOCK, &ts->lock);
+	}
 
 	stktable_release(t, ts);
 	return !!ptr;
@@ -2147,6 +3471,130 @@ static enum act_parse_ret parse_set_gpt0(const char **args, int *arg, struct pro
 	return ACT_RET_PRS_OK;
 }
 
+/* Always returns 1. */
+static enum act_return action_add_hll0(struct act_rule *rule, struct proxy *px,
+                                       struct session *sess, struct stream *s, int flags)
+{
+	void *ptr;
+	struct stksess *ts;
+	struct stkctr *stkctr;
+	struct sample *smp;
+	unsigned long long hash;
+	int smp_opt_dir;
+
+	/* Extract the stksess, return OK if no stksess available. */
+	if (s)
+		stkctr = &s->stkctr[rule->arg.gpt.sc];
+	else
+		stkctr = &sess->stkctr[rule->arg.gpt.sc];
+
+	ts = stkctr_entry(stkctr);
+	if (!ts)
+		return ACT_RET_CONT;
+
+	/* Add the sample to the required sc, and ignore errors. */
+	ptr = stktable_data_ptr(stkctr->table, ts, STKTABLE_DT_HLL0);
+	if (ptr) {
+		switch (rule->from) {
+		case ACT_F_TCP_REQ_SES: smp_opt_dir = SMP_OPT_DIR_REQ; break;
+		case ACT_F_TCP_REQ_CNT: smp_opt_dir = SMP_OPT_DIR_REQ; break;
+		case ACT_F_TCP_RES_CNT: smp_opt_dir = SMP_OPT_DIR_RES; break;
+		case ACT_F_HTTP_REQ:    smp_opt_dir = SMP_OPT_DIR_REQ; break;
+		case ACT_F_HTTP_RES:    smp_opt_dir = SMP_OPT_DIR_RES; break;
+		default:
+			send_log(px, LOG_ERR, "stick table: internal error while adding to hll0.");
+			if (!(global.mode & MODE_QUIET) || (global.mode & MODE_VERBOSE))
+				ha_alert("stick table: internal error while executing adding to hll0.\n");
+			return ACT_RET_CONT;
+		}
+
+		/* Fetch the expression, whose binary form is hashed. */
+		smp = sample_fetch_as_type(px, sess, s, smp_opt_dir|SMP_OPT_FINAL, rule->arg.gpt.expr, SMP_T_BIN);
+		if (!smp)
+			return ACT_RET_CONT;
+
+		hash = XXH64(smp->data.u.str.area, smp->data.u.str.data, 0);
+
+		HA_RWLOCK_WRLOCK(STK_SESS_LOCK, &ts->lock);
+
+		hll_add(&stktable_data_cast(ptr, hll0), hash);
+
+		HA_RWLOCK_WRUNLOCK(STK_SESS_LOCK, &ts->lock);
+
+		stktable_touch_local(stkctr->table, ts, 0);
+	}
+
+	return ACT_RET_CONT;
+}
+
+/* This function is a parser for the "sc-add-hll0" action. It understands the
+ * format:
+ *
+ *   sc-add-hll0(<stick-table ID>) <expression>
+ *
+ * It returns ACT_RET_PRS_ERR if fails and <err> is filled with an error
+ * message. Otherwise, it returns ACT_RET_PRS_OK and the expression to add is
+ * stored in the rule.
+ */
+static enum act_parse_ret parse_add_hll0(const char **args, int *arg, struct proxy *px,
+                                         struct act_rule *rule, char **err)
+{
+	const char *cmd_name = args[*arg-1];
+	char *error;
+	int smp_val;
+
+	cmd_name += strlen("sc-add-hll0");
+	if (*cmd_name == '\0') {
+		/* default stick table id. */
+		rule->arg.gpt.sc = 0;
+	} else {
+		/* parse the stick table id. */
+		if (*cmd_name != '(') {
+			memprintf(err, "invalid stick table track ID '%s'. Expects sc-add-hll0(<Track ID>)", args[*arg-1]);
+			return ACT_RET_PRS_ERR;
+		}
+		cmd_name++; /* jump the '(' */
+		rule->arg.gpt.sc = strtol(cmd_name, &error, 10); /* Convert stick table id. */
+		if (*error != ')') {
+			memprintf(err, "invalid stick table track ID '%s'. Expects sc-add-hll0(<Track ID>)", args[*arg-1]);
+			return ACT_RET_PRS_ERR;
+		}
+
+		if (rule->arg.gpt.sc >= ACT_ACTION_TRK_SCMAX) {
+			memprintf(err, "invalid stick table track ID '%s'. The max allowed ID is %d",
+			          args[*arg-1], ACT_ACTION_TRK_SCMAX-1);
+			return ACT_RET_PRS_ERR;
+		}
+	}
+
+	rule->arg.gpt.expr = sample_parse_expr((char **)args, arg, px->conf.args.file,
+	                                       px->conf.args.line, err, &px->conf.args);
+	if (!rule->arg.gpt.expr)
+		return ACT_RET_PRS_ERR;
+
+	switch (rule->from) {
+	case ACT_F_TCP_REQ_SES: smp_val = SMP_VAL_FE_SES_ACC; break;
+	case ACT_F_TCP_REQ_CNT: smp_val = SMP_VAL_FE_REQ_CNT; break;
+	case ACT_F_TCP_RES_CNT: smp_val = SMP_VAL_BE_RES_CNT; break;
+	case ACT_F_HTTP_REQ:    smp_val = SMP_VAL_FE_HRQ_HDR; break;
+	case ACT_F_HTTP_RES:    smp_val = SMP_VAL_BE_HRS_HDR; break;
+	default:
+		memprintf(err, "internal error, unexpected rule->from=%d, please report this bug!", rule->from);
+		return ACT_RET_PRS_ERR;
+	}
+	if (!(rule->arg.gpt.expr->fetch->val & smp_val)) {
+		memprintf(err, "fetch method '%s' extracts information from '%s', none of which is available here", args[*arg-1],
+		          sample_src_names(rule->arg.gpt.expr->fetch->use));
+		free(rule->arg.gpt.expr);
+		return ACT_RET_PRS_ERR;
+	}
+
+	rule->action = ACT_CUSTOM;
+	rule->action_ptr = action_add_hll0;
+
+	return ACT_RET_PRS_OK;
+}
+
 /* set temp integer to the number of used entries in the table pointed to by expr.
  * Accepts exactly 1 argument of type table.
  */
@@ -2174,6 +3622,61 @@ smp_fetch_table_avl(const struct arg *args, struct sample *smp, const char *kw,
 	return 1;
 }
 
+/* set <smp> to the key of rank <args[1]> (1 by default) among the top keys of
+ * the table pointed to by args[0], ranked on the data type set by "topk".
+ */
+static int
+smp_fetch_table_top(const struct arg *args, struct sample *smp, const char *kw, void *private)
+{
+	struct stktable *t = args[0].data.t;
+	struct buffer *chk;
+	long long rank = 1;
+	unsigned char *key;
+
+	if (args[1].type == ARGT_SINT)
+		rank = args[1].data.sint;
+
+	if (!t->topk.size || rank < 1)
+		return 0;
+
+	smp->flags = SMP_F_VOL_TEST;
+	HA_SPIN_LOCK(STK_TABLE_LOCK, &t->topk.lock);
+	stktable_topk_refresh(t);
+	if (rank > t->topk.used) {
+		HA_SPIN_UNLOCK(STK_TABLE_LOCK, &t->topk.lock);
+		return 0;
+	}
+
+	key = stktable_topk_select(t, rank - 1)->key.key;
+
+	switch (t->type) {
+	case SMP_T_IPV4:
+		smp->data.type = SMP_T_IPV4;
+		memcpy(&smp->data.u.ipv4, key, sizeof(smp->data.u.ipv4));
+		break;
+	case SMP_T_IPV6:
+		smp->data.type = SMP_T_IPV6;
+		memcpy(&smp->data.u.ipv6, key, sizeof(smp->data.u.ipv6));
+		break;
+	case SMP_T_SINT:
+		smp->data.type = SMP_T_SINT;
+		smp->data.u.sint = *(unsigned int *)key;
+		break;
+	default:
+		chk = get_trash_chunk();
+		smp->data.type = t->type;
+		if (t->type == SMP_T_STR)
+			chk->data = strnlen((char *)key, t->key_size);
+		else
+			chk->data = t->key_size;
+		memcpy(chk->area, key, chk->data);
+		smp->data.u.str = *chk;
+		break;
+	}
+	HA_SPIN_UNLOCK(STK_TABLE_LOCK, &t->topk.lock);
+	return 1;
+}
+
 /* Returns a pointer to a stkctr depending on the fetch keyword name.
  * It is designed to be called as sc[0-9]_* sc_* or src_* exclusively.
  * sc[0-9]_* will return a pointer to the respective field in the
@@ -2353,6 +3856,47 @@ smp_fetch_sc_get_gpt0(const struct arg *args, struct sample *smp, const char *kw
 	return 1;
 }
 
+/* set <smp> to the estimated number of distinct values added to the HLL0
+ * counter from the stream's tracked frontend counters or from the src.
+ * Supports being called as "sc[0-9]_get_hll0" or "src_get_hll0" only. Value
+ * zero is returned if the key is new.
+ */
+static int
+smp_fetch_sc_get_hll0(const struct arg *args, struct sample *smp, const char *kw, void *private)
+{
+	struct stkctr tmpstkctr;
+	struct stkctr *stkctr;
+
+	stkctr = smp_fetch_sc_stkctr(smp->sess, smp->strm, args, kw, &tmpstkctr);
+	if (!stkctr)
+		return 0;
+
+	smp->flags = SMP_F_VOL_TEST;
+	smp->data.type = SMP_T_SINT;
+	smp->data.u.sint = 0;
+
+	if (stkctr_entry(stkctr)) {
+		void *ptr;
+
+		ptr = stktable_data_ptr(stkctr->table, stkctr_entry(stkctr), STKTABLE_DT_HLL0);
+		if (!ptr) {
+			if (stkctr == &tmpstkctr)
+				stktable_release(stkctr->table, stkctr_entry(stkctr));
+			return 0; /* parameter not stored */
+		}
+
+		HA_RWLOCK_RDLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
+
+		smp->data.u.sint = hll_count(&stktable_data_cast(ptr, hll0));
+
+		HA_RWLOCK_RDUNLOCK(STK_SESS_LOCK, &stkctr_entry(stkctr)->lock);
+
+		if (stkctr == &tmpstkctr)
+			stktable_release(stkctr->table, stkctr_entry(stkctr));
+	}
+	return 1;
+}
+
 /* set <smp> to the General Purpose Counter 0 value from the stream's tracked
  * frontend counters or from the src.
  * Supports being called as "sc[0-9]_get_gpc0" or "src_get_gpc0" only. Value
@@ -3343,40 +4887,44 @@ static int table_dump_head_to_buffer(struct buffer *msg,
 	return 1;
 }
 
-/* Dump a table entry to a stream interface's
- * read buffer. It returns 0 if the output buffer is full
- * and needs to be called again, otherwise non-zero.
- */
-static int table_dump_entry_to_buffer(struct buffer *msg,
-                                      struct stream_interface *si,
-                                      struct stktable *t, struct stksess *entry)
+/* Appends key <key> of table <t> to chunk <msg> */
+static void table_dump_key_to_buffer(struct buffer *msg, struct stktable *t, const void *key)
 {
-	int dt;
-
-	chunk_appendf(msg, "%p:", entry);
-
 	if (t->type == SMP_T_IPV4) {
 		char addr[INET_ADDRSTRLEN];
-		inet_ntop(AF_INET, (const void *)&entry->key.key, addr, sizeof(addr));
+		inet_ntop(AF_INET, key, addr, sizeof(addr));
 		chunk_appendf(msg, " key=%s", addr);
 	}
 	else if (t->type == SMP_T_IPV6) {
 		char addr[INET6_ADDRSTRLEN];
-		inet_ntop(AF_INET6, (const void *)&entry->key.key, addr, sizeof(addr));
+		inet_ntop(AF_INET6, key, addr, sizeof(addr));
 		chunk_appendf(msg, " key=%s", addr);
 	}
 	else if (t->type == SMP_T_SINT) {
-		chunk_appendf(msg, " key=%u", *(unsigned int *)entry->key.key);
+		chunk_appendf(msg, " key=%u", *(unsigned int *)key);
 	}
 	else if (t->type == SMP_T_STR) {
 		chunk_appendf(msg, " key=");
-		dump_text(msg, (const char *)entry->key.key, t->key_size);
+		dump_text(msg, key, t->key_size);
 	}
 	else {
 		chunk_appendf(msg, " key=");
-		dump_binary(msg, (const char *)entry->key.key, t->key_size);
+		dump_binary(msg, key, t->key_size);
 	}
+}
+
+/* Dump a table entry to a stream interface's
+ * read buffer. It returns 0 if the output buffer is full
+ * and needs to be called again, otherwise non-zero.
+ */
+static int table_dump_entry_to_buffer(struct buffer *msg,
+                                      struct stream_interface *si,
+                                      struct stktable *t, struct stksess *entry)
+{
+	int dt;
 
+	chunk_appendf(msg, "%p:", entry);
+	table_dump_key_to_buffer(msg, t, entry->key.key);
 	chunk_appendf(msg, " use=%d exp=%d", entry->ref_cnt - 1, tick_remain(now_ms, entry->expire));
 
 	for (dt = 0; dt < STKTABLE_DATA_TYPES; dt++) {
@@ -3411,6 +4959,9 @@ static int table_dump_entry_to_buffer(struct buffer *msg,
 			chunk_appendf(msg, "%s", de ? (char *)de->value.key : "-");
 			break;
 		}
+		case STD_T_HLL:
+			chunk_appendf(msg, "%u", hll_count(&stktable_data_cast(ptr, std_t_hll)));
+			break;
 		}
 	}
 	chunk_appendf(msg, "\n");
@@ -3509,6 +5060,9 @@ static int table_process_entry_per_key(struct appctx *appctx, char **args)
 		break;
 
 	case STK_CLI_ACT_CLR:
+		if (t->sketch_depth)
+			return cli_err(appctx, "Keys cannot be removed from sketch tables\n");
+
 		ts = stktable_lookup_key(t, &static_table_key);
 		if (!ts)
 			return 1;
@@ -3549,6 +5103,13 @@ static int table_process_entry_per_key(struct appctx *appctx, char **args)
 				return 1;
 			}
 
+			if (stktable_data_types[data_type].std_type == STD_T_HLL) {
+				cli_err(appctx, "This data type cannot be set\n");
+				HA_RWLOCK_WRUNLOCK(STK_SESS_LOCK, &ts->lock);
+				stktable_touch_local(t, ts, 1);
+				return 1;
+			}
+
 			if (!*args[cur_arg+1] || strl2llrc(args[cur_arg+1], strlen(args[cur_arg+1]), &value) != 0) {
 				cli_err(appctx, "Require a valid integer value to store\n");
 				HA_RWLOCK_WRUNLOCK(STK_SESS_LOCK, &ts->lock);
@@ -3569,12 +5130,21 @@ static int table_process_entry_per_key(struct appctx *appctx, char **args)
 				stktable_data_cast(ptr, std_t_ull) = value;
 				break;
 			case STD_T_FRQP:
+				frqp = &stktable_data_cast(ptr, std_t_frqp);
+				if (t->sketch_depth) {
+					/* sketch rates are only ever added to, the
+					 * events are counted in the current period
+					 * so that they're found when the detached
+					 * entry is folded into the sketch.
+					 */
+					update_freq_ctr_period(frqp, t->data_arg[data_type].u, value);
+					break;
+				}
 				/* We set both the current and previous values. That way
 				 * the reported frequency is stable during all the period
 				 * then slowly fades out. This allows external tools to
 				 * push measures without having to update them too often.
 				 */
-				frqp = &stktable_data_cast(ptr, std_t_frqp);
 				/* First bit is reserved for the freq_ctr_period lock
 				   Note: here we're still protected by the stksess lock
 				   so we don't need to update the update the freq_ctr_period
@@ -3667,10 +5237,38 @@ err_args:
  * on the action stored in appctx->private). It returns 0 if the output buffer is
  * full and it needs to be called again, otherwise non-zero.
  */
+/* Looks for the first entry of the table being dumped by <appctx>, starting
+ * at shard appctx->ctx.table.shard. If one is found, it is referenced as the
+ * next entry to dump, the state is switched to STAT_ST_LIST and non-zero is
+ * returned. Otherwise zero is returned.
+ */
+static int table_dump_next_shard(struct appctx *appctx)
+{
+	struct stktable *t = appctx->ctx.table.t;
+	struct stktable_shard *sh;
+	struct ebmb_node *eb;
+
+	for (; appctx->ctx.table.shard < t->nbshards; appctx->ctx.table.shard++) {
+		sh = &t->shards[appctx->ctx.table.shard];
+		HA_SPIN_LOCK(STK_TABLE_LOCK, &sh->lock);
+		eb = ebmb_first(&sh->keys);
+		if (eb) {
+			appctx->ctx.table.entry = ebmb_entry(eb, struct stksess, key);
+			HA_ATOMIC_ADD(&appctx->ctx.table.entry->ref_cnt, 1);
+			appctx->st2 = STAT_ST_LIST;
+			HA_SPIN_UNLOCK(STK_TABLE_LOCK, &sh->lock);
+			return 1;
+		}
+		HA_SPIN_UNLOCK(STK_TABLE_LOCK, &sh->lock);
+	}
+	return 0;
+}
+
 static int cli_io_handler_table(struct appctx *appctx)
 {
 	struct stream_interface *si = appctx->owner;
 	struct stream *s = si_strm(si);
+	struct stktable_shard *sh;
 	struct ebmb_node *eb;
 	int dt;
 	int skip_entry;
@@ -3683,7 +5281,8 @@ static int cli_io_handler_table(struct appctx *appctx)
 	 *     dump, the entry pointer is NULL ;
 	 *   - STAT_ST_LIST : the proxy pointer points to the current table
 	 *     and the entry pointer points to the next entry to be dumped,
-	 *     and the refcount on the next entry is held ;
+	 *     and the refcount on the next entry is held, the shard index
+	 *     designates the shard holding it ;
 	 *   - STAT_ST_END : nothing left to dump, the buffer may contain some
 	 *     data though.
 	 */
@@ -3724,16 +5323,9 @@ static int cli_io_handler_table(struct appctx *appctx)
 				if (appctx->ctx.table.target &&
 				    (strm_li(s)->bind_conf->level & ACCESS_LVL_MASK) >= ACCESS_LVL_OPER) {
 					/* dump entries only if table explicitly requested */
-					HA_SPIN_LOCK(STK_TABLE_LOCK, &appctx->ctx.table.t->lock);
-					eb = ebmb_first(&appctx->ctx.table.t->keys);
-					if (eb) {
-						appctx->ctx.table.entry = ebmb_entry(eb, struct stksess, key);
-						appctx->ctx.table.entry->ref_cnt++;
-						appctx->st2 = STAT_ST_LIST;
-						HA_SPIN_UNLOCK(STK_TABLE_LOCK, &appctx->ctx.table.t->lock);
+					appctx->ctx.table.shard = 0;
+					if (table_dump_next_shard(appctx))
 						break;
-					}
-					HA_SPIN_UNLOCK(STK_TABLE_LOCK, &appctx->ctx.table.t->lock);
 				}
 			}
 			appctx->ctx.table.t = appctx->ctx.table.t->next;
@@ -3770,6 +5362,9 @@ static int cli_io_handler_table(struct appctx *appctx)
 					data = read_freq_ctr_period(&stktable_data_cast(ptr, std_t_frqp),
 								    appctx->ctx.table.t->data_arg[dt].u);
 					break;
+				case STD_T_HLL:
+					data = hll_count(&stktable_data_cast(ptr, std_t_hll));
+					break;
 				}
 
 				/* skip the entry if the data does not match the test and the value */
@@ -3796,8 +5391,9 @@ static int cli_io_handler_table(struct appctx *appctx)
 
 			HA_RWLOCK_RDUNLOCK(STK_SESS_LOCK, &appctx->ctx.table.entry->lock);
 
-			HA_SPIN_LOCK(STK_TABLE_LOCK, &appctx->ctx.table.t->lock);
-			appctx->ctx.table.entry->ref_cnt--;
+			sh = &appctx->ctx.table.t->shards[appctx->ctx.table.shard];
+			HA_SPIN_LOCK(STK_TABLE_LOCK, &sh->lock);
+			HA_ATOMIC_SUB(&appctx->ctx.table.entry->ref_cnt, 1);
 
 			eb = ebmb_next(&appctx->ctx.table.entry->key);
 			if (eb) {
@@ -3807,8 +5403,8 @@ static int cli_io_handler_table(struct appctx *appctx)
 					__stksess_kill_if_expired(appctx->ctx.table.t, old);
 				else if (!skip_entry && !appctx->ctx.table.entry->ref_cnt)
 					__stksess_kill(appctx->ctx.table.t, old);
-				appctx->ctx.table.entry->ref_cnt++;
-				HA_SPIN_UNLOCK(STK_TABLE_LOCK, &appctx->ctx.table.t->lock);
+				HA_ATOMIC_ADD(&appctx->ctx.table.entry->ref_cnt, 1);
+				HA_SPIN_UNLOCK(STK_TABLE_LOCK, &sh->lock);
 				break;
 			}
 
@@ -3818,7 +5414,12 @@ static int cli_io_handler_table(struct appctx *appctx)
 			else if (!skip_entry && !appctx->ctx.table.entry->ref_cnt)
 				__stksess_kill(appctx->ctx.table.t, appctx->ctx.table.entry);
 
-			HA_SPIN_UNLOCK(STK_TABLE_LOCK, &appctx->ctx.table.t->lock);
+			HA_SPIN_UNLOCK(STK_TABLE_LOCK, &sh->lock);
+
+			/* continue with the next shard's entries */
+			appctx->ctx.table.shard++;
+			if (table_dump_next_shard(appctx))
+				break;
 
 			appctx->ctx.table.t = appctx->ctx.table.t->next;
 			appctx->st2 = STAT_ST_INFO;
@@ -3839,11 +5440,109 @@ static void cli_release_show_table(struct appctx *appctx)
 	}
 }
 
+/* Compares top-K entries <a> and <b> to sort them by decreasing value */
+static int table_top_cmp(const void *a, const void *b)
+{
+	const struct stktable_topk_ent *ea = a, *eb = b;
+
+	return ea->value < eb->value ? 1 : ea->value > eb->value ? -1 : 0;
+}
+
+/* Parses "show table-top <table>" and saves a copy of the table's top-K
+ * entries sorted by decreasing value into appctx->ctx.cli.p1, with their
+ * number in i0. The table is in p0, and i1 is the next line to dump.
+ */
+static int cli_parse_show_table_top(char **args, char *payload, struct appctx *appctx, void *private)
+{
+	struct stktable *t;
+	size_t ent_size;
+	char *ents;
+	unsigned int i, used;
+
+	if (!*args[2])
+		return cli_err(appctx, "Required argument: <table>\n");
+
+	t = stktable_find_by_name(args[2]);
+	if (!t)
+		return cli_err(appctx, "No such table\n");
+
+	if (!t->topk.size)
+		return cli_err(appctx, "This table doesn't track its top keys\n");
+
+	if (!cli_has_level(appctx, ACCESS_LVL_OPER))
+		return 1;
+
+	ent_size = stktable_topk_ent_size(t);
+	ents = calloc(t->topk.size, ent_size);
+	if (!ents)
+		return cli_err(appctx, "Out of memory\n");
+
+	HA_SPIN_LOCK(STK_TABLE_LOCK, &t->topk.lock);
+	stktable_topk_refresh(t);
+	used = t->topk.used;
+	for (i = 0; i < used; i++)
+		memcpy(ents + i * ent_size, t->topk.heap[i], ent_size);
+	HA_SPIN_UNLOCK(STK_TABLE_LOCK, &t->topk.lock);
+
+	qsort(ents, used, ent_size, table_top_cmp);
+
+	appctx->ctx.cli.p0 = t;
+	appctx->ctx.cli.p1 = ents;
+	appctx->ctx.cli.i0 = used;
+	appctx->ctx.cli.i1 = 0;
+	return 0;
+}
+
+/* Dumps the top-K entries saved by cli_parse_show_table_top(). It returns 0 if
+ * the output buffer is full and it needs to be called again, otherwise
+ * non-zero.
+ */
+static int cli_io_handler_table_top(struct appctx *appctx)
+{
+	struct stream_interface *si = appctx->owner;
+	struct stktable *t = appctx->ctx.cli.p0;
+	struct stktable_topk_ent *ent;
+	int type = t->topk.type;
+
+	if (unlikely(si_ic(si)->flags & (CF_WRITE_ERROR|CF_SHUTW)))
+		return 1;
+
+	for (; appctx->ctx.cli.i1 <= appctx->ctx.cli.i0; appctx->ctx.cli.i1++) {
+		chunk_reset(&trash);
+		if (!appctx->ctx.cli.i1) {
+			chunk_appendf(&trash, "# table: %s, type: %s, top:%u, used:%d, data: %s",
+				      t->id, stktable_types[t->type].kw, t->topk.size,
+				      appctx->ctx.cli.i0, stktable_data_types[type].name);
+			if (stktable_data_types[type].arg_type == ARG_T_DELAY)
+				chunk_appendf(&trash, "(%d)", t->data_arg[type].u);
+			chunk_appendf(&trash, "\n");
+		}
+		else {
+			ent = appctx->ctx.cli.p1 + (appctx->ctx.cli.i1 - 1) * stktable_topk_ent_size(t);
+			chunk_appendf(&trash, "%d:", appctx->ctx.cli.i1);
+			table_dump_key_to_buffer(&trash, t, ent->key.key);
+			chunk_appendf(&trash, " %s=%llu\n", stktable_data_types[type].name, ent->value);
+		}
+
+		if (ci_putchk(si_ic(si), &trash) == -1) {
+			si_rx_room_blk(si);
+			return 0;
+		}
+	}
+	return 1;
+}
+
+static void cli_release_show_table_top(struct appctx *appctx)
+{
+	free(appctx->ctx.cli.p1);
+}
+
 /* register cli keywords */
 static struct cli_kw_list cli_kws = {{ },{
 	{ { "clear", "table", NULL }, "clear table    : remove an entry from a table", cli_parse_table_req, cli_io_handler_table, cli_release_show_table, (void *)STK_CLI_ACT_CLR },
 	{ { "set",   "table", NULL }, "set table [id] : update or create a table entry's data", cli_parse_table_req, cli_io_handler_table, NULL, (void *)STK_CLI_ACT_SET },
 	{ { "show",  "table", NULL }, "show table [id]: report table usage stats or dump this table's contents", cli_parse_table_req, cli_io_handler_table, cli_release_show_table, (void *)STK_CLI_ACT_SHOW },
+	{ { "show",  "table-top", NULL }, "show table-top <id> : report the keys having the highest value in this table", cli_parse_show_table_top, cli_io_handler_table_top, cli_release_show_table_top },
 	{{},}
 }};
 
@@ -3853,6 +5552,7 @@ static struct action_kw_list tcp_conn_kws = { { }, {
 	{ "sc-inc-gpc0", parse_inc_gpc0, 1 },
 	{ "sc-inc-gpc1", parse_inc_gpc1, 1 },
 	{ "sc-set-gpt0", parse_set_gpt0, 1 },
+	{ "sc-add-hll0", parse_add_hll0, 1 },
 	{ /* END */ }
 }};
 
@@ -3862,6 +5562,7 @@ static struct action_kw_list tcp_sess_kws = { { }, {
 	{ "sc-inc-gpc0", parse_inc_gpc0, 1 },
 	{ "sc-inc-gpc1", parse_inc_gpc1, 1 },
 	{ "sc-set-gpt0", parse_set_gpt0, 1 },
+	{ "sc-add-hll0", parse_add_hll0, 1 },
 	{ /* END */ }
 }};
 
@@ -3871,6 +5572,7 @@ static struct action_kw_list tcp_req_kws = { { }, {
 	{ "sc-inc-gpc0", parse_inc_gpc0, 1 },
 	{ "sc-inc-gpc1", parse_inc_gpc1, 1 },
 	{ "sc-set-gpt0", parse_set_gpt0, 1 },
+	{ "sc-add-hll0", parse_add_hll0, 1 },
 	{ /* END */ }
 }};
 
@@ -3880,6 +5582,7 @@ static struct action_kw_list tcp_res_kws = { { }, {
 	{ "sc-inc-gpc0", parse_inc_gpc0, 1 },
 	{ "sc-inc-gpc1", parse_inc_gpc1, 1 },
 	{ "sc-set-gpt0", parse_set_gpt0, 1 },
+	{ "sc-add-hll0", parse_add_hll0, 1 },
 	{ /* END */ }
 }};
 
@@ -3889,6 +5592,7 @@ static struct action_kw_list http_req_kws = { { }, {
 	{ "sc-inc-gpc0", parse_inc_gpc0, 1 },
 	{ "sc-inc-gpc1", parse_inc_gpc1, 1 },
 	{ "sc-set-gpt0", parse_set_gpt0, 1 },
+	{ "sc-add-hll0", parse_add_hll0, 1 },
 	{ /* END */ }
 }};
 
@@ -3898,6 +5602,7 @@ static struct action_kw_list http_res_kws = { { }, {
 	{ "sc-inc-gpc0", parse_inc_gpc0, 1 },
 	{ "sc-inc-gpc1", parse_inc_gpc1, 1 },
 	{ "sc-set-gpt0", parse_set_gpt0, 1 },
+	{ "sc-add-hll0", parse_add_hll0, 1 },
 	{ /* END */ }
 }};
 
@@ -3923,6 +5628,7 @@ static struct sample_fetch_kw_list smp_fetch_keywords = {ILH, {
 	{ "sc_conn_cur",        smp_fetch_sc_conn_cur,       ARG2(1,SINT,TAB), NULL, SMP_T_SINT, SMP_USE_INTRN, },
 	{ "sc_conn_rate",       smp_fetch_sc_conn_rate,      ARG2(1,SINT,TAB), NULL, SMP_T_SINT, SMP_USE_INTRN, },
 	{ "sc_get_gpt0",        smp_fetch_sc_get_gpt0,       ARG2(1,SINT,TAB), NULL, SMP_T_SINT, SMP_USE_INTRN, },
+	{ "sc_get_hll0",        smp_fetch_sc_get_hll0,       ARG2(1,SINT,TAB), NULL, SMP_T_SINT, SMP_USE_INTRN, },
 	{ "sc_get_gpc0",        smp_fetch_sc_get_gpc0,       ARG2(1,SINT,TAB), NULL, SMP_T_SINT, SMP_USE_INTRN, },
 	{ "sc_get_gpc1",        smp_fetch_sc_get_gpc1,       ARG2(1,SINT,TAB), NULL, SMP_T_SINT, SMP_USE_INTRN },
 	{ "sc_gpc0_rate",       smp_fetch_sc_gpc0_rate,      ARG2(1,SINT,TAB), NULL, SMP_T_SINT, SMP_USE_INTRN, },
@@ -3947,6 +5653,7 @@ static struct sample_fetch_kw_list smp_fetch_keywords = {ILH, {
 	{ "sc0_conn_cur",       smp_fetch_sc_conn_cur,       ARG1(0,TAB),      NULL, SMP_T_SINT, SMP_USE_INTRN, },
 	{ "sc0_conn_rate",      smp_fetch_sc_conn_rate,      ARG1(0,TAB),      NULL, SMP_T_SINT, SMP_USE_INTRN, },
 	{ "sc0_get_gpt0",       smp_fetch_sc_get_gpt0,       ARG1(0,TAB),      NULL, SMP_T_SINT, SMP_USE_INTRN, },
+	{ "sc0_get_hll0",       smp_fetch_sc_get_hll0,       ARG1(0,TAB),      NULL, SMP_T_SINT, SMP_USE_INTRN, },
 	{ "sc0_get_gpc0",       smp_fetch_sc_get_gpc0,       ARG1(0,TAB),      NULL, SMP_T_SINT, SMP_USE_INTRN, },
 	{ "sc0_get_gpc1",       smp_fetch_sc_get_gpc1,       ARG1(0,TAB),      NULL, SMP_T_SINT, SMP_USE_INTRN, },
 	{ "sc0_gpc0_rate",      smp_fetch_sc_gpc0_rate,      ARG1(0,TAB),      NULL, SMP_T_SINT, SMP_USE_INTRN, },
@@ -3971,6 +5678,7 @@ static struct sample_fetch_kw_list smp_fetch_keywords = {ILH, {
 	{ "sc1_conn_cur",       smp_fetch_sc_conn_cur,       ARG1(0,TAB),      NULL, SMP_T_SINT, SMP_USE_INTRN, },
 	{ "sc1_conn_rate",      smp_fetch_sc_conn_rate,      ARG1(0,TAB),      NULL, SMP_T_SINT, SMP_USE_INTRN, },
 	{ "sc1_get_gpt0",       smp_fetch_sc_get_gpt0,       ARG1(0,TAB),      NULL, SMP_T_SINT, SMP_USE_INTRN, },
+	{ "sc1_get_hll0",       smp_fetch_sc_get_hll0,       ARG1(0,TAB),      NULL, SMP_T_SINT, SMP_USE_INTRN, },
 	{ "sc1_get_gpc0",       smp_fetch_sc_get_gpc0,       ARG1(0,TAB),      NULL, SMP_T_SINT, SMP_USE_INTRN, },
 	{ "sc1_get_gpc1",       smp_fetch_sc_get_gpc1,       ARG1(0,TAB),      NULL, SMP_T_SINT, SMP_USE_INTRN, },
 	{ "sc1_gpc0_rate",      smp_fetch_sc_gpc0_rate,      ARG1(0,TAB),      NULL, SMP_T_SINT, SMP_USE_INTRN, },
@@ -3995,6 +5703,7 @@ static struct sample_fetch_kw_list smp_fetch_keywords = {ILH, {
 	{ "sc2_conn_cur",       smp_fetch_sc_conn_cur,       ARG1(0,TAB),      NULL, SMP_T_SINT, SMP_USE_INTRN, },
 	{ "sc2_conn_rate",      smp_fetch_sc_conn_rate,      ARG1(0,TAB),      NULL, SMP_T_SINT, SMP_USE_INTRN, },
 	{ "sc2_get_gpt0",       smp_fetch_sc_get_gpt0,       ARG1(0,TAB),      NULL, SMP_T_SINT, SMP_USE_INTRN, },
+	{ "sc2_get_hll0",       smp_fetch_sc_get_hll0,       ARG1(0,TAB),      NULL, SMP_T_SINT, SMP_USE_INTRN, },
 	{ "sc2_get_gpc0",       smp_fetch_sc_get_gpc0,       ARG1(0,TAB),      NULL, SMP_T_SINT, SMP_USE_INTRN, },
 	{ "sc2_get_gpc1",       smp_fetch_sc_get_gpc1,       ARG1(0,TAB),      NULL, SMP_T_SINT, SMP_USE_INTRN, },
 	{ "sc2_gpc0_rate",      smp_fetch_sc_gpc0_rate,      ARG1(0,TAB),      NULL, SMP_T_SINT, SMP_USE_INTRN, },
@@ -4019,6 +5728,7 @@ static struct sample_fetch_kw_list smp_fetch_keywords = {ILH, {
 	{ "src_conn_cur",       smp_fetch_sc_conn_cur,       ARG1(1,TAB),      NULL, SMP_T_SINT, SMP_USE_L4CLI, },
 	{ "src_conn_rate",      smp_fetch_sc_conn_rate,      ARG1(1,TAB),      NULL, SMP_T_SINT, SMP_USE_L4CLI, },
 	{ "src_get_gpt0",       smp_fetch_sc_get_gpt0,       ARG1(1,TAB),      NULL, SMP_T_SINT, SMP_USE_L4CLI, },
+	{ "src_get_hll0",       smp_fetch_sc_get_hll0,       ARG1(1,TAB),      NULL, SMP_T_SINT, SMP_USE_L4CLI, },
 	{ "src_get_gpc0",       smp_fetch_sc_get_gpc0,       ARG1(1,TAB),      NULL, SMP_T_SINT, SMP_USE_L4CLI, },
 	{ "src_get_gpc1",       smp_fetch_sc_get_gpc1,       ARG1(1,TAB),      NULL, SMP_T_SINT, SMP_USE_L4CLI, },
 	{ "src_gpc0_rate",      smp_fetch_sc_gpc0_rate,      ARG1(1,TAB),      NULL, SMP_T_SINT, SMP_USE_L4CLI, },
@@ -4036,6 +5746,7 @@ static struct sample_fetch_kw_list smp_fetch_keywords = {ILH, {
 	{ "src_updt_conn_cnt",  smp_fetch_src_updt_conn_cnt, ARG1(1,TAB),      NULL, SMP_T_SINT, SMP_USE_L4CLI, },
 	{ "table_avl",          smp_fetch_table_avl,         ARG1(1,TAB),      NULL, SMP_T_SINT, SMP_USE_INTRN, },
 	{ "table_cnt",          smp_fetch_table_cnt,         ARG1(1,TAB),      NULL, SMP_T_SINT, SMP_USE_INTRN, },
+	{ "table_top",          smp_fetch_table_top,         ARG2(1,TAB,SINT), NULL, SMP_T_STR,  SMP_USE_INTRN, },
 	{ /* END */ },
 }};
 
@@ -4050,6 +5761,7 @@ static struct sample_conv_kw_list sample_conv_kws = {ILH, {
 	{ "table_conn_cur",       sample_conv_table_conn_cur,       ARG1(1,TAB),  NULL, SMP_T_ANY,  SMP_T_SINT  },
 	{ "table_conn_rate",      sample_conv_table_conn_rate,      ARG1(1,TAB),  NULL, SMP_T_ANY,  SMP_T_SINT  },
 	{ "table_gpt0",           sample_conv_table_gpt0,           ARG1(1,TAB),  NULL, SMP_T_ANY,  SMP_T_SINT  },
+	{ "table_hll0",           sample_conv_table_hll0,           ARG1(1,TAB),  NULL, SMP_T_ANY,  SMP_T_SINT  },
 	{ "table_gpc0",           sample_conv_table_gpc0,           ARG1(1,TAB),  NULL, SMP_T_ANY,  SMP_T_SINT  },
 	{ "table_gpc1",           sample_conv_table_gpc1,           ARG1(1,TAB),  NULL, SMP_T_ANY,  SMP_T_SINT  },
 	{ "table_gpc0_rate",      sample_conv_table_gpc0_rate,      ARG1(1,TAB),  NULL, SMP_T_ANY,  SMP_T_SINT  },
@@ -1286,7 +1286,9 @@ static void sess_update_stream_int(struct stream *s)
 	}
 	else if (si->state == SI_ST_QUE) {
 		/* connection request was queued, check for any update */
-		if (!pendconn_dequeue(s)) {
+		int ret = pendconn_dequeue(s);
+
+		if (!ret) {
 			/* The connection is not in the queue anymore. Either
 			 * we have a server connection slot available and we
 			 * go directly to the assigned state, or we need to
@@ -1304,8 +1306,10 @@ static void sess_update_stream_int(struct stream *s)
 		}
 
 		/* Connection request still in queue... */
-		if (si->flags & SI_FL_EXP) {
-			/* ... and timeout expired */
+		if (ret < 0 || (si->flags & SI_FL_EXP)) {
+			/* ... and timeout expired, or it was rejected by the
+			 * queue management.
+			 */
 			si->exp = TICK_ETERNITY;
 			si->flags &= ~SI_FL_EXP;
 			s->logs.t_queue = tv_ms_elapsed(&s->logs.tv_accept, &now);
@@ -1318,9 +1322,10 @@ static void sess_update_stream_int(struct stream *s)
 			_HA_ATOMIC_ADD(&s->be->be_counters.failed_conns, 1);
 			si_shutr(si);
 			si_shutw(si);
-			req->flags |= CF_WRITE_TIMEOUT;
+			if (ret > 0)
+				req->flags |= CF_WRITE_TIMEOUT;
 			if (!si->err_type)
-				si->err_type = SI_ET_QUEUE_TO;
+				si->err_type = ret < 0 ? SI_ET_QUEUE_ERR : SI_ET_QUEUE_TO;
 			si->state = SI_ST_CLO;
 			if (s->srv_error)
 				s->srv_error(s, si);
@@ -2940,6 +2945,19 @@ void stream_update_time_stats(struct stream *s)
 	if (s->be->mode != PR_MODE_HTTP)
 		t_data = t_connect;
 
+	srv = objt_server(s->target);
+	if (srv && srv->adapt_target) {
+		/* status codes 501 and 505 are triggered by the request, they
+		 * are not server failures.
+		 */
+		if (s->si[1].err_type & (SI_ET_CONN_TO | SI_ET_CONN_ERR | SI_ET_DATA_TO | SI_ET_DATA_ERR))
+			srv_adapt_maxconn(srv, 0, 1);
+		else if (t_connect >= 0 && t_data >= 0)
+			srv_adapt_maxconn(srv, t_data - t_queue,
+			                  s->txn && s->txn->status >= 500 &&
+			                  s->txn->status != 501 && s->txn->status != 505);
+	}
+
 	if (t_connect < 0 || t_data < 0)
 		return;
 
@@ -2950,7 +2968,6 @@ void stream_update_time_stats(struct stream *s)
 	t_connect -= t_queue;
 	t_queue   -= t_request;
 
-	srv = objt_server(s->target);
 	if (srv) {
 		swrate_add(&srv->counters.q_time, TIME_STATS_SAMPLES, t_queue);
 		swrate_add(&srv->counters.c_time, TIME_STATS_SAMPLES, t_connect);
@@ -2960,6 +2977,8 @@ void stream_update_time_stats(struct stream *s)
 		HA_ATOMIC_UPDATE_MAX(&srv->counters.ctime_max, t_connect);
 		HA_ATOMIC_UPDATE_MAX(&srv->counters.dtime_max, t_data);
 		HA_ATOMIC_UPDATE_MAX(&srv->counters.ttime_max, t_close);
+		if (srv->proxy->lbprm.server_response)
+			srv->proxy->lbprm.server_response(srv, t_connect + t_data);
 	}
 	swrate_add(&s->be->be_counters.q_time, TIME_STATS_SAMPLES, t_queue);
 	swrate_add(&s->be->be_counters.c_time, TIME_STATS_SAMPLES, t_connect);
@@ -12,6 +12,7 @@
 
 #include <string.h>
 
+#include <common/cfgparse.h>
 #include <common/config.h>
 #include <common/memory.h>
 #include <common/mini-clist.h>
@@ -20,6 +21,7 @@
 #include <eb32sctree.h>
 #include <eb32tree.h>
 
+#include <proto/activity.h>
 #include <proto/fd.h>
 #include <proto/freq_ctr.h>
 #include <proto/proxy.h>
@@ -35,7 +37,7 @@ DECLARE_POOL(pool_head_tasklet, "tasklet", sizeof(struct tasklet));
 DECLARE_POOL(pool_head_notification, "notification", sizeof(struct notification));
 
 unsigned int nb_tasks = 0;
-volatile unsigned long global_tasks_mask = 0; /* Mask of threads with tasks in the global runqueue */
+volatile unsigned long global_tasks_mask = 0; /* Mask of threads which may find tasks in inbound queues */
 unsigned int tasks_run_queue = 0;
 unsigned int tasks_run_queue_cur = 0;    /* copy of the run queue size */
 unsigned int nb_tasks_cur = 0;     /* copy of the tasks count */
@@ -43,19 +45,65 @@ unsigned int niced_tasks = 0;      /* number of niced tasks in the run queue */
 
 THREAD_LOCAL struct task_per_thread *sched = &task_per_thread[0]; /* scheduler context for the current thread */
 
-__decl_aligned_spinlock(rq_lock); /* spin lock related to run queue */
 __decl_aligned_rwlock(wq_lock);   /* RW lock related to the wait queue */
 
 #ifdef USE_THREAD
-struct eb_root timers;      /* sorted timers tree, global */
-struct eb_root rqueue;      /* tree constituting the run queue */
-int global_rqueue_size; /* Number of element sin the global runqueue */
+struct twheel timers;       /* timer wheel, global */
+static THREAD_LOCAL unsigned int inbound_rotor; /* next thread to pick in __task_pick_thread() */
 #endif
 
 static unsigned int rqueue_ticks;  /* insertion count */
 
+/* percentage of each polling loop's budget given to each scheduler class */
+static unsigned int sched_shares[TL_CLASSES] = {
+	[TL_URGENT]     = 50,
+	[TL_NORMAL]     = 30,
+	[TL_BULK]       = 15,
+	[TL_BACKGROUND] = 5,
+};
+
 struct task_per_thread task_per_thread[MAX_THREADS];
 
+#ifdef USE_THREAD
+/* Picks the thread whose inbound queue will receive task <t> woken up by the
+ * current thread. Work is kept within the current thread group whenever the
+ * task may run there, otherwise it goes to the group of the first thread
+ * allowed to run it. The current thread is preferred when allowed, then a
+ * sleeping thread which will be woken up, then the other threads in turn.
+ */
+static inline int __task_pick_thread(const struct task *t)
+{
+	unsigned long mask = t->thread_mask & all_threads_mask;
+	unsigned long m;
+	int thr;
+
+	if (unlikely(!mask))
+		return tid;
+
+	if (likely(mask & ti->tg_mask))
+		mask &= ti->tg_mask;
+	else {
+		activity[tid].xgrp_wake++;
+		mask &= ha_thread_info[my_ffsl(mask) - 1].tg_mask;
+	}
+
+	if (mask & tid_bit)
+		return tid;
+
+	m = mask & sleeping_thread_mask;
+	if (m)
+		return my_ffsl(m) - 1;
+
+	/* all candidates are running, rotate among them */
+	m = mask & ~nbits(inbound_rotor + 1);
+	if (!m)
+		m = mask;
+	thr = my_ffsl(m) - 1;
+	inbound_rotor = thr;
+	return thr;
+}
+#endif
+
 /* Puts the task <t> in run queue at a position depending on t->nice. <t> is
  * returned. The nice value assigns boosts in 32th of the run queue size. A
  * nice value of -1024 sets the task to -tasks_run_queue*32, while a nice value
@@ -63,24 +111,25 @@ struct task_per_thread task_per_thread[MAX_THREADS];
  * the caller will have to set its flags after this call.
  * The task must not already be in the run queue. If unsure, use the safer
  * task_wakeup() function.
+ *
+ * A task which may only run on the current thread is directly inserted into
+ * its local run queue. Other ones are appended to the lock-free inbound queue
+ * of a thread allowed to run them, where the owner picks them at its next
+ * scheduler pass, unless an idle sibling steals them first.
  */
-void __task_wakeup(struct task *t, struct eb_root *root)
+void __task_wakeup(struct task *t)
 {
 #ifdef USE_THREAD
-	if (root == &rqueue) {
-		HA_SPIN_LOCK(TASK_RQ_LOCK, &rq_lock);
-	}
+	unsigned long mask;
+	int thr = tid;
+
+	if (t->thread_mask != tid_bit && global.nbthread != 1)
+		thr = __task_pick_thread(t);
 #endif
 	/* Make sure if the task isn't in the runqueue, nobody inserts it
 	 * in the meanwhile.
 	 */
 	_HA_ATOMIC_ADD(&tasks_run_queue, 1);
-#ifdef USE_THREAD
-	if (root == &rqueue) {
-		global_tasks_mask |= t->thread_mask;
-		__ha_barrier_store();
-	}
-#endif
 	t->rq.key = _HA_ATOMIC_ADD(&rqueue_ticks, 1);
 
 	if (likely(t->nice)) {
@@ -94,33 +143,65 @@ void __task_wakeup(struct task *t, struct eb_root *root)
 	if (task_profiling_mask & tid_bit)
 		t->call_date = now_mono_time();
 
-	eb32sc_insert(root, &t->rq, t->thread_mask);
 #ifdef USE_THREAD
-	if (root == &rqueue) {
-		global_rqueue_size++;
+	if (t->thread_mask != tid_bit && global.nbthread != 1) {
+		/* The task is visible as queued before it's reachable */
+		t->rq_tid = thr;
 		_HA_ATOMIC_OR(&t->state, TASK_GLOBAL);
-		HA_SPIN_UNLOCK(TASK_RQ_LOCK, &rq_lock);
-	} else
-#endif
-	{
-		int nb = ((void *)root - (void *)&task_per_thread[0].rqueue) / sizeof(task_per_thread[0]);
-		task_per_thread[nb].rqueue_size++;
+		MT_LIST_ADDQ(&task_per_thread[thr].inbound, &t->inq);
+		_HA_ATOMIC_ADD(&task_per_thread[thr].inbound_size, 1);
+
+		/* advertise the task to all threads allowed to steal it */
+		mask = t->thread_mask & ha_thread_info[thr].tg_mask;
+		__ha_barrier_atomic_store();
+		_HA_ATOMIC_OR(&global_tasks_mask, mask | (1UL << thr));
+
+		if (thr != tid && (sleeping_thread_mask & (1UL << thr))) {
+			_HA_ATOMIC_AND(&sleeping_thread_mask, ~(1UL << thr));
+			wake_thread(thr);
+		}
+		return;
 	}
+#endif
+	eb32sc_insert(&sched->rqueue, &t->rq, t->thread_mask);
+	sched->rqueue_size++;
+}
+
 #ifdef USE_THREAD
-	/* If all threads that are supposed to handle this task are sleeping,
-	 * wake one.
-	 */
-	if ((((t->thread_mask & all_threads_mask) & sleeping_thread_mask) ==
-	     (t->thread_mask & all_threads_mask))) {
-		unsigned long m = (t->thread_mask & all_threads_mask) &~ tid_bit;
+/* Moves up to <max> tasks from the inbound queue of thread <thr> to the
+ * current thread's local run queue. Tasks at the head of a sibling's queue
+ * which the current thread is not allowed to run stop the stealing. Returns
+ * the number of tasks moved.
+ */
+static int __task_pull_inbound(int thr, int max)
+{
+	struct task_per_thread * const tq = &task_per_thread[thr];
+	struct task *t;
+	int done = 0;
 
-		m = (m & (m - 1)) ^ m; // keep lowest bit set
-		_HA_ATOMIC_AND(&sleeping_thread_mask, ~m);
-		wake_thread(my_ffsl(m) - 1);
+	while (done < max) {
+		t = MT_LIST_POP(&tq->inbound, struct task *, inq);
+		if (!t)
+			break;
+		_HA_ATOMIC_SUB(&tq->inbound_size, 1);
+
+		if (unlikely(!(t->thread_mask & tid_bit)) && thr != tid) {
+			/* not for us, put it back and leave */
+			MT_LIST_ADD(&tq->inbound, &t->inq);
+			_HA_ATOMIC_ADD(&tq->inbound_size, 1);
+			break;
+		}
+
+		eb32sc_insert(&sched->rqueue, &t->rq, t->thread_mask);
+		sched->rqueue_size++;
+		_HA_ATOMIC_AND(&t->state, ~TASK_GLOBAL);
+		done++;
+		if (thr != tid)
+			activity[tid].rq_steal++;
 	}
-#endif
-	return;
+	return done;
 }
+#endif
 
 /*
  * __task_queue()
@@ -128,7 +209,7 @@ void __task_wakeup(struct task *t, struct eb_root *root)
  * Inserts a task into wait queue <wq> at the position given by its expiration
  * date. It does not matter if the task was already in the wait queue or not,
  * as it will be unlinked. The task must not have an infinite expiration timer.
- * Last, tasks must not be queued further than the end of the tree, which is
+ * Last, tasks must not be queued further than the end of the wheel, which is
  * between <now_ms> and <now_ms> + 2^31 ms (now+24days in 32bit).
  *
  * This function should not be used directly, it is meant to be called by the
@@ -137,7 +218,7 @@ void __task_wakeup(struct task *t, struct eb_root *root)
  * at all about locking so the caller must be careful when deciding whether to
  * lock or not around this call.
  */
-void __task_queue(struct task *task, struct eb_root *wq)
+void __task_queue(struct task *task, struct twheel *wq)
 {
 	if (likely(task_in_wq(task)))
 		__task_unlink_wq(task);
@@ -150,7 +231,8 @@ void __task_queue(struct task *task, struct eb_root *wq)
 		return;
 #endif
 
-	eb32_insert(wq, &task->wq);
+	tw_sync(wq, now_ms);
+	tw_insert(wq, &task->wq);
 }
 
 /*
@@ -161,64 +243,41 @@ void wake_expired_tasks()
 {
 	struct task_per_thread * const tt = sched; // thread's tasks
 	struct task *task;
-	struct eb32_node *eb;
-	__decl_hathreads(int key);
-
-	while (1) {
-  lookup_next_local:
-		eb = eb32_lookup_ge(&tt->timers, now_ms - TIMER_LOOK_BACK);
-		if (!eb) {
-			/* we might have reached the end of the tree, typically because
-			* <now_ms> is in the first half and we're first scanning the last
-			* half. Let's loop back to the beginning of the tree now.
-			*/
-			eb = eb32_first(&tt->timers);
-			if (likely(!eb))
-				break;
-		}
+	struct tw_node *node;
+	__decl_hathreads(unsigned int key);
 
-		if (tick_is_lt(now_ms, eb->key))
-			break;
-
-		/* timer looks expired, detach it from the queue */
-		task = eb32_entry(eb, struct task, wq);
-		__task_unlink_wq(task);
+	while ((node = tw_pop_expired(&tt->timers, now_ms))) {
+		/* timer looks expired and was detached from the queue */
+		task = tw_entry(node, struct task, wq);
 
 		/* It is possible that this task was left at an earlier place in the
-		 * tree because a recent call to task_queue() has not moved it. This
+		 * wheel because a recent call to task_queue() has not moved it. This
 		 * happens when the new expiration date is later than the old one.
 		 * Since it is very unlikely that we reach a timeout anyway, it's a
-		 * lot cheaper to proceed like this because we almost never update
-		 * the tree. We may also find disabled expiration dates there. Since
-		 * we have detached the task from the tree, we simply call task_queue
-		 * to take care of this. Note that we might occasionally requeue it at
-		 * the same place, before <eb>, so we have to check if this happens,
-		 * and adjust <eb>, otherwise we may skip it which is not what we want.
-		 * We may also not requeue the task (and not point eb at it) if its
-		 * expiration time is not set.
+		 * lot cheaper to proceed like this because we almost never move
+		 * the timer. We may also find disabled expiration dates there. Since
+		 * the task was detached from the wheel, we simply call task_queue
+		 * to take care of this. Its new date is necessarily in the future so
+		 * it will not be visited again during this round. We may also not
+		 * requeue the task if its expiration time is not set.
 		 */
 		if (!tick_is_expired(task->expire, now_ms)) {
 			if (tick_isset(task->expire))
 				__task_queue(task, &tt->timers);
-			goto lookup_next_local;
+			continue;
 		}
 		task_wakeup(task, TASK_WOKEN_TIMER);
 	}
 
 #ifdef USE_THREAD
-	if (eb_is_empty(&timers))
+	if (tw_is_empty(&timers))
 		goto leave;
 
 	HA_RWLOCK_RDLOCK(TASK_WQ_LOCK, &wq_lock);
-	eb = eb32_lookup_ge(&timers, now_ms - TIMER_LOOK_BACK);
-	if (!eb) {
-		eb = eb32_first(&timers);
-		if (likely(!eb)) {
-			HA_RWLOCK_RDUNLOCK(TASK_WQ_LOCK, &wq_lock);
-			goto leave;
-		}
+	if (!tw_next_key(&timers, &key)) {
+		HA_RWLOCK_RDUNLOCK(TASK_WQ_LOCK, &wq_lock);
+		goto leave;
 	}
-	key = eb->key;
 	HA_RWLOCK_RDUNLOCK(TASK_WQ_LOCK, &wq_lock);
 
 	if (tick_is_lt(now_ms, key))
@@ -229,36 +288,15 @@ void wake_expired_tasks()
 	while (1) {
 		HA_RWLOCK_WRLOCK(TASK_WQ_LOCK, &wq_lock);
   lookup_next:
-		eb = eb32_lookup_ge(&timers, now_ms - TIMER_LOOK_BACK);
-		if (!eb) {
-			/* we might have reached the end of the tree, typically because
-			* <now_ms> is in the first half and we're first scanning the last
-			* half. Let's loop back to the beginning of the tree now.
-			*/
-			eb = eb32_first(&timers);
-			if (likely(!eb))
-				break;
-		}
-
-		if (tick_is_lt(now_ms, eb->key))
+		node = tw_pop_expired(&timers, now_ms);
+		if (!node)
 			break;
 
-		/* timer looks expired, detach it from the queue */
-		task = eb32_entry(eb, struct task, wq);
-		__task_unlink_wq(task);
+		/* timer looks expired and was detached from the queue */
+		task = tw_entry(node, struct task, wq);
 
-		/* It is possible that this task was left at an earlier place in the
-		 * tree because a recent call to task_queue() has not moved it. This
-		 * happens when the new expiration date is later than the old one.
-		 * Since it is very unlikely that we reach a timeout anyway, it's a
-		 * lot cheaper to proceed like this because we almost never update
-		 * the tree. We may also find disabled expiration dates there. Since
-		 * we have detached the task from the tree, we simply call task_queue
-		 * to take care of this. Note that we might occasionally requeue it at
-		 * the same place, before <eb>, so we have to check if this happens,
-		 * and adjust <eb>, otherwise we may skip it which is not what we want.
-		 * We may also not requeue the task (and not point eb at it) if its
-		 * expiration time is not set.
+		/* Same as above, the task might have been left at an earlier
+		 * place in the wheel, in which case it's simply requeued.
 		 */
 		if (!tick_is_expired(task->expire, now_ms)) {
 			if (tick_isset(task->expire))
@@ -277,158 +315,54 @@ leave:
 
 /* Checks the next timer for the current thread by looking into its own timer
  * list and the global one. It may return TICK_ETERNITY if no timer is present.
- * Note that the next timer might very well be slighly in the past.
+ * Note that the next timer might very well be slighly in the past, and that
+ * for timers far away it may be slightly earlier than the real one since the
+ * wheel has to redistribute its timers on the way.
  */
 int next_timer_expiry()
 {
 	struct task_per_thread * const tt = sched; // thread's tasks
-	struct eb32_node *eb;
 	int ret = TICK_ETERNITY;
-	__decl_hathreads(int key);
-
-	/* first check in the thread-local timers */
-	eb = eb32_lookup_ge(&tt->timers, now_ms - TIMER_LOOK_BACK);
-	if (!eb) {
-		/* we might have reached the end of the tree, typically because
-		 * <now_ms> is in the first half and we're first scanning the last
-		 * half. Let's loop back to the beginning of the tree now.
-		 */
-		eb = eb32_first(&tt->timers);
-	}
+	unsigned int key;
 
-	if (eb)
-		ret = eb->key;
+	/* first check in the thread-local timers. A date of zero is a valid
+	 * one for the wheel but not for a tick so we move it one ms earlier.
+	 */
+	if (tw_next_key(&tt->timers, &key))
+		ret = key ? key : key - 1;
 
 #ifdef USE_THREAD
-	if (!eb_is_empty(&timers)) {
+	if (!tw_is_empty(&timers)) {
+		int found;
+
 		HA_RWLOCK_RDLOCK(TASK_WQ_LOCK, &wq_lock);
-		eb = eb32_lookup_ge(&timers, now_ms - TIMER_LOOK_BACK);
-		if (!eb)
-			eb = eb32_first(&timers);
-		if (eb)
-			key = eb->key;
+		found = tw_next_key(&timers, &key);
 		HA_RWLOCK_RDUNLOCK(TASK_WQ_LOCK, &wq_lock);
-		if (eb)
-			ret = tick_first(ret, key);
+		if (found)
+			ret = tick_first(ret, key ? key : key - 1);
 	}
 #endif
 	return ret;
 }
 
-/* The run queue is chronologically sorted in a tree. An insertion counter is
- * used to assign a position to each task. This counter may be combined with
- * other variables (eg: nice value) to set the final position in the tree. The
- * counter may wrap without a problem, of course. We then limit the number of
- * tasks processed to 200 in any case, so that general latency remains low and
- * so that task positions have a chance to be considered. The function scans
- * both the global and local run queues and picks the most urgent task between
- * the two. We need to grab the global runqueue lock to touch it so it's taken
- * on the very first access to the global run queue and is released as soon as
- * it reaches the end.
- *
- * The function adjusts <next> if a new event is closer.
+/* Runs at most <max> tasks and tasklets from list <list>, which is one of the
+ * current thread's class lists, and returns the number of entries processed.
+ * Destroyed tasks which are only freed do not count.
  */
-void process_runnable_tasks()
+static int run_tasks_from_list(struct list *list, int max)
 {
 	struct task_per_thread * const tt = sched;
-	struct eb32sc_node *lrq = NULL; // next local run queue entry
-	struct eb32sc_node *grq = NULL; // next global run queue entry
-	struct task *t;
-	int max_processed;
-	struct mt_list *tmp_list;
+	int done = 0;
 
-	ti->flags &= ~TI_FL_STUCK; // this thread is still running
-
-	if (!thread_has_tasks()) {
-		activity[tid].empty_rq++;
-		return;
-	}
-	/* Merge the list of tasklets waken up by other threads to the
-	 * main list.
-	 */
-	tmp_list = MT_LIST_BEHEAD(&sched->shared_tasklet_list);
-	if (tmp_list)
-		LIST_SPLICE_END_DETACHED(&sched->task_list, (struct list *)tmp_list);
-
-	tasks_run_queue_cur = tasks_run_queue; /* keep a copy for reporting */
-	nb_tasks_cur = nb_tasks;
-	max_processed = global.tune.runqueue_depth;
-
-	if (likely(niced_tasks))
-		max_processed = (max_processed + 3) / 4;
-
-	/* Note: the grq lock is always held when grq is not null */
-
-	while (tt->task_list_size < max_processed) {
-		if ((global_tasks_mask & tid_bit) && !grq) {
-#ifdef USE_THREAD
-			HA_SPIN_LOCK(TASK_RQ_LOCK, &rq_lock);
-			grq = eb32sc_lookup_ge(&rqueue, rqueue_ticks - TIMER_LOOK_BACK, tid_bit);
-			if (unlikely(!grq)) {
-				grq = eb32sc_first(&rqueue, tid_bit);
-				if (!grq) {
-					global_tasks_mask &= ~tid_bit;
-					HA_SPIN_UNLOCK(TASK_RQ_LOCK, &rq_lock);
-				}
-			}
-#endif
-		}
-
-		/* If a global task is available for this thread, it's in grq
-		 * now and the global RQ is locked.
-		 */
-
-		if (!lrq) {
-			lrq = eb32sc_lookup_ge(&tt->rqueue, rqueue_ticks - TIMER_LOOK_BACK, tid_bit);
-			if (unlikely(!lrq))
-				lrq = eb32sc_first(&tt->rqueue, tid_bit);
-		}
-
-		if (!lrq && !grq)
-			break;
-
-		if (likely(!grq || (lrq && (int)(lrq->key - grq->key) <= 0))) {
-			t = eb32sc_entry(lrq, struct task, rq);
-			lrq = eb32sc_next(lrq, tid_bit);
-			__task_unlink_rq(t);
-		}
-#ifdef USE_THREAD
-		else {
-			t = eb32sc_entry(grq, struct task, rq);
-			grq = eb32sc_next(grq, tid_bit);
-			__task_unlink_rq(t);
-			if (unlikely(!grq)) {
-				grq = eb32sc_first(&rqueue, tid_bit);
-				if (!grq) {
-					global_tasks_mask &= ~tid_bit;
-					HA_SPIN_UNLOCK(TASK_RQ_LOCK, &rq_lock);
-				}
-			}
-		}
-#endif
-
-		/* Make sure the entry doesn't appear to be in a list */
-		LIST_INIT(&((struct tasklet *)t)->list);
-		/* And add it to the local task list */
-		tasklet_insert_into_tasklet_list((struct tasklet *)t);
-		tt->task_list_size++;
-		activity[tid].tasksw++;
-	}
-
-	/* release the rqueue lock */
-	if (grq) {
-		HA_SPIN_UNLOCK(TASK_RQ_LOCK, &rq_lock);
-		grq = NULL;
-	}
-
-	while (max_processed > 0 && !LIST_ISEMPTY(&tt->task_list)) {
+	while (done < max && !LIST_ISEMPTY(list)) {
 		struct task *t;
 		unsigned short state;
 		void *ctx;
 		struct task *(*process)(struct task *t, void *ctx, unsigned short state);
+		uint64_t prof_start = 0, prof_lat = 0;
 
-		t = (struct task *)LIST_ELEM(task_per_thread[tid].task_list.n, struct tasklet *, list);
-		state = (t->state & TASK_SHARED_WQ) | TASK_RUNNING;
+		t = (struct task *)LIST_ELEM(list->n, struct tasklet *, list);
+		state = (t->state & (TASK_SHARED_WQ|TASK_CLASS_MASK)) | TASK_RUNNING;
 		state = _HA_ATOMIC_XCHG(&t->state, state);
 		__ha_barrier_atomic_store();
 		__tasklet_remove_from_tasklet_list((struct tasklet *)t);
@@ -439,9 +373,14 @@ void process_runnable_tasks()
 		process = t->process;
 		t->calls++;
 
+		if (unlikely(task_profiling_mask & tid_bit))
+			prof_start = now_mono_time();
+
 		if (TASK_IS_TASKLET(t)) {
 			process(NULL, ctx, state);
-			max_processed--;
+			if (unlikely(prof_start))
+				sched_prof_account(process, 0, now_mono_time() - prof_start);
+			done++;
 			continue;
 		}
 
@@ -449,9 +388,10 @@ void process_runnable_tasks()
 
 		tt->task_list_size--;
 		if (unlikely(t->call_date)) {
-			uint64_t now_ns = now_mono_time();
+			uint64_t now_ns = prof_start ? prof_start : now_mono_time();
 
-			t->lat_time += now_ns - t->call_date;
+			prof_lat = now_ns - t->call_date;
+			t->lat_time += prof_lat;
 			t->call_date = now_ns;
 		}
 
@@ -465,14 +405,18 @@ void process_runnable_tasks()
 			__task_free(t);
 			sched->current = NULL;
 			__ha_barrier_store();
-			/* We don't want max_processed to be decremented if
-			 * we're just freeing a destroyed task, we should only
-			 * do so if we really ran a task.
+			/* We don't want to count this one if we're just
+			 * freeing a destroyed task, we should only do so if
+			 * we really ran a task.
 			 */
 			continue;
 		}
 		sched->current = NULL;
 		__ha_barrier_store();
+
+		if (unlikely(prof_start))
+			sched_prof_account(process, prof_lat, now_mono_time() - prof_start);
+
 		/* If there is a pending state  we have to wake up the task
 		 * immediately, else we defer it into wait queue
 		 */
@@ -489,10 +433,132 @@ void process_runnable_tasks()
 				task_queue(t);
 		}
 
-		max_processed--;
+		done++;
 	}
 
-	if (!LIST_ISEMPTY(&tt->task_list))
+	return done;
+}
+
+/* The run queue is chronologically sorted in a tree. An insertion counter is
+ * used to assign a position to each task. This counter may be combined with
+ * other variables (eg: nice value) to set the final position in the tree. The
+ * counter may wrap without a problem, of course. We then limit the number of
+ * tasks processed to 200 in any case, so that general latency remains low and
+ * so that task positions have a chance to be considered. The tasks woken up by
+ * other threads are first moved from the thread's inbound queue to its local
+ * run queue. If the thread has nothing else to do, it then steals the tasks it
+ * is allowed to run from the inbound queues of the other threads of its
+ * group, which are busy since they did not pick them yet. No lock is needed.
+ * Tasks and tasklets are then run from their class lists, each class getting
+ * its share of the budget first (see tune.sched.shares).
+ *
+ * The function adjusts <next> if a new event is closer.
+ */
+void process_runnable_tasks()
+{
+	struct task_per_thread * const tt = sched;
+	struct eb32sc_node *lrq = NULL; // next local run queue entry
+	struct task *t;
+	int max_processed, done, pass, cls;
+	int budget[TL_CLASSES];
+	struct mt_list *tmp_list;
+
+	ti->flags &= ~TI_FL_STUCK; // this thread is still running
+
+	if (!thread_has_tasks()) {
+		activity[tid].empty_rq++;
+		return;
+	}
+	/* Dispatch the tasklets woken up by other threads to the lists of
+	 * their classes.
+	 */
+	tmp_list = MT_LIST_BEHEAD(&sched->shared_tasklet_list);
+	while (tmp_list) {
+		struct list *elt = (struct list *)tmp_list;
+
+		/* the last element's next is NULL */
+		tmp_list = tmp_list->next;
+		LIST_ADDQ(&tt->tasklets[task_class((struct task *)LIST_ELEM(elt, struct tasklet *, list))], elt);
+	}
+
+	tasks_run_queue_cur = tasks_run_queue; /* keep a copy for reporting */
+	nb_tasks_cur = nb_tasks;
+	max_processed = global.tune.runqueue_depth;
+
+	if (likely(niced_tasks))
+		max_processed = (max_processed + 3) / 4;
+
+#ifdef USE_THREAD
+	if (!MT_LIST_ISEMPTY(&tt->inbound))
+		__task_pull_inbound(tid, max_processed);
+
+	if (global_tasks_mask & tid_bit) {
+		/* The bit is cleared before looking so that any task queued
+		 * after the check sets it again.
+		 */
+		_HA_ATOMIC_AND(&global_tasks_mask, ~tid_bit);
+		__ha_barrier_atomic_store();
+
+		if (!tt->rqueue_size && !sched_has_tasklets(tt)) {
+			unsigned long m = ti->tg_mask & ~tid_bit;
+			int budget = max_processed;
+
+			while (m && budget > 0) {
+				int thr = my_ffsl(m) - 1;
+
+				m &= m - 1;
+				if (task_per_thread[thr].inbound_size > 0)
+					budget -= __task_pull_inbound(thr, budget);
+			}
+			if (budget <= 0)
+				_HA_ATOMIC_OR(&global_tasks_mask, tid_bit);
+		}
+		else if (!MT_LIST_ISEMPTY(&tt->inbound))
+			_HA_ATOMIC_OR(&global_tasks_mask, tid_bit);
+	}
+#endif
+
+	while (tt->task_list_size < max_processed) {
+		if (!lrq) {
+			lrq = eb32sc_lookup_ge(&tt->rqueue, rqueue_ticks - TIMER_LOOK_BACK, tid_bit);
+			if (unlikely(!lrq))
+				lrq = eb32sc_first(&tt->rqueue, tid_bit);
+		}
+
+		if (!lrq)
+			break;
+
+		t = eb32sc_entry(lrq, struct task, rq);
+		lrq = eb32sc_next(lrq, tid_bit);
+		__task_unlink_rq(t);
+
+		/* Make sure the entry doesn't appear to be in a list */
+		LIST_INIT(&((struct tasklet *)t)->list);
+		/* And add it to the local task list */
+		tasklet_insert_into_tasklet_list((struct tasklet *)t);
+		tt->task_list_size++;
+		activity[tid].tasksw++;
+	}
+
+	/* each class gets its share of the budget, rounded up so that no
+	 * class is starved, then what remains is offered to all classes by
+	 * order of priority.
+	 */
+	for (cls = 0; cls < TL_CLASSES; cls++)
+		budget[cls] = (max_processed * sched_shares[cls] + 99) / 100;
+
+	for (pass = 0; pass < 2 && max_processed > 0; pass++) {
+		for (cls = 0; cls < TL_CLASSES && max_processed > 0; cls++) {
+			if (LIST_ISEMPTY(&tt->tasklets[cls]))
+				continue;
+			done = run_tasks_from_list(&tt->tasklets[cls],
+			                           pass ? max_processed : MIN(budget[cls], max_processed));
+			activity[tid].sched_run[cls] += done;
+			max_processed -= done;
+		}
+	}
+
+	if (sched_has_tasklets(tt))
 		activity[tid].long_rq++;
 }
 
@@ -548,22 +614,20 @@ void mworker_cleantasks()
 {
 	struct task *t;
 	int i;
-	struct eb32_node *tmp_wq = NULL;
+	struct tw_node *tmp_wq = NULL;
 	struct eb32sc_node *tmp_rq = NULL;
 
 #ifdef USE_THREAD
-	/* cleanup the global run queue */
-	tmp_rq = eb32sc_first(&rqueue, MAX_THREADS_MASK);
-	while (tmp_rq) {
-		t = eb32sc_entry(tmp_rq, struct task, rq);
-		tmp_rq = eb32sc_next(tmp_rq, MAX_THREADS_MASK);
-		task_destroy(t);
+	/* cleanup the threads' inbound queues */
+	for (i = 0; i < global.nbthread; i++) {
+		while ((t = MT_LIST_POP(&task_per_thread[i].inbound, struct task *, inq))) {
+			_HA_ATOMIC_AND(&t->state, ~TASK_GLOBAL);
+			task_destroy(t);
+		}
 	}
 	/* cleanup the timers queue */
-	tmp_wq = eb32_first(&timers);
-	while (tmp_wq) {
-		t = eb32_entry(tmp_wq, struct task, wq);
-		tmp_wq = eb32_next(tmp_wq);
+	while ((tmp_wq = tw_pop_any(&timers))) {
+		t = tw_entry(tmp_wq, struct task, wq);
 		task_destroy(t);
 	}
 #endif
@@ -576,28 +640,71 @@ void mworker_cleantasks()
 			task_destroy(t);
 		}
 		/* cleanup the per thread timers queue */
-		tmp_wq = eb32_first(&task_per_thread[i].timers);
-		while (tmp_wq) {
-			t = eb32_entry(tmp_wq, struct task, wq);
-			tmp_wq = eb32_next(tmp_wq);
+		while ((tmp_wq = tw_pop_any(&task_per_thread[i].timers))) {
+			t = tw_entry(tmp_wq, struct task, wq);
 			task_destroy(t);
 		}
 	}
 }
 
-/* perform minimal intializations */
+/* config parser for global "tune.sched.shares" */
+static int task_parse_global_sched_shares(char **args, int section_type, struct proxy *curpx,
+                                          struct proxy *defpx, const char *file, int line,
+                                          char **err)
+{
+	unsigned int shares[TL_CLASSES];
+	unsigned int total = 0;
+	int cls;
+
+	if (too_many_args(TL_CLASSES, args, err, NULL))
+		return -1;
+
+	for (cls = 0; cls < TL_CLASSES; cls++) {
+		char *stop;
+
+		shares[cls] = strtoul(args[cls + 1], &stop, 10);
+		if (!*args[cls + 1] || *stop || shares[cls] > 100) {
+			memprintf(err, "'%s' expects %d percentages (urgent, normal, bulk, background).",
+			          args[0], TL_CLASSES);
+			return -1;
+		}
+		total += shares[cls];
+	}
+
+	if (total != 100) {
+		memprintf(err, "'%s' : the shares must add up to 100, not %u.", args[0], total);
+		return -1;
+	}
+
+	memcpy(sched_shares, shares, sizeof(sched_shares));
+	return 0;
+}
+
+/* register global config keywords */
+static struct cfg_kw_list task_cfg_kws = {ILH, {
+	{ CFG_GLOBAL, "tune.sched.shares", task_parse_global_sched_shares },
+	{ 0, NULL, NULL }
+}};
+
+INITCALL1(STG_REGISTER, cfg_register_keywords, &task_cfg_kws);
+
+/* perform minimal intializations. The clock is not set yet, so the wheels'
+ * dates are only set when the first timer is queued (see __task_queue()).
+ */
 static void init_task()
 {
-	int i;
+	int i, cls;
 
 #ifdef USE_THREAD
-	memset(&timers, 0, sizeof(timers));
-	memset(&rqueue, 0, sizeof(rqueue));
+	tw_init(&timers, now_ms);
 #endif
 	memset(&task_per_thread, 0, sizeof(task_per_thread));
 	for (i = 0; i < MAX_THREADS; i++) {
-		LIST_INIT(&task_per_thread[i].task_list);
+		tw_init(&task_per_thread[i].timers, now_ms);
+		for (cls = 0; cls < TL_CLASSES; cls++)
+			LIST_INIT(&task_per_thread[i].tasklets[cls]);
 		MT_LIST_INIT(&task_per_thread[i].shared_tasklet_list);
+		MT_LIST_INIT(&task_per_thread[i].inbound);
 	}
 }
 
@@ -155,6 +155,7 @@ static int xprt_handshake_init(struct connection *conn, void **xprt_ctx)
 	}
 	ctx->wait_event.tasklet->process = xprt_handshake_io_cb;
 	ctx->wait_event.tasklet->context = ctx;
+	tasklet_set_class(ctx->wait_event.tasklet, TL_BULK);
 	ctx->wait_event.events = 0;
 	/* This XPRT expects the underlying XPRT to be provided later,
 	 * with an add_xprt() call, so we start trying to do the handshake
@@ -0,0 +1,209 @@
+/*
+ * Maglev table vs consistent hash tree benchmark.
+ *
+ * Build with :
+ *   gcc -O2 -Wall -Iinclude -Iebtree -o maglev-bench tests/maglev-bench.c \
+ *       ebtree/eb32tree.c ebtree/ebtree.c
+ *
+ * Usage : maglev-bench [servers [weight [lookups]]]
+ *
+ * <servers> servers of user weight <weight> are placed both in a consistent
+ * hash tree built like lb_chash.c does (weight*16 nodes per server) and in a
+ * Maglev table built like lb_maglev.c does. Then <lookups> random hashes are
+ * looked up in both structures to measure the speed and the distribution
+ * (ratio of the most and least loaded servers' shares to the average). Last,
+ * the first server is removed and the fraction of hashes which moved between
+ * two other servers is reported, as well as the time to update the structure.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <eb32tree.h>
+#include <common/maglev.h>
+
+#define WEIGHT_SCALE 16
+#define EWGHT_RANGE  (256 * WEIGHT_SCALE)
+
+struct node {
+	struct eb32_node eb;
+	int srv;
+};
+
+static unsigned int rnd_state = 2463534242U;
+
+static unsigned int rnd32()
+{
+	rnd_state ^= rnd_state << 13;
+	rnd_state ^= rnd_state >> 17;
+	rnd_state ^= rnd_state << 5;
+	return rnd_state;
+}
+
+/* same as full_hash() */
+static unsigned int hash32(unsigned int a)
+{
+	a = (a+0x7ed55d16) + (a<<12);
+	a = (a^0xc761c23c) ^ (a>>19);
+	a = (a+0x165667b1) + (a<<5);
+	a = (a+0xd3a2646c) ^ (a<<9);
+	a = (a+0xfd7046c5) + (a<<3);
+	a = (a^0xb55a4f09) ^ (a>>16);
+	return a * 3221225473U;
+}
+
+static double now_us()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000.0 + ts.tv_nsec / 1000.0;
+}
+
+/* same lookup as chash_get_server_hash() */
+static int chash_lookup(struct eb_root *root, unsigned int hash)
+{
+	struct eb32_node *next, *prev;
+
+	next = eb32_lookup_ge(root, hash);
+	if (!next)
+		next = eb32_first(root);
+	prev = eb32_prev(next);
+	if (!prev)
+		prev = eb32_last(root);
+	if (hash - prev->key <= next->key - hash)
+		next = prev;
+	return container_of(next, struct node, eb)->srv;
+}
+
+/* reports the spread of <cnt> for <nbs> servers out of <tot> lookups,
+ * ignoring server <skip> if >= 0.
+ */
+static void report_spread(const char *name, const unsigned int *cnt, int nbs, int skip, unsigned int tot)
+{
+	unsigned int min = ~0U, max = 0;
+	double avg = (double)tot / (nbs - (skip >= 0));
+	int s;
+
+	for (s = 0; s < nbs; s++) {
+		if (s == skip)
+			continue;
+		if (cnt[s] < min)
+			min = cnt[s];
+		if (cnt[s] > max)
+			max = cnt[s];
+	}
+	printf("%-8s spread  min %.3f max %.3f\n", name, min / avg, max / avg);
+}
+
+int main(int argc, char **argv)
+{
+	int nbs = argc > 1 ? atoi(argv[1]) : 100;
+	int weight = argc > 2 ? atoi(argv[2]) : 1;
+	unsigned int nbl = argc > 3 ? atoi(argv[3]) : 10000000;
+	unsigned int size, i, h, moved_ch, moved_mg, lost_ch, lost_mg;
+	int nodes = weight * WEIGHT_SCALE;
+	struct eb_root root = EB_ROOT;
+	struct node *nd;
+	struct maglev_perm *perm;
+	int *table, *before_ch, *before_mg;
+	unsigned int *cnt_ch, *cnt_mg;
+	double t0, ch_bld, mg_bld, ch_lkp, mg_lkp, ch_upd, mg_upd;
+	unsigned long long sum = 0;
+	int s, n;
+
+	size = maglev_size(nbs);
+	nd = calloc((size_t)nbs * nodes, sizeof(*nd));
+	perm = calloc(nbs, sizeof(*perm));
+	table = calloc(size, sizeof(*table));
+	cnt_ch = calloc(nbs, sizeof(*cnt_ch));
+	cnt_mg = calloc(nbs, sizeof(*cnt_mg));
+	before_ch = calloc(65536, sizeof(*before_ch));
+	before_mg = calloc(65536, sizeof(*before_mg));
+	if (!nd || !perm || !table || !cnt_ch || !cnt_mg || !before_ch || !before_mg) {
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+
+	/* build, server IDs start at 1 like puids */
+	t0 = now_us();
+	for (s = 0; s < nbs; s++) {
+		for (n = 0; n < nodes; n++) {
+			nd[s * nodes + n].srv = s;
+			nd[s * nodes + n].eb.key = hash32((s + 1) * EWGHT_RANGE + n);
+			eb32_insert(&root, &nd[s * nodes + n].eb);
+		}
+	}
+	ch_bld = now_us() - t0;
+
+	t0 = now_us();
+	for (s = 0; s < nbs; s++) {
+		h = hash32(s + 1);
+		maglev_perm_init(&perm[s], size, h, hash32(h));
+		perm[s].weight = nodes;
+	}
+	maglev_populate(table, size, perm, nbs);
+	mg_bld = now_us() - t0;
+
+	/* lookups */
+	rnd_state = 2463534242U;
+	t0 = now_us();
+	for (i = 0; i < nbl; i++) {
+		s = chash_lookup(&root, rnd32());
+		cnt_ch[s]++;
+	}
+	ch_lkp = now_us() - t0;
+
+	rnd_state = 2463534242U;
+	t0 = now_us();
+	for (i = 0; i < nbl; i++) {
+		s = table[rnd32() % size];
+		cnt_mg[s]++;
+	}
+	mg_lkp = now_us() - t0;
+
+	printf("%d servers, weight %d, %u lookups, maglev table size %u\n", nbs, weight, nbl, size);
+	printf("%-8s build %10.1f us  lookup %6.1f ns\n", "chash", ch_bld, ch_lkp * 1000 / nbl);
+	printf("%-8s build %10.1f us  lookup %6.1f ns\n", "maglev", mg_bld, mg_lkp * 1000 / nbl);
+	report_spread("chash", cnt_ch, nbs, -1, nbl);
+	report_spread("maglev", cnt_mg, nbs, -1, nbl);
+
+	/* remove the first server and check how many keys moved */
+	for (i = 0; i < 65536; i++) {
+		h = hash32(i);
+		before_ch[i] = chash_lookup(&root, h);
+		before_mg[i] = table[h % size];
+	}
+
+	t0 = now_us();
+	for (n = 0; n < nodes; n++)
+		eb32_delete(&nd[n].eb);
+	ch_upd = now_us() - t0;
+
+	t0 = now_us();
+	perm[0].weight = 0;
+	maglev_populate(table, size, perm, nbs);
+	mg_upd = now_us() - t0;
+
+	moved_ch = moved_mg = lost_ch = lost_mg = 0;
+	for (i = 0; i < 65536; i++) {
+		h = hash32(i);
+		s = chash_lookup(&root, h);
+		if (before_ch[i] == 0)
+			lost_ch++;
+		else if (s != before_ch[i])
+			moved_ch++;
+		s = table[h % size];
+		if (before_mg[i] == 0)
+			lost_mg++;
+		else if (s != before_mg[i])
+			moved_mg++;
+		sum += s;
+	}
+
+	printf("server 0 removed, %.2f%% of keys were on it\n", lost_mg * 100.0 / 65536);
+	printf("%-8s update %9.1f us  other keys moved %.3f%%\n", "chash", ch_upd, moved_ch * 100.0 / (65536 - lost_ch));
+	printf("%-8s update %9.1f us  other keys moved %.3f%%\n", "maglev", mg_upd, moved_mg * 100.0 / (65536 - lost_mg));
+	return sum == 0; /* prevent the loop from being optimized away */
+}
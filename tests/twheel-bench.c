@@ -0,0 +1,267 @@
+/*
+ * Timer wheel vs ebtree wait queue benchmark and consistency check.
+ *
+ * Build with :
+ *   gcc -O2 -Wall -Iinclude -Iebtree -o twheel-bench tests/twheel-bench.c \
+ *       ebtree/eb32tree.c ebtree/ebtree.c
+ *
+ * Usage : twheel-bench [timers [rearms [ms]]]
+ *
+ * <timers> timers are queued with a random timeout between 1 and 30s, then
+ * <rearms> random timers are moved to a new random date, then the date is
+ * advanced millisecond by millisecond during <ms> ms, expired timers being
+ * requeued. The date starts close to the 32-bit wrapping point so that this
+ * case is covered as well. Both structures must deliver the same timers at
+ * the same dates. Before this, a wheel initialized at date zero and a wheel
+ * left empty for 30 days must still deliver a timer inserted after tw_sync().
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <eb32tree.h>
+#include <common/twheel.h>
+
+#define LOOK_BACK (1U << 31)
+
+struct timer {
+	struct eb32_node eb;
+	struct tw_node tw;
+};
+
+static unsigned int rnd_state = 2463534242U;
+
+static unsigned int rnd32()
+{
+	rnd_state ^= rnd_state << 13;
+	rnd_state ^= rnd_state >> 17;
+	rnd_state ^= rnd_state << 5;
+	return rnd_state;
+}
+
+static unsigned int timeout()
+{
+	return 1000 + rnd32() % 29000;
+}
+
+static double now_us()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000.0 + ts.tv_nsec / 1000.0;
+}
+
+/* same lookup as the wait queue used to do */
+static struct eb32_node *eb_pop_expired(struct eb_root *root, unsigned int now)
+{
+	struct eb32_node *eb;
+
+	eb = eb32_lookup_ge(root, now - LOOK_BACK);
+	if (!eb)
+		eb = eb32_first(root);
+	if (!eb || (int)(eb->key - now) > 0)
+		return NULL;
+	eb32_delete(eb);
+	return eb;
+}
+
+/* Inserts a timer expiring 1s after <now> into wheel <w> after syncing it,
+ * and checks that it's delivered neither too early nor too late. Returns
+ * non-zero on failure.
+ */
+static int check_sync(struct twheel *w, unsigned int now, const char *what)
+{
+	struct tw_node node, *tw;
+	unsigned int key;
+
+	tw_node_init(&node);
+	node.key = now + 1000;
+	tw_sync(w, now);
+	tw_insert(w, &node);
+
+	if (!tw_next_key(w, &key) || (int)(key - now) < 0 || (int)(key - node.key) > 0) {
+		printf("FAIL: %s: next wheel date %u for a timer at %u\n", what, key, node.key);
+		return 1;
+	}
+	if ((tw = tw_pop_expired(w, now + 999))) {
+		printf("FAIL: %s: timer at %u delivered at %u\n", what, tw->key, now + 999);
+		return 1;
+	}
+	if (tw_pop_expired(w, now + 2000) != &node) {
+		printf("FAIL: %s: timer at %u not delivered at %u\n", what, node.key, now + 2000);
+		return 1;
+	}
+	return 0;
+}
+
+/* checks that wheels whose date lags by more than 2^31 ms work after a sync */
+static int check_idle_wheel(struct twheel *w)
+{
+	struct tw_node node;
+	unsigned int now;
+
+	/* initialized before the clock, with the date in the upper half */
+	tw_init(w, 0);
+	if (check_sync(w, 0x90000000U, "start date"))
+		return 1;
+
+	/* left idle 30 days with a deleted timer still marking a slot */
+	now = 0x10000000U;
+	tw_init(w, now);
+	tw_node_init(&node);
+	node.key = now + 5000;
+	tw_insert(w, &node);
+	tw_delete(&node);
+	tw_pop_expired(w, now);
+	now += 30U * 86400 * 1000;
+	if (check_sync(w, now, "idle wheel"))
+		return 1;
+
+	/* a non-empty wheel must not be moved */
+	tw_init(w, now);
+	node.key = now + 5000;
+	tw_insert(w, &node);
+	if (tw_sync(w, now + 100) || w->now != now) {
+		printf("FAIL: non-empty wheel synced\n");
+		return 1;
+	}
+	tw_delete(&node);
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned int nbt = argc > 1 ? atoi(argv[1]) : 100000;
+	unsigned int nbr = argc > 2 ? atoi(argv[2]) : 10000000;
+	unsigned int nbm = argc > 3 ? atoi(argv[3]) : 60000;
+	unsigned int start = 0xFFFFFFFFU - nbm / 2;
+	unsigned int now, i, key = 0;
+	unsigned long long ebn = 0, twn = 0;
+	struct eb_root root = EB_ROOT;
+	struct twheel *wheel;
+	struct timer *t;
+	struct eb32_node *eb;
+	struct tw_node *tw;
+	double t0, eb_ins, tw_ins, eb_mov, tw_mov, eb_exp, tw_exp, eb_del, tw_del;
+	unsigned int *keys;
+
+	t = calloc(nbt, sizeof(*t));
+	keys = calloc(nbr, sizeof(*keys));
+	wheel = malloc(sizeof(*wheel));
+	if (!t || !keys || !wheel) {
+		fprintf(stderr, "out of memory\n");
+		return 1;
+	}
+
+	if (check_idle_wheel(wheel))
+		return 1;
+
+	tw_init(wheel, start);
+	for (i = 0; i < nbt; i++) {
+		t[i].eb.key = t[i].tw.key = start + timeout();
+		tw_node_init(&t[i].tw);
+	}
+	for (i = 0; i < nbr; i++)
+		keys[i] = rnd32();
+
+	/* insertion */
+	t0 = now_us();
+	for (i = 0; i < nbt; i++)
+		eb32_insert(&root, &t[i].eb);
+	eb_ins = now_us() - t0;
+
+	t0 = now_us();
+	for (i = 0; i < nbt; i++)
+		tw_insert(wheel, &t[i].tw);
+	tw_ins = now_us() - t0;
+
+	/* re-arming */
+	t0 = now_us();
+	for (i = 0; i < nbr; i++) {
+		struct timer *tm = &t[keys[i] % nbt];
+
+		eb32_delete(&tm->eb);
+		tm->eb.key = start + 1000 + keys[i] / nbt % 29000;
+		eb32_insert(&root, &tm->eb);
+	}
+	eb_mov = now_us() - t0;
+
+	t0 = now_us();
+	for (i = 0; i < nbr; i++) {
+		struct timer *tm = &t[keys[i] % nbt];
+
+		tw_delete(&tm->tw);
+		tm->tw.key = start + 1000 + keys[i] / nbt % 29000;
+		tw_insert(wheel, &tm->tw);
+	}
+	tw_mov = now_us() - t0;
+
+	/* expiration, both are run in lockstep for the consistency check, so
+	 * they're timed separately.
+	 */
+	eb_exp = tw_exp = 0;
+	for (now = start; now != start + nbm; now++) {
+		unsigned long long ebc = 0, twc = 0;
+
+		t0 = now_us();
+		while ((eb = eb_pop_expired(&root, now))) {
+			eb->key = now + timeout();
+			eb32_insert(&root, eb);
+			ebc++;
+		}
+		eb_exp += now_us() - t0;
+
+		t0 = now_us();
+		while ((tw = tw_pop_expired(wheel, now))) {
+			struct timer *tm = tw_entry(tw, struct timer, tw);
+
+			if (tm->eb.key == tw->key || (int)(tw->key - now) > 0) {
+				/* not expired by the tree or too early */
+				printf("FAIL: timer %u key %u delivered at %u\n",
+				       (unsigned int)(tm - t), tw->key, now);
+				return 1;
+			}
+			tw->key = tm->eb.key;
+			tw_insert(wheel, tw);
+			twc++;
+		}
+		tw_exp += now_us() - t0;
+
+		if (ebc != twc) {
+			printf("FAIL: %llu vs %llu timers expired at %u\n", ebc, twc, now);
+			return 1;
+		}
+		ebn += ebc;
+		twn += twc;
+	}
+
+	/* check that the next dates match */
+	eb = eb32_lookup_ge(&root, now - LOOK_BACK);
+	if (!eb)
+		eb = eb32_first(&root);
+	if (!tw_next_key(wheel, &key) || (int)(key - eb->key) > 0) {
+		printf("FAIL: next wheel date %u after next tree date %u\n", key, eb->key);
+		return 1;
+	}
+
+	/* deletion */
+	t0 = now_us();
+	for (i = 0; i < nbt; i++)
+		eb32_delete(&t[i].eb);
+	eb_del = now_us() - t0;
+
+	t0 = now_us();
+	for (i = 0; i < nbt; i++)
+		tw_delete(&t[i].tw);
+	tw_del = now_us() - t0;
+
+	printf("%u timers, %u re-arms, %u ms, %llu expirations\n", nbt, nbr, nbm, ebn);
+	printf("             %12s %12s\n", "ebtree", "wheel");
+	printf("insert  ns/op %12.1f %12.1f\n", eb_ins * 1000 / nbt, tw_ins * 1000 / nbt);
+	printf("re-arm  ns/op %12.1f %12.1f\n", eb_mov * 1000 / nbr, tw_mov * 1000 / nbr);
+	printf("expire  ns/op %12.1f %12.1f\n", eb_exp * 1000 / (ebn ? ebn : 1), tw_exp * 1000 / (twn ? twn : 1));
+	printf("delete  ns/op %12.1f %12.1f\n", eb_del * 1000 / nbt, tw_del * 1000 / nbt);
+	return 0;
+}